@@ -1,7 +1,27 @@
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <ostream>
 #include "Activation.h"
+#include "Simd.h"
+
+// exp(x) = 2^n * e^r with n = round(x / ln 2) and r = x - n * ln 2, where
+// e^r comes from a degree 7 polynomial (Cephes expf). ln 2 is split in two
+// parts so r is exact. Inputs are clamped to the float range.
+#define EXP_HI 88.3762626647949f
+#define EXP_LO (-88.3762626647949f)
+#define EXP_LOG2E 1.44269504088896341f
+#define EXP_LN2_HI 0.693359375f
+#define EXP_LN2_LO (-2.12194440e-4f)
+#define EXP_P0 1.9875691500e-4f
+#define EXP_P1 1.3981999507e-3f
+#define EXP_P2 8.3334519073e-3f
+#define EXP_P3 4.1665795894e-2f
+#define EXP_P4 1.6666665459e-1f
+#define EXP_P5 5.0000001201e-1f
+#define FLOAT_EXP_BIAS 127
+#define FLOAT_MANTISSA_BITS 23
 
 using std::ostream;  using std::istream;  using std::endl;
 using std::cout; using std::cin; using std::cerr;
@@ -48,42 +68,381 @@ Activation::Activation(const ActivationType act_type) : act_func(act_type)
 */
 Matrix Activation::operator()(const Matrix &input_vector) const
 {
-    Matrix output_vector(input_vector.get_rows(), input_vector.get_cols());
-    output_vector = input_vector;
+    Matrix output_vector(input_vector);
+    // a single distribution over all the elements, whatever the shape
+    apply_in_place(output_vector.data(),
+                   output_vector.get_rows() * output_vector.get_cols(), 1);
+    return output_vector;
+}
+
+/**
+* Applies activation function on a batch, where every column is a
+* separate sample: SOFTMAX is normalized per column.
+* @param batch input matrix, one sample per column
+* @return Output matrix after activation was done on every column.
+*/
+Matrix Activation::apply_batch(const Matrix &batch) const
+{
+    Matrix output(batch);
+    apply_in_place(output);
+    return output;
+}
+
+/**
+* In-place version of apply_batch(): applies the activation function on
+* every column of the batch without allocating a new matrix.
+* @param batch matrix to activate, one sample per column
+*/
+void Activation::apply_in_place(Matrix &batch) const
+{
+    apply_in_place(batch.data(), batch.get_rows(), batch.get_cols());
+}
+
+/**
+* Scalar exp() with exactly the operations of exp_avx2(), so a value gets
+* the same result in every SIMD lane, in the scalar tails and in portable
+* builds. Relative error is within a few ulp.
+* @param x exponent
+* @return e^x (0 below EXP_LO).
+*/
+static inline float fast_exp(float x)
+{
+    x = std::min(std::max(x, EXP_LO), EXP_HI);
+    const float n = std::floor(x * EXP_LOG2E + 0.5f);
+    x = x - n * EXP_LN2_HI;
+    x = x - n * EXP_LN2_LO;
+    const float z = x * x;
+    float y = EXP_P0;
+    y = y * x + EXP_P1;
+    y = y * x + EXP_P2;
+    y = y * x + EXP_P3;
+    y = y * x + EXP_P4;
+    y = y * x + EXP_P5;
+    y = y * z + x + 1.0f;
+    const int32_t bits = ((int32_t) n + FLOAT_EXP_BIAS) << FLOAT_MANTISSA_BITS;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return y * scale;
+}
 
-    switch (act_func)
+/**
+* Helper function that applies the max-shifted SOFTMAX on one column:
+* out = exp(x - max) / sum(exp(x - max)), which cannot overflow.
+* @param out rows x cols row-major buffer
+* @param rows number of rows
+* @param cols number of columns
+* @param j column to activate
+*/
+static void softmax_column(float *out, int rows, int cols, int j)
+{
+    float max_value = out[j];
+    for (int i = 1; i < rows; ++i)
     {
-        case RELU:
-            for (int i = 0; i < output_vector.get_rows(); ++i)
-            {
-                for (int j = 0; j < output_vector.get_cols(); ++j)
-                {
-                    if (output_vector(i, j) < 0)
-
-                    {
-                        output_vector(i, j) = 0;
-                    }
-                }
-            }
-            break;
-        case SOFTMAX:
-            float sum = 0;
-            for (int i = 0; i < output_vector.get_rows(); ++i)
+        max_value = std::max(max_value, out[i * cols + j]);
+    }
+    float sum = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        out[i * cols + j] = fast_exp(out[i * cols + j] - max_value);
+        sum += out[i * cols + j];
+    }
+    if (sum == 0)
+    {
+        exit_func(DIVISION_BY_ZERO_ERR);
+    }
+    const float inv_sum = 1 / sum;
+    for (int i = 0; i < rows; ++i)
+    {
+        out[i * cols + j] *= inv_sum;
+    }
+}
 
+#ifdef MLP_HAVE_AVX2
+/**
+* AVX2 version of fast_exp() on 8 values (no FMA contraction, so every
+* lane rounds exactly like the scalar version).
+*/
+MLP_AVX2_TARGET
+static inline __m256 exp_avx2(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_LO)),
+                      _mm256_set1_ps(EXP_HI));
+    const __m256 n = _mm256_floor_ps(_mm256_add_ps(
+            _mm256_mul_ps(x, _mm256_set1_ps(EXP_LOG2E)),
+            _mm256_set1_ps(0.5f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(EXP_LN2_HI)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(EXP_LN2_LO)));
+    const __m256 z = _mm256_mul_ps(x, x);
+    __m256 y = _mm256_set1_ps(EXP_P0);
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P1));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P2));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P3));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P4));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P5));
+    y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, z), x),
+                      _mm256_set1_ps(1.0f));
+    const __m256i bits = _mm256_slli_epi32(
+            _mm256_add_epi32(_mm256_cvtps_epi32(n),
+                             _mm256_set1_epi32(FLOAT_EXP_BIAS)),
+            FLOAT_MANTISSA_BITS);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(bits));
+}
+
+/**
+* AVX2 RELU: max(0, x) keeps -0 and NaN like the scalar comparison.
+* @param out buffer to activate
+* @param size number of elements
+*/
+MLP_AVX2_TARGET
+static void relu_avx2(float *out, int size)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        _mm256_storeu_ps(out + i,
+                         _mm256_max_ps(zero, _mm256_loadu_ps(out + i)));
+    }
+    for (; i < size; ++i)
+    {
+        if (out[i] < 0)
+        {
+            out[i] = 0;
+        }
+    }
+}
+
+/**
+* AVX2 SOFTMAX of a single contiguous column.
+* @param out buffer to activate
+* @param rows number of elements
+*/
+MLP_AVX2_TARGET
+static void softmax_vector_avx2(float *out, int rows)
+{
+    const int rows8 = rows & ~7;
+    float max_value = out[0];
+    if (rows8 > 0)
+    {
+        __m256 max_vec = _mm256_loadu_ps(out);
+        for (int i = 8; i < rows8; i += 8)
+        {
+            max_vec = _mm256_max_ps(max_vec, _mm256_loadu_ps(out + i));
+        }
+        float lanes[8];
+        _mm256_storeu_ps(lanes, max_vec);
+        max_value = lanes[0];
+        for (int l = 1; l < 8; ++l)
+        {
+            max_value = std::max(max_value, lanes[l]);
+        }
+    }
+    for (int i = rows8; i < rows; ++i)
+    {
+        max_value = std::max(max_value, out[i]);
+    }
+    const __m256 shift = _mm256_set1_ps(max_value);
+    __m256 sum_vec = _mm256_setzero_ps();
+    for (int i = 0; i < rows8; i += 8)
+    {
+        const __m256 e = exp_avx2(_mm256_sub_ps(_mm256_loadu_ps(out + i),
+                                                shift));
+        _mm256_storeu_ps(out + i, e);
+        sum_vec = _mm256_add_ps(sum_vec, e);
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, sum_vec);
+    float sum = 0;
+    for (int l = 0; l < 8; ++l)
+    {
+        sum += lanes[l];
+    }
+    for (int i = rows8; i < rows; ++i)
+    {
+        out[i] = fast_exp(out[i] - max_value);
+        sum += out[i];
+    }
+    if (sum == 0)
+    {
+        exit_func(DIVISION_BY_ZERO_ERR);
+    }
+    const float inv_sum = 1 / sum;
+    const __m256 inv_vec = _mm256_set1_ps(inv_sum);
+    for (int i = 0; i < rows8; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(out + i),
+                                                inv_vec));
+    }
+    for (int i = rows8; i < rows; ++i)
+    {
+        out[i] *= inv_sum;
+    }
+}
+
+/**
+* AVX2 SOFTMAX of a batch: 8 columns (samples) at a time, one per lane, so
+* the row-major layout needs no transposition. Per lane the operations are
+* those of softmax_column().
+* @param out rows x cols row-major buffer
+* @param rows number of rows
+* @param cols number of columns
+* @return number of columns done (a multiple of 8)
+*/
+MLP_AVX2_TARGET
+static int softmax_columns_avx2(float *out, int rows, int cols)
+{
+    const int cols8 = cols & ~7;
+    for (int j = 0; j < cols8; j += 8)
+    {
+        __m256 max_vec = _mm256_loadu_ps(out + j);
+        for (int i = 1; i < rows; ++i)
+        {
+            max_vec = _mm256_max_ps(max_vec,
+                                    _mm256_loadu_ps(out + i * cols + j));
+        }
+        __m256 sum = _mm256_setzero_ps();
+        for (int i = 0; i < rows; ++i)
+        {
+            float *row = out + i * cols + j;
+            const __m256 e = exp_avx2(_mm256_sub_ps(_mm256_loadu_ps(row),
+                                                    max_vec));
+            _mm256_storeu_ps(row, e);
+            sum = _mm256_add_ps(sum, e);
+        }
+        if (_mm256_movemask_ps(_mm256_cmp_ps(sum, _mm256_setzero_ps(),
+                                             _CMP_EQ_OQ)))
+        {
+            exit_func(DIVISION_BY_ZERO_ERR);
+        }
+        const __m256 inv_sum = _mm256_div_ps(_mm256_set1_ps(1.0f), sum);
+        for (int i = 0; i < rows; ++i)
+        {
+            float *row = out + i * cols + j;
+            _mm256_storeu_ps(row, _mm256_mul_ps(_mm256_loadu_ps(row),
+                                                inv_sum));
+        }
+    }
+    return cols8;
+}
+#endif // MLP_HAVE_AVX2
+
+/**
+* Raw buffer version of apply_in_place(). SOFTMAX is shifted by the column
+* maximum, so large logits cannot overflow to inf/NaN.
+* @param out rows x cols row-major buffer, one sample per column
+* @param rows number of rows
+* @param cols number of columns
+*/
+void Activation::apply_in_place(float *out, int rows, int cols) const
+{
+    if (act_func == RELU)
+    {
+#ifdef MLP_HAVE_AVX2
+        if (cpu_has_avx2())
+        {
+            relu_avx2(out, rows * cols);
+            return;
+        }
+#endif
+        for (int i = 0; i < rows * cols; ++i)
+        {
+            if (out[i] < 0)
             {
-                for (int j = 0; j < output_vector.get_cols(); ++j)
-                {
-                    sum+= std::exp(output_vector(i,j));
-                    output_vector(i,j) = std::exp(output_vector(i,j));
-                }
-            }
-            if (sum == 0)
-            {
-                exit_func(DIVISION_BY_ZERO_ERR);
+                out[i] = 0;
             }
-            output_vector = ((1/sum) * output_vector);
-            break;
+        }
+        return;
     }
-    return output_vector;
+    int done = 0;
+#ifdef MLP_HAVE_AVX2
+    if (cpu_has_avx2())
+    {
+        if (cols == 1)
+        {
+            softmax_vector_avx2(out, rows);
+            return;
+        }
+        done = softmax_columns_avx2(out, rows, cols);
+    }
+#endif
+    for (int j = done; j < cols; ++j)
+    {
+        softmax_column(out, rows, cols, j);
+    }
+}
+
+/**
+* Selects the k largest of a strided array of values, largest first (ties
+* keep the lower index first).
+* @param values first value
+* @param rows number of values
+* @param stride distance (in floats) between consecutive values
+* @param k number of values to select
+* @param labels receives the indices of the selected values
+* @return number of selected values, min(k, rows)
+*/
+int top_k_indices(const float *values, int rows, int stride, int k,
+                  unsigned int *labels)
+{
+    k = std::min(k, rows);
+    int selected = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        const float v = values[i * stride];
+        int pos = selected;
+        while (pos > 0 && v > values[labels[pos - 1] * stride])
+        {
+            --pos;
+        }
+        if (pos >= k)
+        {
+            continue;
+        }
+        for (int m = std::min(selected, k - 1); m > pos; --m)
+        {
+            labels[m] = labels[m - 1];
+        }
+        labels[pos] = i;
+        selected = std::min(selected + 1, k);
+    }
+    return selected;
 }
 
+/**
+* Fused SOFTMAX and top-k selection on the logits of one sample, without
+* writing the distribution anywhere. SOFTMAX is monotonic, so the classes
+* are selected on the logits; only the normalizing sum and the selected
+* probabilities need exponentials, and none are computed without probs.
+* @param logits first logit of the sample (values before SOFTMAX)
+* @param rows number of classes
+* @param stride distance (in floats) between consecutive classes
+* @param k number of classes to select
+* @param labels receives the k most probable classes, most probable first
+* @param probs receives their probabilities, or nullptr for labels only
+* @return number of selected classes, min(k, rows)
+*/
+int softmax_top_k(const float *logits, int rows, int stride, int k,
+                  unsigned int *labels, float *probs)
+{
+    const int selected = top_k_indices(logits, rows, stride, k, labels);
+    if (probs == nullptr || selected == 0)
+    {
+        return selected;
+    }
+    const float max_value = logits[labels[0] * stride];
+    float sum = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        sum += fast_exp(logits[i * stride] - max_value);
+    }
+    if (sum == 0)
+    {
+        exit_func(DIVISION_BY_ZERO_ERR);
+    }
+    const float inv_sum = 1 / sum;
+    for (int m = 0; m < selected; ++m)
+    {
+        probs[m] = fast_exp(logits[labels[m] * stride] - max_value) * inv_sum;
+    }
+    return selected;
+}
@@ -46,6 +46,61 @@ public:
     * @return Output vector after activation was done on vector (RELU/SOFTMAX)
     */
     Matrix operator()(const Matrix &input_vector) const;
+
+    /**
+    * Applies activation function on a batch, where every column is a
+    * separate sample: SOFTMAX is normalized per column. On a single column
+    * this is identical to operator().
+    * @param batch input matrix, one sample per column
+    * @return Output matrix after activation was done on every column.
+    */
+    Matrix apply_batch(const Matrix &batch) const;
+
+    /**
+    * In-place version of apply_batch(): applies the activation function on
+    * every column of the batch without allocating a new matrix.
+    * @param batch matrix to activate, one sample per column
+    */
+    void apply_in_place(Matrix &batch) const;
+
+    /**
+    * Raw buffer version of apply_in_place(). SOFTMAX is shifted by the
+    * column maximum, so large logits cannot overflow to inf/NaN; RELU and
+    * SOFTMAX use AVX2 kernels (with a vectorized exp) when available.
+    * @param data rows x cols row-major buffer, one sample per column
+    * @param rows number of rows
+    * @param cols number of columns
+    */
+    void apply_in_place(float *data, int rows, int cols) const;
 };
 
+/**
+* Selects the k largest of a strided array of values, largest first (ties
+* keep the lower index first).
+* @param values first value
+* @param rows number of values
+* @param stride distance (in floats) between consecutive values
+* @param k number of values to select
+* @param labels receives the indices of the selected values
+* @return number of selected values, min(k, rows)
+*/
+int top_k_indices(const float *values, int rows, int stride, int k,
+                  unsigned int *labels);
+
+/**
+* Fused SOFTMAX and top-k selection on the logits of one sample, without
+* writing the distribution anywhere. SOFTMAX is monotonic, so the classes
+* are selected on the logits; only the normalizing sum and the selected
+* probabilities need exponentials, and none are computed without probs.
+* @param logits first logit of the sample (values before SOFTMAX)
+* @param rows number of classes
+* @param stride distance (in floats) between consecutive classes
+* @param k number of classes to select
+* @param labels receives the k most probable classes, most probable first
+* @param probs receives their probabilities, or nullptr for labels only
+* @return number of selected classes, min(k, rows)
+*/
+int softmax_top_k(const float *logits, int rows, int stride, int k,
+                  unsigned int *labels, float *probs);
+
 #endif //ACTIVATION_H
@@ -0,0 +1,92 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "AllocCounter.h"
+
+static std::atomic<size_t> total_count(0);
+static thread_local size_t thread_count = 0;
+
+/**
+* Helper function that counts and performs one allocation.
+* @param size bytes to allocate
+* @return The allocated block, or nullptr on failure.
+*/
+static void *counted_malloc(size_t size)
+{
+    ++thread_count;
+    total_count.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+/**
+* Get the number of heap allocations made by the calling thread so far.
+* @return Allocation count of this thread.
+*/
+size_t thread_alloc_count()
+{
+    return thread_count;
+}
+
+/**
+* Get the number of heap allocations made by all threads so far.
+* @return Allocation count of the process.
+*/
+size_t total_alloc_count()
+{
+    return total_count.load(std::memory_order_relaxed);
+}
+
+void *operator new(size_t size)
+{
+    void *ptr = counted_malloc(size);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_malloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_malloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
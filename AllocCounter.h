@@ -0,0 +1,27 @@
+// AllocCounter.h
+
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H
+
+#include <cstddef>
+
+/**
+ * Heap allocation counting. Linking AllocCounter.cpp into a program replaces
+ * the global operator new/delete with counting versions (backed by
+ * malloc/free), so tests and benchmarks can prove that a code path does not
+ * allocate. Programs that do not link it keep the default allocator.
+ */
+
+/**
+* Get the number of heap allocations made by the calling thread so far.
+* @return Allocation count of this thread.
+*/
+size_t thread_alloc_count();
+
+/**
+* Get the number of heap allocations made by all threads so far.
+* @return Allocation count of the process.
+*/
+size_t total_alloc_count();
+
+#endif //ALLOCCOUNTER_H
@@ -0,0 +1,549 @@
+#include <cstring>
+#include <vector>
+#include "CachedMlp.h"
+
+using std::cerr;
+using std::endl;
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+#define HASH_STRIPE 32
+#define NO_ENTRY (-1)
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that allocates an array.
+* @param count number of elements
+* @return the new array.
+*/
+template <typename T>
+static T *alloc_array(size_t count)
+{
+    T *array = new(std::nothrow) T[count > 0 ? count : 1];
+    if (!array)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    return array;
+}
+
+/**
+* Helper function that rotates a 64-bit word left by r bits.
+*/
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+* Helper function that reads 8 unaligned bytes as a 64-bit word.
+*/
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+/**
+* Helper function that reads 4 unaligned bytes as a 32-bit word.
+*/
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+/**
+* Helper function that mixes one 8 byte input word into a hash lane.
+*/
+static inline uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    return rotl64(acc, 31) * PRIME64_1;
+}
+
+/**
+* Helper function that folds a finished lane into the combined hash.
+*/
+static inline uint64_t merge_round(uint64_t acc, uint64_t lane)
+{
+    acc ^= hash_round(0, lane);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/**
+* Helper function that hashes a byte range (xxHash64 with seed 0).
+* @param p first byte
+* @param len number of bytes
+* @return The hash.
+*/
+static uint64_t hash_bytes(const unsigned char *p, size_t len)
+{
+    const unsigned char *const end = p + len;
+    uint64_t h;
+    if (len >= HASH_STRIPE)
+    {
+        uint64_t v1 = PRIME64_1 + PRIME64_2, v2 = PRIME64_2, v3 = 0,
+                 v4 = 0 - PRIME64_1;
+        do
+        {
+            v1 = hash_round(v1, read64(p));
+            v2 = hash_round(v2, read64(p + 8));
+            v3 = hash_round(v3, read64(p + 16));
+            v4 = hash_round(v4, read64(p + 24));
+            p += HASH_STRIPE;
+        } while (end - p >= HASH_STRIPE);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    }
+    else
+    {
+        h = PRIME64_5;
+    }
+    h += len;
+    for (; end - p >= 8; p += 8)
+    {
+        h ^= hash_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (end - p >= 4)
+    {
+        h ^= (uint64_t) read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+    {
+        h ^= *p * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+/**
+* 64-bit hash of the elements of an image.
+* @param image Matrix (or view) to hash
+* @return The hash.
+*/
+uint64_t hash_image(const MatrixView &image)
+{
+    const int rows = image.get_rows();
+    const int cols = image.get_cols();
+    const size_t count = (size_t) rows * cols;
+    const float *src = image.data();
+    if (image.is_contiguous() || (cols == 1 && image.get_row_stride() == 1))
+    {
+        return hash_bytes((const unsigned char *) src, count * sizeof(float));
+    }
+    // Strided views are gathered into row-major order first, so they hash
+    // like the same elements stored contiguously.
+    thread_local std::vector<float> gathered;
+    gathered.resize(count);
+    const int rs = image.get_row_stride();
+    const int cs = image.get_col_stride();
+    float *dst = gathered.data();
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            *dst++ = src[(size_t) i * rs + (size_t) j * cs];
+        }
+    }
+    return hash_bytes((const unsigned char *) gathered.data(),
+                      count * sizeof(float));
+}
+
+/**
+* Constructor for CachedMlp instance.
+* @param network The network to run - must outlive this instance.
+* @param capacity Most predictions kept (rounded up to whole shards).
+* @param shard_count Number of independently locked shards.
+*/
+CachedMlp::CachedMlp(const MlpNetwork &network, int capacity, int shard_count)
+        : network(network), shards(nullptr), shard_count(shard_count),
+          capacity(capacity > 0 && shard_count > 0 ?
+                   (capacity + shard_count - 1) / shard_count * shard_count : 0)
+{
+    if (capacity <= 0 || shard_count <= 0)
+    {
+        exit_func(CACHE_OPTIONS_ERR);
+    }
+    shards = alloc_array<Shard>((size_t) shard_count);
+    const int per_shard = this->capacity / shard_count;
+    // Keeps the index at most half full, so probe runs stay short.
+    int slot_count = 1;
+    while (slot_count < 2 * per_shard)
+    {
+        slot_count <<= 1;
+    }
+    for (int i = 0; i < shard_count; ++i)
+    {
+        Shard &shard = shards[i];
+        shard.entries = alloc_array<Entry>((size_t) per_shard);
+        shard.slots = alloc_array<int>((size_t) slot_count);
+        shard.slot_mask = slot_count - 1;
+        shard.capacity = per_shard;
+    }
+    clear();
+}
+
+/**
+* Destructor of CachedMlp instance.
+*/
+CachedMlp::~CachedMlp()
+{
+    for (int i = 0; i < shard_count; ++i)
+    {
+        delete[] shards[i].entries;
+        delete[] shards[i].slots;
+    }
+    delete[] shards;
+}
+
+/**
+* Get the most entries the cache can hold.
+* @return Capacity as int.
+*/
+int CachedMlp::get_capacity() const
+{
+    return capacity;
+}
+
+/**
+* Helper function that picks the shard of a key. The high bits choose the
+* shard and the low bits the index slot, so the two stay independent.
+* @param key hash of an image
+* @return The shard.
+*/
+CachedMlp::Shard &CachedMlp::shard_of(uint64_t key) const
+{
+    return shards[(key >> 32) % (uint64_t) shard_count];
+}
+
+/**
+* Helper function that linearly probes the index of a shard.
+* @param shard the shard
+* @param key hash of an image
+* @return The slot holding key, or the empty slot where it belongs.
+*/
+int CachedMlp::find_slot(const Shard &shard, uint64_t key)
+{
+    int slot = (int) (key & (uint64_t) shard.slot_mask);
+    while (shard.slots[slot] != NO_ENTRY &&
+           shard.entries[shard.slots[slot]].key != key)
+    {
+        slot = (slot + 1) & shard.slot_mask;
+    }
+    return slot;
+}
+
+/**
+* Helper function that removes an entry from the LRU list of its shard.
+* @param shard the shard
+* @param entry index of the entry
+*/
+void CachedMlp::unlink(Shard &shard, int entry)
+{
+    const Entry &e = shard.entries[entry];
+    if (e.prev != NO_ENTRY)
+    {
+        shard.entries[e.prev].next = e.next;
+    }
+    else
+    {
+        shard.head = e.next;
+    }
+    if (e.next != NO_ENTRY)
+    {
+        shard.entries[e.next].prev = e.prev;
+    }
+    else
+    {
+        shard.tail = e.prev;
+    }
+}
+
+/**
+* Helper function that makes an entry the most recently used of its shard.
+* @param shard the shard
+* @param entry index of the entry
+*/
+void CachedMlp::push_front(Shard &shard, int entry)
+{
+    Entry &e = shard.entries[entry];
+    e.prev = NO_ENTRY;
+    e.next = shard.head;
+    if (shard.head != NO_ENTRY)
+    {
+        shard.entries[shard.head].prev = entry;
+    }
+    shard.head = entry;
+    if (shard.tail == NO_ENTRY)
+    {
+        shard.tail = entry;
+    }
+}
+
+/**
+* Helper function that empties an index slot, shifting the following probe
+* run back so that every key stays reachable from its home slot.
+* @param shard the shard
+* @param slot the slot to empty
+*/
+void CachedMlp::erase_slot(Shard &shard, int slot)
+{
+    const int mask = shard.slot_mask;
+    int hole = slot;
+    for (int next = (hole + 1) & mask; shard.slots[next] != NO_ENTRY;
+         next = (next + 1) & mask)
+    {
+        const int home = (int) (shard.entries[shard.slots[next]].key &
+                                (uint64_t) mask);
+        // The key may move into the hole unless its home lies after it.
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            shard.slots[hole] = shard.slots[next];
+            hole = next;
+        }
+    }
+    shard.slots[hole] = NO_ENTRY;
+}
+
+/**
+* Helper function that looks a key up and counts the hit or miss.
+* @param key hash of an image
+* @param result receives the cached prediction on a hit
+* @return true on a hit.
+*/
+bool CachedMlp::lookup(uint64_t key, digit &result)
+{
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const int entry = shard.slots[find_slot(shard, key)];
+    if (entry == NO_ENTRY)
+    {
+        ++shard.misses;
+        return false;
+    }
+    result = shard.entries[entry].value;
+    if (shard.head != entry)
+    {
+        unlink(shard, entry);
+        push_front(shard, entry);
+    }
+    ++shard.hits;
+    return true;
+}
+
+/**
+* Helper function that caches a prediction, evicting the least recently used
+* entry of a full shard.
+* @param key hash of an image
+* @param result prediction for it
+*/
+void CachedMlp::insert(uint64_t key, const digit &result)
+{
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    int slot = find_slot(shard, key);
+    int entry = shard.slots[slot];
+    if (entry != NO_ENTRY)
+    {
+        // Another thread missed on the same image meanwhile.
+        shard.entries[entry].value = result;
+        return;
+    }
+    if (shard.size < shard.capacity)
+    {
+        entry = shard.size++;
+    }
+    else
+    {
+        entry = shard.tail;
+        erase_slot(shard, find_slot(shard, shard.entries[entry].key));
+        unlink(shard, entry);
+        ++shard.evictions;
+        slot = find_slot(shard, key);
+    }
+    shard.entries[entry].key = key;
+    shard.entries[entry].value = result;
+    shard.slots[slot] = entry;
+    push_front(shard, entry);
+}
+
+/**
+* Classifies an image, from the cache when it was seen before.
+* @param image Matrix (or view) of the image
+* @return digit struct with the highest probability to be the correct digit
+*/
+digit CachedMlp::operator()(const MatrixView &image)
+{
+    const uint64_t key = hash_image(image);
+    digit result;
+    if (!lookup(key, result))
+    {
+        result = network(image);
+        insert(key, result);
+    }
+    return result;
+}
+
+/**
+* Classifies an image, running misses on a caller owned workspace.
+* @param image Matrix (or view) of the image
+* @param workspace scratch memory (see MlpWorkspace)
+* @return digit struct with the highest probability to be the correct digit
+*/
+digit CachedMlp::operator()(const MatrixView &image, MlpWorkspace &workspace)
+{
+    const uint64_t key = hash_image(image);
+    digit result;
+    if (!lookup(key, result))
+    {
+        result = network(image, workspace);
+        insert(key, result);
+    }
+    return result;
+}
+
+/**
+* Classifies a batch of images: hits are answered from the cache and the
+* misses run through the network as one smaller batch.
+* @param images Matrix (or view), one vectorized image per column.
+* @param results Array of at least N digits.
+*/
+void CachedMlp::predict_batch(const MatrixView &images, digit *results)
+{
+    predict_batch(images, results, [this](const MatrixView &misses,
+                                          digit *miss_results)
+    { network.predict_batch(misses, miss_results); });
+}
+
+/**
+* Like predict_batch(), running the misses with another predictor.
+* @param images Matrix (or view), one vectorized image per column.
+* @param results Array of at least N digits.
+* @param predict Classifies the batch of misses.
+*/
+void CachedMlp::predict_batch(const MatrixView &images, digit *results,
+                              const BatchPredictor &predict)
+{
+    const int rows = images.get_rows();
+    const int count = images.get_cols();
+    thread_local std::vector<uint64_t> keys;
+    thread_local std::vector<int> missed;
+    keys.resize((size_t) count);
+    missed.clear();
+    for (int j = 0; j < count; ++j)
+    {
+        keys[j] = hash_image(images.block(0, j, rows, 1));
+        if (!lookup(keys[j], results[j]))
+        {
+            missed.push_back(j);
+        }
+    }
+    const int miss_count = (int) missed.size();
+    if (miss_count == count)
+    {
+        predict(images, results);
+    }
+    else if (miss_count > 0)
+    {
+        // The misses are packed one image per row, like the batch of a
+        // server, and run as a transposed view.
+        thread_local Matrix packed;
+        thread_local std::vector<digit> packed_results;
+        if (packed.get_rows() < miss_count || packed.get_cols() != rows)
+        {
+            packed = Matrix(count, rows);
+        }
+        packed_results.resize((size_t) count);
+        const float *src = images.data();
+        const int rs = images.get_row_stride();
+        const int cs = images.get_col_stride();
+        for (int m = 0; m < miss_count; ++m)
+        {
+            const float *column = src + (size_t) missed[m] * cs;
+            float *dst = packed.row_ptr(m);
+            for (int i = 0; i < rows; ++i)
+            {
+                dst[i] = column[(size_t) i * rs];
+            }
+        }
+        predict(MatrixView(packed).block(0, 0, miss_count, rows).transposed(),
+                packed_results.data());
+        for (int m = 0; m < miss_count; ++m)
+        {
+            results[missed[m]] = packed_results[m];
+        }
+    }
+    for (int m = 0; m < miss_count; ++m)
+    {
+        insert(keys[missed[m]], results[missed[m]]);
+    }
+}
+
+/**
+* Get the counters of all shards.
+* @return cache_stats struct.
+*/
+cache_stats CachedMlp::get_stats() const
+{
+    cache_stats stats = {0, 0, 0, 0, capacity};
+    for (int i = 0; i < shard_count; ++i)
+    {
+        Shard &shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.size += shard.size;
+    }
+    return stats;
+}
+
+/**
+* Drops every entry and zeroes the counters.
+*/
+void CachedMlp::clear()
+{
+    for (int i = 0; i < shard_count; ++i)
+    {
+        Shard &shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (int s = 0; s <= shard.slot_mask; ++s)
+        {
+            shard.slots[s] = NO_ENTRY;
+        }
+        shard.size = 0;
+        shard.head = NO_ENTRY;
+        shard.tail = NO_ENTRY;
+        shard.hits = 0;
+        shard.misses = 0;
+        shard.evictions = 0;
+    }
+}
@@ -0,0 +1,162 @@
+// CachedMlp.h
+
+#ifndef CACHEDMLP_H
+#define CACHEDMLP_H
+
+#include <cstdint>
+#include <mutex>
+#include "Evaluation.h"
+#include "MlpNetwork.h"
+
+#define DEFAULT_CACHE_CAPACITY 4096
+#define DEFAULT_CACHE_SHARDS 16
+#define CACHE_LINE_SIZE 64
+#define CACHE_OPTIONS_ERR "Error: Cache capacity and shard count must be "\
+"positive!\n"
+
+/**
+ * @struct cache_stats
+ * @brief Counters of a CachedMlp, summed over its shards.
+ * @var hits - lookups answered from the cache
+ * @var misses - lookups that ran the network
+ * @var evictions - entries dropped to make room (least recently used first)
+ * @var size - entries currently cached
+ * @var capacity - most entries the cache can hold
+ */
+typedef struct cache_stats
+{
+    long long hits;
+    long long misses;
+    long long evictions;
+    long long size;
+    long long capacity;
+} cache_stats;
+
+/**
+* 64-bit hash of the elements of an image (xxHash64 style: four
+* multiply-rotate lanes over 32 byte stripes and a final avalanche). Only the
+* element values in row-major order count, so a 28x28 image, its 784x1
+* vector and a column of a batch hash alike.
+* @param image Matrix (or view) to hash
+* @return The hash.
+*/
+uint64_t hash_image(const MatrixView &image);
+
+/**
+   * CachedMlp Class - a bounded LRU cache of predictions in front of a shared
+   * MlpNetwork, keyed by hash_image() of the input. Repeated images are
+   * answered without running the network. The entries are split over
+   * independently locked shards (chosen by the high bits of the hash), each
+   * with a fixed entry array, an intrusive LRU list and an open-addressing
+   * index, so lookups and inserts never allocate and threads rarely contend.
+   * Two images are taken to be equal when their 64-bit hashes are.
+   */
+class CachedMlp
+{
+private:
+    struct Entry
+    {
+        uint64_t key;
+        digit value;
+        int prev, next;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        Entry *entries;
+        int *slots;
+        int slot_mask;
+        int capacity, size;
+        int head, tail;
+        long long hits, misses, evictions;
+        // Keeps neighbouring shards off each other's cache lines (plain new
+        // cannot over-align in C++14).
+        char padding[CACHE_LINE_SIZE];
+    };
+
+    const MlpNetwork &network;
+    Shard *shards;
+    const int shard_count;
+    const int capacity;
+
+    Shard &shard_of(uint64_t key) const;
+    static int find_slot(const Shard &shard, uint64_t key);
+    static void unlink(Shard &shard, int entry);
+    static void push_front(Shard &shard, int entry);
+    static void erase_slot(Shard &shard, int slot);
+    bool lookup(uint64_t key, digit &result);
+    void insert(uint64_t key, const digit &result);
+
+public:
+    /**
+    * Constructor for CachedMlp instance.
+    * @param network The network to run - must outlive this instance.
+    * @param capacity Most predictions kept (rounded up to whole shards).
+    * @param shard_count Number of independently locked shards.
+    */
+    explicit CachedMlp(const MlpNetwork &network,
+                       int capacity = DEFAULT_CACHE_CAPACITY,
+                       int shard_count = DEFAULT_CACHE_SHARDS);
+
+    /**
+    * Destructor of CachedMlp instance.
+    */
+    ~CachedMlp();
+
+    CachedMlp(const CachedMlp &) = delete;
+    CachedMlp &operator=(const CachedMlp &) = delete;
+
+    /**
+    * Get the most entries the cache can hold.
+    * @return Capacity as int.
+    */
+    int get_capacity() const;
+
+    /**
+    * Classifies an image, from the cache when it was seen before.
+    * @param image Matrix (or view) of the image
+    * @return digit struct with the highest probability to be the correct digit
+    */
+    digit operator()(const MatrixView &image);
+
+    /**
+    * Classifies an image, running misses on a caller owned workspace.
+    * @param image Matrix (or view) of the image
+    * @param workspace scratch memory (see MlpWorkspace)
+    * @return digit struct with the highest probability to be the correct digit
+    */
+    digit operator()(const MatrixView &image, MlpWorkspace &workspace);
+
+    /**
+    * Classifies a batch of images: hits are answered from the cache and the
+    * misses run through the network as one smaller batch.
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param results Array of at least N digits, results[j] receives the
+    * prediction for column j.
+    */
+    void predict_batch(const MatrixView &images, digit *results);
+
+    /**
+    * Like predict_batch(), running the misses with another predictor, e.g. a
+    * ParallelMlp over the same network.
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param results Array of at least N digits.
+    * @param predict Classifies the batch of misses.
+    */
+    void predict_batch(const MatrixView &images, digit *results,
+                       const BatchPredictor &predict);
+
+    /**
+    * Get the counters of all shards.
+    * @return cache_stats struct.
+    */
+    cache_stats get_stats() const;
+
+    /**
+    * Drops every entry and zeroes the counters.
+    */
+    void clear();
+};
+
+#endif //CACHEDMLP_H
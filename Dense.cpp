@@ -1,6 +1,8 @@
 
 #include "Matrix.h"
 #include "Dense.h"
+#include "Gemm.h"
+#include "Profiler.h"
 
 using std::string;
 using std::cerr;
@@ -25,25 +27,127 @@ static void exit_func(const string &error_msg)
  * @param weights Weights Matrix
  * @param bias Bias vector (also Matrix)
  * @param act_type Activation Type
+ * @param format Storage format of the weights
  */
 Dense::Dense(const Matrix &weights, const Matrix &bias,
+             ActivationType act_type, WeightFormat format)
+        : owns_params(true), format(format),
+          _weights(format == FP32 ? weights : Matrix()), _bias(bias),
+          half_weights(format == FP32 ? HalfMatrix()
+                                      : HalfMatrix(weights, format)),
+          weights_view(_weights), bias_view(_bias), act(act_type),
+          skip_inputs(false), prepacked(false)
+{
+    if (bias.get_rows() != weights.get_rows())
+    {
+        exit_func(BIAS_WEIGHTS_ROWS_ERR);
+    }
+    if (bias.get_cols() != 1)
+    {
+        exit_func(BIAS_LAYOUT_ERR);
+    }
+}
+
+/**
+ * Constructor for a Dense instance that borrows its parameters.
+ * @param weights Weights view
+ * @param bias Bias view (contiguous column vector)
+ * @param act_type Activation Type
+ */
+Dense::Dense(const MatrixView &weights, const MatrixView &bias,
              ActivationType act_type)
-        : _weights(weights), _bias(bias),
-          act(act_type)
+        : owns_params(false), format(FP32), weights_view(weights),
+          bias_view(bias), act(act_type), skip_inputs(false), prepacked(false)
 {
     if (bias.get_rows() != weights.get_rows())
     {
         exit_func(BIAS_WEIGHTS_ROWS_ERR);
     }
+    if (bias.get_cols() != 1 || (bias.get_rows() > 1 &&
+                                 bias.get_row_stride() != 1))
+    {
+        exit_func(BIAS_LAYOUT_ERR);
+    }
 }
 
+/**
+ * Constructor for a Dense instance on half precision weights.
+ * @param weights FP16 or BF16 weights
+ * @param bias Bias view (contiguous column vector)
+ * @param act_type Activation Type
+ */
+Dense::Dense(const HalfMatrix &weights, const MatrixView &bias,
+             ActivationType act_type)
+        : owns_params(false), format(weights.get_format()),
+          half_weights(weights), weights_view(_weights), bias_view(bias),
+          act(act_type), skip_inputs(false), prepacked(false)
+{
+    if (bias.get_rows() != weights.get_rows())
+    {
+        exit_func(BIAS_WEIGHTS_ROWS_ERR);
+    }
+    if (bias.get_cols() != 1 || (bias.get_rows() > 1 &&
+                                 bias.get_row_stride() != 1))
+    {
+        exit_func(BIAS_LAYOUT_ERR);
+    }
+}
+
+/**
+ * Constructor for a sparse Dense instance.
+ * @param weights Sparse weights
+ * @param bias Bias vector (also Matrix)
+ * @param act_type Activation Type
+ */
+Dense::Dense(const SparseMatrix &weights, const Matrix &bias,
+             ActivationType act_type)
+        : owns_params(true), format(FP32), _bias(bias),
+          sparse_weights(weights), weights_view(_weights), bias_view(_bias),
+          act(act_type), skip_inputs(false), prepacked(false)
+{
+    if (bias.get_rows() != weights.get_rows())
+    {
+        exit_func(BIAS_WEIGHTS_ROWS_ERR);
+    }
+    if (bias.get_cols() != 1)
+    {
+        exit_func(BIAS_LAYOUT_ERR);
+    }
+}
+
+/**
+ * Copy constructor - an owning layer copies its parameters, a borrowing
+ * layer keeps borrowing the same memory.
+ * @param other layer to copy
+ */
+Dense::Dense(const Dense &other)
+        : owns_params(other.owns_params), format(other.format),
+          _weights(other._weights), _bias(other._bias),
+          half_weights(other.half_weights),
+          sparse_weights(other.sparse_weights),
+          weights_view(owns_params || format != FP32 ? MatrixView(_weights)
+                                                     : other.weights_view),
+          bias_view(owns_params ? MatrixView(_bias) : other.bias_view),
+          act(other.act), skip_inputs(other.skip_inputs),
+          input_major(other.input_major), prepacked(other.prepacked),
+          packed_weights(other.packed_weights)
+{}
+
 /**
 * Getter of weights of specific layer
 * @return The weights of specific layer
 */
 Matrix Dense::get_weights() const
 {
-    return _weights;
+    if (format != FP32)
+    {
+        return half_weights.to_matrix();
+    }
+    if (is_sparse())
+    {
+        return sparse_weights.to_matrix();
+    }
+    return Matrix(weights_view);
 }
 
 /**
@@ -52,23 +156,282 @@ Matrix Dense::get_weights() const
 */
 Matrix Dense::get_bias() const
 {
-    return _bias;
+    return Matrix(bias_view);
 }
 
 /**
-* Applies the layer on input and returns output matrix
-* @param m input matrix
-* @return the output matrix.
+* Getter of activation of this layer
+* @return the activation of this layer
 */
 Activation Dense::get_activation() const
 {
     return act;
 }
 
-Matrix Dense::operator()(const Matrix &m) const
+/**
+* Getter of the storage format of the weights
+* @return FP32, FP16 or BF16
+*/
+WeightFormat Dense::get_weight_format() const
+{
+    return format;
+}
+
+/**
+* Tells whether the weights are stored in CSR form.
+* @return true for a sparse layer
+*/
+bool Dense::is_sparse() const
+{
+    return sparse_weights.get_rows() > 0;
+}
+
+/**
+* Getter of the sparse weights of this layer
+* @return The CSR weights, empty for a dense layer
+*/
+const SparseMatrix &Dense::get_sparse_weights() const
+{
+    return sparse_weights;
+}
+
+/**
+* Turns on skipping zero inputs by keeping column-major weights.
+* @param enabled true to skip zero inputs, false to free the copy
+*/
+void Dense::set_input_skipping(bool enabled)
 {
-    Matrix mult_res_mat = (_weights * m);
-    Matrix add_result = mult_res_mat + _bias;
-    return act(add_result);
+    skip_inputs = enabled && format == FP32 && !is_sparse();
+    input_major = skip_inputs ? Matrix(weights_view.transposed()) : Matrix();
+}
+
+/**
+* Tells whether the layer skips zero inputs.
+* @return true if set_input_skipping(true) took effect
+*/
+bool Dense::skips_zero_inputs() const
+{
+    return skip_inputs;
+}
+
+/**
+* Turns on pre-packed weights by packing them once for the GEMM kernel.
+* @param enabled true to pack the weights, false to free the packed copy
+*/
+void Dense::set_weight_packing(bool enabled)
+{
+    prepacked = enabled && format == FP32 && !is_sparse();
+    if (!prepacked)
+    {
+        packed_weights = Matrix();
+        return;
+    }
+    const int rows = weights_view.get_rows(), cols = weights_view.get_cols();
+    // One row per float of the padded panels, so the buffer is aligned and
+    // sized exactly.
+    packed_weights = Matrix((int) gemm_packed_a_size(rows, cols), 1);
+    gemm_pack_a(rows, cols, weights_view.data(), weights_view.get_row_stride(),
+                weights_view.get_col_stride(), packed_weights.data());
+}
+
+/**
+* Tells whether the layer runs batches on pre-packed weights.
+* @return true if set_weight_packing(true) took effect
+*/
+bool Dense::is_prepacked() const
+{
+    return prepacked;
+}
+
+/**
+* Helper function that counts the nonzero elements of a view.
+* @param m the view
+* @return Number of nonzeros.
+*/
+static long long count_nonzeros(const MatrixView &m)
+{
+    const int rows = m.get_rows(), cols = m.get_cols();
+    const int row_stride = m.get_row_stride(), col_stride = m.get_col_stride();
+    const float *data = m.data();
+    if (m.is_contiguous() || (cols == 1 && row_stride == 1))
+    {
+        const int size = rows * cols;
+        int count = 0;
+        for (int p = 0; p < size; ++p)
+        {
+            count += data[p] != 0;
+        }
+        return count;
+    }
+    long long count = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        const float *row = data + (size_t) i * row_stride;
+        for (int j = 0; j < cols; ++j)
+        {
+            count += row[(size_t) j * col_stride] != 0;
+        }
+    }
+    return count;
+}
+
+/**
+* Applies the layer on input and returns output matrix.
+* The input may hold a batch of samples, one per column: the bias is
+* broadcast over the columns and the activation is applied per column.
+* @param m input matrix
+* @return the output matrix.
+*/
+Matrix Dense::operator()(const MatrixView &m) const
+{
+    Matrix output(get_output_size(), m.get_cols());
+    apply(m, output);
+    return output;
+}
+
+/**
+* Fused version of operator(): computes act(weights * m + bias) straight
+* into output.
+* @param m input matrix (or any strided view), one sample per column
+* @param output matrix receiving the result.
+*/
+void Dense::apply(const MatrixView &m, Matrix &output) const
+{
+    if (get_input_size() != m.get_rows())
+    {
+        exit_func(MAT_MULTIPLICATION_ERR);
+    }
+    if (output.get_rows() != get_output_size() ||
+        output.get_cols() != m.get_cols())
+    {
+        output = Matrix(get_output_size(), m.get_cols());
+    }
+    apply(m, output.data());
+}
+
+/**
+* Raw buffer version of apply(): never allocates.
+* @param m input matrix (or any strided view), one sample per column
+* @param output buffer receiving the rows x m.get_cols() result.
+*/
+void Dense::apply(const MatrixView &m, float *output) const
+{
+    apply_logits(m, output);
+    if (act.get_activation_type() == SOFTMAX)
+    {
+        const long long elements = (long long) get_output_size() *
+                                   m.get_cols();
+        ProfileScope profile(PROFILE_ACTIVATION, profile_current_layer(),
+                             m.get_cols(), PROFILE_SOFTMAX_FLOPS * elements,
+                             2 * elements * (long long) sizeof(float));
+        act.apply_in_place(output, get_output_size(), m.get_cols());
+    }
+}
+
+/**
+* Same as the raw buffer apply() but leaves out the SOFTMAX normalization
+* (RELU is still applied), so a SOFTMAX layer writes its logits.
+* @param m input matrix (or any strided view), one sample per column
+* @param output buffer receiving the rows x m.get_cols() result
+* (row-major, contiguous). Must not overlap m.
+*/
+void Dense::apply_logits(const MatrixView &m, float *output) const
+{
+    if (get_input_size() != m.get_rows())
+    {
+        exit_func(MAT_MULTIPLICATION_ERR);
+    }
+    const bool relu = act.get_activation_type() == RELU;
+    const long long rows = get_output_size(), depth = get_input_size();
+    const long long cols = m.get_cols();
+    if (is_sparse())
+    {
+        const long long nonzeros = sparse_weights.get_nonzeros();
+        ProfileScope profile(PROFILE_GEMM, profile_current_layer(), cols,
+                             cols * (2 * nonzeros + rows * (relu ? 2 : 1)),
+                             (long long) sparse_weights.get_bytes() +
+                             (rows + depth * cols + rows * cols) *
+                             (long long) sizeof(float));
+        spmm_bias_act(rows, m.get_cols(), (int) depth,
+                      sparse_weights.get_row_offsets(),
+                      sparse_weights.get_col_indices(),
+                      sparse_weights.get_values(), m.data(),
+                      m.get_row_stride(), m.get_col_stride(), output,
+                      m.get_cols(), bias_view.data(), relu);
+        return;
+    }
+    if (skips_zero_inputs())
+    {
+        const long long nonzeros = count_nonzeros(m);
+        if (nonzeros <= INPUT_SKIP_MAX_DENSITY * (float) (depth * cols))
+        {
+            ProfileScope profile(PROFILE_GEMM, profile_current_layer(), cols,
+                                 rows * (2 * nonzeros +
+                                         cols * (relu ? 2 : 1)),
+                                 (rows * nonzeros + rows + depth * cols +
+                                  rows * cols) * (long long) sizeof(float));
+            gemm_sparse_input_bias_act(rows, m.get_cols(), depth,
+                                       input_major.data(),
+                                       input_major.get_cols(), m.data(),
+                                       m.get_row_stride(), m.get_col_stride(),
+                                       output, m.get_cols(), bias_view.data(),
+                                       relu);
+            return;
+        }
+    }
+    const long long weight_bytes = rows * depth *
+                                   (format == FP32 ? sizeof(float) : 2);
+    ProfileScope profile(PROFILE_GEMM, profile_current_layer(), cols,
+                         rows * cols * (2 * depth + (relu ? 2 : 1)),
+                         weight_bytes + (rows + depth * cols + rows * cols) *
+                                        (long long) sizeof(float));
+    if (prepacked && cols > 1)
+    {
+        gemm_packed_bias_act(weights_view.get_rows(), m.get_cols(),
+                             weights_view.get_cols(), packed_weights.data(),
+                             m.data(), m.get_row_stride(), m.get_col_stride(),
+                             output, m.get_cols(), bias_view.data(), relu);
+    }
+    else if (format == FP32)
+    {
+        gemm_bias_act(weights_view.get_rows(), m.get_cols(),
+                      weights_view.get_cols(), weights_view.data(),
+                      weights_view.get_row_stride(),
+                      weights_view.get_col_stride(),
+                      m.data(), m.get_row_stride(), m.get_col_stride(),
+                      output, m.get_cols(),
+                      bias_view.data(), relu);
+    }
+    else
+    {
+        gemm_half_bias_act(half_weights.get_rows(), m.get_cols(),
+                           half_weights.get_cols(), half_weights.data(),
+                           half_weights.get_cols(), format,
+                           m.data(), m.get_row_stride(), m.get_col_stride(),
+                           output, m.get_cols(),
+                           bias_view.data(), relu);
+    }
+}
+
+/**
+* Get the number of outputs (neurons) of this layer.
+* @return Number of rows of the weights.
+*/
+int Dense::get_output_size() const
+{
+    return bias_view.get_rows();
+}
+
+/**
+* Get the number of inputs of this layer.
+* @return Number of columns of the weights.
+*/
+int Dense::get_input_size() const
+{
+    if (is_sparse())
+    {
+        return sparse_weights.get_cols();
+    }
+    return format == FP32 ? weights_view.get_cols() : half_weights.get_cols();
 }
 
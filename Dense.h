@@ -1,10 +1,16 @@
 #include "Activation.h"
+#include "HalfMatrix.h"
+#include "SparseMatrix.h"
 
 #ifndef DENSE_H
 #define DENSE_H
 
 #define BIAS_WEIGHTS_ROWS_ERR "Error: size of bias rows is incompatible with "\
 "weights rows!\n"
+#define BIAS_LAYOUT_ERR "Error: bias must be a contiguous column vector!\n"
+// Inputs with at most this fraction of nonzeros take the zero skipping path
+// (see set_input_skipping()), denser ones the GEMM.
+#define INPUT_SKIP_MAX_DENSITY 0.3f
 
 /**
      * Dense Class - class that describes a layer on the network.
@@ -12,9 +18,19 @@
 class Dense
 {
 private:
-    const Matrix _weights;
+    const bool owns_params;
+    const WeightFormat format;
+    const Matrix _weights; // owned copies, unused when parameters are borrowed
     const Matrix _bias;
+    const HalfMatrix half_weights; // FP16/BF16 weights, empty for FP32
+    const SparseMatrix sparse_weights; // CSR weights, empty for dense layers
+    const MatrixView weights_view; // parameters used by the kernels
+    const MatrixView bias_view;
     const Activation act;
+    bool skip_inputs;
+    Matrix input_major; // transposed weights, used when skip_inputs is set
+    bool prepacked;
+    Matrix packed_weights; // gemm_pack_a() panels, used when prepacked is set
 public:
     // Constructor for Dense instance:
     /**
@@ -22,11 +38,56 @@ public:
      * @param weights Weights Matrix
      * @param bias Bias vector (also Matrix)
      * @param act_type Activation Type
+     * @param format Storage format of the weights - FP16 and BF16 keep a
+     * 16 bit copy that the kernels widen on the fly, halving weight memory
+     * traffic.
      */
-    Dense(const Matrix &weights, const Matrix &bias, ActivationType act_type);
+    Dense(const Matrix &weights, const Matrix &bias, ActivationType act_type,
+          WeightFormat format = FP32);
 
     /**
-    * Getter of weights of specific layer
+     * Constructor for a Dense instance that borrows its parameters (e.g.
+     * from a memory mapped model file) instead of copying them. The viewed
+     * memory must outlive the layer.
+     * @param weights Weights view
+     * @param bias Bias view (contiguous column vector)
+     * @param act_type Activation Type
+     */
+    Dense(const MatrixView &weights, const MatrixView &bias,
+          ActivationType act_type);
+
+    /**
+     * Constructor for a Dense instance on half precision weights. A
+     * borrowing HalfMatrix stays borrowed, so the viewed memory must
+     * outlive the layer.
+     * @param weights FP16 or BF16 weights
+     * @param bias Bias view (contiguous column vector)
+     * @param act_type Activation Type
+     */
+    Dense(const HalfMatrix &weights, const MatrixView &bias,
+          ActivationType act_type);
+
+    /**
+     * Constructor for a sparse Dense instance: the weights are kept in CSR
+     * form and only their stored (nonzero) elements are multiplied, so a
+     * pruned layer costs in proportion to its density.
+     * @param weights Sparse weights (e.g. from prune_weights())
+     * @param bias Bias vector (also Matrix)
+     * @param act_type Activation Type
+     */
+    Dense(const SparseMatrix &weights, const Matrix &bias,
+          ActivationType act_type);
+
+    /**
+     * Copy constructor - an owning layer copies its parameters, a borrowing
+     * layer keeps borrowing the same memory.
+     * @param other layer to copy
+     */
+    Dense(const Dense &other);
+
+    /**
+    * Getter of weights of specific layer (widened to float32 for half
+    * precision layers, expanded for sparse layers)
     * @return The weights of specific layer
     */
     Matrix get_weights() const;
@@ -44,11 +105,107 @@ public:
     Activation get_activation() const;
 
     /**
-    * Applies the layer on input and returns output matrix
+    * Getter of the storage format of the weights
+    * @return FP32, FP16 or BF16
+    */
+    WeightFormat get_weight_format() const;
+
+    /**
+    * Tells whether the weights are stored in CSR form.
+    * @return true for a sparse layer
+    */
+    bool is_sparse() const;
+
+    /**
+    * Getter of the sparse weights of this layer
+    * @return The CSR weights, empty for a dense layer
+    */
+    const SparseMatrix &get_sparse_weights() const;
+
+    /**
+    * Turns on skipping zero inputs (e.g. the background pixels of an image):
+    * the layer keeps a column-major copy of its weights, and for inputs
+    * that are at most INPUT_SKIP_MAX_DENSITY nonzero it accumulates only the
+    * weight columns of the nonzero inputs. Denser inputs still run the
+    * GEMM. Only float32 dense weights can skip inputs; the call does
+    * nothing for other layers.
+    * @param enabled true to skip zero inputs, false to free the copy
+    */
+    void set_input_skipping(bool enabled);
+
+    /**
+    * Tells whether the layer skips zero inputs.
+    * @return true if set_input_skipping(true) took effect
+    */
+    bool skips_zero_inputs() const;
+
+    /**
+    * Turns on pre-packed weights: the layer packs its weights once into the
+    * panel layout of the GEMM micro-kernel (zero padded to whole GEMM_MR
+    * row panels, see gemm_pack_a()), so batches stream them with unit
+    * stride instead of repacking every block on every call. A single
+    * sample keeps using the row-major weights, which the matrix-vector
+    * kernel already reads contiguously. Only float32 dense weights are
+    * packed; the call does nothing for other layers. The packed copy is not
+    * updated if borrowed weights change afterwards.
+    * @param enabled true to pack the weights, false to free the packed copy
+    */
+    void set_weight_packing(bool enabled);
+
+    /**
+    * Tells whether the layer runs batches on pre-packed weights.
+    * @return true if set_weight_packing(true) took effect
+    */
+    bool is_prepacked() const;
+
+    /**
+    * Applies the layer on input and returns output matrix.
+    * The input may hold a batch of samples, one per column: the bias is
+    * broadcast over the columns and the activation is applied per column.
     * @param m input matrix
     * @return the output matrix.
     */
-    Matrix operator()(const Matrix &m) const;
+    Matrix operator()(const MatrixView &m) const;
+
+    /**
+    * Fused version of operator(): computes act(weights * m + bias) straight
+    * into output. The bias-add and RELU run in the GEMM epilogue, so no
+    * intermediate matrix is created. Results are bit-identical to
+    * operator().
+    * @param m input matrix (or any strided view), one sample per column
+    * @param output matrix receiving the result - it is (re)allocated only
+    * if its size does not fit. Must not overlap m.
+    */
+    void apply(const MatrixView &m, Matrix &output) const;
+
+    /**
+    * Raw buffer version of apply(): never allocates.
+    * @param m input matrix (or any strided view), one sample per column
+    * @param output buffer receiving the rows x m.get_cols() result
+    * (row-major, contiguous). Must not overlap m.
+    */
+    void apply(const MatrixView &m, float *output) const;
+
+    /**
+    * Same as the raw buffer apply() but leaves out the SOFTMAX normalization
+    * (RELU is still applied), so a SOFTMAX layer writes its logits.
+    * @param m input matrix (or any strided view), one sample per column
+    * @param output buffer receiving the rows x m.get_cols() result
+    * (row-major, contiguous). Must not overlap m.
+    */
+    void apply_logits(const MatrixView &m, float *output) const;
+
+    /**
+    * Get the number of outputs (neurons) of this layer.
+    * @return Number of rows of the weights.
+    */
+    int get_output_size() const;
+
+    /**
+    * Get the number of inputs of this layer.
+    * @return Number of columns of the weights.
+    */
+    int get_input_size() const;
 
 };
 
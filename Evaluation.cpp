@@ -0,0 +1,125 @@
+#include <chrono>
+#include <iomanip>
+#include "Evaluation.h"
+
+using std::cerr;
+using std::endl;
+
+typedef std::chrono::steady_clock eval_clock;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that gives the seconds passed since a time point.
+*/
+static double seconds_since(const eval_clock::time_point &start)
+{
+    return std::chrono::duration<double>(eval_clock::now() - start).count();
+}
+
+/**
+ * Streams a labelled IDX data set through a network and collects accuracy,
+ * the confusion matrix and timing.
+ * @param reader labelled data set
+ * @param predict the network to evaluate
+ * @param batch_size number of images classified per call
+ * @return The evaluation report.
+ */
+eval_report evaluate(IdxReader &reader, const BatchPredictor &predict,
+                     int batch_size)
+{
+    if (!reader.has_labels())
+    {
+        exit_func(EVAL_LABELS_ERR);
+    }
+    if (batch_size <= 0)
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    eval_report report{};
+    const int pixels = reader.get_image_rows() * reader.get_image_cols();
+    Matrix batch(pixels, batch_size);
+    unsigned int *labels = new(std::nothrow) unsigned int[batch_size];
+    digit *results = new(std::nothrow) digit[batch_size];
+    if (!labels || !results)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    const eval_clock::time_point start = eval_clock::now();
+    int n;
+    while ((n = reader.read_batch(batch, labels)) > 0)
+    {
+        const eval_clock::time_point batch_start = eval_clock::now();
+        predict(MatrixView(batch).block(0, 0, pixels, n), results);
+        report.inference_seconds += seconds_since(batch_start);
+        for (int j = 0; j < n; ++j)
+        {
+            // Labels and predictions outside 0..9 (e.g. from a network
+            // with more outputs) count as errors but have no confusion cell.
+            if (labels[j] < DIGIT_COUNT && results[j].value < DIGIT_COUNT)
+            {
+                report.confusion[labels[j]][results[j].value]++;
+            }
+            report.correct += results[j].value == labels[j];
+        }
+        report.samples += n;
+    }
+    report.total_seconds = seconds_since(start);
+    delete[] labels;
+    delete[] results;
+    return report;
+}
+
+/**
+ * Prints accuracy, images/sec and the confusion matrix of a report.
+ * @param os output stream
+ * @param report evaluation report
+ */
+void print_report(std::ostream &os, const eval_report &report)
+{
+    const double samples = report.samples > 0 ? report.samples : 1;
+    os << "images: " << report.samples << endl;
+    os << "accuracy: " << std::fixed << std::setprecision(4)
+       << report.correct / samples << " (" << report.correct << "/"
+       << report.samples << ")" << endl;
+    os << std::setprecision(1);
+    if (report.inference_seconds > 0)
+    {
+        os << "inference images/sec: "
+           << report.samples / report.inference_seconds << endl;
+    }
+    if (report.total_seconds > 0)
+    {
+        os << "end-to-end images/sec: "
+           << report.samples / report.total_seconds << endl;
+    }
+    os << "confusion matrix (rows: label, columns: prediction):" << endl;
+    os << "     ";
+    for (int p = 0; p < DIGIT_COUNT; ++p)
+    {
+        os << std::setw(6) << p;
+    }
+    os << endl;
+    for (int l = 0; l < DIGIT_COUNT; ++l)
+    {
+        os << std::setw(5) << l;
+        for (int p = 0; p < DIGIT_COUNT; ++p)
+        {
+            os << std::setw(6) << report.confusion[l][p];
+        }
+        os << endl;
+    }
+    os.unsetf(std::ios::floatfield);
+    os << std::setprecision(6);
+}
@@ -0,0 +1,60 @@
+// Evaluation.h
+
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include <functional>
+#include <iostream>
+#include "IdxReader.h"
+#include "MlpNetwork.h"
+
+#define DIGIT_COUNT 10
+#define DEFAULT_EVAL_BATCH 256
+#define EVAL_LABELS_ERR "Error: Evaluation needs a labelled data set!\n"
+
+/**
+ * @struct eval_report
+ * @brief Result of evaluating a network on a labelled data set.
+ * @var samples - number of images evaluated
+ * @var correct - number of images classified as their label
+ * @var confusion - confusion[label][prediction] counts, for labels and
+ * predictions below DIGIT_COUNT
+ * @var inference_seconds - time spent inside the network
+ * @var total_seconds - time including reading and converting the images
+ */
+typedef struct eval_report
+{
+    int samples;
+    int correct;
+    unsigned int confusion[DIGIT_COUNT][DIGIT_COUNT];
+    double inference_seconds;
+    double total_seconds;
+} eval_report;
+
+/**
+ * Classifies a batch of images (one per column) into results - e.g. a
+ * lambda calling MlpNetwork::predict_batch() or ParallelMlp::predict_batch().
+ */
+typedef std::function<void(const MatrixView &images, digit *results)>
+        BatchPredictor;
+
+/**
+ * Streams a labelled IDX data set through a network and collects accuracy,
+ * the confusion matrix and timing. Reading starts from the current position
+ * of the reader.
+ * @param reader labelled data set
+ * @param predict the network to evaluate
+ * @param batch_size number of images classified per call
+ * @return The evaluation report.
+ */
+eval_report evaluate(IdxReader &reader, const BatchPredictor &predict,
+                     int batch_size = DEFAULT_EVAL_BATCH);
+
+/**
+ * Prints accuracy, images/sec and the confusion matrix of a report.
+ * @param os output stream
+ * @param report evaluation report
+ */
+void print_report(std::ostream &os, const eval_report &report);
+
+#endif //EVALUATION_H
@@ -0,0 +1,1011 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include "Matrix.h"
+#include "HalfMatrix.h"
+#include "Gemm.h"
+#include "Simd.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Growable aligned scratch buffer used for packing the operands.
+ * One instance per thread, so gemm() can run concurrently.
+ */
+struct PackBuffer
+{
+    char *raw = nullptr;
+    float *data = nullptr;
+    size_t capacity = 0;
+
+    ~PackBuffer()
+    {
+        delete[] raw;
+    }
+
+    /**
+    * Makes sure the buffer can hold at least the given number of floats.
+    * @param floats required capacity
+    * @return Pointer to the aligned buffer.
+    */
+    float *reserve(size_t floats)
+    {
+        if (floats <= capacity)
+        {
+            return data;
+        }
+        delete[] raw;
+        raw = new(std::nothrow) char[floats * sizeof(float) +
+                                     MATRIX_ALIGNMENT - 1];
+        if (!raw)
+        {
+            exit_func(MEMORY_ALLOC_FAIL);
+        }
+        uintptr_t addr = reinterpret_cast<uintptr_t>(raw);
+        addr = (addr + MATRIX_ALIGNMENT - 1) &
+               ~((uintptr_t) MATRIX_ALIGNMENT - 1);
+        data = reinterpret_cast<float *>(addr);
+        capacity = floats;
+        return data;
+    }
+};
+
+static thread_local PackBuffer a_pack_buf;
+static thread_local PackBuffer b_pack_buf;
+static thread_local PackBuffer index_buf; // int indices, stored as floats
+
+/**
+* Scalar epilogue: adds the bias of the given row and applies ReLU.
+* Same operations, in the same order, as a separate bias-add and ReLU pass.
+*/
+static inline float epilogue(float v, const float *bias, int row, bool relu)
+{
+    if (bias)
+    {
+        v += bias[row];
+    }
+    if (relu && v < 0)
+    {
+        v = 0;
+    }
+    return v;
+}
+
+/**
+* Reads element idx of the A operand and widens it to float. A is float32
+* for the plain GEMM and FP16/BF16 for the half precision weights.
+*/
+template <WeightFormat F>
+static inline float load_a(const void *a, size_t idx);
+
+template <>
+inline float load_a<FP32>(const void *a, size_t idx)
+{
+    return static_cast<const float *>(a)[idx];
+}
+
+template <>
+inline float load_a<FP16>(const void *a, size_t idx)
+{
+    return fp16_to_float(static_cast<const uint16_t *>(a)[idx]);
+}
+
+template <>
+inline float load_a<BF16>(const void *a, size_t idx)
+{
+    return bf16_to_float(static_cast<const uint16_t *>(a)[idx]);
+}
+
+/**
+* Packs an mc x kc block of A into panels of GEMM_MR rows. Inside a panel the
+* elements are stored column after column, so the kernel reads A with unit
+* stride. Rows past mc are zero padded. Half precision elements are widened
+* here, once per block, so the micro-kernel always runs on floats.
+* @param a_offset index of the block's first element in a
+*/
+template <WeightFormat F>
+static void pack_a(int mc, int kc, const void *a, size_t a_offset, int a_rs,
+                   int a_cs, float *dst)
+{
+    for (int ir = 0; ir < mc; ir += GEMM_MR)
+    {
+        const int rows = (mc - ir < GEMM_MR) ? mc - ir : GEMM_MR;
+        for (int p = 0; p < kc; ++p)
+        {
+            const size_t src = a_offset + (size_t) ir * a_rs +
+                               (size_t) p * a_cs;
+            int r = 0;
+            for (; r < rows; ++r)
+            {
+                dst[r] = load_a<F>(a, src + (size_t) r * a_rs);
+            }
+            for (; r < GEMM_MR; ++r)
+            {
+                dst[r] = 0;
+            }
+            dst += GEMM_MR;
+        }
+    }
+}
+
+/**
+* Packs a kc x nc block of B into panels of GEMM_NR columns, each panel
+* stored row after row. Columns past nc are zero padded.
+*/
+static void pack_b(int kc, int nc, const float *b, int b_rs, int b_cs,
+                   float *dst)
+{
+    for (int jr = 0; jr < nc; jr += GEMM_NR)
+    {
+        const int cols = (nc - jr < GEMM_NR) ? nc - jr : GEMM_NR;
+        for (int p = 0; p < kc; ++p)
+        {
+            const float *src = b + (size_t) p * b_rs + (size_t) jr * b_cs;
+            if (cols == GEMM_NR && b_cs == 1)
+            {
+                std::memcpy(dst, src, GEMM_NR * sizeof(float));
+            }
+            else
+            {
+                int j = 0;
+                for (; j < cols; ++j)
+                {
+                    dst[j] = src[(size_t) j * b_cs];
+                }
+                for (; j < GEMM_NR; ++j)
+                {
+                    dst[j] = 0;
+                }
+            }
+            dst += GEMM_NR;
+        }
+    }
+}
+
+/**
+* Portable micro-kernel: computes a full GEMM_MR x GEMM_NR tile of C from a
+* packed A panel and a packed B panel.
+*/
+static void kernel_scalar(int kc, const float *pa, const float *pb,
+                          float *c, int ldc, bool accumulate,
+                          const float *bias, bool relu)
+{
+    float acc[GEMM_MR][GEMM_NR] = {};
+    for (int p = 0; p < kc; ++p)
+    {
+        for (int r = 0; r < GEMM_MR; ++r)
+        {
+            const float a = pa[r];
+            for (int j = 0; j < GEMM_NR; ++j)
+            {
+                acc[r][j] += a * pb[j];
+            }
+        }
+        pa += GEMM_MR;
+        pb += GEMM_NR;
+    }
+    for (int r = 0; r < GEMM_MR; ++r)
+    {
+        float *c_row = c + (size_t) r * ldc;
+        for (int j = 0; j < GEMM_NR; ++j)
+        {
+            const float v = accumulate ? c_row[j] + acc[r][j] : acc[r][j];
+            c_row[j] = epilogue(v, bias, r, relu);
+        }
+    }
+}
+
+/**
+* Portable matrix-vector product y = A * x (or y += A * x).
+*/
+template <WeightFormat F>
+static void gemv_scalar(int m, int k, const void *a, int lda,
+                        const float *x, float *y, int ldy, bool accumulate,
+                        const float *bias, bool relu)
+{
+    for (int i = 0; i < m; ++i)
+    {
+        const size_t a_row = (size_t) i * lda;
+        float sum = 0;
+        for (int p = 0; p < k; ++p)
+        {
+            sum += load_a<F>(a, a_row + p) * x[p];
+        }
+        const float v = accumulate ? y[(size_t) i * ldy] + sum : sum;
+        y[(size_t) i * ldy] = epilogue(v, bias, i, relu);
+    }
+}
+
+/**
+* Portable sparse product C = A * B + bias with A in CSR form. Rows of a
+* batch with contiguous columns are accumulated as scaled rows of B, other
+* operands as one sparse dot product per column.
+*/
+static void spmm_scalar(int m, int n, const int *row_ptr, const int *col_idx,
+                        const float *values, const float *b, int b_rs,
+                        int b_cs, float *c, int ldc, const float *bias,
+                        bool relu)
+{
+    for (int i = 0; i < m; ++i)
+    {
+        float *c_row = c + (size_t) i * ldc;
+        if (n > 1 && b_cs == 1)
+        {
+            std::memset(c_row, 0, (size_t) n * sizeof(float));
+            for (int p = row_ptr[i]; p < row_ptr[i + 1]; ++p)
+            {
+                const float a = values[p];
+                const float *b_row = b + (size_t) col_idx[p] * b_rs;
+                for (int j = 0; j < n; ++j)
+                {
+                    c_row[j] += a * b_row[j];
+                }
+            }
+            for (int j = 0; j < n; ++j)
+            {
+                c_row[j] = epilogue(c_row[j], bias, i, relu);
+            }
+            continue;
+        }
+        for (int j = 0; j < n; ++j)
+        {
+            const float *b_col = b + (size_t) j * b_cs;
+            float sum = 0;
+            for (int p = row_ptr[i]; p < row_ptr[i + 1]; ++p)
+            {
+                sum += values[p] * b_col[(size_t) col_idx[p] * b_rs];
+            }
+            c_row[j] = epilogue(sum, bias, i, relu);
+        }
+    }
+}
+
+/**
+* Portable column product for a sparse input: y = A * x + bias with A given
+* column-major (row p of at is column p of A), x given by its nonzeros.
+* @param count number of nonzero elements of x
+* @param rows their indices, ascending
+* @param values their values
+*/
+static void sparse_input_scalar(int m, int count, const int *rows,
+                                const float *values, const float *at,
+                                int ldat, float *y, int ldy,
+                                const float *bias, bool relu)
+{
+    for (int i = 0; i < m; ++i)
+    {
+        float sum = 0;
+        for (int q = 0; q < count; ++q)
+        {
+            sum += values[q] * at[(size_t) rows[q] * ldat + i];
+        }
+        y[(size_t) i * ldy] = epilogue(sum, bias, i, relu);
+    }
+}
+
+#ifdef MLP_HAVE_AVX2
+
+/**
+* AVX2/FMA micro-kernel: the 6x16 tile of C lives in 12 ymm registers for the
+* whole kc loop.
+*/
+MLP_AVX2_TARGET
+static void kernel_avx2(int kc, const float *pa, const float *pb,
+                        float *c, int ldc, bool accumulate,
+                        const float *bias, bool relu)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+    for (int p = 0; p < kc; ++p)
+    {
+        const __m256 b0 = _mm256_load_ps(pb);
+        const __m256 b1 = _mm256_load_ps(pb + 8);
+        __m256 a = _mm256_broadcast_ss(pa);
+        c00 = _mm256_fmadd_ps(a, b0, c00);
+        c01 = _mm256_fmadd_ps(a, b1, c01);
+        a = _mm256_broadcast_ss(pa + 1);
+        c10 = _mm256_fmadd_ps(a, b0, c10);
+        c11 = _mm256_fmadd_ps(a, b1, c11);
+        a = _mm256_broadcast_ss(pa + 2);
+        c20 = _mm256_fmadd_ps(a, b0, c20);
+        c21 = _mm256_fmadd_ps(a, b1, c21);
+        a = _mm256_broadcast_ss(pa + 3);
+        c30 = _mm256_fmadd_ps(a, b0, c30);
+        c31 = _mm256_fmadd_ps(a, b1, c31);
+        a = _mm256_broadcast_ss(pa + 4);
+        c40 = _mm256_fmadd_ps(a, b0, c40);
+        c41 = _mm256_fmadd_ps(a, b1, c41);
+        a = _mm256_broadcast_ss(pa + 5);
+        c50 = _mm256_fmadd_ps(a, b0, c50);
+        c51 = _mm256_fmadd_ps(a, b1, c51);
+        pa += GEMM_MR;
+        pb += GEMM_NR;
+    }
+    const __m256 acc[GEMM_MR][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                                    {c30, c31}, {c40, c41}, {c50, c51}};
+    for (int r = 0; r < GEMM_MR; ++r)
+    {
+        float *c_row = c + (size_t) r * ldc;
+        __m256 lo = acc[r][0];
+        __m256 hi = acc[r][1];
+        if (accumulate)
+        {
+            lo = _mm256_add_ps(_mm256_loadu_ps(c_row), lo);
+            hi = _mm256_add_ps(_mm256_loadu_ps(c_row + 8), hi);
+        }
+        if (bias)
+        {
+            const __m256 b = _mm256_set1_ps(bias[r]);
+            lo = _mm256_add_ps(lo, b);
+            hi = _mm256_add_ps(hi, b);
+        }
+        if (relu)
+        {
+            // blend rather than max, to keep -0 and NaN exactly as the
+            // scalar "if (v < 0) v = 0" does.
+            const __m256 zero = _mm256_setzero_ps();
+            lo = _mm256_blendv_ps(lo, zero, _mm256_cmp_ps(lo, zero,
+                                                          _CMP_LT_OQ));
+            hi = _mm256_blendv_ps(hi, zero, _mm256_cmp_ps(hi, zero,
+                                                          _CMP_LT_OQ));
+        }
+        _mm256_storeu_ps(c_row, lo);
+        _mm256_storeu_ps(c_row + 8, hi);
+    }
+}
+
+/**
+* Horizontal sum of the 8 lanes of a ymm register.
+*/
+MLP_AVX2_TARGET
+static inline float hsum_avx2(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v),
+                            _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+/**
+* Loads 8 consecutive elements of the A operand, widened to float: F16C
+* vcvtph2ps for FP16, a 16 bit shift for BF16.
+*/
+template <WeightFormat F>
+static inline __m256 load8_a(const void *a, size_t idx);
+
+template <>
+MLP_AVX2_TARGET
+inline __m256 load8_a<FP32>(const void *a, size_t idx)
+{
+    return _mm256_loadu_ps(static_cast<const float *>(a) + idx);
+}
+
+template <>
+MLP_AVX2_TARGET
+inline __m256 load8_a<FP16>(const void *a, size_t idx)
+{
+    return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(
+            static_cast<const uint16_t *>(a) + idx)));
+}
+
+template <>
+MLP_AVX2_TARGET
+inline __m256 load8_a<BF16>(const void *a, size_t idx)
+{
+    const __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(
+                    static_cast<const uint16_t *>(a) + idx)));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+}
+
+/**
+* AVX2/FMA matrix-vector product y = A * x (or y += A * x). Four rows of A
+* are streamed at once so every load of x is reused four times. Half
+* precision rows are widened in registers, so only 2 bytes per weight are
+* read from memory.
+*/
+template <WeightFormat F>
+MLP_AVX2_TARGET
+static void gemv_avx2(int m, int k, const void *a, int lda,
+                      const float *x, float *y, int ldy, bool accumulate,
+                      const float *bias, bool relu)
+{
+    const int k8 = k & ~7;
+    int i = 0;
+    for (; i + 4 <= m; i += 4)
+    {
+        const size_t a0 = (size_t) i * lda;
+        const size_t a1 = a0 + lda;
+        const size_t a2 = a1 + lda;
+        const size_t a3 = a2 + lda;
+        __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+        __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+        for (int p = 0; p < k8; p += 8)
+        {
+            const __m256 xv = _mm256_loadu_ps(x + p);
+            s0 = _mm256_fmadd_ps(load8_a<F>(a, a0 + p), xv, s0);
+            s1 = _mm256_fmadd_ps(load8_a<F>(a, a1 + p), xv, s1);
+            s2 = _mm256_fmadd_ps(load8_a<F>(a, a2 + p), xv, s2);
+            s3 = _mm256_fmadd_ps(load8_a<F>(a, a3 + p), xv, s3);
+        }
+        float sums[4] = {hsum_avx2(s0), hsum_avx2(s1),
+                         hsum_avx2(s2), hsum_avx2(s3)};
+        for (int p = k8; p < k; ++p)
+        {
+            sums[0] += load_a<F>(a, a0 + p) * x[p];
+            sums[1] += load_a<F>(a, a1 + p) * x[p];
+            sums[2] += load_a<F>(a, a2 + p) * x[p];
+            sums[3] += load_a<F>(a, a3 + p) * x[p];
+        }
+        for (int r = 0; r < 4; ++r)
+        {
+            float &out = y[(size_t) (i + r) * ldy];
+            out = epilogue(accumulate ? out + sums[r] : sums[r], bias, i + r,
+                           relu);
+        }
+    }
+    for (; i < m; ++i)
+    {
+        const size_t a_row = (size_t) i * lda;
+        __m256 s = _mm256_setzero_ps();
+        for (int p = 0; p < k8; p += 8)
+        {
+            s = _mm256_fmadd_ps(load8_a<F>(a, a_row + p),
+                                _mm256_loadu_ps(x + p), s);
+        }
+        float sum = hsum_avx2(s);
+        for (int p = k8; p < k; ++p)
+        {
+            sum += load_a<F>(a, a_row + p) * x[p];
+        }
+        float &out = y[(size_t) i * ldy];
+        out = epilogue(accumulate ? out + sum : sum, bias, i, relu);
+    }
+}
+
+/**
+* Vector epilogue: adds the bias of the given row to 8 values and applies
+* ReLU, with the same results as the scalar epilogue().
+*/
+MLP_AVX2_TARGET
+static inline __m256 epilogue_avx2(__m256 v, const float *bias, int row,
+                                   bool relu)
+{
+    if (bias)
+    {
+        v = _mm256_add_ps(v, _mm256_set1_ps(bias[row]));
+    }
+    if (relu)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        v = _mm256_blendv_ps(v, zero, _mm256_cmp_ps(v, zero, _CMP_LT_OQ));
+    }
+    return v;
+}
+
+/**
+* Gathers the 8 elements of a column of B at the given row indices.
+* @param b_col pointer to B(0,j)
+* @param rows 8 row indices
+* @param rs the row stride of B in every lane
+*/
+MLP_AVX2_TARGET
+static inline __m256 gather8_avx2(const float *b_col, const int *rows,
+                                  __m256i rs)
+{
+    const __m256i idx = _mm256_mullo_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows)), rs);
+    return _mm256_i32gather_ps(b_col, idx, 4);
+}
+
+/**
+* AVX2/FMA sparse product C = A * B + bias with A in CSR form. Rows of a
+* batch with contiguous columns are updated 16 (then 8) columns at a time
+* from broadcast weights; a vector, or B with strided columns, is read with
+* 8-wide gathers of the stored column indices.
+*/
+MLP_AVX2_TARGET
+static void spmm_avx2(int m, int n, const int *row_ptr, const int *col_idx,
+                      const float *values, const float *b, int b_rs, int b_cs,
+                      float *c, int ldc, const float *bias, bool relu)
+{
+    const __m256i rs = _mm256_set1_epi32(b_rs);
+    for (int i = 0; i < m; ++i)
+    {
+        const int begin = row_ptr[i], end = row_ptr[i + 1];
+        float *c_row = c + (size_t) i * ldc;
+        int j = 0;
+        if (n > 1 && b_cs == 1)
+        {
+            for (; j + 16 <= n; j += 16)
+            {
+                __m256 lo = _mm256_setzero_ps(), hi = _mm256_setzero_ps();
+                for (int p = begin; p < end; ++p)
+                {
+                    const __m256 a = _mm256_broadcast_ss(values + p);
+                    const float *b_row = b + (size_t) col_idx[p] * b_rs + j;
+                    lo = _mm256_fmadd_ps(a, _mm256_loadu_ps(b_row), lo);
+                    hi = _mm256_fmadd_ps(a, _mm256_loadu_ps(b_row + 8), hi);
+                }
+                _mm256_storeu_ps(c_row + j, epilogue_avx2(lo, bias, i, relu));
+                _mm256_storeu_ps(c_row + j + 8,
+                                 epilogue_avx2(hi, bias, i, relu));
+            }
+            for (; j + 8 <= n; j += 8)
+            {
+                __m256 acc = _mm256_setzero_ps();
+                for (int p = begin; p < end; ++p)
+                {
+                    const float *b_row = b + (size_t) col_idx[p] * b_rs + j;
+                    acc = _mm256_fmadd_ps(_mm256_broadcast_ss(values + p),
+                                          _mm256_loadu_ps(b_row), acc);
+                }
+                _mm256_storeu_ps(c_row + j, epilogue_avx2(acc, bias, i, relu));
+            }
+        }
+        for (; j < n; ++j)
+        {
+            const float *b_col = b + (size_t) j * b_cs;
+            __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+            __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+            int p = begin;
+            for (; p + 32 <= end; p += 32)
+            {
+                s0 = _mm256_fmadd_ps(_mm256_loadu_ps(values + p),
+                                     gather8_avx2(b_col, col_idx + p, rs), s0);
+                s1 = _mm256_fmadd_ps(_mm256_loadu_ps(values + p + 8),
+                                     gather8_avx2(b_col, col_idx + p + 8, rs),
+                                     s1);
+                s2 = _mm256_fmadd_ps(_mm256_loadu_ps(values + p + 16),
+                                     gather8_avx2(b_col, col_idx + p + 16, rs),
+                                     s2);
+                s3 = _mm256_fmadd_ps(_mm256_loadu_ps(values + p + 24),
+                                     gather8_avx2(b_col, col_idx + p + 24, rs),
+                                     s3);
+            }
+            for (; p + 8 <= end; p += 8)
+            {
+                s0 = _mm256_fmadd_ps(_mm256_loadu_ps(values + p),
+                                     gather8_avx2(b_col, col_idx + p, rs), s0);
+            }
+            if (p < end)
+            {
+                // masked tail: lanes past the row read nothing and add 0
+                const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6,
+                                                       7);
+                const __m256i mask = _mm256_cmpgt_epi32(
+                        _mm256_set1_epi32(end - p), lane);
+                const __m256i idx = _mm256_mullo_epi32(
+                        _mm256_maskload_epi32(col_idx + p, mask), rs);
+                const __m256 g = _mm256_mask_i32gather_ps(
+                        _mm256_setzero_ps(), b_col, idx,
+                        _mm256_castsi256_ps(mask), 4);
+                s1 = _mm256_fmadd_ps(_mm256_maskload_ps(values + p, mask), g,
+                                     s1);
+            }
+            const float sum = hsum_avx2(_mm256_add_ps(_mm256_add_ps(s0, s1),
+                                                      _mm256_add_ps(s2, s3)));
+            c_row[j] = epilogue(sum, bias, i, relu);
+        }
+    }
+}
+
+/**
+* AVX2/FMA column product for a sparse input (see sparse_input_scalar()).
+* 64 rows of y stay in 8 ymm registers while the nonzero columns of A are
+* streamed, each scaled by its broadcast input value.
+*/
+MLP_AVX2_TARGET
+static void sparse_input_avx2(int m, int count, const int *rows,
+                              const float *values, const float *at, int ldat,
+                              float *y, int ldy, const float *bias, bool relu)
+{
+    alignas(MATRIX_ALIGNMENT) float block[64];
+    int i = 0;
+    for (; i + 64 <= m; i += 64)
+    {
+        __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps();
+        __m256 c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+        __m256 c4 = _mm256_setzero_ps(), c5 = _mm256_setzero_ps();
+        __m256 c6 = _mm256_setzero_ps(), c7 = _mm256_setzero_ps();
+        for (int q = 0; q < count; ++q)
+        {
+            const __m256 x = _mm256_broadcast_ss(values + q);
+            const float *col = at + (size_t) rows[q] * ldat + i;
+            c0 = _mm256_fmadd_ps(_mm256_loadu_ps(col), x, c0);
+            c1 = _mm256_fmadd_ps(_mm256_loadu_ps(col + 8), x, c1);
+            c2 = _mm256_fmadd_ps(_mm256_loadu_ps(col + 16), x, c2);
+            c3 = _mm256_fmadd_ps(_mm256_loadu_ps(col + 24), x, c3);
+            c4 = _mm256_fmadd_ps(_mm256_loadu_ps(col + 32), x, c4);
+            c5 = _mm256_fmadd_ps(_mm256_loadu_ps(col + 40), x, c5);
+            c6 = _mm256_fmadd_ps(_mm256_loadu_ps(col + 48), x, c6);
+            c7 = _mm256_fmadd_ps(_mm256_loadu_ps(col + 56), x, c7);
+        }
+        _mm256_store_ps(block, c0);
+        _mm256_store_ps(block + 8, c1);
+        _mm256_store_ps(block + 16, c2);
+        _mm256_store_ps(block + 24, c3);
+        _mm256_store_ps(block + 32, c4);
+        _mm256_store_ps(block + 40, c5);
+        _mm256_store_ps(block + 48, c6);
+        _mm256_store_ps(block + 56, c7);
+        for (int r = 0; r < 64; ++r)
+        {
+            y[(size_t) (i + r) * ldy] = epilogue(block[r], bias, i + r, relu);
+        }
+    }
+    for (; i + 8 <= m; i += 8)
+    {
+        __m256 acc = _mm256_setzero_ps();
+        for (int q = 0; q < count; ++q)
+        {
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(at + (size_t) rows[q] * ldat
+                                                  + i),
+                                  _mm256_broadcast_ss(values + q), acc);
+        }
+        _mm256_store_ps(block, acc);
+        for (int r = 0; r < 8; ++r)
+        {
+            y[(size_t) (i + r) * ldy] = epilogue(block[r], bias, i + r, relu);
+        }
+    }
+    if (i < m)
+    {
+        sparse_input_scalar(m - i, count, rows, values, at + i, ldat,
+                            y + (size_t) i * ldy, ldy,
+                            bias ? bias + i : nullptr, relu);
+    }
+}
+
+#endif // MLP_HAVE_AVX2
+
+/**
+* Tells whether gemm() dispatches to the AVX2/FMA kernels on this machine.
+* @return true if the SIMD kernels are in use.
+*/
+bool gemm_uses_simd()
+{
+    return cpu_has_avx2();
+}
+
+/**
+* Runs the micro-kernel on one tile. Tiles on the right/bottom edges of C
+* are computed into a local buffer and only the valid part is written back.
+*/
+static void run_kernel(int kc, const float *pa, const float *pb, float *c,
+                       int ldc, bool accumulate, int rows, int cols,
+                       const float *bias, bool relu)
+{
+    const bool full = (rows == GEMM_MR && cols == GEMM_NR);
+    alignas(MATRIX_ALIGNMENT) float tile[GEMM_MR * GEMM_NR];
+    float *dst = full ? c : tile;
+    const int dst_ld = full ? ldc : GEMM_NR;
+    const bool dst_acc = full && accumulate;
+    const float *dst_bias = full ? bias : nullptr;
+    const bool dst_relu = full && relu;
+#ifdef MLP_HAVE_AVX2
+    if (cpu_has_avx2())
+    {
+        kernel_avx2(kc, pa, pb, dst, dst_ld, dst_acc, dst_bias, dst_relu);
+    }
+    else
+    {
+        kernel_scalar(kc, pa, pb, dst, dst_ld, dst_acc, dst_bias, dst_relu);
+    }
+#else
+    kernel_scalar(kc, pa, pb, dst, dst_ld, dst_acc, dst_bias, dst_relu);
+#endif
+    if (full)
+    {
+        return;
+    }
+    for (int r = 0; r < rows; ++r)
+    {
+        float *c_row = c + (size_t) r * ldc;
+        for (int j = 0; j < cols; ++j)
+        {
+            const float v = tile[r * GEMM_NR + j];
+            c_row[j] = epilogue(accumulate ? c_row[j] + v : v, bias, r, relu);
+        }
+    }
+}
+
+/**
+* Number of rows of A after padding to whole GEMM_MR panels.
+*/
+static inline int padded_rows(int m)
+{
+    return (m + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+}
+
+/**
+* Shared driver of gemm(), gemm_bias_act(), gemm_half_bias_act() and
+* gemm_packed_bias_act(), for an A operand stored in format F. When
+* packed_a is given (see gemm_pack_a()), its blocks are used in place and
+* a is not read. The epilogue (bias, relu) is only applied while storing the
+* last block of k.
+*/
+template <WeightFormat F>
+static void gemm_impl(int m, int n, int k,
+                      const void *a, int a_rs, int a_cs,
+                      const float *b, int b_rs, int b_cs,
+                      float *c, int ldc, bool accumulate,
+                      const float *bias, bool relu,
+                      const float *packed_a = nullptr)
+{
+    if (m <= 0 || n <= 0)
+    {
+        return;
+    }
+    if (k <= 0)
+    {
+        for (int i = 0; i < m; ++i)
+        {
+            float *c_row = c + (size_t) i * ldc;
+            for (int j = 0; j < n; ++j)
+            {
+                c_row[j] = epilogue(accumulate ? c_row[j] : 0, bias, i, relu);
+            }
+        }
+        return;
+    }
+    // Matrix-vector products (a single image through a layer) do not profit
+    // from packing - stream the rows of A directly. A strided vector (e.g. a
+    // column of a larger batch) is gathered into the B packing buffer first.
+    if (n == 1 && a_cs == 1 && packed_a == nullptr)
+    {
+        const float *x = b;
+        if (b_rs != 1)
+        {
+            float *gathered = b_pack_buf.reserve((size_t) k);
+            for (int p = 0; p < k; ++p)
+            {
+                gathered[p] = b[(size_t) p * b_rs];
+            }
+            x = gathered;
+        }
+#ifdef MLP_HAVE_AVX2
+        if (cpu_has_avx2())
+        {
+            gemv_avx2<F>(m, k, a, a_rs, x, c, ldc, accumulate, bias, relu);
+            return;
+        }
+#endif
+        gemv_scalar<F>(m, k, a, a_rs, x, c, ldc, accumulate, bias, relu);
+        return;
+    }
+
+    float *a_pack = packed_a ? nullptr
+                             : a_pack_buf.reserve((size_t) GEMM_MC * GEMM_KC);
+    float *b_pack = b_pack_buf.reserve((size_t) GEMM_KC * GEMM_NC);
+    const size_t packed_stride = (size_t) padded_rows(m);
+    for (int jc = 0; jc < n; jc += GEMM_NC)
+    {
+        const int nc = (n - jc < GEMM_NC) ? n - jc : GEMM_NC;
+        for (int pc = 0; pc < k; pc += GEMM_KC)
+        {
+            const int kc = (k - pc < GEMM_KC) ? k - pc : GEMM_KC;
+            const bool acc = accumulate || pc > 0;
+            const bool last = pc + kc >= k;
+            pack_b(kc, nc, b + (size_t) pc * b_rs + (size_t) jc * b_cs,
+                   b_rs, b_cs, b_pack);
+            for (int ic = 0; ic < m; ic += GEMM_MC)
+            {
+                const int mc = (m - ic < GEMM_MC) ? m - ic : GEMM_MC;
+                const float *a_block = a_pack;
+                if (packed_a)
+                {
+                    a_block = packed_a + (size_t) pc * packed_stride +
+                              (size_t) ic * kc;
+                }
+                else
+                {
+                    pack_a<F>(mc, kc, a, (size_t) ic * a_rs +
+                                         (size_t) pc * a_cs,
+                              a_rs, a_cs, a_pack);
+                }
+                for (int jr = 0; jr < nc; jr += GEMM_NR)
+                {
+                    const int cols = (nc - jr < GEMM_NR) ? nc - jr : GEMM_NR;
+                    for (int ir = 0; ir < mc; ir += GEMM_MR)
+                    {
+                        const int rows =
+                                (mc - ir < GEMM_MR) ? mc - ir : GEMM_MR;
+                        run_kernel(kc, a_block + (size_t) ir * kc,
+                                   b_pack + (size_t) jr * kc,
+                                   c + (size_t) (ic + ir) * ldc + jc + jr,
+                                   ldc, acc, rows, cols,
+                                   last && bias ? bias + ic + ir : nullptr,
+                                   last && relu);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+* General single precision matrix multiplication: C = A * B, or
+* C += A * B when accumulate is true.
+* A is m x k, B is k x n and C is m x n, A and B given by row/column strides.
+*/
+void gemm(int m, int n, int k,
+          const float *a, int a_rs, int a_cs,
+          const float *b, int b_rs, int b_cs,
+          float *c, int ldc, bool accumulate)
+{
+    gemm_impl<FP32>(m, n, k, a, a_rs, a_cs, b, b_rs, b_cs, c, ldc,
+                    accumulate, nullptr, false);
+}
+
+/**
+* Fused layer product: C = A * B + bias (broadcast over the columns),
+* optionally followed by ReLU, applied while storing C.
+*/
+void gemm_bias_act(int m, int n, int k,
+                   const float *a, int a_rs, int a_cs,
+                   const float *b, int b_rs, int b_cs,
+                   float *c, int ldc, const float *bias, bool relu)
+{
+    gemm_impl<FP32>(m, n, k, a, a_rs, a_cs, b, b_rs, b_cs, c, ldc, false,
+                    bias, relu);
+}
+
+/**
+* Fused layer product with half precision weights: as gemm_bias_act(), with
+* A a row-major FP16 or BF16 matrix that is widened on the fly.
+*/
+void gemm_half_bias_act(int m, int n, int k,
+                        const uint16_t *a, int lda, WeightFormat format,
+                        const float *b, int b_rs, int b_cs,
+                        float *c, int ldc, const float *bias, bool relu)
+{
+    if (format == FP16)
+    {
+        gemm_impl<FP16>(m, n, k, a, lda, 1, b, b_rs, b_cs, c, ldc, false,
+                        bias, relu);
+    }
+    else if (format == BF16)
+    {
+        gemm_impl<BF16>(m, n, k, a, lda, 1, b, b_rs, b_cs, c, ldc, false,
+                        bias, relu);
+    }
+    else
+    {
+        exit_func(HALF_FORMAT_ERR);
+    }
+}
+
+/**
+* Size of an m x k matrix pre-packed by gemm_pack_a().
+* @return Number of floats.
+*/
+size_t gemm_packed_a_size(int m, int k)
+{
+    return (size_t) padded_rows(m) * (size_t) (k > 0 ? k : 0);
+}
+
+/**
+* Packs all of A once, in the order the blocked driver visits it: the
+* GEMM_KC deep blocks one after the other, each holding the GEMM_MC row
+* blocks as pack_a() lays them out. Block (ic, pc) then starts at
+* pc * padded_rows(m) + ic * kc.
+*/
+void gemm_pack_a(int m, int k, const float *a, int a_rs, int a_cs,
+                 float *packed)
+{
+    static_assert(GEMM_MC % GEMM_MR == 0,
+                  "row blocks must hold whole panels");
+    const size_t stride = (size_t) padded_rows(m);
+    for (int pc = 0; pc < k; pc += GEMM_KC)
+    {
+        const int kc = (k - pc < GEMM_KC) ? k - pc : GEMM_KC;
+        for (int ic = 0; ic < m; ic += GEMM_MC)
+        {
+            const int mc = (m - ic < GEMM_MC) ? m - ic : GEMM_MC;
+            pack_a<FP32>(mc, kc, a, (size_t) ic * a_rs + (size_t) pc * a_cs,
+                         a_rs, a_cs,
+                         packed + (size_t) pc * stride + (size_t) ic * kc);
+        }
+    }
+}
+
+/**
+* Fused layer product on pre-packed weights: as gemm_bias_act(), reading the
+* blocks of A from packed_a instead of packing them on every call.
+*/
+void gemm_packed_bias_act(int m, int n, int k, const float *packed_a,
+                          const float *b, int b_rs, int b_cs,
+                          float *c, int ldc, const float *bias, bool relu)
+{
+    gemm_impl<FP32>(m, n, k, nullptr, 0, 0, b, b_rs, b_cs, c, ldc, false,
+                    bias, relu, packed_a);
+}
+
+/**
+* Fused sparse layer product: C = A * B + bias (broadcast over the columns),
+* optionally followed by ReLU, with A in CSR form.
+*/
+void spmm_bias_act(int m, int n, int k, const int *row_ptr,
+                   const int *col_idx, const float *values, const float *b,
+                   int b_rs, int b_cs, float *c, int ldc, const float *bias,
+                   bool relu)
+{
+    if (m <= 0 || n <= 0)
+    {
+        return;
+    }
+#ifdef MLP_HAVE_AVX2
+    // The gathers compute col_idx * b_rs in 32-bit lanes.
+    if (cpu_has_avx2() && (long long) k * b_rs <= INT32_MAX)
+    {
+        spmm_avx2(m, n, row_ptr, col_idx, values, b, b_rs, b_cs, c, ldc,
+                  bias, relu);
+        return;
+    }
+#else
+    (void) k;
+#endif
+    spmm_scalar(m, n, row_ptr, col_idx, values, b, b_rs, b_cs, c, ldc, bias,
+                relu);
+}
+
+/**
+* Layer product for mostly zero inputs: C = A * B + bias, optionally followed
+* by ReLU, with A given column-major. Only the columns of A that meet a
+* nonzero element of B are read.
+*/
+void gemm_sparse_input_bias_act(int m, int n, int k, const float *at,
+                                int ldat, const float *b, int b_rs, int b_cs,
+                                float *c, int ldc, const float *bias,
+                                bool relu)
+{
+    if (m <= 0 || n <= 0)
+    {
+        return;
+    }
+    float *values = b_pack_buf.reserve((size_t) k);
+    int *rows = reinterpret_cast<int *>(index_buf.reserve((size_t) k));
+    for (int j = 0; j < n; ++j)
+    {
+        const float *b_col = b + (size_t) j * b_cs;
+        int count = 0;
+        for (int p = 0; p < k; ++p)
+        {
+            // branch free: whether a pixel is ink is not predictable
+            const float v = b_col[(size_t) p * b_rs];
+            rows[count] = p;
+            values[count] = v;
+            count += v != 0;
+        }
+#ifdef MLP_HAVE_AVX2
+        if (cpu_has_avx2())
+        {
+            sparse_input_avx2(m, count, rows, values, at, ldat, c + j, ldc,
+                              bias, relu);
+            continue;
+        }
+#endif
+        sparse_input_scalar(m, count, rows, values, at, ldat, c + j, ldc,
+                            bias, relu);
+    }
+}
@@ -0,0 +1,154 @@
+// Gemm.h
+
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <cstddef>
+#include <cstdint>
+#include "HalfMatrix.h"
+
+/**
+ * Register blocking of the micro-kernel: every call of the inner kernel
+ * updates a GEMM_MR x GEMM_NR tile of C that is kept entirely in registers.
+ */
+#define GEMM_MR 6
+#define GEMM_NR 16
+
+/**
+ * Cache blocking: a GEMM_MC x GEMM_KC block of A is packed to stay in L2,
+ * a GEMM_KC x GEMM_NR panel of B stays in L1 while the kernel sweeps A.
+ */
+#define GEMM_MC 72
+#define GEMM_KC 256
+#define GEMM_NC 1024
+
+/**
+ * General single precision matrix multiplication: C = A * B, or
+ * C += A * B when accumulate is true.
+ * A is m x k, B is k x n and C is m x n. A and B are addressed through a row
+ * stride and a column stride, so transposed operands can be passed without
+ * copying them (a row-major matrix has row stride = cols, column stride = 1).
+ * C is row-major with leading dimension ldc.
+ * Uses AVX2/FMA kernels when the CPU supports them and a portable scalar
+ * kernel otherwise.
+ * @param m rows of A and C
+ * @param n columns of B and C
+ * @param k columns of A, rows of B
+ * @param a pointer to A(0,0)
+ * @param a_rs distance (in floats) between A(i,p) and A(i+1,p)
+ * @param a_cs distance (in floats) between A(i,p) and A(i,p+1)
+ * @param b pointer to B(0,0)
+ * @param b_rs distance (in floats) between B(p,j) and B(p+1,j)
+ * @param b_cs distance (in floats) between B(p,j) and B(p,j+1)
+ * @param c pointer to C(0,0)
+ * @param ldc distance (in floats) between C(i,j) and C(i+1,j)
+ * @param accumulate add the product to C instead of overwriting it
+ */
+void gemm(int m, int n, int k,
+          const float *a, int a_rs, int a_cs,
+          const float *b, int b_rs, int b_cs,
+          float *c, int ldc, bool accumulate);
+
+/**
+ * Fused layer product: C = A * B + bias, where bias holds one value per row
+ * of C and is broadcast over the columns, optionally followed by ReLU.
+ * The bias-add and ReLU run in the kernel epilogue while the tile is still
+ * in registers, with exactly the same float operations as a separate
+ * gemm(), bias-add and ReLU pass.
+ * Operands are given as in gemm().
+ * @param bias m values, or nullptr for no bias
+ * @param relu apply max(x, 0) (keeping -0 and NaN as is) after the bias
+ */
+void gemm_bias_act(int m, int n, int k,
+                   const float *a, int a_rs, int a_cs,
+                   const float *b, int b_rs, int b_cs,
+                   float *c, int ldc, const float *bias, bool relu);
+
+/**
+ * Fused layer product with half precision weights: C = A * B + bias,
+ * optionally followed by ReLU, where A is a row-major FP16 or BF16 matrix.
+ * The weights are widened to float32 inside the kernels (F16C / AVX2 when
+ * available), so A is read from memory at 2 bytes per element and all
+ * arithmetic stays in float32.
+ * @param a pointer to A(0,0), 16 bit elements
+ * @param lda distance (in elements) between A(i,p) and A(i+1,p)
+ * @param format FP16 or BF16
+ * Other parameters as in gemm_bias_act().
+ */
+void gemm_half_bias_act(int m, int n, int k,
+                        const uint16_t *a, int lda, WeightFormat format,
+                        const float *b, int b_rs, int b_cs,
+                        float *c, int ldc, const float *bias, bool relu);
+
+/**
+ * Size of an m x k matrix pre-packed by gemm_pack_a(): the rows are zero
+ * padded to a multiple of GEMM_MR.
+ * @return Number of floats.
+ */
+size_t gemm_packed_a_size(int m, int k);
+
+/**
+ * Packs an m x k matrix A once into the panel layout of the micro-kernel
+ * (GEMM_MR row panels stored column after column, grouped in the
+ * GEMM_MC x GEMM_KC cache blocks of the driver), so that later products
+ * read it with unit stride and no packing. Used for layer weights.
+ * @param packed destination of gemm_packed_a_size(m, k) floats
+ * Other parameters as in gemm().
+ */
+void gemm_pack_a(int m, int k, const float *a, int a_rs, int a_cs,
+                 float *packed);
+
+/**
+ * Fused layer product on weights packed by gemm_pack_a(): C = A * B + bias,
+ * optionally followed by ReLU, with the same results as gemm_bias_act().
+ * Meant for batches; a single vector runs faster through the matrix-vector
+ * path of gemm_bias_act() on the row-major weights.
+ * @param packed_a A as written by gemm_pack_a(m, k, ...)
+ * Other parameters as in gemm_bias_act().
+ */
+void gemm_packed_bias_act(int m, int n, int k, const float *packed_a,
+                          const float *b, int b_rs, int b_cs,
+                          float *c, int ldc, const float *bias, bool relu);
+
+/**
+ * Fused sparse layer product: C = A * B + bias, optionally followed by ReLU,
+ * where A is an m-row matrix in CSR form (see SparseMatrix). Only the
+ * stored elements of A are multiplied. With AVX2 a single vector (or any
+ * B with strided columns) is gathered 8 elements at a time, and rows of a
+ * batch with contiguous columns are updated 8 columns at a time. The
+ * gathers use 32-bit element offsets, so shapes with k * b_rs above
+ * INT32_MAX run the scalar kernel.
+ * @param k number of columns of A (rows of B)
+ * @param row_ptr m + 1 offsets of the rows into col_idx / values
+ * @param col_idx column index of every stored element of A
+ * @param values value of every stored element of A
+ * Other parameters as in gemm_bias_act().
+ */
+void spmm_bias_act(int m, int n, int k, const int *row_ptr,
+                   const int *col_idx, const float *values, const float *b,
+                   int b_rs, int b_cs, float *c, int ldc, const float *bias,
+                   bool relu);
+
+/**
+ * Fused layer product for inputs that are mostly zero (e.g. image
+ * background): C = A * B + bias, optionally followed by ReLU. A is given
+ * column-major, as its transpose at (k x m, row-major), so a column of A is
+ * contiguous. The nonzero elements of every column of B are collected once
+ * and only the matching columns of A are accumulated, so the cost scales
+ * with the nonzeros of B instead of k.
+ * @param at pointer to A(0,0) of the column-major A
+ * @param ldat distance (in floats) between A(i,p) and A(i,p+1)
+ * Other parameters as in gemm_bias_act().
+ */
+void gemm_sparse_input_bias_act(int m, int n, int k, const float *at,
+                                int ldat, const float *b, int b_rs, int b_cs,
+                                float *c, int ldc, const float *bias,
+                                bool relu);
+
+/**
+ * Tells whether gemm() dispatches to the AVX2/FMA kernels on this machine.
+ * @return true if the SIMD kernels are in use.
+ */
+bool gemm_uses_simd();
+
+#endif //GEMM_H
@@ -0,0 +1,191 @@
+#include "HalfMatrix.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that allocates an element buffer.
+* @param count number of elements
+* @return the new buffer.
+*/
+static uint16_t *alloc_elements(size_t count)
+{
+    uint16_t *elem = new(std::nothrow) uint16_t[count];
+    if (!elem)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    return elem;
+}
+
+/**
+* Constructor of an empty HalfMatrix (no elements).
+*/
+HalfMatrix::HalfMatrix()
+        : owns(false), elem(nullptr), rows(0), cols(0), format(FP16)
+{}
+
+/**
+* Constructor that converts float elements.
+* @param m matrix (or view) to convert
+* @param format FP16 or BF16
+*/
+HalfMatrix::HalfMatrix(const MatrixView &m, WeightFormat format)
+        : owns(true), elem(nullptr), rows(m.get_rows()), cols(m.get_cols()),
+          format(format)
+{
+    if (format != FP16 && format != BF16)
+    {
+        exit_func(HALF_FORMAT_ERR);
+    }
+    elem = alloc_elements((size_t) rows * cols);
+    for (int i = 0; i < rows; ++i)
+    {
+        uint16_t *dst = elem + (size_t) i * cols;
+        for (int j = 0; j < cols; ++j)
+        {
+            dst[j] = format == FP16 ? float_to_fp16(m(i, j))
+                                    : float_to_bf16(m(i, j));
+        }
+    }
+}
+
+/**
+* Constructor of a HalfMatrix that borrows a row-major buffer.
+* @param data pointer to element (0,0)
+* @param rows number of rows
+* @param cols number of columns
+* @param format FP16 or BF16
+*/
+HalfMatrix::HalfMatrix(const uint16_t *data, int rows, int cols,
+                       WeightFormat format)
+        : owns(false), elem(const_cast<uint16_t *>(data)), rows(rows),
+          cols(cols), format(format)
+{
+    if (rows <= 0 || cols <= 0)
+    {
+        exit_func(ROWS_OR_COLS_ERR);
+    }
+    if (format != FP16 && format != BF16)
+    {
+        exit_func(HALF_FORMAT_ERR);
+    }
+}
+
+/**
+* Copy constructor - an owning matrix copies its elements, a borrowing
+* matrix keeps borrowing the same buffer.
+* @param other matrix to copy
+*/
+HalfMatrix::HalfMatrix(const HalfMatrix &other)
+        : owns(other.owns), elem(other.elem), rows(other.rows),
+          cols(other.cols), format(other.format)
+{
+    if (owns)
+    {
+        elem = alloc_elements((size_t) rows * cols);
+        std::memcpy(elem, other.elem, get_bytes());
+    }
+}
+
+/**
+* Destructor of HalfMatrix instance.
+*/
+HalfMatrix::~HalfMatrix()
+{
+    if (owns)
+    {
+        delete[] elem;
+    }
+}
+
+/**
+* Get the number of rows.
+* @return Number of rows as int.
+*/
+int HalfMatrix::get_rows() const
+{
+    return rows;
+}
+
+/**
+* Get the number of columns.
+* @return Number of columns as int.
+*/
+int HalfMatrix::get_cols() const
+{
+    return cols;
+}
+
+/**
+* @return The storage format of the elements.
+*/
+WeightFormat HalfMatrix::get_format() const
+{
+    return format;
+}
+
+/**
+* @return Pointer to element (0,0).
+*/
+const uint16_t *HalfMatrix::data() const
+{
+    return elem;
+}
+
+/**
+* @return Size of the elements in bytes.
+*/
+size_t HalfMatrix::get_bytes() const
+{
+    return (size_t) rows * cols * sizeof(uint16_t);
+}
+
+/**
+* returns the widened value of the element in the given index.
+* @param i row index
+* @param j col index
+* @return Value in index (i,j) as float.
+*/
+float HalfMatrix::operator()(int i, int j) const
+{
+    if (i < 0 || i >= rows || j < 0 || j >= cols)
+    {
+        exit_func(IDX_OUT_OF_BOUNDS_ERR);
+    }
+    const uint16_t h = elem[(size_t) i * cols + j];
+    return format == FP16 ? fp16_to_float(h) : bf16_to_float(h);
+}
+
+/**
+* Widens all elements into a float matrix.
+* @return The matrix as float32.
+*/
+Matrix HalfMatrix::to_matrix() const
+{
+    Matrix result(rows, cols);
+    for (int i = 0; i < rows; ++i)
+    {
+        float *dst = result.row_ptr(i);
+        const uint16_t *src = elem + (size_t) i * cols;
+        for (int j = 0; j < cols; ++j)
+        {
+            dst[j] = format == FP16 ? fp16_to_float(src[j])
+                                    : bf16_to_float(src[j]);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,232 @@
+// HalfMatrix.h
+
+#ifndef HALFMATRIX_H
+#define HALFMATRIX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "Matrix.h"
+
+#define HALF_FORMAT_ERR "Error: Half matrix format must be FP16 or BF16!\n"
+
+/**
+ * @enum WeightFormat
+ * @brief Storage format of layer weights. FP16 is IEEE binary16 (10 bit
+ * mantissa, range +-65504), BF16 keeps the float32 exponent with a 7 bit
+ * mantissa. Both are widened to float32 before any arithmetic.
+ */
+enum WeightFormat {
+    FP32,
+    FP16,
+    BF16
+};
+
+/**
+* Converts a float to IEEE half precision, rounding to nearest even.
+* Values beyond the half range become infinity, NaN stays NaN.
+* @param f value to convert
+* @return the binary16 bit pattern.
+*/
+inline uint16_t float_to_fp16(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const uint32_t abs = x & 0x7fffffff;
+    if (abs >= 0x7f800000)
+    {
+        return (uint16_t) (sign | (abs > 0x7f800000 ? 0x7e00 : 0x7c00));
+    }
+    if (abs >= 0x477ff000) // 65520 and above round to infinity
+    {
+        return (uint16_t) (sign | 0x7c00);
+    }
+    if (abs < 0x38800000) // below 2^-14: subnormal half
+    {
+        if (abs < 0x33000000)
+        {
+            return (uint16_t) sign;
+        }
+        const uint32_t shift = 126 - (abs >> 23);
+        const uint32_t mant = (abs & 0x7fffff) | 0x800000;
+        uint32_t h = mant >> shift;
+        const uint32_t rem = mant & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (rem > halfway || (rem == halfway && (h & 1)))
+        {
+            ++h;
+        }
+        return (uint16_t) (sign | h);
+    }
+    uint32_t h = (abs >> 13) - ((127 - 15) << 10);
+    const uint32_t rem = abs & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+    {
+        ++h;
+    }
+    return (uint16_t) (sign | h);
+}
+
+/**
+* Widens an IEEE half precision value to float (exact).
+* @param h the binary16 bit pattern
+* @return the value as float.
+*/
+inline float fp16_to_float(uint16_t h)
+{
+    const uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t x;
+    if (exp == 0x1f)
+    {
+        x = sign | 0x7f800000 | (mant << 13);
+    }
+    else if (exp != 0)
+    {
+        x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+    else if (mant == 0)
+    {
+        x = sign;
+    }
+    else
+    {
+        // subnormal half: normalize into a float exponent
+        exp = 127 - 14;
+        while (!(mant & 0x400))
+        {
+            mant <<= 1;
+            --exp;
+        }
+        x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+/**
+* Converts a float to bfloat16, rounding to nearest even. NaN stays NaN.
+* @param f value to convert
+* @return the bfloat16 bit pattern.
+*/
+inline uint16_t float_to_bf16(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffff) > 0x7f800000)
+    {
+        return (uint16_t) ((x >> 16) | 0x40);
+    }
+    return (uint16_t) ((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+}
+
+/**
+* Widens a bfloat16 value to float (exact).
+* @param h the bfloat16 bit pattern
+* @return the value as float.
+*/
+inline float bf16_to_float(uint16_t h)
+{
+    const uint32_t x = (uint32_t) h << 16;
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+/**
+   * HalfMatrix Class - a row-major matrix stored in 16 bits per element
+   * (FP16 or BF16), either owning its buffer or borrowing one (e.g. from a
+   * memory mapped model file). Used to halve the memory traffic of layer
+   * weights; elements are widened to float32 on every read.
+   */
+class HalfMatrix
+{
+private:
+    bool owns;
+    uint16_t *elem;
+    int rows, cols;
+    WeightFormat format;
+
+public:
+    /**
+    * Constructor of an empty HalfMatrix (no elements).
+    */
+    HalfMatrix();
+
+    /**
+    * Constructor that converts float elements.
+    * @param m matrix (or view) to convert
+    * @param format FP16 or BF16
+    */
+    HalfMatrix(const MatrixView &m, WeightFormat format);
+
+    /**
+    * Constructor of a HalfMatrix that borrows a row-major buffer. The
+    * buffer must outlive the matrix.
+    * @param data pointer to element (0,0)
+    * @param rows number of rows
+    * @param cols number of columns
+    * @param format FP16 or BF16
+    */
+    HalfMatrix(const uint16_t *data, int rows, int cols, WeightFormat format);
+
+    /**
+    * Copy constructor - an owning matrix copies its elements, a borrowing
+    * matrix keeps borrowing the same buffer.
+    * @param other matrix to copy
+    */
+    HalfMatrix(const HalfMatrix &other);
+
+    /**
+    * Destructor of HalfMatrix instance.
+    */
+    ~HalfMatrix();
+
+    HalfMatrix &operator=(const HalfMatrix &) = delete;
+
+    /**
+    * Get the number of rows.
+    * @return Number of rows as int.
+    */
+    int get_rows() const;
+
+    /**
+    * Get the number of columns.
+    * @return Number of columns as int.
+    */
+    int get_cols() const;
+
+    /**
+    * @return The storage format of the elements.
+    */
+    WeightFormat get_format() const;
+
+    /**
+    * @return Pointer to element (0,0).
+    */
+    const uint16_t *data() const;
+
+    /**
+    * @return Size of the elements in bytes.
+    */
+    size_t get_bytes() const;
+
+    /**
+    * returns the widened value of the element in the given index.
+    * @param i row index
+    * @param j col index
+    * @return Value in index (i,j) as float.
+    */
+    float operator()(int i, int j) const;
+
+    /**
+    * Widens all elements into a float matrix.
+    * @return The matrix as float32.
+    */
+    Matrix to_matrix() const;
+};
+
+#endif //HALFMATRIX_H
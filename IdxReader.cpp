@@ -0,0 +1,202 @@
+#include "IdxReader.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that reads a big-endian 32 bit header field.
+* @param is stream to read
+* @return the field value.
+*/
+static uint32_t read_be32(std::ifstream &is)
+{
+    unsigned char bytes[4];
+    if (!is.read(reinterpret_cast<char *>(bytes), sizeof(bytes)))
+    {
+        exit_func(IDX_FORMAT_ERR);
+    }
+    return ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) |
+           ((uint32_t) bytes[2] << 8) | (uint32_t) bytes[3];
+}
+
+/**
+* Constructor for IdxReader instance: opens the files and reads their
+* headers.
+* @param images_path Path of an idx3 image file.
+* @param labels_path Path of the matching idx1 label file, or empty.
+*/
+IdxReader::IdxReader(const std::string &images_path,
+                     const std::string &labels_path)
+        : labelled(!labels_path.empty()), count(0), rows(0), cols(0),
+          position(0), buffer(nullptr), buffer_size(0)
+{
+    images.open(images_path, std::ios::in | std::ios::binary);
+    if (!images.is_open())
+    {
+        exit_func(IDX_OPEN_ERR);
+    }
+    if (read_be32(images) != IDX_IMAGES_MAGIC)
+    {
+        exit_func(IDX_FORMAT_ERR);
+    }
+    const uint32_t image_count = read_be32(images);
+    const uint32_t image_rows = read_be32(images);
+    const uint32_t image_cols = read_be32(images);
+    if (image_count > INT32_MAX || image_rows == 0 || image_cols == 0 ||
+        (uint64_t) image_rows * image_cols > INT32_MAX)
+    {
+        exit_func(IDX_FORMAT_ERR);
+    }
+    count = (int) image_count;
+    rows = (int) image_rows;
+    cols = (int) image_cols;
+    if (labelled)
+    {
+        labels.open(labels_path, std::ios::in | std::ios::binary);
+        if (!labels.is_open())
+        {
+            exit_func(IDX_OPEN_ERR);
+        }
+        if (read_be32(labels) != IDX_LABELS_MAGIC)
+        {
+            exit_func(IDX_FORMAT_ERR);
+        }
+        if (read_be32(labels) != image_count)
+        {
+            exit_func(IDX_LABELS_ERR);
+        }
+    }
+}
+
+/**
+* Destructor of IdxReader instance.
+*/
+IdxReader::~IdxReader()
+{
+    delete[] buffer;
+}
+
+/**
+* Get the number of images in the file.
+* @return Number of images as int.
+*/
+int IdxReader::get_count() const
+{
+    return count;
+}
+
+/**
+* Get the number of rows of every image.
+* @return Image rows as int.
+*/
+int IdxReader::get_image_rows() const
+{
+    return rows;
+}
+
+/**
+* Get the number of columns of every image.
+* @return Image columns as int.
+*/
+int IdxReader::get_image_cols() const
+{
+    return cols;
+}
+
+/**
+* @return true if a label file was given.
+*/
+bool IdxReader::has_labels() const
+{
+    return labelled;
+}
+
+/**
+* Reads the next images into the columns of a batch matrix.
+* @param batch Matrix of (image rows * image cols) x B.
+* @param batch_labels Array of at least B labels, or nullptr.
+* @return Number of images read, 0 once everything was read.
+*/
+int IdxReader::read_batch(Matrix &batch, unsigned int *batch_labels)
+{
+    const int pixels = rows * cols;
+    if (batch.get_rows() != pixels)
+    {
+        exit_func(IDX_BATCH_ERR);
+    }
+    const int width = batch.get_cols();
+    const int n = (count - position < width) ? count - position : width;
+    if (n <= 0)
+    {
+        return 0;
+    }
+    const size_t bytes = (size_t) n * pixels;
+    if (bytes > buffer_size)
+    {
+        delete[] buffer;
+        buffer = new(std::nothrow) uint8_t[bytes];
+        if (!buffer)
+        {
+            exit_func(MEMORY_ALLOC_FAIL);
+        }
+        buffer_size = bytes;
+    }
+    if (!images.read(reinterpret_cast<char *>(buffer),
+                     (std::streamsize) bytes))
+    {
+        exit_func(FILE_SIZE_ERR);
+    }
+    // The file holds image after image; the batch wants one image per
+    // column, so every batch row gathers one pixel of all n images.
+    for (int p = 0; p < pixels; ++p)
+    {
+        float *dst = batch.row_ptr(p);
+        const uint8_t *src = buffer + p;
+        for (int j = 0; j < n; ++j)
+        {
+            dst[j] = (float) src[(size_t) j * pixels] / IDX_PIXEL_SCALE;
+        }
+    }
+    if (labelled)
+    {
+        if (!labels.read(reinterpret_cast<char *>(buffer), n))
+        {
+            exit_func(FILE_SIZE_ERR);
+        }
+        for (int j = 0; j < n && batch_labels; ++j)
+        {
+            batch_labels[j] = buffer[j];
+        }
+    }
+    position += n;
+    return n;
+}
+
+/**
+* Restarts reading from the first image: positions both files right after
+* their headers.
+*/
+void IdxReader::rewind()
+{
+    images.clear();
+    images.seekg(4 * sizeof(uint32_t), std::ios_base::beg);
+    if (labelled)
+    {
+        labels.clear();
+        labels.seekg(2 * sizeof(uint32_t), std::ios_base::beg);
+    }
+    position = 0;
+}
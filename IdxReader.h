@@ -0,0 +1,97 @@
+// IdxReader.h
+
+#ifndef IDXREADER_H
+#define IDXREADER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "Matrix.h"
+
+#define IDX_OPEN_ERR "Error: Failed to open IDX file!\n"
+#define IDX_FORMAT_ERR "Error: Invalid IDX file format!\n"
+#define IDX_LABELS_ERR "Error: IDX image and label counts differ!\n"
+#define IDX_BATCH_ERR "Error: IDX batch matrix does not fit the images!\n"
+
+#define IDX_IMAGES_MAGIC 0x00000803
+#define IDX_LABELS_MAGIC 0x00000801
+#define IDX_PIXEL_SCALE 255.0f
+
+/**
+   * IdxReader Class - streams the standard MNIST IDX files (e.g.
+   * t10k-images-idx3-ubyte with t10k-labels-idx1-ubyte). Images are read a
+   * batch at a time, so the file is never loaded as a whole, and converted
+   * to the network input layout: one image per column, pixels scaled from
+   * 0..255 to 0..1 floats.
+   */
+class IdxReader
+{
+private:
+    std::ifstream images;
+    std::ifstream labels;
+    bool labelled;
+    int count, rows, cols;
+    int position;
+    uint8_t *buffer;
+    size_t buffer_size;
+
+public:
+    /**
+    * Constructor for IdxReader instance: opens the files and reads their
+    * headers.
+    * @param images_path Path of an idx3 image file.
+    * @param labels_path Path of the matching idx1 label file, or an empty
+    * string to read images only.
+    */
+    explicit IdxReader(const std::string &images_path,
+                       const std::string &labels_path = "");
+
+    /**
+    * Destructor of IdxReader instance.
+    */
+    ~IdxReader();
+
+    IdxReader(const IdxReader &) = delete;
+    IdxReader &operator=(const IdxReader &) = delete;
+
+    /**
+    * Get the number of images in the file.
+    * @return Number of images as int.
+    */
+    int get_count() const;
+
+    /**
+    * Get the number of rows of every image.
+    * @return Image rows as int.
+    */
+    int get_image_rows() const;
+
+    /**
+    * Get the number of columns of every image.
+    * @return Image columns as int.
+    */
+    int get_image_cols() const;
+
+    /**
+    * @return true if a label file was given.
+    */
+    bool has_labels() const;
+
+    /**
+    * Reads the next images into the columns of a batch matrix.
+    * @param batch Matrix of (image rows * image cols) x B; column j receives
+    * the j'th image read. Columns past the returned count are left as is.
+    * @param batch_labels Array of at least B labels, or nullptr. Ignored
+    * when no label file was given.
+    * @return Number of images read - less than B only at the end of the
+    * file, 0 once everything was read.
+    */
+    int read_batch(Matrix &batch, unsigned int *batch_labels);
+
+    /**
+    * Restarts reading from the first image.
+    */
+    void rewind();
+};
+
+#endif //IDXREADER_H
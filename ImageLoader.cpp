@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ImageLoader.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that reads a whole image file, checking its size with one
+* fstat.
+* @param path file path
+* @param dst receives the file
+* @param bytes expected file size
+* @return true on success.
+*/
+static bool read_image(const std::string &path, float *dst, size_t bytes)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+              (size_t) st.st_size == bytes;
+    char *out = (char *) dst;
+    size_t done = 0;
+    while (ok && done < bytes)
+    {
+        const ssize_t n = read(fd, out + done, bytes - done);
+        if (n > 0)
+        {
+            done += (size_t) n;
+        }
+        else if (n == 0 || errno != EINTR)
+        {
+            ok = false;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+/**
+ * Lists the regular files of a directory, sorted by name.
+ * @param dir directory path
+ * @return The paths (dir/name).
+ */
+std::vector<std::string> list_files(const std::string &dir)
+{
+    DIR *handle = opendir(dir.c_str());
+    if (handle == nullptr)
+    {
+        exit_func(LOADER_DIR_ERR + dir);
+    }
+    const std::string prefix = dir.empty() || dir.back() == '/' ? dir
+                                                                 : dir + "/";
+    std::vector<std::string> files;
+    for (const dirent *entry = readdir(handle); entry != nullptr;
+         entry = readdir(handle))
+    {
+        const std::string path = prefix + entry->d_name;
+        // d_type saves a stat per file where the file system fills it in
+        struct stat st;
+        if (entry->d_type == DT_REG ||
+            (entry->d_type == DT_UNKNOWN && stat(path.c_str(), &st) == 0 &&
+             S_ISREG(st.st_mode)))
+        {
+            files.push_back(path);
+        }
+    }
+    closedir(handle);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+/**
+* Constructor for ImageLoader instance - starts the I/O threads.
+* @param paths image files, each image_size floats
+* @param image_size elements per image, e.g. 784
+* @param batch_size images per batch
+* @param io_threads number of reading threads
+* @param depth number of pooled batch buffers
+*/
+ImageLoader::ImageLoader(const std::vector<std::string> &paths,
+                         int image_size, int batch_size, int io_threads,
+                         int depth)
+        : paths(paths), image_size(image_size), batch_size(batch_size),
+          batch_count(batch_size > 0 ? ((int) paths.size() + batch_size - 1) /
+                                       batch_size : 0),
+          depth(depth), slots(nullptr), next_claim(0), next_batch(0),
+          holding(false), stopping(false), images_out(0), failed_out(0),
+          batches_out(0), depth_sum(0), max_depth(0),
+          consumer_stall_seconds(0), producer_stall_seconds(0)
+{
+    if (image_size <= 0 || batch_size <= 0 || io_threads <= 0 || depth <= 0)
+    {
+        exit_func(LOADER_OPTIONS_ERR);
+    }
+    slots = new(std::nothrow) Slot[depth];
+    if (!slots)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    for (int s = 0; s < depth; ++s)
+    {
+        slots[s].images = Matrix(batch_size, image_size);
+        slots[s].valid = new(std::nothrow) bool[batch_size];
+        if (!slots[s].valid)
+        {
+            exit_func(MEMORY_ALLOC_FAIL);
+        }
+        slots[s].batch = s;
+        slots[s].failed = 0;
+        slots[s].ready = false;
+    }
+    threads.reserve((size_t) io_threads);
+    for (int t = 0; t < io_threads; ++t)
+    {
+        threads.emplace_back(&ImageLoader::io_loop, this);
+    }
+}
+
+/**
+* Destructor of ImageLoader instance - stops and joins the I/O threads.
+*/
+ImageLoader::~ImageLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    free_cv.notify_all();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    for (int s = 0; s < depth; ++s)
+    {
+        delete[] slots[s].valid;
+    }
+    delete[] slots;
+}
+
+/**
+* Get the number of files.
+* @return Number of paths as int.
+*/
+int ImageLoader::get_count() const
+{
+    return (int) paths.size();
+}
+
+/**
+* Get the path of an image.
+* @param i index in the path list
+* @return The path.
+*/
+const std::string &ImageLoader::get_path(int i) const
+{
+    return paths.at((size_t) i);
+}
+
+/**
+* Helper function with the loop of an I/O thread. Batches are claimed in
+* order and batch b always goes to slot b % depth, so a thread only waits
+* for the consumer to release batch b - depth.
+*/
+void ImageLoader::io_loop()
+{
+    for (;;)
+    {
+        const int batch = next_claim.fetch_add(1, std::memory_order_relaxed);
+        if (batch >= batch_count)
+        {
+            return;
+        }
+        Slot &slot = slots[batch % depth];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (slot.batch != batch && !stopping)
+            {
+                const loader_clock::time_point start = loader_clock::now();
+                free_cv.wait(lock, [&]
+                { return stopping || slot.batch == batch; });
+                producer_stall_seconds += std::chrono::duration<double>(
+                        loader_clock::now() - start).count();
+            }
+            if (stopping)
+            {
+                return;
+            }
+        }
+        // The slot belongs to this thread until it is marked ready.
+        const int failed = load_batch(slot, batch);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.failed = failed;
+            slot.ready = true;
+        }
+        ready_cv.notify_one();
+    }
+}
+
+/**
+* Helper function that reads one batch into a slot.
+* @param slot the slot
+* @param batch batch index
+* @return Number of files that could not be read.
+*/
+int ImageLoader::load_batch(Slot &slot, int batch) const
+{
+    const int first = batch * batch_size;
+    const int count = std::min(batch_size, (int) paths.size() - first);
+    const size_t bytes = (size_t) image_size * sizeof(float);
+    int failed = 0;
+    for (int j = 0; j < count; ++j)
+    {
+        float *dst = slot.images.row_ptr(j);
+        slot.valid[j] = read_image(paths[(size_t) (first + j)], dst, bytes);
+        if (!slot.valid[j])
+        {
+            std::memset(dst, 0, bytes);
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+/**
+* Helper function that returns the held buffer to the pool - with the
+* mutex held.
+*/
+void ImageLoader::release_locked()
+{
+    Slot &slot = slots[(next_batch - 1) % depth];
+    slot.ready = false;
+    slot.batch += depth;
+    holding = false;
+    free_cv.notify_all();
+}
+
+/**
+* Waits for the next batch, in path order, and releases the previous one.
+* @param batch receives the batch
+* @return false once every batch was handed out.
+*/
+bool ImageLoader::next(loaded_batch &batch)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (holding)
+    {
+        release_locked();
+    }
+    if (next_batch >= batch_count)
+    {
+        return false;
+    }
+    int waiting = 0;
+    for (int s = 0; s < depth; ++s)
+    {
+        waiting += slots[s].ready;
+    }
+    depth_sum += waiting;
+    max_depth = std::max(max_depth, waiting);
+    Slot &slot = slots[next_batch % depth];
+    if (!slot.ready)
+    {
+        const loader_clock::time_point start = loader_clock::now();
+        ready_cv.wait(lock, [&slot]
+        { return slot.ready; });
+        consumer_stall_seconds += std::chrono::duration<double>(
+                loader_clock::now() - start).count();
+    }
+    batch.first = next_batch * batch_size;
+    batch.count = std::min(batch_size, (int) paths.size() - batch.first);
+    batch.pixels = slot.images.data();
+    batch.valid = slot.valid;
+    images_out += batch.count;
+    failed_out += slot.failed;
+    ++batches_out;
+    ++next_batch;
+    holding = true;
+    return true;
+}
+
+/**
+* View of the images of a batch, one per column.
+* @param batch a batch returned by next()
+* @return image_size x count view.
+*/
+MatrixView ImageLoader::get_images(const loaded_batch &batch) const
+{
+    return MatrixView(batch.pixels, image_size, batch.count, 1, image_size);
+}
+
+/**
+* Get the counters.
+* @return loader_stats struct.
+*/
+loader_stats ImageLoader::get_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int waiting = holding ? -1 : 0;
+    for (int s = 0; s < depth; ++s)
+    {
+        waiting += slots[s].ready;
+    }
+    loader_stats stats;
+    stats.images = images_out;
+    stats.failed = failed_out;
+    stats.batches = batches_out;
+    stats.depth = waiting;
+    stats.mean_depth = batches_out ? (double) depth_sum / batches_out : 0;
+    stats.max_depth = max_depth;
+    stats.consumer_stall_seconds = consumer_stall_seconds;
+    stats.producer_stall_seconds = producer_stall_seconds;
+    return stats;
+}
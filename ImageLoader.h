@@ -0,0 +1,197 @@
+// ImageLoader.h
+
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Matrix.h"
+
+#define DEFAULT_LOADER_BATCH 64
+#define DEFAULT_LOADER_THREADS 4
+#define DEFAULT_LOADER_DEPTH 8
+#define LOADER_OPTIONS_ERR "Error: Loader batch size, thread count and "\
+"depth must be positive!\n"
+#define LOADER_DIR_ERR "Error: Failed to open directory: "
+
+/**
+ * @struct loaded_batch
+ * @brief A batch handed out by ImageLoader::next(). It stays valid until
+ * the next call to next().
+ * @var first - index (in the path list) of the first image
+ * @var count - number of images
+ * @var pixels - count x image_size floats, one image per row (see
+ * ImageLoader::get_images())
+ * @var valid - valid[j] is false if file first + j could not be read or
+ * has the wrong size (its column is then zero)
+ */
+typedef struct loaded_batch
+{
+    int first;
+    int count;
+    const float *pixels;
+    const bool *valid;
+} loaded_batch;
+
+/**
+ * @struct loader_stats
+ * @brief Counters of an ImageLoader.
+ * @var images - images handed out so far
+ * @var failed - of which could not be read
+ * @var batches - batches handed out so far
+ * @var depth - batches loaded and waiting for the consumer right now
+ * @var mean_depth - mean number of waiting batches seen by next()
+ * @var max_depth - most waiting batches seen by next()
+ * @var consumer_stall_seconds - time next() waited for a batch (the
+ * network starved for input)
+ * @var producer_stall_seconds - time I/O threads waited for a free buffer
+ * (inference is the bottleneck), summed over the threads
+ */
+typedef struct loader_stats
+{
+    long long images;
+    long long failed;
+    long long batches;
+    int depth;
+    double mean_depth;
+    int max_depth;
+    double consumer_stall_seconds;
+    double producer_stall_seconds;
+} loader_stats;
+
+/**
+ * Lists the regular files of a directory, sorted by name.
+ * @param dir directory path
+ * @return The paths (dir/name).
+ */
+std::vector<std::string> list_files(const std::string &dir);
+
+/**
+   * ImageLoader Class - reads raw float32 image files (the format of
+   * readFileToMatrix()) on a few I/O threads ahead of inference. The paths
+   * are cut into batches; each I/O thread claims the next batch, reads its
+   * files into one of depth pooled, pre-sized buffers (one image per row,
+   * checked with a single fstat and read with plain read() calls) and
+   * marks it ready. The consumer takes the batches in path order through
+   * next(), which returns the previous buffer to the pool, so at most depth
+   * batches are in memory and nothing is allocated after construction.
+   */
+class ImageLoader
+{
+private:
+    typedef std::chrono::steady_clock loader_clock;
+
+    /**
+     * One pooled buffer and the batch it holds.
+     */
+    struct Slot
+    {
+        Matrix images; // batch_size x image_size
+        bool *valid;
+        int batch; // batch the slot is filled with (or waits for)
+        int failed;
+        bool ready;
+    };
+
+    const std::vector<std::string> paths;
+    const int image_size;
+    const int batch_size;
+    const int batch_count;
+    const int depth;
+    Slot *slots;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable ready_cv, free_cv;
+    std::atomic<int> next_claim;
+    int next_batch; // next batch handed to the consumer
+    bool holding; // the consumer holds batch next_batch - 1
+    bool stopping;
+    long long images_out, failed_out, batches_out;
+    long long depth_sum;
+    int max_depth;
+    double consumer_stall_seconds;
+    double producer_stall_seconds;
+
+    /**
+    * Helper function with the loop of an I/O thread.
+    */
+    void io_loop();
+
+    /**
+    * Helper function that reads one batch into a slot.
+    * @param slot the slot
+    * @param batch batch index
+    * @return Number of files that could not be read.
+    */
+    int load_batch(Slot &slot, int batch) const;
+
+    /**
+    * Helper function that returns the held buffer to the pool - with the
+    * mutex held.
+    */
+    void release_locked();
+
+public:
+    /**
+    * Constructor for ImageLoader instance - starts the I/O threads.
+    * @param paths image files, each image_size floats
+    * @param image_size elements per image, e.g. 784
+    * @param batch_size images per batch
+    * @param io_threads number of reading threads
+    * @param depth number of pooled batch buffers
+    */
+    ImageLoader(const std::vector<std::string> &paths, int image_size,
+                int batch_size = DEFAULT_LOADER_BATCH,
+                int io_threads = DEFAULT_LOADER_THREADS,
+                int depth = DEFAULT_LOADER_DEPTH);
+
+    /**
+    * Destructor of ImageLoader instance - stops and joins the I/O threads.
+    */
+    ~ImageLoader();
+
+    ImageLoader(const ImageLoader &) = delete;
+    ImageLoader &operator=(const ImageLoader &) = delete;
+
+    /**
+    * Get the number of files.
+    * @return Number of paths as int.
+    */
+    int get_count() const;
+
+    /**
+    * Get the path of an image.
+    * @param i index in the path list
+    * @return The path.
+    */
+    const std::string &get_path(int i) const;
+
+    /**
+    * Waits for the next batch, in path order, and releases the previous
+    * one. Call from one consumer thread.
+    * @param batch receives the batch
+    * @return false once every batch was handed out.
+    */
+    bool next(loaded_batch &batch);
+
+    /**
+    * View of the images of a batch, one per column, as predict_batch()
+    * takes them.
+    * @param batch a batch returned by next()
+    * @return image_size x count view.
+    */
+    MatrixView get_images(const loaded_batch &batch) const;
+
+    /**
+    * Get the counters.
+    * @return loader_stats struct.
+    */
+    loader_stats get_stats();
+};
+
+#endif //IMAGELOADER_H
@@ -0,0 +1,177 @@
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "InferenceClient.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Constructor for InferenceClient instance - connects to a server.
+* @param socket_path Path of the server's Unix domain socket.
+* @param input_size Number of pixels of an image.
+*/
+InferenceClient::InferenceClient(const std::string &socket_path,
+                                 int input_size)
+        : fd(-1), input_size(input_size), buffer(nullptr)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (input_size <= 0 || socket_path.empty() ||
+        socket_path.size() >= sizeof(address.sun_path))
+    {
+        exit_func(CLIENT_CONNECT_ERR + socket_path);
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *) &address, sizeof(address)) != 0)
+    {
+        exit_func(CLIENT_CONNECT_ERR + socket_path);
+    }
+    buffer = new(std::nothrow) unsigned char[sizeof(request_header) +
+                                             input_size * sizeof(float)];
+    if (buffer == nullptr)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+}
+
+/**
+* Destructor of InferenceClient instance - closes the connection.
+*/
+InferenceClient::~InferenceClient()
+{
+    close(fd);
+    delete[] buffer;
+}
+
+/**
+* Helper function that sends a header and its payload.
+* @param id request id
+* @param format pixel format
+* @param payload_bytes payload size, already copied after the header
+* @return true on success.
+*/
+bool InferenceClient::send_request(uint32_t id, PixelFormat format,
+                                   size_t payload_bytes)
+{
+    request_header header;
+    header.format = (uint32_t) format;
+    header.id = id;
+    std::memcpy(buffer, &header, sizeof(header));
+    const size_t size = sizeof(header) + payload_bytes;
+    size_t sent = 0;
+    while (sent < size)
+    {
+        const ssize_t n = ::send(fd, buffer + sent, size - sent,
+                                 MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += (size_t) n;
+    }
+    return true;
+}
+
+/**
+* Sends an image of scaled float pixels.
+* @param id request id, echoed in the reply
+* @param image input_size elements (any shape, read in row-major order)
+* @return true on success, false if the connection failed.
+*/
+bool InferenceClient::send(uint32_t id, const MatrixView &image)
+{
+    const int rows = image.get_rows(), cols = image.get_cols();
+    if (rows * cols != input_size)
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    float *dst = (float *) (buffer + sizeof(request_header));
+    const float *src = image.data();
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            dst[i * cols + j] = src[i * image.get_row_stride() +
+                                    j * image.get_col_stride()];
+        }
+    }
+    return send_request(id, PIXELS_FLOAT32, input_size * sizeof(float));
+}
+
+/**
+* Sends an image of 0..255 pixels.
+* @param id request id, echoed in the reply
+* @param pixels input_size bytes
+* @return true on success, false if the connection failed.
+*/
+bool InferenceClient::send(uint32_t id, const unsigned char *pixels)
+{
+    std::memcpy(buffer + sizeof(request_header), pixels, input_size);
+    return send_request(id, PIXELS_UINT8, input_size);
+}
+
+/**
+* Waits for the next reply.
+* @param reply receives the reply
+* @return true on success, false if the connection closed.
+*/
+bool InferenceClient::receive(server_reply &reply)
+{
+    char *dst = (char *) &reply;
+    size_t received = 0;
+    while (received < sizeof(reply))
+    {
+        const ssize_t n = recv(fd, dst + received, sizeof(reply) - received,
+                               0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        received += (size_t) n;
+    }
+    return true;
+}
+
+/**
+* Classifies one image and waits for the result.
+* @param image input_size elements (any shape, read in row-major order)
+* @return digit struct with the most probable digit.
+*/
+digit InferenceClient::classify(const MatrixView &image)
+{
+    server_reply reply;
+    if (!send(0, image) || !receive(reply))
+    {
+        exit_func(CLIENT_REPLY_ERR);
+    }
+    digit result;
+    result.value = reply.value;
+    result.probability = reply.probability;
+    return result;
+}
@@ -0,0 +1,79 @@
+// InferenceClient.h
+
+#ifndef INFERENCECLIENT_H
+#define INFERENCECLIENT_H
+
+#include "InferenceServer.h"
+
+#define CLIENT_CONNECT_ERR "Error: Failed to connect to socket: "
+#define CLIENT_REPLY_ERR "Error: Server closed the connection!\n"
+
+/**
+   * InferenceClient Class - one blocking connection to an InferenceServer.
+   * Requests may be pipelined: several send() calls can precede the
+   * matching receive() calls, and replies come back in request order.
+   */
+class InferenceClient
+{
+private:
+    int fd;
+    int input_size;
+    unsigned char *buffer; // header + float pixels of one request
+
+    /**
+    * Helper function that sends a header and its payload.
+    * @param id request id
+    * @param format pixel format
+    * @param payload_bytes payload size, already copied after the header
+    * @return true on success.
+    */
+    bool send_request(uint32_t id, PixelFormat format, size_t payload_bytes);
+
+public:
+    /**
+    * Constructor for InferenceClient instance - connects to a server.
+    * @param socket_path Path of the server's Unix domain socket.
+    * @param input_size Number of pixels of an image.
+    */
+    InferenceClient(const std::string &socket_path, int input_size);
+
+    /**
+    * Destructor of InferenceClient instance - closes the connection.
+    */
+    ~InferenceClient();
+
+    InferenceClient(const InferenceClient &) = delete;
+    InferenceClient &operator=(const InferenceClient &) = delete;
+
+    /**
+    * Sends an image of scaled float pixels.
+    * @param id request id, echoed in the reply
+    * @param image input_size elements (any shape, read in row-major order)
+    * @return true on success, false if the connection failed.
+    */
+    bool send(uint32_t id, const MatrixView &image);
+
+    /**
+    * Sends an image of 0..255 pixels.
+    * @param id request id, echoed in the reply
+    * @param pixels input_size bytes
+    * @return true on success, false if the connection failed.
+    */
+    bool send(uint32_t id, const unsigned char *pixels);
+
+    /**
+    * Waits for the next reply.
+    * @param reply receives the reply
+    * @return true on success, false if the connection closed.
+    */
+    bool receive(server_reply &reply);
+
+    /**
+    * Classifies one image and waits for the result.
+    * @param image input_size elements (any shape, read in row-major order)
+    * @return digit struct with the most probable digit.
+    */
+    digit classify(const MatrixView &image);
+};
+
+#endif //INFERENCECLIENT_H
@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "IdxReader.h"
+#include "InferenceServer.h"
+
+using std::cerr;
+using std::endl;
+
+#define READ_BUFFER_SIZE 65536
+#define LISTEN_BACKLOG 128
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that makes a descriptor non-blocking.
+* @param fd descriptor
+* @return true on success.
+*/
+static bool set_non_blocking(int fd)
+{
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/**
+* Helper function with the payload size of a request.
+* @param format pixel format from the header
+* @param input_size pixels per image
+* @return Payload bytes, or 0 for an unknown format.
+*/
+static size_t payload_size(uint32_t format, int input_size)
+{
+    if (format == PIXELS_FLOAT32)
+    {
+        return (size_t) input_size * sizeof(float);
+    }
+    if (format == PIXELS_UINT8)
+    {
+        return (size_t) input_size;
+    }
+    return 0;
+}
+
+/**
+ * Default batching policy: DEFAULT_SERVER_BATCH images or
+ * DEFAULT_SERVER_DEADLINE_US microseconds.
+ * @return The options.
+ */
+server_options default_server_options()
+{
+    server_options options;
+    options.max_batch = DEFAULT_SERVER_BATCH;
+    options.deadline_us = DEFAULT_SERVER_DEADLINE_US;
+    return options;
+}
+
+/**
+* Constructor for InferenceServer instance - binds and listens on the
+* socket (an existing file at the path is replaced).
+* @param socket_path Path of the Unix domain socket.
+* @param input_size Number of pixels of an image.
+* @param predict Classifies a batch, e.g. a lambda calling
+* MlpNetwork::predict_batch(). Runs on the thread of run().
+* @param options Batching policy.
+*/
+InferenceServer::InferenceServer(const std::string &socket_path,
+                                 int input_size,
+                                 const BatchPredictor &predict,
+                                 const server_options &options)
+        : socket_path(socket_path), input_size(input_size), predict(predict),
+          options(options), listen_fd(-1), results(nullptr),
+          read_buffer(READ_BUFFER_SIZE), connection_count(0),
+          request_count(0), batch_count(0), error_count(0)
+{
+    if (input_size <= 0 || options.max_batch <= 0 || options.deadline_us < 0)
+    {
+        exit_func(SERVER_OPTIONS_ERR);
+    }
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path))
+    {
+        exit_func(SERVER_SOCKET_ERR + socket_path);
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+    unlink(socket_path.c_str());
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, (sockaddr *) &address, sizeof(address)) != 0 ||
+        listen(listen_fd, LISTEN_BACKLOG) != 0 ||
+        !set_non_blocking(listen_fd) || pipe(wake_fds) != 0)
+    {
+        exit_func(SERVER_SOCKET_ERR + socket_path);
+    }
+    set_non_blocking(wake_fds[0]);
+    set_non_blocking(wake_fds[1]);
+    batch = Matrix(options.max_batch, input_size);
+    results = new(std::nothrow) digit[options.max_batch];
+    if (results == nullptr)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    pending.reserve(options.max_batch);
+}
+
+/**
+* Destructor of InferenceServer instance - closes all sockets and
+* removes the socket file.
+*/
+InferenceServer::~InferenceServer()
+{
+    for (size_t c = 0; c < connections.size(); ++c)
+    {
+        close(connections[c].fd);
+    }
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    delete[] results;
+}
+
+/**
+* Makes run() return. Safe to call from any thread or from a signal
+* handler.
+*/
+void InferenceServer::stop()
+{
+    const char byte = 0;
+    ssize_t written = write(wake_fds[1], &byte, 1);
+    (void) written; // a full pipe already holds a wake-up
+}
+
+/**
+* Getter of the counters (may be read while the server runs).
+* @return The counters.
+*/
+server_stats InferenceServer::get_stats() const
+{
+    server_stats stats;
+    stats.connections = connection_count.load(std::memory_order_relaxed);
+    stats.requests = request_count.load(std::memory_order_relaxed);
+    stats.batches = batch_count.load(std::memory_order_relaxed);
+    stats.protocol_errors = error_count.load(std::memory_order_relaxed);
+    return stats;
+}
+
+/**
+* Serves clients until stop() is called.
+*/
+void InferenceServer::run()
+{
+    std::vector<pollfd> fds;
+    while (true)
+    {
+        fds.clear();
+        fds.push_back({wake_fds[0], POLLIN, 0});
+        fds.push_back({listen_fd, POLLIN, 0});
+        for (size_t c = 0; c < connections.size(); ++c)
+        {
+            const short events = (short) ((connections[c].eof ? 0 : POLLIN) |
+                                          (connections[c].out.empty() ?
+                                           0 : POLLOUT));
+            fds.push_back({connections[c].fd, events, 0});
+        }
+        timespec timeout = {0, 0};
+        timespec *timeout_ptr = nullptr;
+        if (!pending.empty())
+        {
+            const long long wait_ns = std::max<long long>(
+                    0, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            batch_deadline - server_clock::now()).count());
+            timeout.tv_sec = (time_t) (wait_ns / 1000000000LL);
+            timeout.tv_nsec = (long) (wait_ns % 1000000000LL);
+            timeout_ptr = &timeout;
+        }
+        if (ppoll(fds.data(), fds.size(), timeout_ptr, nullptr) < 0 &&
+            errno != EINTR)
+        {
+            exit_func(SERVER_SOCKET_ERR + socket_path);
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            return;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            accept_clients();
+        }
+        for (size_t c = 0; c + 2 < fds.size(); ++c)
+        {
+            const short revents = fds[c + 2].revents;
+            if ((revents & (POLLOUT | POLLHUP | POLLERR)) &&
+                !connections[c].out.empty())
+            {
+                write_client((int) c);
+            }
+            if (revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                read_client((int) c);
+            }
+        }
+        if (!pending.empty() && server_clock::now() >= batch_deadline)
+        {
+            run_batch();
+        }
+
+        // Drop closed connections, and connections at EOF once all their
+        // replies are out; pending requests follow the indices.
+        size_t kept = 0;
+        for (size_t c = 0; c < connections.size(); ++c)
+        {
+            bool waiting = false;
+            for (size_t p = 0; p < pending.size(); ++p)
+            {
+                waiting = waiting || pending[p].connection == (int) c;
+            }
+            if ((connections[c].closed || (connections[c].eof && !waiting)) &&
+                connections[c].out.empty())
+            {
+                close(connections[c].fd);
+                for (size_t p = 0; p < pending.size(); ++p)
+                {
+                    if (pending[p].connection == (int) c)
+                    {
+                        pending[p].connection = -1;
+                    }
+                }
+                continue;
+            }
+            for (size_t p = 0; p < pending.size(); ++p)
+            {
+                if (pending[p].connection == (int) c)
+                {
+                    pending[p].connection = (int) kept;
+                }
+            }
+            if (kept != c)
+            {
+                connections[kept] = std::move(connections[c]);
+            }
+            ++kept;
+        }
+        connections.resize(kept);
+    }
+}
+
+/**
+* Helper function that accepts all waiting clients.
+*/
+void InferenceServer::accept_clients()
+{
+    while (true)
+    {
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            return;
+        }
+        if (!set_non_blocking(fd))
+        {
+            close(fd);
+            continue;
+        }
+        Connection connection;
+        connection.fd = fd;
+        connection.closed = false;
+        connection.eof = false;
+        connections.push_back(std::move(connection));
+        connection_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Helper function that reads from a client and queues its complete
+* requests, running the batch whenever it fills up.
+* @param c connection index
+*/
+void InferenceServer::read_client(int c)
+{
+    Connection &connection = connections[c];
+    if (connection.closed)
+    {
+        return;
+    }
+    if (connection.eof)
+    {
+        // Input is not polled after EOF, so this is POLLHUP or POLLERR:
+        // the client is gone and will not read its replies.
+        connection.closed = true;
+        connection.out.clear();
+        return;
+    }
+    while (true)
+    {
+        const ssize_t n = read(connection.fd, read_buffer.data(),
+                               read_buffer.size());
+        if (n > 0)
+        {
+            connection.in.insert(connection.in.end(), read_buffer.data(),
+                                 read_buffer.data() + n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == 0)
+        {
+            // No more requests, but the queued ones are still answered.
+            connection.eof = true;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            connection.closed = true;
+        }
+        break;
+    }
+
+    size_t consumed = 0;
+    while (connection.in.size() - consumed >= sizeof(request_header))
+    {
+        request_header header;
+        std::memcpy(&header, connection.in.data() + consumed, sizeof(header));
+        const size_t size = payload_size(header.format, input_size);
+        if (size == 0)
+        {
+            error_count.fetch_add(1, std::memory_order_relaxed);
+            connection.closed = true;
+            connection.in.clear();
+            return;
+        }
+        if (connection.in.size() - consumed < sizeof(header) + size)
+        {
+            break;
+        }
+        const char *pixels = connection.in.data() + consumed + sizeof(header);
+        float *dst = batch.row_ptr((int) pending.size());
+        if (header.format == PIXELS_FLOAT32)
+        {
+            std::memcpy(dst, pixels, size);
+        }
+        else
+        {
+            for (int i = 0; i < input_size; ++i)
+            {
+                dst[i] = (float) (unsigned char) pixels[i] / IDX_PIXEL_SCALE;
+            }
+        }
+        if (pending.empty())
+        {
+            batch_deadline = server_clock::now() +
+                             std::chrono::microseconds(options.deadline_us);
+        }
+        pending.push_back({c, header.id});
+        consumed += sizeof(header) + size;
+        if ((int) pending.size() == options.max_batch)
+        {
+            run_batch();
+        }
+    }
+    connection.in.erase(connection.in.begin(),
+                        connection.in.begin() + consumed);
+}
+
+/**
+* Helper function that sends as much pending output as the socket takes.
+* @param c connection index
+*/
+void InferenceServer::write_client(int c)
+{
+    Connection &connection = connections[c];
+    size_t sent = 0;
+    while (sent < connection.out.size())
+    {
+        const ssize_t n = send(connection.fd, connection.out.data() + sent,
+                               connection.out.size() - sent, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            sent += (size_t) n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            // The client is gone: drop what it will never read.
+            connection.closed = true;
+            connection.out.clear();
+            return;
+        }
+        break;
+    }
+    connection.out.erase(connection.out.begin(),
+                         connection.out.begin() + sent);
+}
+
+/**
+* Helper function that classifies the pending batch and queues the
+* replies.
+*/
+void InferenceServer::run_batch()
+{
+    const int n = (int) pending.size();
+    predict(MatrixView(batch).block(0, 0, n, input_size).transposed(),
+            results);
+    request_count.fetch_add(n, std::memory_order_relaxed);
+    batch_count.fetch_add(1, std::memory_order_relaxed);
+    for (int j = 0; j < n; ++j)
+    {
+        if (pending[j].connection < 0)
+        {
+            continue;
+        }
+        server_reply reply;
+        reply.id = pending[j].id;
+        reply.value = results[j].value;
+        reply.probability = results[j].probability;
+        reply.batch_size = (uint32_t) n;
+        std::vector<char> &out = connections[pending[j].connection].out;
+        const char *bytes = (const char *) &reply;
+        out.insert(out.end(), bytes, bytes + sizeof(reply));
+    }
+    for (int j = 0; j < n; ++j)
+    {
+        const int c = pending[j].connection;
+        if (c >= 0 && !connections[c].out.empty())
+        {
+            write_client(c);
+        }
+    }
+    pending.clear();
+}
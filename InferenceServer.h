@@ -0,0 +1,207 @@
+// InferenceServer.h
+
+#ifndef INFERENCESERVER_H
+#define INFERENCESERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Evaluation.h"
+
+#define DEFAULT_SERVER_BATCH 32
+#define DEFAULT_SERVER_DEADLINE_US 200
+#define SERVER_SOCKET_ERR "Error: Failed to listen on socket: "
+#define SERVER_OPTIONS_ERR "Error: Invalid server options!\n"
+
+/**
+ * @enum PixelFormat
+ * @brief Encoding of the pixels of a request.
+ */
+enum PixelFormat
+{
+    PIXELS_FLOAT32 = 0, // input_size floats, already scaled
+    PIXELS_UINT8 = 1 // input_size bytes, 0..255 (scaled like IDX files)
+};
+
+/**
+ * @struct request_header
+ * @brief Header of a request, followed by the image pixels. All fields
+ * are in host byte order (the socket is local).
+ * @var format - PixelFormat of the pixels
+ * @var id - chosen by the client, echoed in the reply
+ */
+typedef struct request_header
+{
+    uint32_t format;
+    uint32_t id;
+} request_header;
+
+/**
+ * @struct server_reply
+ * @brief Reply to one request.
+ * @var id - id of the request
+ * @var value - predicted digit
+ * @var probability - its probability
+ * @var batch_size - number of requests of the batch it ran in
+ */
+typedef struct server_reply
+{
+    uint32_t id;
+    uint32_t value;
+    float probability;
+    uint32_t batch_size;
+} server_reply;
+
+/**
+ * @struct server_options
+ * @brief Dynamic batching policy.
+ * @var max_batch - a batch runs as soon as it has max_batch images
+ * @var deadline_us - or once its oldest image waited deadline_us
+ * microseconds (0 runs every poll round)
+ */
+typedef struct server_options
+{
+    int max_batch;
+    int deadline_us;
+} server_options;
+
+/**
+ * @struct server_stats
+ * @brief Counters of a server.
+ * @var connections - clients accepted
+ * @var requests - images classified
+ * @var batches - network calls
+ * @var protocol_errors - connections closed on a malformed request
+ */
+typedef struct server_stats
+{
+    long long connections;
+    long long requests;
+    long long batches;
+    long long protocol_errors;
+} server_stats;
+
+/**
+   * InferenceServer Class - classifies images sent over a Unix domain
+   * socket. A single event loop polls the listening socket and all clients;
+   * requests from every connection are gathered into one batch, which runs
+   * through the predictor when it is full or when its oldest request
+   * reaches the deadline. Clients may pipeline requests; each reply carries
+   * the request id.
+   */
+class InferenceServer
+{
+private:
+    /**
+     * One client connection with its partial input and pending output.
+     */
+    struct Connection
+    {
+        int fd;
+        std::vector<char> in;
+        std::vector<char> out;
+        bool closed;
+        bool eof; // the client shut down its side; replies still go out
+    };
+
+    /**
+     * A request waiting in the current batch.
+     */
+    struct Pending
+    {
+        int connection;
+        uint32_t id;
+    };
+
+    typedef std::chrono::steady_clock server_clock;
+
+    std::string socket_path;
+    int input_size;
+    BatchPredictor predict;
+    server_options options;
+    int listen_fd;
+    int wake_fds[2];
+    std::vector<Connection> connections;
+    std::vector<Pending> pending;
+    server_clock::time_point batch_deadline; // of the oldest pending request
+    Matrix batch; // max_batch x input_size, one image per row
+    digit *results;
+    std::vector<char> read_buffer;
+    std::atomic<long long> connection_count, request_count, batch_count,
+            error_count;
+
+    /**
+    * Helper function that accepts all waiting clients.
+    */
+    void accept_clients();
+
+    /**
+    * Helper function that reads from a client and queues its complete
+    * requests, running the batch whenever it fills up.
+    * @param c connection index
+    */
+    void read_client(int c);
+
+    /**
+    * Helper function that sends as much pending output as the socket takes.
+    * @param c connection index
+    */
+    void write_client(int c);
+
+    /**
+    * Helper function that classifies the pending batch and queues the
+    * replies.
+    */
+    void run_batch();
+
+public:
+    /**
+    * Constructor for InferenceServer instance - binds and listens on the
+    * socket (an existing file at the path is replaced).
+    * @param socket_path Path of the Unix domain socket.
+    * @param input_size Number of pixels of an image.
+    * @param predict Classifies a batch, e.g. a lambda calling
+    * MlpNetwork::predict_batch(). Runs on the thread of run().
+    * @param options Batching policy.
+    */
+    InferenceServer(const std::string &socket_path, int input_size,
+                    const BatchPredictor &predict,
+                    const server_options &options);
+
+    /**
+    * Destructor of InferenceServer instance - closes all sockets and
+    * removes the socket file.
+    */
+    ~InferenceServer();
+
+    InferenceServer(const InferenceServer &) = delete;
+    InferenceServer &operator=(const InferenceServer &) = delete;
+
+    /**
+    * Serves clients until stop() is called.
+    */
+    void run();
+
+    /**
+    * Makes run() return. Safe to call from any thread or from a signal
+    * handler.
+    */
+    void stop();
+
+    /**
+    * Getter of the counters (may be read while the server runs).
+    * @return The counters.
+    */
+    server_stats get_stats() const;
+};
+
+/**
+ * Default batching policy: DEFAULT_SERVER_BATCH images or
+ * DEFAULT_SERVER_DEADLINE_US microseconds.
+ * @return The options.
+ */
+server_options default_server_options();
+
+#endif //INFERENCESERVER_H
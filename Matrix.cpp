@@ -2,7 +2,10 @@
 #include <iostream>
 #include <istream>
 #include <ostream>
+#include <cstdint>
+#include <cstring>
 #include "Matrix.h"
+#include "Gemm.h"
 
 using std::ostream;  using std::istream;  using std::endl;
 using std::cout; using std::cin;
@@ -22,31 +25,69 @@ static void exit_func(const std::string &error_msg)
 }
 
 /**
-* Helper function that dynamically allocates memory for matrix elements.
+* Helper function that copies a strided rows x cols source into a row-major
+* destination. Sources with unit column stride are copied row by row; others
+* (e.g. a transposed view) in TRANSPOSE_BLOCK square tiles, so the strided
+* reads of a tile reuse the same cache lines instead of touching a new line
+* for every element.
+* @param src pointer to element (0,0) of the source
+* @param rs distance (in floats) between source (i,j) and (i+1,j)
+* @param cs distance (in floats) between source (i,j) and (i,j+1)
+* @param rows number of rows
+* @param cols number of columns
+* @param dst row-major destination of rows x cols floats
 */
-void Matrix::alloc_matrix_elements()
+static void copy_blocked(const float *src, long rs, long cs, int rows,
+                         int cols, float *dst)
 {
-    elem = new(std::nothrow) float *[dims.rows];
-    if (!elem)
+    if (cs == 1)
     {
-        exit_func(MEMORY_ALLOC_FAIL);
+        for (int i = 0; i < rows; ++i)
+        {
+            std::memcpy(dst + (size_t) i * cols, src + i * rs,
+                        (size_t) cols * sizeof(float));
+        }
+        return;
     }
-    for (int i = 0; i < dims.rows; ++i)
+    for (int ib = 0; ib < rows; ib += TRANSPOSE_BLOCK)
     {
-        elem[i] = new(std::nothrow) float[dims.cols];
-        if (!elem[i])
-
+        const int i_end = ib + TRANSPOSE_BLOCK < rows ? ib + TRANSPOSE_BLOCK
+                                                      : rows;
+        for (int jb = 0; jb < cols; jb += TRANSPOSE_BLOCK)
         {
-            for (int j = 0; j < i; ++j)
+            const int j_end = jb + TRANSPOSE_BLOCK < cols ?
+                              jb + TRANSPOSE_BLOCK : cols;
+            for (int i = ib; i < i_end; ++i)
             {
-                delete[] elem[j];
+                const float *src_row = src + i * rs;
+                float *dst_row = dst + (size_t) i * cols;
+                for (int j = jb; j < j_end; ++j)
+                {
+                    dst_row[j] = src_row[j * cs];
+                }
             }
-            delete[] elem;
-            exit_func(MEMORY_ALLOC_FAIL);
         }
     }
 }
 
+/**
+* Helper function that dynamically allocates one contiguous block for the
+* matrix elements, aligned to MATRIX_ALIGNMENT bytes (row-major order).
+*/
+void Matrix::alloc_matrix_elements()
+{
+    size_t bytes = (size_t) dims.rows * dims.cols * sizeof(float);
+    raw_buf = new(std::nothrow) char[bytes + MATRIX_ALIGNMENT - 1];
+    if (!raw_buf)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    uintptr_t addr = reinterpret_cast<uintptr_t>(raw_buf);
+    addr = (addr + MATRIX_ALIGNMENT - 1) &
+           ~((uintptr_t) MATRIX_ALIGNMENT - 1);
+    elem = reinterpret_cast<float *>(addr);
+}
+
 // Constructors:
 /**
 * Main Constructor:
@@ -63,13 +104,7 @@ Matrix::Matrix(int rows, int cols)
     dims.rows = rows;
     dims.cols = cols;
     alloc_matrix_elements();
-    for (int i = 0; i < dims.rows; ++i)
-    {
-        for (int j = 0; j < dims.cols; ++j)
-        {
-            (*this)(i, j) = 0;
-        }
-    }
+    std::memset(elem, 0, (size_t) rows * cols * sizeof(float));
 }
 
 /**
@@ -83,14 +118,8 @@ Matrix::Matrix() : Matrix(1,1)
 * Destructor of Matrix instance.
 */
 Matrix::~Matrix()
-
 {
-    for (int i = 0; i < dims.rows; ++i)
-
-    {
-        delete[] elem[i];
-    }
-    delete[] elem;
+    delete[] raw_buf;
 }
 
 /**
@@ -98,15 +127,37 @@ Matrix::~Matrix()
 * Copy constructor of class Matrix.
 * @param m
  */
-Matrix::Matrix(const Matrix &m) : Matrix(m.dims.rows, m.dims.cols)
+Matrix::Matrix(const Matrix &m) : dims(m.dims)
 {
-    for (int i = 0; i < dims.rows; ++i)
-    {
-        for (int j = 0; j < dims.cols; ++j)
-        {
-            (*this)(i, j) = m(i, j);
-        }
-    }
+    alloc_matrix_elements();
+    std::memcpy(elem, m.elem, (size_t) dims.rows * dims.cols * sizeof(float));
+}
+
+/**
+* Move Constructor:
+* Takes over the elements buffer of m, leaving m empty (0x0).
+* @param m
+*/
+Matrix::Matrix(Matrix &&m) noexcept
+        : dims(m.dims), raw_buf(m.raw_buf), elem(m.elem)
+{
+    m.dims.rows = 0;
+    m.dims.cols = 0;
+    m.raw_buf = nullptr;
+    m.elem = nullptr;
+}
+
+/**
+* Copies the elements seen through a view into a new (contiguous) matrix.
+* @param v A matrix view
+*/
+Matrix::Matrix(const MatrixView &v)
+{
+    dims.rows = v.get_rows();
+    dims.cols = v.get_cols();
+    alloc_matrix_elements();
+    copy_blocked(v.data(), v.get_row_stride(), v.get_col_stride(), dims.rows,
+                 dims.cols, elem);
 }
 
 /**
@@ -129,6 +180,44 @@ int Matrix::get_cols() const
     return dims.cols;
 }
 
+/**
+* Raw access to the contiguous row-major elements buffer.
+* @return Pointer to the first element (aligned to MATRIX_ALIGNMENT).
+*/
+float *Matrix::data()
+{
+    return elem;
+}
+
+/**
+* Const version of data().
+* @return Pointer to the first element (aligned to MATRIX_ALIGNMENT).
+*/
+const float *Matrix::data() const
+{
+    return elem;
+}
+
+/**
+* Raw access to a single row of the matrix (no bounds check).
+* @param i row index
+* @return Pointer to the first element of row i.
+*/
+float *Matrix::row_ptr(int i)
+{
+    return elem + (size_t) i * dims.cols;
+}
+
+/**
+* Const version of row_ptr().
+* @param i row index
+* @return Pointer to the first element of row i.
+*/
+const float *Matrix::row_ptr(int i) const
+{
+    return elem + (size_t) i * dims.cols;
+}
+
 /**
 * Prints the matrix elements one by one with a space between each value
 * each matrix row in a separate row.
@@ -159,24 +248,35 @@ Matrix &Matrix::operator=(const Matrix &m)
         return *this;
     }
 
-    if (dims.rows != m.dims.rows || dims.cols != m.dims.cols)
+    // Same element count means the buffer can be reused as is.
+    if (dims.rows * dims.cols != m.dims.rows * m.dims.cols)
     {
-        for (int i = 0; i < dims.rows; ++i)
-        {
-            delete[] elem[i];
-        }
-        delete[] elem;
-
-        dims.rows = m.dims.rows;
-        dims.cols = m.dims.cols;
+        delete[] raw_buf;
+        dims = m.dims;
         alloc_matrix_elements();
     }
-    for (int i = 0; i < dims.rows; ++i)
+    dims = m.dims;
+    std::memcpy(elem, m.elem, (size_t) dims.rows * dims.cols * sizeof(float));
+    return *this;
+}
+
+/**
+* Move assignment.
+* @param m A matrix - its buffer is taken over and m is left empty (0x0).
+* @return The matrix (this) after the move.
+*/
+Matrix &Matrix::operator=(Matrix &&m) noexcept
+{
+    if (this != &m)
     {
-        for (int j = 0; j < dims.cols; ++j)
-        {
-            (*this)(i, j) = m(i, j);
-        }
+        delete[] raw_buf;
+        dims = m.dims;
+        raw_buf = m.raw_buf;
+        elem = m.elem;
+        m.dims.rows = 0;
+        m.dims.cols = 0;
+        m.raw_buf = nullptr;
+        m.elem = nullptr;
     }
     return *this;
 }
@@ -193,7 +293,7 @@ float Matrix::operator[](int i) const
     {
         exit_func(IDX_OUT_OF_BOUNDS_ERR);
     }
-    return elem[i / dims.cols][i % dims.cols];
+    return elem[i];
 }
 
 /**
@@ -208,7 +308,7 @@ float &Matrix::operator[](int i)
     {
         exit_func(IDX_OUT_OF_BOUNDS_ERR);
     }
-    return elem[i / dims.cols][i % dims.cols];
+    return elem[i];
 }
 
 /**
@@ -224,7 +324,7 @@ float Matrix::operator()(int i, int j) const
     {
         exit_func(IDX_OUT_OF_BOUNDS_ERR);
     }
-    return elem[i][j];
+    return elem[i * dims.cols + j];
 }
 
 /**
@@ -239,7 +339,7 @@ float &Matrix::operator()(int i, int j)
     {
         exit_func(IDX_OUT_OF_BOUNDS_ERR);
     }
-    return elem[i][j];
+    return elem[i * dims.cols + j];
 }
 
 /**
@@ -253,12 +353,10 @@ Matrix &Matrix::operator+=(const Matrix &m)
     {
         exit_func(MAT_ADDITION_ERR);
     }
-    for (int i = 0; i < dims.rows; ++i)
+    const int size = dims.rows * dims.cols;
+    for (int i = 0; i < size; ++i)
     {
-        for (int j = 0; j < dims.cols; ++j)
-        {
-            (*this)(i, j) += m(i, j);
-        }
+        elem[i] += m.elem[i];
     }
     return *this;
 }
@@ -281,11 +379,7 @@ std::istream &operator>>(std::istream& is, Matrix& read_mat)
             read_mat.dims.cols * read_mat.dims.rows * sizeof(float);
     if (file_len == matrix_len)
     {
-        for (int i = 0; i < read_mat.dims.rows; ++i)
-        {
-            size_t read_size = sizeof(float) * read_mat.dims.cols;
-            is.read((char *) (read_mat.elem[i]), read_size);
-        }
+        is.read((char *) read_mat.elem, (std::streamsize) matrix_len);
     }
     if (is.eof() || is.fail())
     {
@@ -333,74 +427,25 @@ Matrix operator*(const Matrix &m1, const Matrix &m2)
         exit_func(MAT_MULTIPLICATION_ERR);
     }
     Matrix mult_mat(m1.dims.rows, m2.dims.cols);
-    for (int i = 0; i < mult_mat.dims.rows; ++i)
-    {
-        for (int j = 0; j < mult_mat.dims.cols; ++j)
-        {
-            for (int k = 0; k < m1.dims.cols; ++k)
-            {
-                mult_mat(i, j) += m1(i, k) * m2(k, j);
-            }
-        }
-    }
+    gemm(m1.dims.rows, m2.dims.cols, m1.dims.cols,
+         m1.elem, m1.dims.cols, 1,
+         m2.elem, m2.dims.cols, 1,
+         mult_mat.elem, mult_mat.dims.cols, false);
     return mult_mat;
 }
 
 /**
-* Scalar multiplication on right.
-* Returns a matrix * scalar.
-* @param mat A const matrix.
-* @param scalar scalar to multiply the matrix with.
-* @return A matrix with all elements multiplied by the scalar.
-*/
-Matrix operator*(const Matrix &mat, float scalar)
-{
-    Matrix scalar_mat(mat);
-    for (int i = 0; i < mat.dims.rows; ++i)
-    {
-        for (int j = 0; j < mat.dims.cols; ++j)
-        {
-            scalar_mat(i, j) *= scalar;
-        }
-    }
-    return scalar_mat;
-}
-
-/**
-* Scalar multiplication on left.
-* Returns a scalar * matrix.
-* @param scalar scalar to multiply the matrix with.
-* @param mat A const matrix.
-* @return A matrix with all elements multiplied by the scalar.
-*/
-Matrix operator*(float scalar, const Matrix &mat)
-{
-    return mat*scalar;
-}
-
-/**
-* Sums 2 matrices.
-* @param m1 first matrix.
-* @param m2 second matrix.
-* @return Returns a new Matrix instance which equals the result of addition:
-* m1+m2.
-*/
-Matrix operator+(const Matrix &m1, const Matrix &m2)
+ * Checks that both operands of an element-wise sum have the same size and
+ * terminates the program with MAT_ADDITION_ERR otherwise.
+ * @param d1 dims of first operand
+ * @param d2 dims of second operand
+ */
+void check_addition_dims(const matrix_dims &d1, const matrix_dims &d2)
 {
-    if (m1.dims.rows != m2.dims.rows ||
-        m1.dims.cols != m2.dims.cols)
+    if (d1.rows != d2.rows || d1.cols != d2.cols)
     {
         exit_func(MAT_ADDITION_ERR);
     }
-    Matrix add_mat(m1.dims.rows, m1.dims.cols);
-    for (int i = 0; i < m1.dims.rows; i++)
-    {
-        for (int j = 0; j < m1.dims.cols; j++)
-        {
-            add_mat(i, j) = m1(i, j) + m2(i, j);
-        }
-    }
-    return add_mat;
 }
 
 /** This function Transposes the matrix and returns the
@@ -411,14 +456,8 @@ Matrix operator+(const Matrix &m1, const Matrix &m2)
 Matrix &Matrix::transpose()
 {
     Matrix transposed(dims.cols, dims.rows); // switch col num with row num.
-    for (int i = 0; i < dims.rows; ++i)
-    {
-        for (int j = 0; j < dims.cols; ++j)
-        {
-            transposed(j, i) = (*this)(i, j);
-        }
-    }
-    *this = transposed; // Assignment of transposed matrix to *this object.
+    copy_blocked(elem, 1, dims.cols, dims.cols, dims.rows, transposed.elem);
+    *this = std::move(transposed); // Takes over the transposed buffer.
     return *this;
 }
 
@@ -430,17 +469,10 @@ Matrix &Matrix::transpose()
  */
 Matrix &Matrix::vectorize()
 {
-    const Matrix vectorized(dims.rows * dims.cols, 1);
-    for (int i = 0; i < dims.rows; ++i)
-    {
-        for (int j = 0; j < dims.cols; ++j)
-        {
-            *vectorized.elem[i * dims.cols + j] = (*this)(i,j);
-            // Assigns element of the matrix in an array of floats where each
-            // array (pointer) stores only 1 float value.
-        }
-    }
-    *this = vectorized; // assignment of vectorized matrix to *this object.
+    // Elements are stored contiguously in row-major order, so the vector
+    // holds exactly the same bytes - only the dimensions change.
+    dims.rows = dims.rows * dims.cols;
+    dims.cols = 1;
     return *this;
 }
 
@@ -457,13 +489,10 @@ Matrix Matrix::dot(const Matrix &m) const
         exit_func(DOT_ERR);
     }
     Matrix dot_mat(dims.rows, dims.cols);
-    for (int i = 0; i < dims.rows; ++i)
+    const int size = dims.rows * dims.cols;
+    for (int i = 0; i < size; ++i)
     {
-        for (int j = 0; j < dims.cols; ++j)
-        {
-            dot_mat(i, j) = m(i, j) * (*this)(i, j);
-            // Dot product for each elem
-        }
+        dot_mat.elem[i] = m.elem[i] * elem[i]; // Dot product for each elem
     }
     return dot_mat;
 }
@@ -475,12 +504,10 @@ Matrix Matrix::dot(const Matrix &m) const
 float Matrix::norm() const
 {
     float sq_sum = 0;
-    for (int i = 0; i < dims.rows; i++)
+    const int size = dims.rows * dims.cols;
+    for (int i = 0; i < size; i++)
     {
-        for (int j = 0; j < dims.cols; j++)
-        {
-            sq_sum += (*this)(i, j)*(*this)(i, j);
-        }
+        sq_sum += elem[i] * elem[i];
     }
     // Return the square root of the sum of squares
     return sqrtf(sq_sum);
@@ -6,6 +6,8 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <utility>
+#include "MatrixView.h"
 
 #define IDX_OUT_OF_BOUNDS_ERR "Error: Index out of bounds!\n"
 #define ROWS_OR_COLS_ERR "Error: Incompatible _rows or _cols number!\n"
@@ -17,6 +19,10 @@
 #define MAT_MULTIPLICATION_ERR "Error: Cannot multiply matrices!\n"
 #define MIN_VALUE 0.1
 #define DOT_ERR "Error: cannot perform 'dot' function on matrices!\n"
+#define MATRIX_ALIGNMENT 64
+// Tile edge of the cache-blocked transpose: a tile of the source and of the
+// destination (32 x 32 floats, 4KB each) stay in L1 together.
+#define TRANSPOSE_BLOCK 32
 
 
 /**
@@ -28,13 +34,117 @@ typedef struct matrix_dims
     int rows, cols;
 } matrix_dims;
 
+/**
+ * @class MatrixExpr
+ * @brief Base of the lazy element-wise matrix expressions (expression
+ * templates). Sums and scalar products that start from lazy(m) build a
+ * small tree of nodes instead of temporary matrices; the whole tree is
+ * evaluated in a single loop when it is assigned to a Matrix, e.g.
+ * c = lazy(a) + lazy(b) * s. Plain Matrix operands keep returning Matrix.
+ * Nodes refer to the matrices they were built from, so an expression must be
+ * assigned before those matrices go out of scope (do not keep it in auto).
+ */
+template <typename E>
+class MatrixExpr
+{
+public:
+    /**
+    * @return The concrete expression node.
+    */
+    const E &self() const
+    {
+        return static_cast<const E &>(*this);
+    }
+};
+
+/**
+ * Leaf of an expression: a read-only reference to a matrix buffer.
+ */
+class MatrixLeaf : public MatrixExpr<MatrixLeaf>
+{
+    const float *elem;
+    matrix_dims dims;
+public:
+    MatrixLeaf(const float *elements, const matrix_dims &leaf_dims)
+            : elem(elements), dims(leaf_dims)
+    {}
+
+    matrix_dims get_dims() const
+    {
+        return dims;
+    }
+
+    float operator[](int i) const
+    {
+        return elem[i];
+    }
+};
+
+/**
+ * Checks that both operands of an element-wise sum have the same size and
+ * terminates the program with MAT_ADDITION_ERR otherwise.
+ * @param d1 dims of first operand
+ * @param d2 dims of second operand
+ */
+void check_addition_dims(const matrix_dims &d1, const matrix_dims &d2);
+
+/**
+ * Lazy element-wise sum of two expressions.
+ */
+template <typename L, typename R>
+class MatrixSum : public MatrixExpr<MatrixSum<L, R>>
+{
+    const L lhs;
+    const R rhs;
+public:
+    MatrixSum(const L &l, const R &r) : lhs(l), rhs(r)
+    {
+        check_addition_dims(lhs.get_dims(), rhs.get_dims());
+    }
+
+    matrix_dims get_dims() const
+    {
+        return lhs.get_dims();
+    }
+
+    float operator[](int i) const
+    {
+        return lhs[i] + rhs[i];
+    }
+};
+
+/**
+ * Lazy product of an expression and a scalar.
+ */
+template <typename E>
+class MatrixScaled : public MatrixExpr<MatrixScaled<E>>
+{
+    const E expr;
+    const float scalar;
+public:
+    MatrixScaled(const E &e, float s) : expr(e), scalar(s)
+    {}
+
+    matrix_dims get_dims() const
+    {
+        return expr.get_dims();
+    }
+
+    float operator[](int i) const
+    {
+        return expr[i] * scalar;
+    }
+};
+
 class Matrix
 {
 private:
     matrix_dims dims{};
-    float **elem;
+    char *raw_buf;
+    float *elem;
     /**
-    * Helper function that dynamically allocates memory for matrix elements.
+    * Helper function that dynamically allocates one contiguous block for the
+    * matrix elements, aligned to MATRIX_ALIGNMENT bytes (row-major order).
     */
     void alloc_matrix_elements();
 
@@ -67,6 +177,27 @@ public:
     */
     Matrix(const Matrix &);
 
+    /**
+    * Move Constructor:
+    * Takes over the elements buffer of m, leaving m empty (0x0).
+    * @param m
+    */
+    Matrix(Matrix &&m) noexcept;
+
+    /**
+    * Copies the elements seen through a view into a new (contiguous) matrix.
+    * @param v A matrix view
+    */
+    explicit Matrix(const MatrixView &v);
+
+    /**
+    * Evaluates a lazy element-wise expression into a new matrix, in a single
+    * loop.
+    * @param expr expression to evaluate
+    */
+    template <typename E>
+    Matrix(const MatrixExpr<E> &expr);
+
     /**
     * Get the number of rows in matrix.
     * @return Number of rows as int.
@@ -79,6 +210,32 @@ public:
     */
     int get_cols() const;
 
+    /**
+    * Raw access to the contiguous row-major elements buffer.
+    * @return Pointer to the first element (aligned to MATRIX_ALIGNMENT).
+    */
+    float *data();
+
+    /**
+    * Const version of data().
+    * @return Pointer to the first element (aligned to MATRIX_ALIGNMENT).
+    */
+    const float *data() const;
+
+    /**
+    * Raw access to a single row of the matrix (no bounds check).
+    * @param i row index
+    * @return Pointer to the first element of row i.
+    */
+    float *row_ptr(int i);
+
+    /**
+    * Const version of row_ptr().
+    * @param i row index
+    * @return Pointer to the first element of row i.
+    */
+    const float *row_ptr(int i) const;
+
     /**
     * Prints the matrix elements one by one with a space between each value
     * each matrix row in a separate row.
@@ -92,6 +249,22 @@ public:
     */
     Matrix &operator=(const Matrix &);
 
+    /**
+    * Move assignment.
+    * @param m A matrix - its buffer is taken over and m is left empty (0x0).
+    * @return The matrix (this) after the move.
+    */
+    Matrix &operator=(Matrix &&m) noexcept;
+
+    /**
+    * Evaluates a lazy element-wise expression into this matrix, in a single
+    * loop. The expression may refer to this matrix itself.
+    * @param expr expression to evaluate
+    * @return The matrix (this) holding the result.
+    */
+    template <typename E>
+    Matrix &operator=(const MatrixExpr<E> &expr);
+
     /**
     * Returns the i'th element in the matrix.
     * @param i the index of element
@@ -131,6 +304,22 @@ public:
     */
     Matrix &operator+=(const Matrix &);
 
+    /**
+    * Adds a lazy element-wise expression to this matrix in a single loop.
+    * @param expr expression to add
+    * @return Returns this matrix after we add the expression to it.
+    */
+    template <typename E>
+    Matrix &operator+=(const MatrixExpr<E> &expr);
+
+    /**
+    * @return A lazy expression leaf referring to this matrix.
+    */
+    MatrixLeaf leaf() const
+    {
+        return MatrixLeaf(elem, dims);
+    }
+
     /**
     * Reads from a binary file and fills the matrix.
     * @param is the input stream
@@ -155,35 +344,9 @@ public:
     */
     friend Matrix operator*(const Matrix &, const Matrix &);
 
-    /**
-    * Scalar multiplication on right.
-    * Returns a matrix * scalar.
-    * @param mat A const matrix.
-    * @param scalar scalar to multiply the matrix with.
-    * @return A matrix with all elements multiplied by the scalar.
-    */
-    friend Matrix operator*(float , const Matrix &);
-
-    /**
-    * Scalar multiplication on left.
-    * Returns a scalar * matrix.
-    * @param scalar scalar to multiply the matrix with.
-    * @param mat A const matrix.
-    * @return A matrix with all elements multiplied by the scalar.
-    */
-    friend Matrix operator*(const Matrix &, float );
-
-    /**
-    * Sums 2 matrices.
-    * @param m1 first matrix.
-    * @param m2 second matrix.
-    * @return Returns a new Matrix instance which equals the result
-    * of addition: m1+m2.
-    */
-    friend Matrix operator+(const Matrix &, const Matrix &);
-
     /** This function Transposes the matrix and returns the
-    * same matrix as transposed.
+    * same matrix as transposed. Works in TRANSPOSE_BLOCK square tiles, so
+    * both the reads and the writes stay within a few cache lines at a time.
     *
     * @return Transposed matrix as this object.
     */
@@ -199,7 +362,8 @@ public:
 
     /** Returns the matrix as vector - with rows*cols size of rows and cols
     * as 1 - so we get the matrix values represented as a new matrix
-    * which is a vector.
+    * which is a vector. Zero-copy: only the dimensions change (for a
+    * non-modifying reshape use MatrixView::reshaped()).
     *
     * @return The matrix represented as a vector - returns *this the same
     * object as vector.
@@ -213,5 +377,181 @@ public:
     float norm() const;
 };
 
+template <typename E>
+Matrix::Matrix(const MatrixExpr<E> &expr) : dims(expr.self().get_dims())
+{
+    alloc_matrix_elements();
+    const E &e = expr.self();
+    const int size = dims.rows * dims.cols;
+    for (int i = 0; i < size; ++i)
+    {
+        elem[i] = e[i];
+    }
+}
+
+template <typename E>
+Matrix &Matrix::operator=(const MatrixExpr<E> &expr)
+{
+    const E &e = expr.self();
+    const matrix_dims e_dims = e.get_dims();
+    if (e_dims.rows != dims.rows || e_dims.cols != dims.cols)
+    {
+        // The expression cannot refer to this matrix when sizes differ.
+        *this = Matrix(e_dims.rows, e_dims.cols);
+    }
+    const int size = dims.rows * dims.cols;
+    for (int i = 0; i < size; ++i)
+    {
+        elem[i] = e[i];
+    }
+    return *this;
+}
+
+template <typename E>
+Matrix &Matrix::operator+=(const MatrixExpr<E> &expr)
+{
+    const E &e = expr.self();
+    check_addition_dims(dims, e.get_dims());
+    const int size = dims.rows * dims.cols;
+    for (int i = 0; i < size; ++i)
+    {
+        elem[i] += e[i];
+    }
+    return *this;
+}
+
+/**
+* Starts a lazy expression from a matrix: sums and scalar products of the
+* result are evaluated in a single loop when assigned to a Matrix.
+* @param m A matrix.
+* @return Expression leaf referring to m.
+*/
+inline MatrixLeaf lazy(const Matrix &m)
+{
+    return m.leaf();
+}
+
+/**
+* Sums an expression and a matrix (lazily).
+*/
+template <typename E>
+MatrixSum<E, MatrixLeaf> operator+(const MatrixExpr<E> &e, const Matrix &m)
+{
+    return MatrixSum<E, MatrixLeaf>(e.self(), m.leaf());
+}
+
+/**
+* Sums a matrix and an expression (lazily).
+*/
+template <typename E>
+MatrixSum<MatrixLeaf, E> operator+(const Matrix &m, const MatrixExpr<E> &e)
+{
+    return MatrixSum<MatrixLeaf, E>(m.leaf(), e.self());
+}
+
+/**
+* Sums 2 expressions (lazily).
+*/
+template <typename L, typename R>
+MatrixSum<L, R> operator+(const MatrixExpr<L> &l, const MatrixExpr<R> &r)
+{
+    return MatrixSum<L, R>(l.self(), r.self());
+}
+
+/**
+* Scalar multiplication of an expression on right (lazy).
+*/
+template <typename E>
+MatrixScaled<E> operator*(const MatrixExpr<E> &e, float scalar)
+{
+    return MatrixScaled<E>(e.self(), scalar);
+}
+
+/**
+* Scalar multiplication of an expression on left (lazy).
+*/
+template <typename E>
+MatrixScaled<E> operator*(float scalar, const MatrixExpr<E> &e)
+{
+    return MatrixScaled<E>(e.self(), scalar);
+}
+
+/**
+* Sums 2 matrices.
+* @param m1 first matrix.
+* @param m2 second matrix.
+* @return m1+m2 as new instance matrix.
+*/
+inline Matrix operator+(const Matrix &m1, const Matrix &m2)
+{
+    return Matrix(lazy(m1) + lazy(m2));
+}
+
+/**
+* Sums 2 matrices, reusing the buffer of the temporary first one.
+*/
+inline Matrix operator+(Matrix &&m1, const Matrix &m2)
+{
+    m1 += m2;
+    return std::move(m1);
+}
+
+/**
+* Sums 2 matrices, reusing the buffer of the temporary second one.
+*/
+inline Matrix operator+(const Matrix &m1, Matrix &&m2)
+{
+    m2 += m1;
+    return std::move(m2);
+}
+
+/**
+* Sums 2 temporary matrices, reusing the buffer of the first one.
+*/
+inline Matrix operator+(Matrix &&m1, Matrix &&m2)
+{
+    m1 += m2;
+    return std::move(m1);
+}
+
+/**
+* Scalar multiplication on right.
+* @param mat A const matrix.
+* @param scalar scalar to multiply the matrix with.
+* @return A new matrix with all elements multiplied by the scalar.
+*/
+inline Matrix operator*(const Matrix &mat, float scalar)
+{
+    return Matrix(lazy(mat) * scalar);
+}
+
+/**
+* Scalar multiplication on left.
+* @param scalar scalar to multiply the matrix with.
+* @param mat A const matrix.
+* @return A new matrix with all elements multiplied by the scalar.
+*/
+inline Matrix operator*(float scalar, const Matrix &mat)
+{
+    return Matrix(scalar * lazy(mat));
+}
+
+/**
+* Scalar multiplication on right, in place on a temporary matrix.
+*/
+inline Matrix operator*(Matrix &&mat, float scalar)
+{
+    mat = lazy(mat) * scalar;
+    return std::move(mat);
+}
+
+/**
+* Scalar multiplication on left, in place on a temporary matrix.
+*/
+inline Matrix operator*(float scalar, Matrix &&mat)
+{
+    mat = scalar * lazy(mat);
+    return std::move(mat);
+}
 
 #endif //MATRIX_H
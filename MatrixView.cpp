@@ -0,0 +1,158 @@
+#include <iostream>
+#include "Matrix.h"
+#include "MatrixView.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Constructor of a view over a raw buffer.
+* @param data pointer to element (0,0)
+* @param rows number of rows
+* @param cols number of columns
+* @param row_stride distance (in floats) between (i,j) and (i+1,j)
+* @param col_stride distance (in floats) between (i,j) and (i,j+1)
+*/
+MatrixView::MatrixView(const float *data, int rows, int cols, int row_stride,
+                       int col_stride)
+        : elem(data), rows(rows), cols(cols), row_stride(row_stride),
+          col_stride(col_stride)
+{
+    if (rows <= 0 || cols <= 0)
+    {
+        exit_func(ROWS_OR_COLS_ERR);
+    }
+}
+
+/**
+* Constructor of a view over a whole matrix.
+* @param m the viewed matrix
+*/
+MatrixView::MatrixView(const Matrix &m)
+        : elem(m.data()), rows(m.get_rows()), cols(m.get_cols()),
+          row_stride(m.get_cols()), col_stride(1)
+{}
+
+/**
+* Get the number of rows in the view.
+* @return Number of rows as int.
+*/
+int MatrixView::get_rows() const
+{
+    return rows;
+}
+
+/**
+* Get the number of columns in the view.
+* @return Number of columns as int.
+*/
+int MatrixView::get_cols() const
+{
+    return cols;
+}
+
+/**
+* @return Distance (in floats) between consecutive rows.
+*/
+int MatrixView::get_row_stride() const
+{
+    return row_stride;
+}
+
+/**
+* @return Distance (in floats) between consecutive columns.
+*/
+int MatrixView::get_col_stride() const
+{
+    return col_stride;
+}
+
+/**
+* @return Pointer to element (0,0).
+*/
+const float *MatrixView::data() const
+{
+    return elem;
+}
+
+/**
+* @return true if the elements are dense and row-major.
+*/
+bool MatrixView::is_contiguous() const
+{
+    return col_stride == 1 && (row_stride == cols || rows == 1);
+}
+
+/**
+* returns the value of the element in the given index.
+* @param i row index
+* @param j col index
+* @return Value in index (i,j) of the view.
+*/
+float MatrixView::operator()(int i, int j) const
+{
+    if (i >= rows || j >= cols || i < 0 || j < 0)
+    {
+        exit_func(IDX_OUT_OF_BOUNDS_ERR);
+    }
+    return elem[(long) i * row_stride + (long) j * col_stride];
+}
+
+/**
+* Transposed view - swaps shape and strides, no data is moved.
+* @return A cols x rows view of the same elements.
+*/
+MatrixView MatrixView::transposed() const
+{
+    return MatrixView(elem, cols, rows, col_stride, row_stride);
+}
+
+/**
+* Reshaped view of a contiguous view (row-major order is kept).
+* @param new_rows number of rows
+* @param new_cols number of columns
+* @return A new_rows x new_cols view of the same elements.
+*/
+MatrixView MatrixView::reshaped(int new_rows, int new_cols) const
+{
+    if (!is_contiguous() || new_rows * new_cols != rows * cols)
+    {
+        exit_func(VIEW_RESHAPE_ERR);
+    }
+    return MatrixView(elem, new_rows, new_cols, new_cols, 1);
+}
+
+/**
+* Sub-view of a rectangular block.
+* @param first_row first row of the block
+* @param first_col first column of the block
+* @param block_rows number of rows in the block
+* @param block_cols number of columns in the block
+* @return A block_rows x block_cols view of the same elements.
+*/
+MatrixView MatrixView::block(int first_row, int first_col, int block_rows,
+                             int block_cols) const
+{
+    if (first_row < 0 || first_col < 0 || block_rows <= 0 ||
+        block_cols <= 0 || first_row + block_rows > rows ||
+        first_col + block_cols > cols)
+    {
+        exit_func(VIEW_BLOCK_ERR);
+    }
+    return MatrixView(elem + (long) first_row * row_stride +
+                      (long) first_col * col_stride,
+                      block_rows, block_cols, row_stride, col_stride);
+}
@@ -0,0 +1,111 @@
+// MatrixView.h
+
+#ifndef MATRIXVIEW_H
+#define MATRIXVIEW_H
+
+#define VIEW_RESHAPE_ERR "Error: Cannot reshape a non contiguous view or "\
+"to a different number of elements!\n"
+#define VIEW_BLOCK_ERR "Error: View block is out of the matrix bounds!\n"
+
+class Matrix;
+
+/**
+ * MatrixView Class - a non-owning, read-only window on matrix elements
+ * described by a shape and a row/column stride. Views are O(1) to create,
+ * so reshaping, transposing and slicing rows/columns never copies data.
+ * The viewed buffer must outlive the view.
+ */
+class MatrixView
+{
+private:
+    const float *elem;
+    int rows, cols;
+    int row_stride, col_stride;
+
+public:
+    /**
+    * Constructor of a view over a raw buffer.
+    * @param data pointer to element (0,0)
+    * @param rows number of rows
+    * @param cols number of columns
+    * @param row_stride distance (in floats) between (i,j) and (i+1,j)
+    * @param col_stride distance (in floats) between (i,j) and (i,j+1)
+    */
+    MatrixView(const float *data, int rows, int cols, int row_stride,
+               int col_stride);
+
+    /**
+    * Constructor of a view over a whole matrix (implicit, so a Matrix can
+    * be passed wherever a view is expected).
+    * @param m the viewed matrix
+    */
+    MatrixView(const Matrix &m);
+
+    /**
+    * Get the number of rows in the view.
+    * @return Number of rows as int.
+    */
+    int get_rows() const;
+
+    /**
+    * Get the number of columns in the view.
+    * @return Number of columns as int.
+    */
+    int get_cols() const;
+
+    /**
+    * @return Distance (in floats) between consecutive rows.
+    */
+    int get_row_stride() const;
+
+    /**
+    * @return Distance (in floats) between consecutive columns.
+    */
+    int get_col_stride() const;
+
+    /**
+    * @return Pointer to element (0,0).
+    */
+    const float *data() const;
+
+    /**
+    * @return true if the elements are dense and row-major.
+    */
+    bool is_contiguous() const;
+
+    /**
+    * returns the value of the element in the given index.
+    * @param i row index
+    * @param j col index
+    * @return Value in index (i,j) of the view.
+    */
+    float operator()(int i, int j) const;
+
+    /**
+    * Transposed view - swaps shape and strides, no data is moved.
+    * @return A cols x rows view of the same elements.
+    */
+    MatrixView transposed() const;
+
+    /**
+    * Reshaped view of a contiguous view (row-major order is kept), e.g. a
+    * 28x28 image as a 784x1 vector.
+    * @param new_rows number of rows
+    * @param new_cols number of columns
+    * @return A new_rows x new_cols view of the same elements.
+    */
+    MatrixView reshaped(int new_rows, int new_cols) const;
+
+    /**
+    * Sub-view of a rectangular block, e.g. a range of columns of a batch.
+    * @param first_row first row of the block
+    * @param first_col first column of the block
+    * @param block_rows number of rows in the block
+    * @param block_cols number of columns in the block
+    * @return A block_rows x block_cols view of the same elements.
+    */
+    MatrixView block(int first_row, int first_col, int block_rows,
+                     int block_cols) const;
+};
+
+#endif //MATRIXVIEW_H
@@ -0,0 +1,355 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MlpModel.h"
+
+using std::cerr;
+using std::endl;
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static_assert(sizeof(model_header) == MODEL_HEADER_SIZE,
+              "model_header must match the on-disk header size");
+static_assert(sizeof(model_layer) == 32,
+              "model_layer must match the on-disk table entry size");
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that computes a 64-bit FNV-1a hash of a buffer.
+* @param data buffer start
+* @param len buffer length in bytes
+* @param hash hash to continue from
+* @return the updated hash.
+*/
+static uint64_t fnv1a(const uint8_t *data, size_t len,
+                      uint64_t hash = FNV_OFFSET_BASIS)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+* Helper function that rounds an offset up to MODEL_PAYLOAD_ALIGNMENT.
+*/
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + MODEL_PAYLOAD_ALIGNMENT - 1) &
+           ~((uint64_t) MODEL_PAYLOAD_ALIGNMENT - 1);
+}
+
+/**
+* Helper function that gives the size of one weight element.
+* @param format storage format
+* @return Size in bytes.
+*/
+static uint64_t weight_size(uint32_t format)
+{
+    return format == FP32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+/**
+* Constructor for MlpModel instance: maps and validates a model file.
+* @param path Path of the packed model file.
+*/
+MlpModel::MlpModel(const std::string &path)
+        : base(nullptr), size(0), header(nullptr), layers(nullptr)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        exit_func(MODEL_OPEN_ERR);
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size < MODEL_HEADER_SIZE)
+    {
+        close(fd);
+        exit_func(MODEL_FORMAT_ERR);
+    }
+    size = (size_t) st.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        exit_func(MODEL_OPEN_ERR);
+    }
+    base = static_cast<const uint8_t *>(mapped);
+    header = reinterpret_cast<const model_header *>(base);
+    layers = reinterpret_cast<const model_layer *>(base + MODEL_HEADER_SIZE);
+    validate();
+}
+
+/**
+* Destructor of MlpModel instance - unmaps the file.
+*/
+MlpModel::~MlpModel()
+{
+    if (base)
+    {
+        munmap(const_cast<uint8_t *>(base), size);
+    }
+}
+
+/**
+* Helper function that checks the header, layer table and checksum of
+* the mapped file, terminating the program if they are invalid.
+*/
+void MlpModel::validate() const
+{
+    if (std::memcmp(header->magic, MODEL_MAGIC, 4) != 0 ||
+        header->file_size != size)
+    {
+        exit_func(MODEL_FORMAT_ERR);
+    }
+    if (header->version < MODEL_MIN_VERSION ||
+        header->version > MODEL_VERSION)
+    {
+        exit_func(MODEL_VERSION_ERR);
+    }
+    const uint64_t table_end = MODEL_HEADER_SIZE +
+                               (uint64_t) header->layer_count *
+                               sizeof(model_layer);
+    if (header->layer_count == 0 || table_end > size)
+    {
+        exit_func(MODEL_FORMAT_ERR);
+    }
+    for (uint32_t i = 0; i < header->layer_count; ++i)
+    {
+        const model_layer &layer = layers[i];
+        // Products of two 32-bit fields cannot wrap in 64 bits.
+        const uint64_t elements = (uint64_t) layer.rows * layer.cols;
+        const uint64_t b_bytes = (uint64_t) layer.rows * sizeof(float);
+        if (layer.rows == 0 || layer.cols == 0 ||
+            layer.rows > INT32_MAX || layer.cols > INT32_MAX ||
+            (layer.activation != RELU && layer.activation != SOFTMAX) ||
+            (layer.weight_format != FP32 && layer.weight_format != FP16 &&
+             layer.weight_format != BF16) ||
+            (header->version < MODEL_WEIGHT_FORMAT_VERSION &&
+             layer.weight_format != FP32) ||
+            layer.weights_offset % MODEL_PAYLOAD_ALIGNMENT != 0 ||
+            layer.bias_offset % MODEL_PAYLOAD_ALIGNMENT != 0 ||
+            layer.weights_offset < table_end ||
+            layer.bias_offset < table_end ||
+            // offsets come from the file: compare without adding, so a
+            // huge offset cannot wrap around past the end of the mapping
+            layer.weights_offset > size || layer.bias_offset > size ||
+            elements > size ||
+            elements * weight_size(layer.weight_format) >
+            size - layer.weights_offset ||
+            b_bytes > size - layer.bias_offset)
+        {
+            exit_func(MODEL_FORMAT_ERR);
+        }
+    }
+    if (fnv1a(base + MODEL_HEADER_SIZE, size - MODEL_HEADER_SIZE) !=
+        header->checksum)
+    {
+        exit_func(MODEL_CHECKSUM_ERR);
+    }
+}
+
+/**
+* Get the number of layers in the model.
+* @return Number of layers as int.
+*/
+int MlpModel::get_layer_count() const
+{
+    return (int) header->layer_count;
+}
+
+/**
+* Getter of weights of specific layer (no copy).
+* @param layer layer index
+* @return View of the layer weights inside the mapped file.
+*/
+MatrixView MlpModel::get_weights(int layer) const
+{
+    if (layer < 0 || layer >= get_layer_count())
+    {
+        exit_func(MODEL_LAYER_ERR);
+    }
+    const model_layer &l = layers[layer];
+    if (l.weight_format != FP32)
+    {
+        exit_func(MODEL_WEIGHT_FORMAT_ERR);
+    }
+    return MatrixView(reinterpret_cast<const float *>(base +
+                                                      l.weights_offset),
+                      (int) l.rows, (int) l.cols, (int) l.cols, 1);
+}
+
+/**
+* Getter of half precision weights of specific layer (no copy).
+* @param layer layer index
+* @return HalfMatrix borrowing the weights inside the mapped file.
+*/
+HalfMatrix MlpModel::get_half_weights(int layer) const
+{
+    const WeightFormat format = get_weight_format(layer);
+    if (format == FP32)
+    {
+        exit_func(MODEL_WEIGHT_FORMAT_ERR);
+    }
+    const model_layer &l = layers[layer];
+    return HalfMatrix(reinterpret_cast<const uint16_t *>(base +
+                                                         l.weights_offset),
+                      (int) l.rows, (int) l.cols, format);
+}
+
+/**
+* Getter of the weight storage format of specific layer.
+* @param layer layer index
+* @return FP32, FP16 or BF16.
+*/
+WeightFormat MlpModel::get_weight_format(int layer) const
+{
+    if (layer < 0 || layer >= get_layer_count())
+    {
+        exit_func(MODEL_LAYER_ERR);
+    }
+    return (WeightFormat) layers[layer].weight_format;
+}
+
+/**
+* Getter of bias of specific layer (no copy).
+* @param layer layer index
+* @return View of the layer bias inside the mapped file.
+*/
+MatrixView MlpModel::get_bias(int layer) const
+{
+    if (layer < 0 || layer >= get_layer_count())
+    {
+        exit_func(MODEL_LAYER_ERR);
+    }
+    const model_layer &l = layers[layer];
+    return MatrixView(reinterpret_cast<const float *>(base + l.bias_offset),
+                      (int) l.rows, 1, 1, 1);
+}
+
+/**
+* Getter of activation type of specific layer.
+* @param layer layer index
+* @return The layer activation type.
+*/
+ActivationType MlpModel::get_activation(int layer) const
+{
+    if (layer < 0 || layer >= get_layer_count())
+    {
+        exit_func(MODEL_LAYER_ERR);
+    }
+    return (ActivationType) layers[layer].activation;
+}
+
+/**
+* Writes a packed model file.
+* @param path Path of the file to create.
+* @param weights Weights of each layer.
+* @param biases Biases of each layer.
+* @param act_types Activation type of each layer.
+* @param layer_count Number of layers.
+* @param format Format to store the weights in.
+* @return true on success, false if the file could not be written.
+*/
+bool MlpModel::save(const std::string &path, const Matrix *weights,
+                    const Matrix *biases, const ActivationType *act_types,
+                    int layer_count, WeightFormat format)
+{
+    if (layer_count <= 0 || (format != FP32 && format != FP16 &&
+                             format != BF16))
+    {
+        return false;
+    }
+    // Lay out the payloads first, so the whole file can be hashed in memory.
+    uint64_t offset = align_offset(MODEL_HEADER_SIZE +
+                                   (uint64_t) layer_count *
+                                   sizeof(model_layer));
+    model_layer *table = new(std::nothrow) model_layer[layer_count];
+    if (!table)
+    {
+        return false;
+    }
+    for (int i = 0; i < layer_count; ++i)
+    {
+        if (biases[i].get_rows() != weights[i].get_rows() ||
+            biases[i].get_cols() != 1)
+        {
+            delete[] table;
+            return false;
+        }
+        table[i].rows = (uint32_t) weights[i].get_rows();
+        table[i].cols = (uint32_t) weights[i].get_cols();
+        table[i].activation = (uint32_t) act_types[i];
+        table[i].weight_format = (uint32_t) format;
+        table[i].weights_offset = offset;
+        offset = align_offset(offset + (uint64_t) table[i].rows *
+                                       table[i].cols * weight_size(format));
+        table[i].bias_offset = offset;
+        offset = align_offset(offset + (uint64_t) table[i].rows *
+                                       sizeof(float));
+    }
+    uint8_t *file = new(std::nothrow) uint8_t[offset]();
+    if (!file)
+    {
+        delete[] table;
+        return false;
+    }
+    std::memcpy(file + MODEL_HEADER_SIZE, table,
+                layer_count * sizeof(model_layer));
+    for (int i = 0; i < layer_count; ++i)
+    {
+        const size_t w_count = (size_t) table[i].rows * table[i].cols;
+        if (format == FP32)
+        {
+            std::memcpy(file + table[i].weights_offset, weights[i].data(),
+                        w_count * sizeof(float));
+        }
+        else
+        {
+            uint16_t *dst = reinterpret_cast<uint16_t *>(
+                    file + table[i].weights_offset);
+            const float *src = weights[i].data();
+            for (size_t j = 0; j < w_count; ++j)
+            {
+                dst[j] = format == FP16 ? float_to_fp16(src[j])
+                                        : float_to_bf16(src[j]);
+            }
+        }
+        std::memcpy(file + table[i].bias_offset, biases[i].data(),
+                    (size_t) table[i].rows * sizeof(float));
+    }
+    model_header header{};
+    std::memcpy(header.magic, MODEL_MAGIC, 4);
+    header.version = MODEL_VERSION;
+    header.layer_count = (uint32_t) layer_count;
+    header.file_size = offset;
+    header.checksum = fnv1a(file + MODEL_HEADER_SIZE,
+                            offset - MODEL_HEADER_SIZE);
+    std::memcpy(file, &header, sizeof(header));
+    delete[] table;
+
+    std::ofstream os(path, std::ios::out | std::ios::binary |
+                           std::ios::trunc);
+    os.write(reinterpret_cast<const char *>(file), (std::streamsize) offset);
+    delete[] file;
+    return os.good();
+}
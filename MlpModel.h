@@ -0,0 +1,158 @@
+// MlpModel.h
+
+#ifndef MLPMODEL_H
+#define MLPMODEL_H
+
+#include <cstdint>
+#include <string>
+#include "Activation.h"
+#include "HalfMatrix.h"
+
+#define MODEL_OPEN_ERR "Error: Failed to open or map model file!\n"
+#define MODEL_FORMAT_ERR "Error: Invalid model file format!\n"
+#define MODEL_VERSION_ERR "Error: Unsupported model file version!\n"
+#define MODEL_CHECKSUM_ERR "Error: Model file checksum mismatch!\n"
+#define MODEL_LAYER_ERR "Error: Model layer index out of range!\n"
+#define MODEL_WEIGHT_FORMAT_ERR "Error: Model layer weights are not stored "\
+"in the requested format!\n"
+
+#define MODEL_MAGIC "MLPM"
+#define MODEL_VERSION 2
+#define MODEL_MIN_VERSION 1
+// First version with a weight format per layer (the reserved field of
+// version 1, which only held float32 weights).
+#define MODEL_WEIGHT_FORMAT_VERSION 2
+#define MODEL_HEADER_SIZE 64
+#define MODEL_PAYLOAD_ALIGNMENT 64
+
+/**
+ * @struct model_header
+ * @brief Fixed size header at the start of a packed model file.
+ * All fields are little-endian. The checksum is a 64-bit FNV-1a hash of
+ * every byte after the header (layer table and payloads).
+ */
+typedef struct model_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t layer_count;
+    uint32_t reserved;
+    uint64_t file_size;
+    uint64_t checksum;
+    uint8_t padding[MODEL_HEADER_SIZE - 32];
+} model_header;
+
+/**
+ * @struct model_layer
+ * @brief Layer table entry: shape, activation, weight format and the offsets
+ * (from the start of the file, multiples of MODEL_PAYLOAD_ALIGNMENT) of the
+ * row-major weights and of the float32 bias vector. The weights are float32,
+ * FP16 or BF16 (a WeightFormat value; 0 = FP32). Version 1 files are
+ * float32 only.
+ */
+typedef struct model_layer
+{
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t activation;
+    uint32_t weight_format;
+    uint64_t weights_offset;
+    uint64_t bias_offset;
+} model_layer;
+
+/**
+   * MlpModel Class - a read-only, memory mapped packed model file holding
+   * every layer of a network in a single versioned container. The layer
+   * parameters are exposed as views straight into the mapping, so the
+   * weights are never copied and the page cache is shared by every process
+   * that maps the same file.
+   */
+class MlpModel
+{
+private:
+    const uint8_t *base;
+    size_t size;
+    const model_header *header;
+    const model_layer *layers;
+
+    /**
+    * Helper function that checks the header, layer table and checksum of
+    * the mapped file, terminating the program if they are invalid.
+    */
+    void validate() const;
+
+public:
+    /**
+    * Constructor for MlpModel instance: maps and validates a model file.
+    * @param path Path of the packed model file.
+    */
+    explicit MlpModel(const std::string &path);
+
+    /**
+    * Destructor of MlpModel instance - unmaps the file.
+    */
+    ~MlpModel();
+
+    MlpModel(const MlpModel &) = delete;
+    MlpModel &operator=(const MlpModel &) = delete;
+
+    /**
+    * Get the number of layers in the model.
+    * @return Number of layers as int.
+    */
+    int get_layer_count() const;
+
+    /**
+    * Getter of weights of specific layer (no copy). The layer must be
+    * stored as FP32.
+    * @param layer layer index
+    * @return View of the layer weights inside the mapped file.
+    */
+    MatrixView get_weights(int layer) const;
+
+    /**
+    * Getter of half precision weights of specific layer (no copy). The
+    * layer must be stored as FP16 or BF16.
+    * @param layer layer index
+    * @return HalfMatrix borrowing the weights inside the mapped file.
+    */
+    HalfMatrix get_half_weights(int layer) const;
+
+    /**
+    * Getter of the weight storage format of specific layer.
+    * @param layer layer index
+    * @return FP32, FP16 or BF16.
+    */
+    WeightFormat get_weight_format(int layer) const;
+
+    /**
+    * Getter of bias of specific layer (no copy).
+    * @param layer layer index
+    * @return View of the layer bias inside the mapped file.
+    */
+    MatrixView get_bias(int layer) const;
+
+    /**
+    * Getter of activation type of specific layer.
+    * @param layer layer index
+    * @return The layer activation type.
+    */
+    ActivationType get_activation(int layer) const;
+
+    /**
+    * Writes a packed model file.
+    * @param path Path of the file to create.
+    * @param weights Weights of each layer.
+    * @param biases Biases of each layer.
+    * @param act_types Activation type of each layer.
+    * @param layer_count Number of layers.
+    * @param format Format to store the weights in - float32 weights are
+    * converted to FP16 or BF16 while writing. Biases stay float32.
+    * @return true on success, false if the file could not be written.
+    */
+    static bool save(const std::string &path, const Matrix *weights,
+                     const Matrix *biases, const ActivationType *act_types,
+                     int layer_count, WeightFormat format = FP32);
+};
+
+#endif //MLPMODEL_H
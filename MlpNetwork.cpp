@@ -1,9 +1,9 @@
+#include <algorithm>
 #include "MlpNetwork.h"
+#include "Profiler.h"
 
 #define ZERO_DIGIT 0
 
-#define TEN_DIGIT 10
-
 using std::string;
 using std::cerr;
 using std::endl;
@@ -22,26 +22,222 @@ static void exit_func(const string &error_msg)
 }
 
 /**
-* Constructor for MlpNetwork instance.
+* Helper function that allocates the layer pointer array.
+* @param layer_count Number of layers
+* @return The array.
+*/
+static Dense **alloc_layers(int layer_count)
+{
+    if (layer_count <= 0)
+    {
+        exit_func(LAYER_COUNT_ERR);
+    }
+    Dense **layers = new(std::nothrow) Dense *[layer_count];
+    if (!layers)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    return layers;
+}
+
+/**
+* Helper function that checks a layer allocation.
+* @param layer the new layer, nullptr if the allocation failed
+* @return The layer.
+*/
+static Dense *check_layer(Dense *layer)
+{
+    if (!layer)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    return layer;
+}
+
+/**
+* Constructor for MlpNetwork instance with the default MLP_SIZE layers.
+* @param weights Weights list
+* @param biases Biases list
+* @param format Storage format of the layer weights
+*/
+MlpNetwork::MlpNetwork(const Matrix *weights, const Matrix *biases,
+                       WeightFormat format) :
+        MlpNetwork(weights, biases, mlp_act_types, MLP_SIZE, format)
+{}
+
+/**
+* Constructor for MlpNetwork instance of any topology.
 * @param weights Weights list
 * @param biases Biases list
+* @param act_types Activation of each layer
+* @param layer_count Number of layers
+* @param format Storage format of the layer weights
 */
-MlpNetwork::MlpNetwork(const Matrix *weights, const Matrix *biases) :
-        dense1(weights[0], biases[0], RELU),
-        dense2(weights[1], biases[1], RELU),
-        dense3(weights[2], biases[2], RELU),
-        dense4(weights[3], biases[3], SOFTMAX)
+MlpNetwork::MlpNetwork(const Matrix *weights, const Matrix *biases,
+                       const ActivationType *act_types, int layer_count,
+                       WeightFormat format) :
+        layers(alloc_layers(layer_count)), layer_count(layer_count),
+        max_width(0)
 {
-    for (int i = 0; i < MLP_SIZE; ++i)
+    for (int i = 0; i < layer_count; ++i)
     {
-        if (weights[i].get_rows() != weights_dims[i].rows ||
-            weights[i].get_cols() != weights_dims[i].cols ||
-            biases[i].get_rows() != bias_dims[i].rows ||
-            biases[i].get_cols() != bias_dims[i].cols)
+        if (biases[i].get_rows() != weights[i].get_rows() ||
+            biases[i].get_cols() != 1)
         {
             exit_func(BIAS_OR_WEIGHTS_SIZE_ERR);
         }
+        layers[i] = check_layer(new(std::nothrow) Dense(
+                weights[i], biases[i], act_types[i], format));
     }
+    validate();
+}
+
+/**
+* Constructor for MlpNetwork instance on a packed model file.
+* @param model Memory mapped model
+*/
+MlpNetwork::MlpNetwork(const MlpModel &model) :
+        layers(alloc_layers(model.get_layer_count())),
+        layer_count(model.get_layer_count()), max_width(0)
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        if (model.get_weight_format(i) == FP32)
+        {
+            layers[i] = check_layer(new(std::nothrow) Dense(
+                    model.get_weights(i), model.get_bias(i),
+                    model.get_activation(i)));
+        }
+        else
+        {
+            layers[i] = check_layer(new(std::nothrow) Dense(
+                    model.get_half_weights(i), model.get_bias(i),
+                    model.get_activation(i)));
+        }
+    }
+    validate();
+}
+
+/**
+* Constructor for MlpNetwork instance on given layers.
+* @param layers Array of layer_count layers, each is copied
+* @param layer_count Number of layers
+*/
+MlpNetwork::MlpNetwork(const Dense *const *layers, int layer_count) :
+        layers(alloc_layers(layer_count)), layer_count(layer_count),
+        max_width(0)
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        this->layers[i] = check_layer(new(std::nothrow) Dense(*layers[i]));
+    }
+    validate();
+}
+
+/**
+* Copy constructor - copies every layer.
+* @param other network to copy
+*/
+MlpNetwork::MlpNetwork(const MlpNetwork &other) :
+        layers(alloc_layers(other.layer_count)),
+        layer_count(other.layer_count), max_width(other.max_width)
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        layers[i] = check_layer(new(std::nothrow) Dense(*other.layers[i]));
+    }
+}
+
+/**
+* Destructor of MlpNetwork instance.
+*/
+MlpNetwork::~MlpNetwork()
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        delete layers[i];
+    }
+    delete[] layers;
+}
+
+/**
+* Helper function that checks that the layers chain and records the
+* widest layer, terminating the program if the shapes do not fit.
+*/
+void MlpNetwork::validate()
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        if (i > 0 && layers[i]->get_input_size() !=
+                     layers[i - 1]->get_output_size())
+        {
+            exit_func(BIAS_OR_WEIGHTS_SIZE_ERR);
+        }
+        if (layers[i]->get_output_size() > max_width)
+        {
+            max_width = layers[i]->get_output_size();
+        }
+    }
+}
+
+/**
+* Helper function that returns the workspace used by the calls that do not
+* get one from the caller - one per thread, so those calls stay thread safe
+* and stop allocating once it has grown to the largest batch seen.
+* @return This thread's default workspace.
+*/
+static MlpWorkspace &default_workspace()
+{
+    static thread_local MlpWorkspace workspace;
+    return workspace;
+}
+
+/**
+* Constructor for an empty MlpWorkspace instance - it grows on first use.
+*/
+MlpWorkspace::MlpWorkspace() : capacity(0), input_size(0), width(0)
+{}
+
+/**
+* Constructor for MlpWorkspace instance, sized for a network.
+* @param network Network the workspace will be used with.
+* @param batch_capacity Number of images a single call may process
+* without growing the buffers.
+*/
+MlpWorkspace::MlpWorkspace(const MlpNetwork &network, int batch_capacity)
+        : MlpWorkspace()
+{
+    reserve(network, batch_capacity);
+}
+
+/**
+* Get the number of images the buffers currently fit.
+* @return the capacity in images.
+*/
+int MlpWorkspace::get_capacity() const
+{
+    return capacity;
+}
+
+/**
+* Grows the buffers if a batch of a network does not fit.
+* @param network Network of the coming call.
+* @param batch_size Number of images of the coming call.
+*/
+void MlpWorkspace::reserve(const MlpNetwork &network, int batch_size)
+{
+    if (batch_size <= 0 ||
+        (batch_size <= capacity && network.get_input_size() <= input_size &&
+         network.get_max_width() <= width))
+    {
+        return;
+    }
+    capacity = std::max(capacity, batch_size);
+    input_size = std::max(input_size, network.get_input_size());
+    width = std::max(width, network.get_max_width());
+    input = Matrix(input_size, capacity);
+    ping = Matrix(width, capacity);
+    pong = Matrix(width, capacity);
 }
 
 /**
@@ -49,22 +245,320 @@ MlpNetwork::MlpNetwork(const Matrix *weights, const Matrix *biases) :
 * @param image Matrix that represents an image to be read.
 * @return digit struct with the highest probability to be the correct digit
 */
-digit MlpNetwork::operator()(const Matrix &image) const
+digit MlpNetwork::operator()(const MatrixView &image) const
 {
-    Matrix out1 = dense1(image);
-    Matrix out2 = dense2(out1);
-    Matrix out3 = dense3(out2);
-    Matrix final_output = dense4(out3);
-    digit best_match;
-    best_match.value = ZERO_DIGIT;
-    best_match.probability = 0.0;
-    for (int i = ZERO_DIGIT; i < TEN_DIGIT; i++)
+    return (*this)(image, default_workspace());
+}
+
+/**
+* Applies the entire network on input using a caller owned workspace.
+* @param image Matrix that represents an image to be read.
+* @param workspace Scratch buffers for the layer activations.
+* @return digit struct with the highest probability to be the correct digit
+*/
+digit MlpNetwork::operator()(const MatrixView &image,
+                             MlpWorkspace &workspace) const
+{
+    digit result;
+    predict_batch(image, &result, workspace);
+    return result;
+}
+
+/**
+* Applies the entire network on a batch of images at once.
+* @param images Matrix (or view) of size get_input_size() x N, where
+* column j is the j'th vectorized image.
+* @param results Array of at least N digits.
+*/
+void MlpNetwork::predict_batch(const MatrixView &images,
+                               digit *results) const
+{
+    predict_batch(images, results, default_workspace());
+}
+
+/**
+* Batch prediction using a caller owned workspace. The layer outputs
+* alternate between the ping and pong buffers, each stored as a contiguous
+* (layer rows) x N block.
+* @param images Matrix (or view), one vectorized image per column.
+* @param results Array of at least N digits.
+* @param workspace Scratch buffers for the layer activations.
+*/
+void MlpNetwork::predict_batch(const MatrixView &images, digit *results,
+                               MlpWorkspace &workspace) const
+{
+    const int n = images.get_cols();
+    if (n <= 0)
     {
-        if (final_output[i] > best_match.probability)
+        return;
+    }
+    ProfileInference profile(n);
+    const float *final_output = forward_logits(images, workspace);
+    ProfileScope selection(PROFILE_ACTIVATION, layer_count - 1, n,
+                           (long long) PROFILE_SOFTMAX_FLOPS *
+                           get_output_size() * n,
+                           (long long) get_output_size() * n * sizeof(float));
+    for (int j = 0; j < n; ++j)
+    {
+        select(final_output, n, j, 1, &results[j].value,
+               &results[j].probability);
+    }
+}
+
+/**
+* Helper function that runs all layers on a batch, leaving out the
+* SOFTMAX of the output layer (see Dense::apply_logits()).
+* @param images Matrix (or view), one vectorized image per column.
+* @param workspace Scratch buffers for the layer activations.
+* @return The output layer result, get_output_size() x N row-major.
+*/
+const float *MlpNetwork::forward_logits(const MatrixView &images,
+                                        MlpWorkspace &workspace) const
+{
+    if (images.get_rows() != get_input_size())
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    const int n = images.get_cols();
+    workspace.reserve(*this, n);
+    float *buffers[2] = {workspace.ping.data(), workspace.pong.data()};
+    if (layer_count == 1)
+    {
+        ProfileScope profile(PROFILE_LAYER, 0, n, 0, 0);
+        layers[0]->apply_logits(images, buffers[0]);
+        return buffers[0];
+    }
+    {
+        ProfileScope profile(PROFILE_LAYER, 0, n, 0, 0);
+        layers[0]->apply(images, buffers[0]);
+    }
+    for (int i = 1; i < layer_count; ++i)
+    {
+        ProfileScope profile(PROFILE_LAYER, i, n, 0, 0);
+        const MatrixView input(buffers[(i - 1) % 2],
+                               layers[i - 1]->get_output_size(), n, n, 1);
+        if (i + 1 < layer_count)
+        {
+            layers[i]->apply(input, buffers[i % 2]);
+        }
+        else
+        {
+            layers[i]->apply_logits(input, buffers[i % 2]);
+        }
+    }
+    return buffers[(layer_count - 1) % 2];
+}
+
+/**
+* Helper function that selects the k most probable classes of one
+* column of forward_logits().
+* @param output Result of forward_logits().
+* @param cols Number of columns (images) in the output.
+* @param col Column to scan.
+* @param k Number of classes to select.
+* @param labels Receives the selected classes, most probable first.
+* @param probs Receives their probabilities, or nullptr for labels only.
+* @return Number of selected classes.
+*/
+int MlpNetwork::select(const float *output, int cols, int col, int k,
+                       unsigned int *labels, float *probs) const
+{
+    const Dense &last = *layers[layer_count - 1];
+    if (last.get_activation().get_activation_type() == SOFTMAX)
+    {
+        return softmax_top_k(output + col, get_output_size(), cols, k,
+                             labels, probs);
+    }
+    const int selected = top_k_indices(output + col, get_output_size(), cols,
+                                       k, labels);
+    for (int m = 0; probs != nullptr && m < selected; ++m)
+    {
+        probs[m] = output[labels[m] * cols + col];
+    }
+    return selected;
+}
+
+/**
+* Classifies one image without computing any probability: the most
+* probable class of a SOFTMAX output layer is the one with the largest
+* logit, so no exponential is evaluated.
+* @param image Matrix that represents an image to be read.
+* @return the predicted digit.
+*/
+unsigned int MlpNetwork::classify(const MatrixView &image) const
+{
+    return classify(image, default_workspace());
+}
+
+/**
+* Label-only classification using a caller owned workspace.
+* @param image Matrix that represents an image to be read.
+* @param workspace Scratch buffers for the layer activations.
+* @return the predicted digit.
+*/
+unsigned int MlpNetwork::classify(const MatrixView &image,
+                                  MlpWorkspace &workspace) const
+{
+    unsigned int label = ZERO_DIGIT;
+    top_k(image, 1, &label, nullptr, workspace);
+    return label;
+}
+
+/**
+* Applies the entire network on one image and returns the k most probable
+* digits. The SOFTMAX of the output layer is fused with the selection, so
+* the distribution is never written out.
+* @param image Matrix that represents an image to be read.
+* @param k Number of digits to return.
+* @param labels Array of at least k digits, most probable first.
+* @param probs Array of at least k probabilities of the labels, or nullptr
+* for labels only (then no exponential is evaluated).
+* @return Number of digits written, min(k, get_output_size()).
+*/
+int MlpNetwork::top_k(const MatrixView &image, int k, unsigned int *labels,
+                      float *probs) const
+{
+    return top_k(image, k, labels, probs, default_workspace());
+}
+
+/**
+* Top-k classification using a caller owned workspace.
+* @param image Matrix that represents an image to be read.
+* @param k Number of digits to return.
+* @param labels Array of at least k digits, most probable first.
+* @param probs Array of at least k probabilities, or nullptr.
+* @param workspace Scratch buffers for the layer activations.
+* @return Number of digits written, min(k, get_output_size()).
+*/
+int MlpNetwork::top_k(const MatrixView &image, int k, unsigned int *labels,
+                      float *probs, MlpWorkspace &workspace) const
+{
+    if (image.get_cols() != 1)
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    ProfileInference profile(1);
+    const float *output = forward_logits(image, workspace);
+    ProfileScope selection(PROFILE_ACTIVATION, layer_count - 1, 1,
+                           (long long) PROFILE_SOFTMAX_FLOPS *
+                           get_output_size(),
+                           (long long) get_output_size() * sizeof(float));
+    return select(output, 1, 0, k, labels, probs);
+}
+
+/**
+* Applies the entire network on an array of images at once.
+* @param images Array of count images.
+* @param count Number of images.
+* @param results Array of at least count digits.
+*/
+void MlpNetwork::predict_batch(const Matrix *images, int count,
+                               digit *results) const
+{
+    predict_batch(images, count, results, default_workspace());
+}
+
+/**
+* Array batch prediction using a caller owned workspace: the images are
+* packed as columns of the workspace input buffer.
+* @param images Array of count images.
+* @param count Number of images.
+* @param results Array of at least count digits.
+* @param workspace Scratch buffers for the input and layer activations.
+*/
+void MlpNetwork::predict_batch(const Matrix *images, int count,
+                               digit *results, MlpWorkspace &workspace) const
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    const int img_size = get_input_size();
+    workspace.reserve(*this, count);
+    float *dst = workspace.input.data();
+    for (int j = 0; j < count; ++j)
+    {
+        if (images[j].get_rows() * images[j].get_cols() != img_size)
         {
-            best_match.probability = final_output[i];
-            best_match.value = i;
+            exit_func(BATCH_SIZE_ERR);
         }
+        const float *src = images[j].data();
+        for (int i = 0; i < img_size; ++i)
+        {
+            dst[i * count + j] = src[i];
+        }
+    }
+    predict_batch(MatrixView(dst, img_size, count, count, 1), results,
+                  workspace);
+}
+
+/**
+* Getter of a layer of the network.
+* @param i layer index, in [0, get_layer_count())
+* @return The i'th Dense layer.
+*/
+const Dense &MlpNetwork::get_layer(int i) const
+{
+    if (i < 0 || i >= layer_count)
+    {
+        exit_func(LAYER_INDEX_ERR);
+    }
+    return *layers[i];
+}
+
+/**
+* Get the number of layers.
+* @return Number of layers as int.
+*/
+int MlpNetwork::get_layer_count() const
+{
+    return layer_count;
+}
+
+/**
+* Get the number of inputs of the network (pixels of an image).
+* @return Input size as int.
+*/
+int MlpNetwork::get_input_size() const
+{
+    return layers[0]->get_input_size();
+}
+
+/**
+* Get the number of outputs of the network (classes).
+* @return Output size as int.
+*/
+int MlpNetwork::get_output_size() const
+{
+    return layers[layer_count - 1]->get_output_size();
+}
+
+/**
+* Turns skipping of zero pixels in the first layer on or off.
+* @param enabled true to skip zero pixels
+*/
+void MlpNetwork::set_input_skipping(bool enabled)
+{
+    layers[0]->set_input_skipping(enabled);
+}
+
+/**
+* Turns pre-packed weights of every layer on or off.
+* @param enabled true to run batches on pre-packed weights
+*/
+void MlpNetwork::set_weight_packing(bool enabled)
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        layers[i]->set_weight_packing(enabled);
     }
-    return best_match;
+}
+
+/**
+* Get the widest layer output - the size of the scratch buffers.
+* @return Maximum layer output size as int.
+*/
+int MlpNetwork::get_max_width() const
+{
+    return max_width;
 }
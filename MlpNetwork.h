@@ -4,12 +4,19 @@
 #define MLPNETWORK_H
 
 #include "Dense.h"
+#include "MlpModel.h"
 
+// Default (course) topology: 784-128-64-20-10 with RELU hidden layers and a
+// SOFTMAX output, as stored in the w1..w4, b1..b4 parameter files.
 #define MLP_SIZE 4
 
 
 #define BIAS_OR_WEIGHTS_SIZE_ERR "Error: One of matrices size of rows or "\
 "columns does not fit!\n"
+#define LAYER_COUNT_ERR "Error: A network needs at least one layer!\n"
+#define BATCH_SIZE_ERR "Error: Batch images do not fit the network input "\
+"size!\n"
+#define LAYER_INDEX_ERR "Error: Layer index out of range!\n"
 /**
  * @struct digit
  * @brief Identified (by Mlp network) digit with
@@ -23,38 +30,309 @@ typedef struct digit
     float probability;
 } digit;
 
-const matrix_dims img_dims = {28, 28};
-const matrix_dims weights_dims[] = {{128, 784},
+constexpr ActivationType mlp_act_types[] = {RELU, RELU, RELU, SOFTMAX};
+constexpr matrix_dims img_dims = {28, 28};
+constexpr matrix_dims weights_dims[] = {{128, 784},
                                     {64, 128},
                                     {20, 64},
                                     {10, 20}};
-const matrix_dims bias_dims[]    = {{128, 1},
+constexpr matrix_dims bias_dims[]    = {{128, 1},
                                     {64, 1},
                                     {20, 1},
                                     {10, 1}};
+class MlpNetwork;
+
+/**
+   * MlpWorkspace Class - preallocated scratch memory for inference: two
+   * ping-pong activation buffers sized for the widest layer of a network and
+   * an input buffer for packing image arrays, all for up to get_capacity()
+   * images. Passing the same workspace to every call makes steady-state
+   * inference allocation free. A workspace must not be shared by concurrent
+   * calls.
+   */
+class MlpWorkspace
+{
+private:
+    int capacity;
+    int input_size;
+    int width;
+    Matrix input, ping, pong;
+    friend class MlpNetwork;
+
+public:
+    /**
+    * Constructor for an empty MlpWorkspace instance - it grows on first use.
+    */
+    MlpWorkspace();
+
+    /**
+    * Constructor for MlpWorkspace instance, sized for a network.
+    * @param network Network the workspace will be used with.
+    * @param batch_capacity Number of images a single call may process
+    * without growing the buffers.
+    */
+    MlpWorkspace(const MlpNetwork &network, int batch_capacity);
+
+    /**
+    * Get the number of images the buffers currently fit.
+    * @return the capacity in images.
+    */
+    int get_capacity() const;
+
+    /**
+    * Grows the buffers (the only place a workspace allocates) if a batch
+    * of a network does not fit. Does nothing for an empty batch.
+    * @param network Network of the coming call.
+    * @param batch_size Number of images of the coming call.
+    */
+    void reserve(const MlpNetwork &network, int batch_size);
+};
+
 /**
    * MlpNetwork Class - The class that holds the
-   * MlpNetwork with all the layers.
+   * MlpNetwork with all the layers. The number of layers, their shapes and
+   * activations are given at runtime; consecutive layers must chain (the
+   * inputs of a layer are the outputs of the previous one).
    */
 class MlpNetwork
 {
 public:
     /**
-    * Constructor for MlpNetwork instance.
+    * Constructor for MlpNetwork instance with the default MLP_SIZE layers
+    * and mlp_act_types activations.
     * @param weights Weights list
     * @param biases Biases list
+    * @param format Storage format of the layer weights (see Dense)
+    */
+    MlpNetwork(const Matrix *weights, const Matrix *biases,
+               WeightFormat format = FP32);
+
+    /**
+    * Constructor for MlpNetwork instance of any topology.
+    * @param weights Weights list, weights[i] is rows(i) x rows(i - 1)
+    * @param biases Biases list, biases[i] is rows(i) x 1
+    * @param act_types Activation of each layer
+    * @param layer_count Number of layers
+    * @param format Storage format of the layer weights (see Dense)
     */
-    MlpNetwork(const Matrix *weights, const Matrix *biases);
+    MlpNetwork(const Matrix *weights, const Matrix *biases,
+               const ActivationType *act_types, int layer_count,
+               WeightFormat format = FP32);
+
+    /**
+    * Constructor for MlpNetwork instance on a packed model file. The layers
+    * borrow their parameters (in whatever format each layer was stored)
+    * from the mapping, so the model must outlive the network.
+    * @param model Memory mapped model
+    */
+    explicit MlpNetwork(const MlpModel &model);
+
+    /**
+    * Constructor for MlpNetwork instance on given layers, which may mix
+    * dense, half precision and sparse weights (e.g. a pruned first layer).
+    * @param layers Array of layer_count layers, each is copied
+    * @param layer_count Number of layers
+    */
+    MlpNetwork(const Dense *const *layers, int layer_count);
+
+    /**
+    * Copy constructor - copies every layer.
+    * @param other network to copy
+    */
+    MlpNetwork(const MlpNetwork &other);
+
+    /**
+    * Destructor of MlpNetwork instance.
+    */
+    ~MlpNetwork();
+
+    MlpNetwork &operator=(const MlpNetwork &) = delete;
 
    /**
    * Applies the entire network on input.
    * @param image Matrix that represents an image to be read.
    * @return digit struct with the highest probability to be the correct digit
    */
-    digit operator()(const Matrix &image) const;
+    digit operator()(const MatrixView &image) const;
+
+   /**
+   * Applies the entire network on input using a caller owned workspace -
+   * performs no heap allocation once the workspace fits.
+   * @param image Matrix that represents an image to be read.
+   * @param workspace Scratch buffers for the layer activations.
+   * @return digit struct with the highest probability to be the correct digit
+   */
+    digit operator()(const MatrixView &image, MlpWorkspace &workspace) const;
+
+    /**
+    * Applies the entire network on a batch of images at once. Every layer
+    * multiplies its weights with the whole batch, so the weights are loaded
+    * once per batch instead of once per image.
+    * @param images Matrix (or view) of size get_input_size() x N, where
+    * column j is the j'th vectorized image. Images stored one per
+    * row can be passed without copying as a transposed view.
+    * @param results Array of at least N digits, results[j] receives the
+    * prediction for column j.
+    * An empty batch (N == 0) does nothing.
+    */
+    void predict_batch(const MatrixView &images, digit *results) const;
+
+    /**
+    * Batch prediction using a caller owned workspace (see predict_batch()).
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param results Array of at least N digits.
+    * @param workspace Scratch buffers for the layer activations.
+    */
+    void predict_batch(const MatrixView &images, digit *results,
+                       MlpWorkspace &workspace) const;
+
+    /**
+    * Applies the entire network on an array of images at once.
+    * @param images Array of count images, each holding get_input_size()
+    * elements (as image or as vector).
+    * @param count Number of images.
+    * @param results Array of at least count digits, results[j] receives the
+    * prediction for images[j].
+    * An empty batch (count <= 0) does nothing.
+    */
+    void predict_batch(const Matrix *images, int count, digit *results) const;
+
+    /**
+    * Array batch prediction using a caller owned workspace.
+    * @param images Array of count images.
+    * @param count Number of images.
+    * @param results Array of at least count digits.
+    * @param workspace Scratch buffers for the input and layer activations.
+    */
+    void predict_batch(const Matrix *images, int count, digit *results,
+                       MlpWorkspace &workspace) const;
+
+    /**
+    * Classifies one image without computing any probability: the most
+    * probable class of a SOFTMAX output layer is the one with the largest
+    * logit, so no exponential is evaluated.
+    * @param image Matrix that represents an image to be read.
+    * @return the predicted digit.
+    */
+    unsigned int classify(const MatrixView &image) const;
+
+    /**
+    * Label-only classification using a caller owned workspace.
+    * @param image Matrix that represents an image to be read.
+    * @param workspace Scratch buffers for the layer activations.
+    * @return the predicted digit.
+    */
+    unsigned int classify(const MatrixView &image,
+                          MlpWorkspace &workspace) const;
+
+    /**
+    * Applies the entire network on one image and returns the k most
+    * probable digits. The SOFTMAX of the output layer is fused with the
+    * selection, so the distribution is never written out.
+    * @param image Matrix that represents an image to be read.
+    * @param k Number of digits to return.
+    * @param labels Array of at least k digits, most probable first.
+    * @param probs Array of at least k probabilities of the labels, or
+    * nullptr for labels only (then no exponential is evaluated).
+    * @return Number of digits written, min(k, get_output_size()).
+    */
+    int top_k(const MatrixView &image, int k, unsigned int *labels,
+              float *probs) const;
+
+    /**
+    * Top-k classification using a caller owned workspace.
+    * @param image Matrix that represents an image to be read.
+    * @param k Number of digits to return.
+    * @param labels Array of at least k digits, most probable first.
+    * @param probs Array of at least k probabilities, or nullptr.
+    * @param workspace Scratch buffers for the layer activations.
+    * @return Number of digits written, min(k, get_output_size()).
+    */
+    int top_k(const MatrixView &image, int k, unsigned int *labels,
+              float *probs, MlpWorkspace &workspace) const;
+
+    /**
+    * Getter of a layer of the network.
+    * @param i layer index, in [0, get_layer_count())
+    * @return The i'th Dense layer.
+    */
+    const Dense &get_layer(int i) const;
+
+    /**
+    * Get the number of layers.
+    * @return Number of layers as int.
+    */
+    int get_layer_count() const;
+
+    /**
+    * Get the number of inputs of the network (pixels of an image).
+    * @return Input size as int.
+    */
+    int get_input_size() const;
+
+    /**
+    * Get the number of outputs of the network (classes).
+    * @return Output size as int.
+    */
+    int get_output_size() const;
+
+    /**
+    * Get the widest layer output - the size of the scratch buffers.
+    * @return Maximum layer output size as int.
+    */
+    int get_max_width() const;
+
+    /**
+    * Turns skipping of zero pixels in the first layer on or off (the
+    * default) - see Dense::set_input_skipping(). Turning it on keeps a
+    * private column-major copy of the first layer weights, also when they
+    * are borrowed from an MlpModel; turning it off frees the copy.
+    * @param enabled true to skip zero pixels
+    */
+    void set_input_skipping(bool enabled);
+
+    /**
+    * Turns pre-packed weights of every layer on or off (the default) - see
+    * Dense::set_weight_packing(). Turning it on keeps a private packed copy
+    * of every layer, also when the weights are borrowed from an MlpModel;
+    * turning it off frees the copies.
+    * @param enabled true to run batches on pre-packed weights
+    */
+    void set_weight_packing(bool enabled);
 private:
-    const Dense dense1, dense2, dense3, dense4;
+    Dense **layers;
+    int layer_count;
+    int max_width;
+
+    /**
+    * Helper function that checks that the layers chain and records the
+    * widest layer, terminating the program if the shapes do not fit.
+    */
+    void validate();
 
+    /**
+    * Helper function that runs all layers on a batch, leaving out the
+    * SOFTMAX of the output layer (see Dense::apply_logits()).
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param workspace Scratch buffers for the layer activations.
+    * @return The output layer result, get_output_size() x N row-major.
+    */
+    const float *forward_logits(const MatrixView &images,
+                                MlpWorkspace &workspace) const;
+
+    /**
+    * Helper function that selects the k most probable classes of one
+    * column of forward_logits().
+    * @param output Result of forward_logits().
+    * @param cols Number of columns (images) in the output.
+    * @param col Column to scan.
+    * @param k Number of classes to select.
+    * @param labels Receives the selected classes, most probable first.
+    * @param probs Receives their probabilities, or nullptr for labels only.
+    * @return Number of selected classes.
+    */
+    int select(const float *output, int cols, int col, int k,
+               unsigned int *labels, float *probs) const;
 };
 
 
@@ -0,0 +1,95 @@
+#include "ParallelMlp.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Constructor for ParallelMlp instance.
+* @param network The network to run - must outlive this instance.
+* @param thread_count Number of workers, 0 for one per hardware thread.
+* @param chunk_size Number of images each task processes as one batch.
+*/
+ParallelMlp::ParallelMlp(const MlpNetwork &network, int thread_count,
+                         int chunk_size)
+        : network(network), pool(thread_count), workspaces(nullptr),
+          chunk_size(chunk_size)
+{
+    if (chunk_size <= 0)
+    {
+        exit_func(CHUNK_SIZE_ERR);
+    }
+    workspaces = new MlpWorkspace[pool.get_thread_count()];
+    for (int i = 0; i < pool.get_thread_count(); ++i)
+    {
+        workspaces[i].reserve(network, chunk_size);
+    }
+}
+
+/**
+* Destructor of ParallelMlp instance.
+*/
+ParallelMlp::~ParallelMlp()
+{
+    delete[] workspaces;
+}
+
+/**
+* Get the number of worker threads.
+* @return Number of workers as int.
+*/
+int ParallelMlp::get_thread_count() const
+{
+    return pool.get_thread_count();
+}
+
+/**
+* Classifies a batch of images on all workers.
+* @param images Matrix (or view), one vectorized image per column.
+* @param results Array of at least N digits.
+*/
+void ParallelMlp::predict_batch(const MatrixView &images, digit *results)
+{
+    const int count = images.get_cols();
+    const int chunks = (count + chunk_size - 1) / chunk_size;
+    pool.parallel_for(chunks, [&](int chunk, int worker)
+    {
+        const int first = chunk * chunk_size;
+        const int len = (count - first < chunk_size) ? count - first
+                                                     : chunk_size;
+        network.predict_batch(images.block(0, first, images.get_rows(), len),
+                              results + first, workspaces[worker]);
+    });
+}
+
+/**
+* Classifies an array of images on all workers.
+* @param images Array of count images.
+* @param count Number of images.
+* @param results Array of at least count digits.
+*/
+void ParallelMlp::predict_batch(const Matrix *images, int count,
+                                digit *results)
+{
+    const int chunks = (count + chunk_size - 1) / chunk_size;
+    pool.parallel_for(chunks, [&](int chunk, int worker)
+    {
+        const int first = chunk * chunk_size;
+        const int len = (count - first < chunk_size) ? count - first
+                                                     : chunk_size;
+        network.predict_batch(images + first, len, results + first,
+                              workspaces[worker]);
+    });
+}
@@ -0,0 +1,69 @@
+// ParallelMlp.h
+
+#ifndef PARALLELMLP_H
+#define PARALLELMLP_H
+
+#include "MlpNetwork.h"
+#include "ThreadPool.h"
+
+#define DEFAULT_CHUNK_SIZE 64
+#define CHUNK_SIZE_ERR "Error: Chunk size must be positive!\n"
+
+/**
+   * ParallelMlp Class - multi-threaded batch inference over one shared
+   * MlpNetwork. A batch is cut into chunks of consecutive images, the chunks
+   * are spread over a work-stealing ThreadPool, and every worker runs its
+   * chunks on its own MlpWorkspace. Each chunk writes its slice of the
+   * results array, so results come back in input order.
+   */
+class ParallelMlp
+{
+private:
+    const MlpNetwork &network;
+    ThreadPool pool;
+    MlpWorkspace *workspaces;
+    const int chunk_size;
+
+public:
+    /**
+    * Constructor for ParallelMlp instance.
+    * @param network The network to run - must outlive this instance.
+    * @param thread_count Number of workers, 0 for one per hardware thread.
+    * @param chunk_size Number of images each task processes as one batch.
+    */
+    explicit ParallelMlp(const MlpNetwork &network, int thread_count = 0,
+                         int chunk_size = DEFAULT_CHUNK_SIZE);
+
+    /**
+    * Destructor of ParallelMlp instance.
+    */
+    ~ParallelMlp();
+
+    ParallelMlp(const ParallelMlp &) = delete;
+    ParallelMlp &operator=(const ParallelMlp &) = delete;
+
+    /**
+    * Get the number of worker threads.
+    * @return Number of workers as int.
+    */
+    int get_thread_count() const;
+
+    /**
+    * Classifies a batch of images on all workers.
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param results Array of at least N digits, results[j] receives the
+    * prediction for column j.
+    */
+    void predict_batch(const MatrixView &images, digit *results);
+
+    /**
+    * Classifies an array of images on all workers.
+    * @param images Array of count images.
+    * @param count Number of images.
+    * @param results Array of at least count digits, results[j] receives the
+    * prediction for images[j].
+    */
+    void predict_batch(const Matrix *images, int count, digit *results);
+};
+
+#endif //PARALLELMLP_H
@@ -0,0 +1,447 @@
+#include <iomanip>
+#include "PipelinedMlp.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using std::cerr;
+using std::endl;
+
+#define FRAME_ALIGN_FLOATS (MATRIX_ALIGNMENT / (int) sizeof(float))
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that rounds a buffer length up to whole cache lines, so
+* every activation buffer of a frame starts on its own line.
+* @param n number of floats
+* @return The rounded length.
+*/
+static int frame_align(int n)
+{
+    return (n + FRAME_ALIGN_FLOATS - 1) / FRAME_ALIGN_FLOATS *
+           FRAME_ALIGN_FLOATS;
+}
+
+/**
+* Constructor for PipelinedMlp instance with one stage per layer.
+* @param network The network to run - must outlive this instance.
+* @param depth Maximal number of images in flight.
+* @param pin_threads Pin stage s to CPU s (Linux only).
+*/
+PipelinedMlp::PipelinedMlp(const MlpNetwork &network, int depth,
+                           bool pin_threads)
+        : network(network), stage_count(network.get_layer_count()),
+          depth(depth), stages(nullptr), offsets(nullptr), frame_stride(0),
+          results(nullptr), queues(nullptr),
+          free_frames(depth > 0 ? depth : 1), stopping(false)
+{
+    int *stage_layers = new(std::nothrow) int[stage_count];
+    if (stage_layers == nullptr)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    for (int s = 0; s < stage_count; ++s)
+    {
+        stage_layers[s] = 1;
+    }
+    init(stage_layers, pin_threads);
+    delete[] stage_layers;
+}
+
+/**
+* Constructor for PipelinedMlp instance with a given split, e.g.
+* {1, 3} runs layer 0 on one worker and the other three on another.
+* @param network The network to run - must outlive this instance.
+* @param stage_layers Number of layers of each stage (positive, summing
+* to the layer count).
+* @param stage_count Number of stages.
+* @param depth Maximal number of images in flight.
+* @param pin_threads Pin stage s to CPU s (Linux only).
+*/
+PipelinedMlp::PipelinedMlp(const MlpNetwork &network,
+                           const int *stage_layers, int stage_count,
+                           int depth, bool pin_threads)
+        : network(network), stage_count(stage_count), depth(depth),
+          stages(nullptr), offsets(nullptr), frame_stride(0),
+          results(nullptr), queues(nullptr),
+          free_frames(depth > 0 ? depth : 1), stopping(false)
+{
+    init(stage_layers, pin_threads);
+}
+
+/**
+* Helper function that checks the stages and starts the workers.
+* @param stage_layers Number of layers of each stage.
+* @param pin_threads Pin stage s to CPU s (modulo the CPU count).
+*/
+void PipelinedMlp::init(const int *stage_layers, bool pin_threads)
+{
+    if (depth <= 0)
+    {
+        exit_func(PIPELINE_DEPTH_ERR);
+    }
+    const int layer_count = network.get_layer_count();
+    int covered = 0;
+    for (int s = 0; s < stage_count; ++s)
+    {
+        if (stage_layers[s] <= 0)
+        {
+            exit_func(PIPELINE_STAGES_ERR);
+        }
+        covered += stage_layers[s];
+    }
+    if (stage_count <= 0 || covered != layer_count)
+    {
+        exit_func(PIPELINE_STAGES_ERR);
+    }
+
+    offsets = new(std::nothrow) int[layer_count + 1];
+    results = new(std::nothrow) digit[depth];
+    stages = new(std::nothrow) Stage[stage_count];
+    queues = new(std::nothrow) SpscQueue<int> *[stage_count + 1];
+    if (offsets == nullptr || results == nullptr || stages == nullptr ||
+        queues == nullptr)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    offsets[0] = 0;
+    for (int l = 0; l < layer_count; ++l)
+    {
+        offsets[l + 1] = offsets[l] +
+                         frame_align(network.get_layer(l).get_input_size());
+    }
+    frame_stride = offsets[layer_count] +
+                   frame_align(network.get_output_size());
+    frames = Matrix(depth, frame_stride);
+
+    // Every queue can hold all frames, so a push never fails.
+    for (int s = 0; s <= stage_count; ++s)
+    {
+        queues[s] = new SpscQueue<int>(depth);
+    }
+    for (int f = 0; f < depth; ++f)
+    {
+        free_frames.try_push(f);
+    }
+
+    stats_start = pipeline_clock::now();
+    int first_layer = 0;
+    for (int s = 0; s < stage_count; ++s)
+    {
+        stages[s].first_layer = first_layer;
+        stages[s].layer_count = stage_layers[s];
+        stages[s].busy_ns = 0;
+        stages[s].images = 0;
+        first_layer += stage_layers[s];
+    }
+    for (int s = 0; s < stage_count; ++s)
+    {
+        stages[s].thread = std::thread(&PipelinedMlp::stage_loop, this, s);
+#ifdef __linux__
+        if (pin_threads)
+        {
+            const unsigned int hw = std::thread::hardware_concurrency();
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(hw ? s % (int) hw : 0, &cpus);
+            pthread_setaffinity_np(stages[s].thread.native_handle(),
+                                   sizeof(cpus), &cpus);
+        }
+#else
+        (void) pin_threads;
+#endif
+    }
+}
+
+/**
+* Destructor of PipelinedMlp instance - stops and joins the workers.
+* Images still in flight are dropped.
+*/
+PipelinedMlp::~PipelinedMlp()
+{
+    stopping.store(true, std::memory_order_release);
+    for (int s = 0; s < stage_count; ++s)
+    {
+        stages[s].thread.join();
+    }
+    for (int s = 0; s <= stage_count; ++s)
+    {
+        delete queues[s];
+    }
+    delete[] queues;
+    delete[] stages;
+    delete[] results;
+    delete[] offsets;
+}
+
+/**
+* Helper function with the loop of a stage worker.
+* @param s stage index
+*/
+void PipelinedMlp::stage_loop(int s)
+{
+    Stage &stage = stages[s];
+    SpscQueue<int> &input = *queues[s];
+    SpscQueue<int> &output = *queues[s + 1];
+    const int last_layer = network.get_layer_count() - 1;
+    int spins = 0;
+    while (true)
+    {
+        int f;
+        if (!input.try_pop(f))
+        {
+            if (stopping.load(std::memory_order_acquire))
+            {
+                return;
+            }
+            spsc_backoff(spins);
+            continue;
+        }
+        spins = 0;
+        const pipeline_clock::time_point start = pipeline_clock::now();
+        float *frame = frames.row_ptr(f);
+        for (int l = stage.first_layer;
+             l < stage.first_layer + stage.layer_count; ++l)
+        {
+            const Dense &layer = network.get_layer(l);
+            const MatrixView in(frame + offsets[l], layer.get_input_size(), 1,
+                                1, 1);
+            if (l < last_layer)
+            {
+                layer.apply(in, frame + offsets[l + 1]);
+                continue;
+            }
+            // Last layer: fused SOFTMAX + argmax on the logits.
+            float *logits = frame + offsets[l + 1];
+            const int n = layer.get_output_size();
+            layer.apply_logits(in, logits);
+            digit &best_match = results[f];
+            if (layer.get_activation().get_activation_type() == SOFTMAX)
+            {
+                softmax_top_k(logits, n, 1, 1, &best_match.value,
+                              &best_match.probability);
+            }
+            else
+            {
+                top_k_indices(logits, n, 1, 1, &best_match.value);
+                best_match.probability = logits[best_match.value];
+            }
+        }
+        stage.busy_ns.fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        pipeline_clock::now() - start).count(),
+                std::memory_order_relaxed);
+        stage.images.fetch_add(1, std::memory_order_relaxed);
+        output.try_push(f);
+    }
+}
+
+/**
+* Get the number of stages (worker threads).
+* @return Number of stages as int.
+*/
+int PipelinedMlp::get_stage_count() const
+{
+    return stage_count;
+}
+
+/**
+* Feeds an image into the pipeline if fewer than depth images are in
+* flight. Call from one producer thread.
+* @param image input_size elements (any shape, read in row-major order),
+* copied before returning.
+* @return true if the image was submitted, false if the pipeline is full.
+*/
+bool PipelinedMlp::try_submit(const MatrixView &image)
+{
+    const int rows = image.get_rows(), cols = image.get_cols();
+    if (rows * cols != network.get_input_size())
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    int f;
+    if (!free_frames.try_pop(f))
+    {
+        return false;
+    }
+    float *dst = frames.row_ptr(f);
+    const float *src = image.data();
+    const int row_stride = image.get_row_stride();
+    const int col_stride = image.get_col_stride();
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            dst[i * cols + j] = src[i * row_stride + j * col_stride];
+        }
+    }
+    queues[0]->try_push(f);
+    return true;
+}
+
+/**
+* Feeds an image into the pipeline, waiting while it is full. A full
+* pipeline only drains through receive(), so a caller that both submits
+* and receives must not have depth images pending.
+* @param image input_size elements (any shape, read in row-major order),
+* copied before returning.
+*/
+void PipelinedMlp::submit(const MatrixView &image)
+{
+    int spins = 0;
+    while (!try_submit(image))
+    {
+        spsc_backoff(spins);
+    }
+}
+
+/**
+* Takes the next result if it is ready. Call from one consumer thread.
+* @param result receives the prediction
+* @return true if a result was taken, false if none is ready yet.
+*/
+bool PipelinedMlp::try_receive(digit &result)
+{
+    int f;
+    if (!queues[stage_count]->try_pop(f))
+    {
+        return false;
+    }
+    result = results[f];
+    free_frames.try_push(f);
+    return true;
+}
+
+/**
+* Waits for the next result. Results come in submission order.
+* @return The prediction of the oldest image in flight.
+*/
+digit PipelinedMlp::receive()
+{
+    digit result;
+    int spins = 0;
+    while (!try_receive(result))
+    {
+        spsc_backoff(spins);
+    }
+    return result;
+}
+
+/**
+* Streams a batch through the pipeline, keeping it full.
+* @param images Matrix (or view), one vectorized image per column.
+* @param results Array of at least N digits, results[j] receives the
+* prediction for column j.
+*/
+void PipelinedMlp::predict_stream(const MatrixView &images, digit *results)
+{
+    const int input_size = network.get_input_size();
+    if (images.get_rows() != input_size)
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    const int n = images.get_cols();
+    int submitted = 0, received = 0, spins = 0;
+    while (received < n)
+    {
+        bool progress = false;
+        while (submitted < n &&
+               try_submit(MatrixView(images.data() +
+                                     (size_t) submitted *
+                                     images.get_col_stride(),
+                                     input_size, 1, images.get_row_stride(),
+                                     1)))
+        {
+            ++submitted;
+            progress = true;
+        }
+        while (received < n && try_receive(results[received]))
+        {
+            ++received;
+            progress = true;
+        }
+        if (progress)
+        {
+            spins = 0;
+        }
+        else
+        {
+            spsc_backoff(spins);
+        }
+    }
+}
+
+/**
+* Getter of the activity of a stage.
+* @param s stage index, in [0, get_stage_count())
+* @return The stage's counters.
+*/
+stage_stats PipelinedMlp::get_stage_stats(int s) const
+{
+    if (s < 0 || s >= stage_count)
+    {
+        exit_func(PIPELINE_STAGES_ERR);
+    }
+    stage_stats stats;
+    stats.first_layer = stages[s].first_layer;
+    stats.layer_count = stages[s].layer_count;
+    stats.images = stages[s].images.load(std::memory_order_relaxed);
+    stats.busy_seconds =
+            (double) stages[s].busy_ns.load(std::memory_order_relaxed) * 1e-9;
+    const double wall = std::chrono::duration<double>(
+            pipeline_clock::now() - stats_start).count();
+    stats.utilization = wall > 0 ? stats.busy_seconds / wall : 0;
+    if (stats.utilization > 1)
+    {
+        stats.utilization = 1;
+    }
+    return stats;
+}
+
+/**
+* Clears the counters of all stages and restarts the wall clock.
+*/
+void PipelinedMlp::reset_stats()
+{
+    for (int s = 0; s < stage_count; ++s)
+    {
+        stages[s].busy_ns.store(0, std::memory_order_relaxed);
+        stages[s].images.store(0, std::memory_order_relaxed);
+    }
+    stats_start = pipeline_clock::now();
+}
+
+/**
+* Prints one line per stage: its layers, images and utilization.
+* @param os output stream
+*/
+void PipelinedMlp::print_stats(std::ostream &os) const
+{
+    const std::ios::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    for (int s = 0; s < stage_count; ++s)
+    {
+        const stage_stats stats = get_stage_stats(s);
+        os << "stage " << s << " (layers " << stats.first_layer << "-"
+           << stats.first_layer + stats.layer_count - 1 << "): "
+           << stats.images << " images, busy " << std::fixed
+           << std::setprecision(3) << stats.busy_seconds << "s, utilization "
+           << std::setprecision(1) << stats.utilization * 100 << "%" << endl;
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
@@ -0,0 +1,189 @@
+// PipelinedMlp.h
+
+#ifndef PIPELINEDMLP_H
+#define PIPELINEDMLP_H
+
+#include <chrono>
+#include <ostream>
+#include "MlpNetwork.h"
+#include "SpscQueue.h"
+
+#define DEFAULT_PIPELINE_DEPTH 16
+#define PIPELINE_STAGES_ERR "Error: Pipeline stages must cover every layer "\
+"in order!\n"
+#define PIPELINE_DEPTH_ERR "Error: Pipeline depth must be positive!\n"
+
+/**
+ * @struct stage_stats
+ * @brief Activity of one pipeline stage since construction or the last
+ * reset_stats().
+ * @var first_layer - index of the first layer of the stage
+ * @var layer_count - number of consecutive layers the stage runs
+ * @var images - images the stage has processed
+ * @var busy_seconds - time spent computing (not waiting for input)
+ * @var utilization - busy_seconds over the elapsed wall time, in [0, 1]
+ */
+typedef struct stage_stats
+{
+    int first_layer;
+    int layer_count;
+    long long images;
+    double busy_seconds;
+    double utilization;
+} stage_stats;
+
+/**
+   * PipelinedMlp Class - low latency streaming inference over one shared
+   * MlpNetwork. The layers are split into stages of consecutive layers and
+   * every stage runs on its own worker thread, so while image k is in layer
+   * 2, image k + 1 is already in layer 1. Images travel between the stages
+   * as frames (per-image activation buffers) through bounded lock-free
+   * SpscQueues; the caller submits images and receives results in
+   * submission order. A waiting worker spins briefly and then yields.
+   * Per-stage utilization shows which stage bounds the throughput, so the
+   * split can be rebalanced.
+   */
+class PipelinedMlp
+{
+private:
+    /**
+     * One stage: its layers, worker thread and counters.
+     */
+    struct Stage
+    {
+        int first_layer;
+        int layer_count;
+        std::thread thread;
+        std::atomic<long long> busy_ns;
+        std::atomic<long long> images;
+    };
+
+    typedef std::chrono::steady_clock pipeline_clock;
+
+    const MlpNetwork &network;
+    int stage_count;
+    int depth;
+    Stage *stages;
+    int *offsets; // start of each layer's input inside a frame
+    int frame_stride;
+    Matrix frames; // depth x frame_stride activations
+    digit *results; // result of each frame
+    // queues[s] feeds stage s, queues[stage_count] holds finished frames,
+    // free_frames returns them to the producer.
+    SpscQueue<int> **queues;
+    SpscQueue<int> free_frames;
+    std::atomic<bool> stopping;
+    pipeline_clock::time_point stats_start;
+
+    /**
+    * Helper function that checks the stages and starts the workers.
+    * @param stage_layers Number of layers of each stage.
+    * @param pin_threads Pin stage s to CPU s (modulo the CPU count).
+    */
+    void init(const int *stage_layers, bool pin_threads);
+
+    /**
+    * Helper function with the loop of a stage worker.
+    * @param s stage index
+    */
+    void stage_loop(int s);
+
+public:
+    /**
+    * Constructor for PipelinedMlp instance with one stage per layer.
+    * @param network The network to run - must outlive this instance.
+    * @param depth Maximal number of images in flight.
+    * @param pin_threads Pin stage s to CPU s (Linux only).
+    */
+    explicit PipelinedMlp(const MlpNetwork &network,
+                          int depth = DEFAULT_PIPELINE_DEPTH,
+                          bool pin_threads = false);
+
+    /**
+    * Constructor for PipelinedMlp instance with a given split, e.g.
+    * {1, 3} runs layer 0 on one worker and the other three on another.
+    * @param network The network to run - must outlive this instance.
+    * @param stage_layers Number of layers of each stage (positive, summing
+    * to the layer count).
+    * @param stage_count Number of stages.
+    * @param depth Maximal number of images in flight.
+    * @param pin_threads Pin stage s to CPU s (Linux only).
+    */
+    PipelinedMlp(const MlpNetwork &network, const int *stage_layers,
+                 int stage_count, int depth = DEFAULT_PIPELINE_DEPTH,
+                 bool pin_threads = false);
+
+    /**
+    * Destructor of PipelinedMlp instance - stops and joins the workers.
+    * Images still in flight are dropped.
+    */
+    ~PipelinedMlp();
+
+    PipelinedMlp(const PipelinedMlp &) = delete;
+    PipelinedMlp &operator=(const PipelinedMlp &) = delete;
+
+    /**
+    * Get the number of stages (worker threads).
+    * @return Number of stages as int.
+    */
+    int get_stage_count() const;
+
+    /**
+    * Feeds an image into the pipeline if fewer than depth images are in
+    * flight. Call from one producer thread.
+    * @param image input_size elements (any shape, read in row-major order),
+    * copied before returning.
+    * @return true if the image was submitted, false if the pipeline is full.
+    */
+    bool try_submit(const MatrixView &image);
+
+    /**
+    * Feeds an image into the pipeline, waiting while it is full. A full
+    * pipeline only drains through receive(), so a caller that both submits
+    * and receives must not have depth images pending.
+    * @param image input_size elements (any shape, read in row-major order),
+    * copied before returning.
+    */
+    void submit(const MatrixView &image);
+
+    /**
+    * Takes the next result if it is ready. Call from one consumer thread.
+    * @param result receives the prediction
+    * @return true if a result was taken, false if none is ready yet.
+    */
+    bool try_receive(digit &result);
+
+    /**
+    * Waits for the next result. Results come in submission order.
+    * @return The prediction of the oldest image in flight.
+    */
+    digit receive();
+
+    /**
+    * Streams a batch through the pipeline, keeping it full.
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param results Array of at least N digits, results[j] receives the
+    * prediction for column j.
+    */
+    void predict_stream(const MatrixView &images, digit *results);
+
+    /**
+    * Getter of the activity of a stage.
+    * @param s stage index, in [0, get_stage_count())
+    * @return The stage's counters.
+    */
+    stage_stats get_stage_stats(int s) const;
+
+    /**
+    * Clears the counters of all stages and restarts the wall clock.
+    */
+    void reset_stats();
+
+    /**
+    * Prints one line per stage: its layers, images and utilization.
+    * @param os output stream
+    */
+    void print_stats(std::ostream &os) const;
+};
+
+#endif //PIPELINEDMLP_H
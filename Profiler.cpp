@@ -0,0 +1,450 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include "AllocCounter.h"
+#include "Profiler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Resolved only when AllocCounter.cpp is linked in.
+size_t thread_alloc_count() __attribute__((weak));
+
+#define PROFILE_SLOTS ((PROFILE_MAX_LAYERS + 1) * PROFILE_PHASE_COUNT + 1)
+#define INFERENCE_SLOT (PROFILE_SLOTS - 1)
+#define PHASE_NAMES {"layer", "gemm", "activation"}
+
+/**
+ * Counters of one (layer, phase) on one thread. Only the owning thread
+ * writes them; relaxed atomics let snapshots read them at any time.
+ */
+struct ThreadCounter
+{
+    std::atomic<long long> calls, items, total_ns, total_cycles, flops,
+            bytes, allocations;
+    std::atomic<long long> histogram[PROFILE_BUCKETS];
+};
+
+/**
+ * All counters of one thread, linked into the registry. They stay there
+ * after the thread exits, so its samples are kept.
+ */
+struct ThreadProfile
+{
+    ThreadCounter slots[PROFILE_SLOTS];
+    ThreadProfile *next;
+};
+
+/**
+* Helper function that reads the MLP_PROFILE environment variable.
+* @return true if it is set to anything but "0".
+*/
+static bool profile_env_enabled()
+{
+    const char *value = std::getenv(PROFILE_ENV);
+    return value != nullptr && *value != '\0' && std::strcmp(value, "0") != 0;
+}
+
+std::atomic<bool> profiler_active(profile_env_enabled());
+
+static std::mutex registry_mutex;
+static ThreadProfile *registry = nullptr;
+#ifndef MLP_NO_PROFILE
+static thread_local ThreadProfile *thread_profile = nullptr;
+#endif
+static thread_local int current_layer = PROFILE_NO_LAYER;
+
+/**
+* Helper function that adds to a counter owned by the calling thread
+* (a plain load and store - no other thread writes it).
+* @param counter the counter
+* @param value amount to add
+*/
+static inline void bump(std::atomic<long long> &counter, long long value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+}
+
+/**
+* Helper function that clears the counters of one thread.
+* @param profile the thread's counters
+*/
+static void clear_profile(ThreadProfile &profile)
+{
+    for (int s = 0; s < PROFILE_SLOTS; ++s)
+    {
+        ThreadCounter &counter = profile.slots[s];
+        counter.calls.store(0, std::memory_order_relaxed);
+        counter.items.store(0, std::memory_order_relaxed);
+        counter.total_ns.store(0, std::memory_order_relaxed);
+        counter.total_cycles.store(0, std::memory_order_relaxed);
+        counter.flops.store(0, std::memory_order_relaxed);
+        counter.bytes.store(0, std::memory_order_relaxed);
+        counter.allocations.store(0, std::memory_order_relaxed);
+        for (int b = 0; b < PROFILE_BUCKETS; ++b)
+        {
+            counter.histogram[b].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+#ifndef MLP_NO_PROFILE
+/**
+* Helper function that returns the calling thread's counters, registering
+* them on first use.
+* @return The counters.
+*/
+static ThreadProfile &local_profile()
+{
+    if (thread_profile == nullptr)
+    {
+        ThreadProfile *profile = new ThreadProfile;
+        clear_profile(*profile);
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        profile->next = registry;
+        registry = profile;
+        thread_profile = profile;
+    }
+    return *thread_profile;
+}
+#endif
+
+/**
+* Helper function with the monotonic clock in ns.
+* @return Current time.
+*/
+static inline long long now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* Helper function with the CPU timestamp counter.
+* @return Current cycle count, 0 where unavailable.
+*/
+static inline long long now_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (long long) __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+* Helper function with the calling thread's allocation count.
+* @return Allocations so far, 0 without AllocCounter.
+*/
+static inline long long now_allocations()
+{
+    return thread_alloc_count != nullptr ? (long long) thread_alloc_count() :
+           0;
+}
+
+/**
+ * Turns recording on or off (for all threads).
+ * @param enabled true to record
+ */
+void profiler_enable(bool enabled)
+{
+    profiler_active.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * Clears the counters of all threads. Samples recorded concurrently may
+ * survive the reset.
+ */
+void profiler_reset()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (ThreadProfile *profile = registry; profile != nullptr;
+         profile = profile->next)
+    {
+        clear_profile(*profile);
+    }
+}
+
+/**
+ * Layer of the network running on this thread, set by a PROFILE_LAYER
+ * ProfileScope so the phases inside the layer are attributed to it.
+ * @return The layer index, or PROFILE_NO_LAYER.
+ */
+int profile_current_layer()
+{
+    return current_layer;
+}
+
+#ifndef MLP_NO_PROFILE
+/**
+* Helper function that starts the timers (recording is on).
+*/
+void ProfileScope::begin()
+{
+    if (phase == PROFILE_LAYER)
+    {
+        outer_layer = current_layer;
+        current_layer = layer;
+    }
+    local_profile(); // registers the thread before allocations are read
+    start_allocations = now_allocations();
+    start_cycles = now_cycles();
+    start_ns = now_ns();
+}
+
+/**
+* Helper function that records the sample.
+*/
+void ProfileScope::end()
+{
+    const long long ns = now_ns() - start_ns;
+    const long long cycles = now_cycles() - start_cycles;
+    const long long allocations = now_allocations() - start_allocations;
+    if (phase == PROFILE_LAYER)
+    {
+        current_layer = outer_layer;
+    }
+    int slot = INFERENCE_SLOT;
+    if (phase != PROFILE_PHASE_COUNT)
+    {
+        const int l = layer >= 0 && layer < PROFILE_MAX_LAYERS ?
+                      layer : PROFILE_MAX_LAYERS;
+        slot = l * PROFILE_PHASE_COUNT + phase;
+    }
+    ThreadCounter &counter = local_profile().slots[slot];
+    bump(counter.calls, 1);
+    bump(counter.items, items);
+    bump(counter.total_ns, ns);
+    bump(counter.total_cycles, cycles);
+    bump(counter.flops, flops);
+    bump(counter.bytes, bytes);
+    bump(counter.allocations, allocations);
+    int bucket = 0;
+    while (bucket < PROFILE_BUCKETS - 1 && (ns >> bucket) != 0)
+    {
+        ++bucket;
+    }
+    bump(counter.histogram[bucket], 1);
+}
+#endif
+
+/**
+* Helper function that adds one thread's counter to a total.
+* @param total the total
+* @param counter one thread's counter
+*/
+static void accumulate(profile_counter &total, const ThreadCounter &counter)
+{
+    total.calls += counter.calls.load(std::memory_order_relaxed);
+    total.items += counter.items.load(std::memory_order_relaxed);
+    total.total_ns += counter.total_ns.load(std::memory_order_relaxed);
+    total.total_cycles += counter.total_cycles.load(std::memory_order_relaxed);
+    total.flops += counter.flops.load(std::memory_order_relaxed);
+    total.bytes += counter.bytes.load(std::memory_order_relaxed);
+    total.allocations += counter.allocations.load(std::memory_order_relaxed);
+    for (int b = 0; b < PROFILE_BUCKETS; ++b)
+    {
+        total.histogram[b] +=
+                counter.histogram[b].load(std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Sums the counters of all threads.
+ * @return The report.
+ */
+profile_report profiler_snapshot()
+{
+    profile_report report;
+    std::memset(&report, 0, sizeof(report));
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (ThreadProfile *profile = registry; profile != nullptr;
+         profile = profile->next)
+    {
+        for (int l = 0; l <= PROFILE_MAX_LAYERS; ++l)
+        {
+            profile_counter *phases = l < PROFILE_MAX_LAYERS ?
+                                      report.layers[l] : report.standalone;
+            for (int p = 0; p < PROFILE_PHASE_COUNT; ++p)
+            {
+                accumulate(phases[p],
+                           profile->slots[l * PROFILE_PHASE_COUNT + p]);
+            }
+        }
+        accumulate(report.inference, profile->slots[INFERENCE_SLOT]);
+    }
+    // Layer and inference scopes count the work of the phases inside them.
+    for (int l = 0; l < PROFILE_MAX_LAYERS; ++l)
+    {
+        profile_counter *phases = report.layers[l];
+        for (int p = PROFILE_LAYER + 1; p < PROFILE_PHASE_COUNT; ++p)
+        {
+            phases[PROFILE_LAYER].flops += phases[p].flops;
+            phases[PROFILE_LAYER].bytes += phases[p].bytes;
+            report.inference.flops += phases[p].flops;
+            report.inference.bytes += phases[p].bytes;
+        }
+        for (int p = 0; p < PROFILE_PHASE_COUNT; ++p)
+        {
+            if (phases[p].calls > 0)
+            {
+                report.layer_count = l + 1;
+            }
+        }
+    }
+    return report;
+}
+
+/**
+ * Estimates a latency percentile from a histogram (the upper bound of the
+ * bucket, so within a factor of 2).
+ * @param counter counter to read
+ * @param p percentile in [0, 1]
+ * @return The latency in ns, 0 without samples.
+ */
+double profile_percentile(const profile_counter &counter, double p)
+{
+    if (counter.calls <= 0)
+    {
+        return 0;
+    }
+    const double target = p * (double) counter.calls;
+    long long seen = 0;
+    for (int b = 0; b < PROFILE_BUCKETS; ++b)
+    {
+        seen += counter.histogram[b];
+        if ((double) seen >= target && seen > 0)
+        {
+            return (double) (1LL << b);
+        }
+    }
+    return (double) (1LL << (PROFILE_BUCKETS - 1));
+}
+
+/**
+* Helper function that prints one row of the table.
+* @param os output stream
+* @param name row label
+* @param counter the counter
+*/
+static void print_row(std::ostream &os, const std::string &name,
+                      const profile_counter &counter)
+{
+    if (counter.calls == 0)
+    {
+        return;
+    }
+    const double calls = (double) counter.calls;
+    const double seconds = (double) counter.total_ns * 1e-9;
+    os << std::left << std::setw(18) << name << std::right
+       << std::setw(10) << counter.calls << std::setw(10) << counter.items
+       << std::setw(11) << (double) counter.total_ns / calls * 1e-3
+       << std::setw(11) << profile_percentile(counter, 0.5) * 1e-3
+       << std::setw(11) << profile_percentile(counter, 0.99) * 1e-3
+       << std::setw(12) << (double) counter.total_cycles / calls
+       << std::setw(9) << (seconds > 0 ? counter.flops / seconds * 1e-9 : 0)
+       << std::setw(9) << (seconds > 0 ? counter.bytes / seconds * 1e-9 : 0)
+       << std::setw(9) << (double) counter.allocations / calls << std::endl;
+}
+
+/**
+ * Prints a report as a table: one line per layer and phase with calls,
+ * mean/p50/p99 time, cycles, GFLOP/s, GB/s and allocations per call.
+ * @param os output stream
+ * @param report the report
+ */
+void print_profile(std::ostream &os, const profile_report &report)
+{
+    static const char *const phase_names[] = PHASE_NAMES;
+    const std::ios::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << std::left << std::setw(18) << "scope" << std::right
+       << std::setw(10) << "calls" << std::setw(10) << "images"
+       << std::setw(11) << "mean_us" << std::setw(11) << "p50_us"
+       << std::setw(11) << "p99_us" << std::setw(12) << "cycles"
+       << std::setw(9) << "GFLOP/s" << std::setw(9) << "GB/s"
+       << std::setw(9) << "allocs" << std::endl;
+    os << std::fixed << std::setprecision(2);
+    print_row(os, "inference", report.inference);
+    for (int l = 0; l < report.layer_count; ++l)
+    {
+        for (int p = 0; p < PROFILE_PHASE_COUNT; ++p)
+        {
+            print_row(os, p == PROFILE_LAYER ?
+                          "layer " + std::to_string(l) :
+                          std::string("  ") + phase_names[p],
+                      report.layers[l][p]);
+        }
+    }
+    for (int p = 0; p < PROFILE_PHASE_COUNT; ++p)
+    {
+        print_row(os, std::string("dense ") + phase_names[p],
+                  report.standalone[p]);
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+/**
+* Helper function that prints a counter as a JSON object.
+* @param os output stream
+* @param counter the counter
+*/
+static void print_counter_json(std::ostream &os,
+                               const profile_counter &counter)
+{
+    os << "{\"calls\": " << counter.calls << ", \"images\": " << counter.items
+       << ", \"total_ns\": " << counter.total_ns
+       << ", \"total_cycles\": " << counter.total_cycles
+       << ", \"flops\": " << counter.flops << ", \"bytes\": " << counter.bytes
+       << ", \"allocations\": " << counter.allocations
+       << ", \"p50_ns\": " << profile_percentile(counter, 0.5)
+       << ", \"p99_ns\": " << profile_percentile(counter, 0.99)
+       << ", \"histogram\": [";
+    for (int b = 0; b < PROFILE_BUCKETS; ++b)
+    {
+        os << (b ? ", " : "") << counter.histogram[b];
+    }
+    os << "]}";
+}
+
+/**
+* Helper function that prints the phases of one layer as JSON members.
+* @param os output stream
+* @param phases PROFILE_PHASE_COUNT counters
+*/
+static void print_phases_json(std::ostream &os, const profile_counter *phases)
+{
+    static const char *const phase_names[] = PHASE_NAMES;
+    for (int p = 0; p < PROFILE_PHASE_COUNT; ++p)
+    {
+        os << (p ? ", " : "") << "\"" << phase_names[p] << "\": ";
+        print_counter_json(os, phases[p]);
+    }
+}
+
+/**
+ * Prints a report as a JSON object.
+ * @param os output stream
+ * @param report the report
+ */
+void print_profile_json(std::ostream &os, const profile_report &report)
+{
+    os << "{\"inference\": ";
+    print_counter_json(os, report.inference);
+    os << ",\n \"layers\": [";
+    for (int l = 0; l < report.layer_count; ++l)
+    {
+        os << (l ? ",\n  " : "\n  ") << "{\"layer\": " << l << ", ";
+        print_phases_json(os, report.layers[l]);
+        os << "}";
+    }
+    os << "],\n \"standalone\": {";
+    print_phases_json(os, report.standalone);
+    os << "}}" << std::endl;
+}
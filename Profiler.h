@@ -0,0 +1,229 @@
+// Profiler.h
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <ostream>
+
+/**
+ * Inference instrumentation. MlpNetwork and Dense time every layer and its
+ * phases (ns and CPU cycles) and count FLOPs, bytes touched and heap
+ * allocations. Samples go to per-thread counters and log2 latency
+ * histograms that only their own thread writes, so recording takes no lock
+ * and no atomic read-modify-write; profiler_snapshot() sums all threads.
+ * Recording is off until profiler_enable(true) or the MLP_PROFILE
+ * environment variable is set (then a disabled probe costs one load and a
+ * branch). Define MLP_NO_PROFILE to compile the probes out.
+ * Allocations are counted only in programs that link AllocCounter.cpp.
+ */
+
+#define PROFILE_MAX_LAYERS 16
+#define PROFILE_BUCKETS 32 // bucket b holds samples below 2^b ns
+#define PROFILE_NO_LAYER (-1)
+#define PROFILE_ENV "MLP_PROFILE"
+#define PROFILE_SOFTMAX_FLOPS 4 // per element: max, exp, sum, scale
+
+/**
+ * @enum ProfilePhase
+ * @brief What a sample measured.
+ */
+enum ProfilePhase
+{
+    PROFILE_LAYER, // a whole Dense layer
+    PROFILE_GEMM, // weights * input with the fused bias-add and RELU
+    PROFILE_ACTIVATION, // separate activation pass (SOFTMAX, output top-k)
+    PROFILE_PHASE_COUNT
+};
+
+/**
+ * @struct profile_counter
+ * @brief Totals of one (layer, phase) or of whole inferences.
+ * @var calls - number of samples
+ * @var items - images processed by them
+ * @var total_ns - wall time
+ * @var total_cycles - CPU timestamp cycles (0 where unavailable)
+ * @var flops - floating point operations
+ * @var bytes - bytes of weights, inputs and outputs touched
+ * @var allocations - heap allocations made during the samples
+ * @var histogram - histogram[b] samples took less than 2^b ns (and at
+ * least 2^(b-1))
+ */
+typedef struct profile_counter
+{
+    long long calls;
+    long long items;
+    long long total_ns;
+    long long total_cycles;
+    long long flops;
+    long long bytes;
+    long long allocations;
+    long long histogram[PROFILE_BUCKETS];
+} profile_counter;
+
+/**
+ * @struct profile_report
+ * @brief Snapshot of all threads' counters.
+ * @var inference - whole network calls (items = images)
+ * @var layers - layers[l][phase] for layers 0..layer_count-1
+ * @var standalone - Dense layers run outside an MlpNetwork, per phase
+ * @var layer_count - number of layers with samples
+ */
+typedef struct profile_report
+{
+    profile_counter inference;
+    profile_counter layers[PROFILE_MAX_LAYERS][PROFILE_PHASE_COUNT];
+    profile_counter standalone[PROFILE_PHASE_COUNT];
+    int layer_count;
+} profile_report;
+
+extern std::atomic<bool> profiler_active;
+
+/**
+ * Turns recording on or off (for all threads).
+ * @param enabled true to record
+ */
+void profiler_enable(bool enabled);
+
+/**
+ * Tells whether probes record.
+ * @return true if recording.
+ */
+inline bool profiler_enabled()
+{
+#ifdef MLP_NO_PROFILE
+    return false;
+#else
+    return profiler_active.load(std::memory_order_relaxed);
+#endif
+}
+
+/**
+ * Clears the counters of all threads. Samples recorded concurrently may
+ * survive the reset.
+ */
+void profiler_reset();
+
+/**
+ * Sums the counters of all threads.
+ * @return The report.
+ */
+profile_report profiler_snapshot();
+
+/**
+ * Estimates a latency percentile from a histogram (the upper bound of the
+ * bucket, so within a factor of 2).
+ * @param counter counter to read
+ * @param p percentile in [0, 1]
+ * @return The latency in ns, 0 without samples.
+ */
+double profile_percentile(const profile_counter &counter, double p);
+
+/**
+ * Prints a report as a table: one line per layer and phase with calls,
+ * mean/p50/p99 time, cycles, GFLOP/s, GB/s and allocations per call.
+ * @param os output stream
+ * @param report the report
+ */
+void print_profile(std::ostream &os, const profile_report &report);
+
+/**
+ * Prints a report as a JSON object.
+ * @param os output stream
+ * @param report the report
+ */
+void print_profile_json(std::ostream &os, const profile_report &report);
+
+/**
+ * Layer of the network running on this thread, set by a PROFILE_LAYER
+ * ProfileScope so the phases inside the layer are attributed to it.
+ * @return The layer index, or PROFILE_NO_LAYER.
+ */
+int profile_current_layer();
+
+/**
+   * ProfileScope Class - times the enclosing scope and records it as one
+   * sample of (layer, phase). Does nothing when recording is off. A
+   * PROFILE_LAYER scope also makes its layer the current one until it ends.
+   */
+class ProfileScope
+{
+#ifndef MLP_NO_PROFILE
+private:
+    bool active;
+    ProfilePhase phase;
+    int layer;
+    int outer_layer;
+    long long items, flops, bytes;
+    long long start_ns, start_cycles, start_allocations;
+
+    /**
+    * Helper function that starts the timers (recording is on).
+    */
+    void begin();
+
+    /**
+    * Helper function that records the sample.
+    */
+    void end();
+
+public:
+    /**
+    * Constructor for ProfileScope instance - starts timing.
+    * @param phase what is measured
+    * @param layer layer index, or PROFILE_NO_LAYER
+    * @param items images processed
+    * @param flops floating point operations of the scope
+    * @param bytes bytes touched by the scope
+    */
+    ProfileScope(ProfilePhase phase, int layer, long long items,
+                 long long flops, long long bytes)
+            : active(profiler_enabled()), phase(phase), layer(layer),
+              outer_layer(PROFILE_NO_LAYER), items(items), flops(flops),
+              bytes(bytes), start_ns(0), start_cycles(0),
+              start_allocations(0)
+    {
+        if (active)
+        {
+            begin();
+        }
+    }
+
+    /**
+    * Destructor of ProfileScope instance - records the sample.
+    */
+    ~ProfileScope()
+    {
+        if (active)
+        {
+            end();
+        }
+    }
+#else
+public:
+    ProfileScope(ProfilePhase, int, long long, long long, long long)
+    {}
+#endif
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+/**
+   * ProfileInference Class - times a whole network call (all layers and
+   * the output selection) and records it in profile_report::inference.
+   */
+class ProfileInference : public ProfileScope
+{
+public:
+    /**
+    * Constructor for ProfileInference instance - starts timing.
+    * @param images images processed by the call
+    */
+    explicit ProfileInference(long long images)
+            : ProfileScope(PROFILE_PHASE_COUNT, PROFILE_NO_LAYER, images, 0,
+                           0)
+    {}
+};
+
+#endif //PROFILER_H
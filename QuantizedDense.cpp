@@ -0,0 +1,224 @@
+#include <cmath>
+#include <iostream>
+#include "QuantizedDense.h"
+#include "Simd.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that rounds and clamps a scaled value to int8.
+* @param v value already divided by its scale
+* @return v rounded to the nearest integer in [-QUANT_MAX, QUANT_MAX].
+*/
+static int8_t quantize(float v)
+{
+    float r = std::nearbyint(v);
+    if (r > QUANT_MAX)
+    {
+        r = QUANT_MAX;
+    }
+    else if (r < -QUANT_MAX)
+    {
+        r = -QUANT_MAX;
+    }
+    return (int8_t) r;
+}
+
+/**
+* Portable int8 dot product with int32 accumulation.
+*/
+static int32_t dot_scalar(const int8_t *a, const int8_t *b, int len)
+{
+    int32_t sum = 0;
+    for (int p = 0; p < len; ++p)
+    {
+        sum += (int32_t) a[p] * b[p];
+    }
+    return sum;
+}
+
+#ifdef MLP_HAVE_AVX2
+
+/**
+* AVX2 int8 dot product: 16 bytes per step are widened to int16 and
+* multiplied pairwise into int32 lanes (vpmaddwd), which cannot saturate.
+*/
+MLP_AVX2_TARGET
+static int32_t dot_avx2(const int8_t *a, const int8_t *b, int len)
+{
+    __m256i acc = _mm256_setzero_si256();
+    int p = 0;
+    for (; p + 16 <= len; p += 16)
+    {
+        const __m256i a16 = _mm256_cvtepi8_epi16(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + p)));
+        const __m256i b16 = _mm256_cvtepi8_epi16(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + p)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a16, b16));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                                _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    int32_t total = _mm_cvtsi128_si32(sum);
+    for (; p < len; ++p)
+    {
+        total += (int32_t) a[p] * b[p];
+    }
+    return total;
+}
+
+#endif // MLP_HAVE_AVX2
+
+/**
+* Helper function that dispatches to the fastest int8 dot product.
+*/
+static int32_t dot_int8(const int8_t *a, const int8_t *b, int len)
+{
+#ifdef MLP_HAVE_AVX2
+    if (cpu_has_avx2())
+    {
+        return dot_avx2(a, b, len);
+    }
+#endif
+    return dot_scalar(a, b, len);
+}
+
+/**
+ * Constructor for QuantizedDense instance - quantizes a float layer.
+ * @param layer The float layer.
+ * @param input_range Largest absolute input value expected.
+ */
+QuantizedDense::QuantizedDense(const Dense &layer, float input_range)
+        : rows(layer.get_output_size()), cols(0), weights(nullptr),
+          row_scales(nullptr), bias(nullptr),
+          input_scale(input_range > 0 ? input_range / QUANT_MAX : 1),
+          act(layer.get_activation())
+{
+    const Matrix w = layer.get_weights();
+    const Matrix b = layer.get_bias();
+    cols = w.get_cols();
+    weights = new(std::nothrow) int8_t[(size_t) rows * cols];
+    row_scales = new(std::nothrow) float[rows];
+    bias = new(std::nothrow) float[rows];
+    if (!weights || !row_scales || !bias)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    for (int i = 0; i < rows; ++i)
+    {
+        const float *w_row = w.row_ptr(i);
+        float max_abs = 0;
+        for (int j = 0; j < cols; ++j)
+        {
+            max_abs = std::fmax(max_abs, std::fabs(w_row[j]));
+        }
+        row_scales[i] = max_abs > 0 ? max_abs / QUANT_MAX : 1;
+        for (int j = 0; j < cols; ++j)
+        {
+            weights[(size_t) i * cols + j] = quantize(w_row[j] /
+                                                      row_scales[i]);
+        }
+        bias[i] = b[i];
+    }
+}
+
+/**
+ * Destructor of QuantizedDense instance.
+ */
+QuantizedDense::~QuantizedDense()
+{
+    delete[] weights;
+    delete[] row_scales;
+    delete[] bias;
+}
+
+/**
+* Get the number of inputs of this layer.
+* @return Number of columns of the weights.
+*/
+int QuantizedDense::get_input_size() const
+{
+    return cols;
+}
+
+/**
+* Get the number of outputs (neurons) of this layer.
+* @return Number of rows of the weights.
+*/
+int QuantizedDense::get_output_size() const
+{
+    return rows;
+}
+
+/**
+* Get the memory taken by the quantized weights and their scales.
+* @return Size in bytes.
+*/
+size_t QuantizedDense::get_weight_bytes() const
+{
+    return (size_t) rows * cols + rows * sizeof(float);
+}
+
+/**
+* Applies the layer on a batch.
+* @param input input matrix (or view), one sample per column
+* @param output buffer receiving the rows x N float result (row-major)
+* @param scratch buffer of at least get_input_size() * N bytes
+*/
+void QuantizedDense::apply(const MatrixView &input, float *output,
+                           int8_t *scratch) const
+{
+    if (input.get_rows() != cols)
+    {
+        exit_func(QUANT_INPUT_ERR);
+    }
+    const int n = input.get_cols();
+    const float inv_scale = 1 / input_scale;
+    // Quantize sample-major, so every dot product reads unit stride.
+    for (int j = 0; j < n; ++j)
+    {
+        const float *src = input.data() + (long) j * input.get_col_stride();
+        int8_t *dst = scratch + (size_t) j * cols;
+        for (int p = 0; p < cols; ++p)
+        {
+            dst[p] = quantize(src[(long) p * input.get_row_stride()] *
+                              inv_scale);
+        }
+    }
+    const bool relu = act.get_activation_type() == RELU;
+    for (int i = 0; i < rows; ++i)
+    {
+        const int8_t *w_row = weights + (size_t) i * cols;
+        const float scale = row_scales[i] * input_scale;
+        float *out_row = output + (size_t) i * n;
+        for (int j = 0; j < n; ++j)
+        {
+            float v = (float) dot_int8(w_row, scratch + (size_t) j * cols,
+                                       cols) * scale + bias[i];
+            if (relu && v < 0)
+            {
+                v = 0;
+            }
+            out_row[j] = v;
+        }
+    }
+    if (!relu)
+    {
+        act.apply_in_place(output, rows, n);
+    }
+}
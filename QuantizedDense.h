@@ -0,0 +1,77 @@
+// QuantizedDense.h
+
+#ifndef QUANTIZEDDENSE_H
+#define QUANTIZEDDENSE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "Dense.h"
+
+#define QUANT_MAX 127
+#define QUANT_INPUT_ERR "Error: Quantized layer input size does not fit!\n"
+
+/**
+     * QuantizedDense Class - an int8 version of a Dense layer. The weights
+     * are quantized symmetrically with one scale per output row, the layer
+     * input with a single scale calibrated from sample data. Products are
+     * accumulated in int32 and dequantized before the float bias-add and
+     * activation.
+     */
+class QuantizedDense
+{
+private:
+    int rows, cols;
+    int8_t *weights;
+    float *row_scales;
+    float *bias;
+    float input_scale;
+    const Activation act;
+
+public:
+    /**
+     * Constructor for QuantizedDense instance - quantizes a float layer.
+     * @param layer The float layer.
+     * @param input_range Largest absolute input value expected (from
+     * calibration); larger inputs are clamped.
+     */
+    QuantizedDense(const Dense &layer, float input_range);
+
+    /**
+     * Destructor of QuantizedDense instance.
+     */
+    ~QuantizedDense();
+
+    QuantizedDense(const QuantizedDense &) = delete;
+    QuantizedDense &operator=(const QuantizedDense &) = delete;
+
+    /**
+    * Get the number of inputs of this layer.
+    * @return Number of columns of the weights.
+    */
+    int get_input_size() const;
+
+    /**
+    * Get the number of outputs (neurons) of this layer.
+    * @return Number of rows of the weights.
+    */
+    int get_output_size() const;
+
+    /**
+    * Get the memory taken by the quantized weights and their scales.
+    * @return Size in bytes.
+    */
+    size_t get_weight_bytes() const;
+
+    /**
+    * Applies the layer: quantizes the input, runs int8 x int8 -> int32 dot
+    * products, dequantizes with the row and input scales, adds the bias and
+    * applies the activation.
+    * @param input input matrix (or view), one sample per column
+    * @param output buffer receiving the rows x N float result (row-major)
+    * @param scratch buffer of at least get_input_size() * N bytes for the
+    * quantized input
+    */
+    void apply(const MatrixView &input, float *output, int8_t *scratch) const;
+};
+
+#endif //QUANTIZEDDENSE_H
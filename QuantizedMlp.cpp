@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cmath>
+#include "QuantizedMlp.h"
+
+#define ZERO_DIGIT 0
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Per-thread scratch memory of the quantized forward pass: two float
+ * ping-pong buffers and the quantized input, grown on demand.
+ */
+struct QuantScratch
+{
+    Matrix ping, pong;
+    int8_t *quantized = nullptr;
+    int capacity = 0;
+    int width = 0;
+    int input_size = 0;
+
+    ~QuantScratch()
+    {
+        delete[] quantized;
+    }
+
+    /**
+    * Makes sure the buffers fit a batch of n images of a network. The
+    * scratch is shared by every QuantizedMlp on the thread, so it grows to
+    * the largest batch, width and input seen so far.
+    * @param network_width widest layer of the network
+    * @param network_input largest layer input
+    * @param n batch size
+    */
+    void reserve(int network_width, int network_input, int n)
+    {
+        if (n <= capacity && network_width <= width &&
+            network_input <= input_size)
+        {
+            return;
+        }
+        capacity = std::max(capacity, n);
+        width = std::max(width, network_width);
+        input_size = std::max(input_size, network_input);
+        ping = Matrix(width, capacity);
+        pong = Matrix(width, capacity);
+        delete[] quantized;
+        quantized = new(std::nothrow) int8_t[(size_t) input_size * capacity];
+        if (!quantized)
+        {
+            exit_func(MEMORY_ALLOC_FAIL);
+        }
+    }
+};
+
+/**
+* Helper function that finds the largest absolute value seen through a view.
+*/
+static float max_abs(const MatrixView &m)
+{
+    float result = 0;
+    for (int i = 0; i < m.get_rows(); ++i)
+    {
+        for (int j = 0; j < m.get_cols(); ++j)
+        {
+            result = std::fmax(result, std::fabs(m(i, j)));
+        }
+    }
+    return result;
+}
+
+/**
+* Constructor for QuantizedMlp instance.
+* @param network The float network to quantize.
+* @param calibration_images Representative images, one per column.
+*/
+QuantizedMlp::QuantizedMlp(const MlpNetwork &network,
+                           const MatrixView &calibration_images)
+        : layers(nullptr), layer_count(network.get_layer_count()),
+          max_width(network.get_max_width()),
+          max_input(network.get_input_size())
+{
+    if (calibration_images.get_rows() != network.get_input_size())
+    {
+        exit_func(CALIBRATION_SIZE_ERR);
+    }
+    layers = new(std::nothrow) QuantizedDense *[layer_count];
+    if (!layers)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    // Run the float network layer by layer and record the input range of
+    // every layer.
+    Matrix activations(calibration_images);
+    for (int i = 0; i < layer_count; ++i)
+    {
+        layers[i] = new(std::nothrow) QuantizedDense(network.get_layer(i),
+                                                     max_abs(activations));
+        if (!layers[i])
+        {
+            exit_func(MEMORY_ALLOC_FAIL);
+        }
+        max_input = std::max(max_input, layers[i]->get_input_size());
+        if (i + 1 < layer_count)
+        {
+            activations = network.get_layer(i)(activations);
+        }
+    }
+}
+
+/**
+* Destructor of QuantizedMlp instance.
+*/
+QuantizedMlp::~QuantizedMlp()
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        delete layers[i];
+    }
+    delete[] layers;
+}
+
+/**
+* Applies the quantized network on input.
+* @param image Matrix that represents an image to be read.
+* @return digit struct with the highest probability to be the correct digit
+*/
+digit QuantizedMlp::operator()(const MatrixView &image) const
+{
+    digit result;
+    predict_batch(image, &result);
+    return result;
+}
+
+/**
+* Applies the quantized network on a batch of images.
+* @param images Matrix (or view), one vectorized image per column.
+* @param results Array of at least N digits.
+*/
+void QuantizedMlp::predict_batch(const MatrixView &images,
+                                 digit *results) const
+{
+    static thread_local QuantScratch scratch;
+    const int n = images.get_cols();
+    scratch.reserve(max_width, max_input, n);
+    float *buffers[2] = {scratch.ping.data(), scratch.pong.data()};
+    layers[0]->apply(images, buffers[0], scratch.quantized);
+    for (int i = 1; i < layer_count; ++i)
+    {
+        const MatrixView input(buffers[(i - 1) % 2],
+                               layers[i - 1]->get_output_size(), n, n, 1);
+        layers[i]->apply(input, buffers[i % 2], scratch.quantized);
+    }
+    const float *final_output = buffers[(layer_count - 1) % 2];
+    const int classes = layers[layer_count - 1]->get_output_size();
+    for (int j = 0; j < n; ++j)
+    {
+        results[j].value = ZERO_DIGIT;
+        results[j].probability = 0.0;
+        for (int i = ZERO_DIGIT; i < classes; i++)
+        {
+            if (final_output[i * n + j] > results[j].probability)
+            {
+                results[j].probability = final_output[i * n + j];
+                results[j].value = i;
+            }
+        }
+    }
+}
+
+/**
+* Get the memory taken by the quantized weights of all layers.
+* @return Size in bytes.
+*/
+size_t QuantizedMlp::get_weight_bytes() const
+{
+    size_t bytes = 0;
+    for (int i = 0; i < layer_count; ++i)
+    {
+        bytes += layers[i]->get_weight_bytes();
+    }
+    return bytes;
+}
+
+/**
+* Compares the float and quantized networks on a labelled set.
+* @param network The float network.
+* @param quantized Its quantized version.
+* @param images Matrix (or view), one vectorized image per column.
+* @param labels Correct digit of every column.
+* @return The accuracy report.
+*/
+quant_report QuantizedMlp::compare(const MlpNetwork &network,
+                                   const QuantizedMlp &quantized,
+                                   const MatrixView &images,
+                                   const unsigned int *labels)
+{
+    const int n = images.get_cols();
+    digit *float_res = new(std::nothrow) digit[n];
+    digit *quant_res = new(std::nothrow) digit[n];
+    if (!float_res || !quant_res)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    network.predict_batch(images, float_res);
+    quantized.predict_batch(images, quant_res);
+    int float_correct = 0;
+    int quant_correct = 0;
+    int agree = 0;
+    for (int j = 0; j < n; ++j)
+    {
+        float_correct += float_res[j].value == labels[j];
+        quant_correct += quant_res[j].value == labels[j];
+        agree += float_res[j].value == quant_res[j].value;
+    }
+    delete[] float_res;
+    delete[] quant_res;
+    quant_report report;
+    report.samples = n;
+    report.float_accuracy = (float) float_correct / n;
+    report.quantized_accuracy = (float) quant_correct / n;
+    report.agreement = (float) agree / n;
+    return report;
+}
@@ -0,0 +1,94 @@
+// QuantizedMlp.h
+
+#ifndef QUANTIZEDMLP_H
+#define QUANTIZEDMLP_H
+
+#include "MlpNetwork.h"
+#include "QuantizedDense.h"
+
+#define CALIBRATION_SIZE_ERR "Error: Calibration images do not fit the "\
+"network input size!\n"
+
+/**
+ * @struct quant_report
+ * @brief Accuracy of the float and int8 networks on a labelled set.
+ * @var samples - number of labelled images
+ * @var float_accuracy - fraction classified correctly by the float network
+ * @var quantized_accuracy - fraction classified correctly by the int8 network
+ * @var agreement - fraction where both networks predict the same digit
+ */
+typedef struct quant_report
+{
+    int samples;
+    float float_accuracy;
+    float quantized_accuracy;
+    float agreement;
+} quant_report;
+
+/**
+   * QuantizedMlp Class - int8 execution mode of an MlpNetwork. Every layer
+   * is converted to a QuantizedDense; the activation range of each layer
+   * input is calibrated by running the float network on sample images.
+   * The weights take about a quarter of the float32 size.
+   */
+class QuantizedMlp
+{
+private:
+    QuantizedDense **layers;
+    int layer_count;
+    int max_width;
+    int max_input;
+
+public:
+    /**
+    * Constructor for QuantizedMlp instance.
+    * @param network The float network to quantize.
+    * @param calibration_images Representative images, one vectorized image
+    * per column, used to calibrate the activation ranges.
+    */
+    QuantizedMlp(const MlpNetwork &network,
+                 const MatrixView &calibration_images);
+
+    /**
+    * Destructor of QuantizedMlp instance.
+    */
+    ~QuantizedMlp();
+
+    QuantizedMlp(const QuantizedMlp &) = delete;
+    QuantizedMlp &operator=(const QuantizedMlp &) = delete;
+
+   /**
+   * Applies the quantized network on input.
+   * @param image Matrix that represents an image to be read.
+   * @return digit struct with the highest probability to be the correct digit
+   */
+    digit operator()(const MatrixView &image) const;
+
+    /**
+    * Applies the quantized network on a batch of images.
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param results Array of at least N digits.
+    */
+    void predict_batch(const MatrixView &images, digit *results) const;
+
+    /**
+    * Get the memory taken by the quantized weights of all layers.
+    * @return Size in bytes.
+    */
+    size_t get_weight_bytes() const;
+
+    /**
+    * Compares the float and quantized networks on a labelled set.
+    * @param network The float network.
+    * @param quantized Its quantized version.
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param labels Correct digit of every column.
+    * @return The accuracy report.
+    */
+    static quant_report compare(const MlpNetwork &network,
+                                const QuantizedMlp &quantized,
+                                const MatrixView &images,
+                                const unsigned int *labels);
+};
+
+#endif //QUANTIZEDMLP_H
@@ -0,0 +1,26 @@
+#include "Simd.h"
+
+/**
+* Helper function that queries the CPU features once.
+* @return true if the CPU supports AVX2, FMA and F16C.
+*/
+static bool detect_avx2()
+{
+#ifdef MLP_HAVE_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+           __builtin_cpu_supports("f16c");
+#else
+    return false;
+#endif
+}
+
+/**
+ * Tells whether the running CPU supports AVX2, FMA and F16C.
+ * @return true if the AVX2 kernels may be used.
+ */
+bool cpu_has_avx2()
+{
+    static const bool has_avx2 = detect_avx2();
+    return has_avx2;
+}
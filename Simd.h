@@ -0,0 +1,28 @@
+// Simd.h
+
+#ifndef SIMD_H
+#define SIMD_H
+
+/**
+ * x86 SIMD support shared by the compute kernels. The AVX2 code paths are
+ * compiled with a per-function target attribute (the rest of the project
+ * keeps the default flags) and selected at runtime with cpu_has_avx2().
+ * F16C (half precision conversion) is part of the same level - every CPU
+ * with AVX2 has it.
+ * Define MLP_NO_SIMD to build the portable scalar kernels only.
+ */
+#if !defined(MLP_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define MLP_HAVE_AVX2 1
+#include <immintrin.h>
+#define MLP_AVX2_TARGET __attribute__((target("avx2,fma,f16c")))
+#endif
+
+/**
+ * Tells whether the running CPU supports AVX2, FMA and F16C. Always false
+ * when the SIMD kernels are not compiled in.
+ * @return true if the AVX2 kernels may be used.
+ */
+bool cpu_has_avx2();
+
+#endif //SIMD_H
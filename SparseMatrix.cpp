@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "SparseMatrix.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that allocates an array.
+* @param count number of elements
+* @return the new array.
+*/
+template <typename T>
+static T *alloc_array(size_t count)
+{
+    T *array = new(std::nothrow) T[count > 0 ? count : 1];
+    if (!array)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    return array;
+}
+
+/**
+* Constructor of an empty SparseMatrix (no elements).
+*/
+SparseMatrix::SparseMatrix()
+        : rows(0), cols(0), nonzeros(0), row_ptr(nullptr), col_idx(nullptr),
+          values(nullptr)
+{}
+
+/**
+* Constructor that keeps the nonzero elements of a dense matrix.
+* @param m matrix (or view) to compress
+*/
+SparseMatrix::SparseMatrix(const MatrixView &m)
+        : rows(m.get_rows()), cols(m.get_cols()), nonzeros(0),
+          row_ptr(nullptr), col_idx(nullptr), values(nullptr)
+{
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            nonzeros += m(i, j) != 0;
+        }
+    }
+    row_ptr = alloc_array<int>((size_t) rows + 1);
+    col_idx = alloc_array<int>((size_t) nonzeros);
+    values = alloc_array<float>((size_t) nonzeros);
+    int p = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        row_ptr[i] = p;
+        for (int j = 0; j < cols; ++j)
+        {
+            const float v = m(i, j);
+            if (v != 0)
+            {
+                col_idx[p] = j;
+                values[p] = v;
+                ++p;
+            }
+        }
+    }
+    row_ptr[rows] = p;
+}
+
+/**
+* Copy constructor - copies the elements.
+* @param other matrix to copy
+*/
+SparseMatrix::SparseMatrix(const SparseMatrix &other)
+        : rows(other.rows), cols(other.cols), nonzeros(other.nonzeros),
+          row_ptr(nullptr), col_idx(nullptr), values(nullptr)
+{
+    if (other.row_ptr == nullptr)
+    {
+        return;
+    }
+    row_ptr = alloc_array<int>((size_t) rows + 1);
+    col_idx = alloc_array<int>((size_t) nonzeros);
+    values = alloc_array<float>((size_t) nonzeros);
+    std::memcpy(row_ptr, other.row_ptr, ((size_t) rows + 1) * sizeof(int));
+    std::memcpy(col_idx, other.col_idx, (size_t) nonzeros * sizeof(int));
+    std::memcpy(values, other.values, (size_t) nonzeros * sizeof(float));
+}
+
+/**
+* Destructor of SparseMatrix instance.
+*/
+SparseMatrix::~SparseMatrix()
+{
+    delete[] row_ptr;
+    delete[] col_idx;
+    delete[] values;
+}
+
+/**
+* Get the number of rows.
+* @return Number of rows as int.
+*/
+int SparseMatrix::get_rows() const
+{
+    return rows;
+}
+
+/**
+* Get the number of columns.
+* @return Number of columns as int.
+*/
+int SparseMatrix::get_cols() const
+{
+    return cols;
+}
+
+/**
+* Get the number of stored (nonzero) elements.
+* @return Number of nonzeros as int.
+*/
+int SparseMatrix::get_nonzeros() const
+{
+    return nonzeros;
+}
+
+/**
+* Get the fraction of elements that are stored.
+* @return get_nonzeros() / (rows * cols), 0 for an empty matrix.
+*/
+float SparseMatrix::get_density() const
+{
+    if (rows == 0 || cols == 0)
+    {
+        return 0;
+    }
+    return (float) nonzeros / ((float) rows * (float) cols);
+}
+
+/**
+* @return Size of the values and indices in bytes.
+*/
+size_t SparseMatrix::get_bytes() const
+{
+    return (size_t) nonzeros * (sizeof(int) + sizeof(float)) +
+           ((size_t) rows + 1) * sizeof(int);
+}
+
+/**
+* @return The rows + 1 row offsets into get_col_indices()/get_values().
+*/
+const int *SparseMatrix::get_row_offsets() const
+{
+    return row_ptr;
+}
+
+/**
+* @return Column index of every stored element.
+*/
+const int *SparseMatrix::get_col_indices() const
+{
+    return col_idx;
+}
+
+/**
+* @return Value of every stored element.
+*/
+const float *SparseMatrix::get_values() const
+{
+    return values;
+}
+
+/**
+* returns the value of the element in the given index.
+* @param i row index
+* @param j col index
+* @return Value in index (i,j), 0 if it is not stored.
+*/
+float SparseMatrix::operator()(int i, int j) const
+{
+    if (i < 0 || i >= rows || j < 0 || j >= cols)
+    {
+        exit_func(IDX_OUT_OF_BOUNDS_ERR);
+    }
+    const int *begin = col_idx + row_ptr[i];
+    const int *end = col_idx + row_ptr[i + 1];
+    const int *found = std::lower_bound(begin, end, j);
+    return found != end && *found == j ? values[found - col_idx] : 0;
+}
+
+/**
+* Expands the matrix into a dense one.
+* @return The dense matrix.
+*/
+Matrix SparseMatrix::to_matrix() const
+{
+    Matrix result(rows, cols);
+    for (int i = 0; i < rows; ++i)
+    {
+        float *dst = result.row_ptr(i);
+        for (int p = row_ptr[i]; p < row_ptr[i + 1]; ++p)
+        {
+            dst[col_idx[p]] = values[p];
+        }
+    }
+    return result;
+}
+
+/**
+* Magnitude pruning: zeroes the given fraction of the elements with the
+* smallest absolute values.
+* @param m matrix (or view) to prune
+* @param sparsity fraction of elements to zero, in [0, 1]
+* @return The pruned matrix.
+*/
+Matrix prune_weights(const MatrixView &m, float sparsity)
+{
+    if (!(sparsity >= 0 && sparsity <= 1))
+    {
+        exit_func(SPARSITY_ERR);
+    }
+    Matrix result(m);
+    const int size = result.get_rows() * result.get_cols();
+    const int pruned = (int) std::lround((double) sparsity * size);
+    if (pruned == 0)
+    {
+        return result;
+    }
+    std::vector<int> order((size_t) size);
+    for (int i = 0; i < size; ++i)
+    {
+        order[i] = i;
+    }
+    std::nth_element(order.begin(), order.begin() + (pruned - 1), order.end(),
+                     [&result](int a, int b)
+                     {
+                         return std::fabs(result[a]) < std::fabs(result[b]);
+                     });
+    for (int i = 0; i < pruned; ++i)
+    {
+        result[order[i]] = 0;
+    }
+    return result;
+}
@@ -0,0 +1,119 @@
+// SparseMatrix.h
+
+#ifndef SPARSEMATRIX_H
+#define SPARSEMATRIX_H
+
+#include <cstddef>
+#include "Matrix.h"
+
+#define SPARSITY_ERR "Error: Sparsity must be in [0, 1]!\n"
+
+/**
+   * SparseMatrix Class - a matrix in compressed sparse row (CSR) form: the
+   * nonzero elements of each row are stored one after the other, with their
+   * column indices, and row_ptr[i]..row_ptr[i + 1] is the range of row i.
+   * Used for pruned layer weights, whose cost then scales with the number of
+   * nonzeros instead of rows x cols.
+   */
+class SparseMatrix
+{
+private:
+    int rows, cols, nonzeros;
+    int *row_ptr;
+    int *col_idx;
+    float *values;
+
+public:
+    /**
+    * Constructor of an empty SparseMatrix (no elements).
+    */
+    SparseMatrix();
+
+    /**
+    * Constructor that keeps the nonzero elements of a dense matrix.
+    * @param m matrix (or view) to compress
+    */
+    explicit SparseMatrix(const MatrixView &m);
+
+    /**
+    * Copy constructor - copies the elements.
+    * @param other matrix to copy
+    */
+    SparseMatrix(const SparseMatrix &other);
+
+    /**
+    * Destructor of SparseMatrix instance.
+    */
+    ~SparseMatrix();
+
+    SparseMatrix &operator=(const SparseMatrix &) = delete;
+
+    /**
+    * Get the number of rows.
+    * @return Number of rows as int.
+    */
+    int get_rows() const;
+
+    /**
+    * Get the number of columns.
+    * @return Number of columns as int.
+    */
+    int get_cols() const;
+
+    /**
+    * Get the number of stored (nonzero) elements.
+    * @return Number of nonzeros as int.
+    */
+    int get_nonzeros() const;
+
+    /**
+    * Get the fraction of elements that are stored.
+    * @return get_nonzeros() / (rows * cols), 0 for an empty matrix.
+    */
+    float get_density() const;
+
+    /**
+    * @return Size of the values and indices in bytes.
+    */
+    size_t get_bytes() const;
+
+    /**
+    * @return The rows + 1 row offsets into get_col_indices()/get_values().
+    */
+    const int *get_row_offsets() const;
+
+    /**
+    * @return Column index of every stored element.
+    */
+    const int *get_col_indices() const;
+
+    /**
+    * @return Value of every stored element.
+    */
+    const float *get_values() const;
+
+    /**
+    * returns the value of the element in the given index.
+    * @param i row index
+    * @param j col index
+    * @return Value in index (i,j), 0 if it is not stored.
+    */
+    float operator()(int i, int j) const;
+
+    /**
+    * Expands the matrix into a dense one.
+    * @return The dense matrix.
+    */
+    Matrix to_matrix() const;
+};
+
+/**
+* Magnitude pruning: zeroes the given fraction of the elements with the
+* smallest absolute values.
+* @param m matrix (or view) to prune
+* @param sparsity fraction of elements to zero, in [0, 1]
+* @return The pruned matrix.
+*/
+Matrix prune_weights(const MatrixView &m, float sparsity);
+
+#endif //SPARSEMATRIX_H
@@ -0,0 +1,136 @@
+// SpscQueue.h
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <thread>
+
+#define SPSC_CACHE_LINE 64
+#define SPSC_SPIN_LIMIT 128
+
+/**
+   * SpscQueue Class - a bounded lock-free queue for exactly one producer
+   * thread and one consumer thread. The slots form a power-of-two ring; the
+   * producer only writes tail and the consumer only writes head, each on its
+   * own cache line, and each side caches the other's index so that the
+   * shared line is read only when the queue looks full (or empty).
+   */
+template<typename T>
+class SpscQueue
+{
+private:
+    T *slots;
+    size_t mask;
+    char pad0[SPSC_CACHE_LINE];
+    std::atomic<size_t> head; // next slot to pop, written by the consumer
+    size_t cached_tail;
+    char pad1[SPSC_CACHE_LINE];
+    std::atomic<size_t> tail; // next slot to push, written by the producer
+    size_t cached_head;
+    char pad2[SPSC_CACHE_LINE];
+
+public:
+    /**
+    * Constructor for SpscQueue instance.
+    * @param capacity Minimal number of elements, rounded up to a power of 2.
+    */
+    explicit SpscQueue(size_t capacity)
+            : slots(nullptr), mask(0), head(0), cached_tail(0), tail(0),
+              cached_head(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        slots = new T[size];
+        mask = size - 1;
+    }
+
+    /**
+    * Destructor of SpscQueue instance.
+    */
+    ~SpscQueue()
+    {
+        delete[] slots;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    /**
+    * Get the number of slots.
+    * @return The capacity.
+    */
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    /**
+    * Appends an element - producer thread only.
+    * @param value element to append
+    * @return true on success, false if the queue is full.
+    */
+    bool try_push(const T &value)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head > mask)
+        {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head > mask)
+            {
+                return false;
+            }
+        }
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+    * Removes the oldest element - consumer thread only.
+    * @param value receives the element
+    * @return true on success, false if the queue is empty.
+    */
+    bool try_pop(T &value)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail)
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail)
+            {
+                return false;
+            }
+        }
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * Backoff of a thread waiting on an SpscQueue: spins for SPSC_SPIN_LIMIT
+ * rounds, then yields the core on every call.
+ * @param spins number of failed attempts so far (updated)
+ */
+inline void spsc_backoff(int &spins)
+{
+    if (spins < SPSC_SPIN_LIMIT)
+    {
+        ++spins;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    else
+    {
+        std::this_thread::yield();
+    }
+}
+
+#endif //SPSCQUEUE_H
@@ -0,0 +1,367 @@
+// StaticMatrix.h
+
+#ifndef STATICMATRIX_H
+#define STATICMATRIX_H
+
+#include "Activation.h"
+#include "Gemm.h"
+#include "Simd.h"
+
+#define STATIC_SHAPE_ERR "Error: Parameters do not fit the static layer "\
+"shape!\n"
+
+/**
+ * Layers with at most this many weights run the fully unrolled kernels
+ * below (AVX2 when available); larger ones call the runtime dispatched GEMV
+ * kernel of gemm_bias_act(), still with constant bounds.
+ */
+#ifndef STATIC_UNROLL_LIMIT
+#define STATIC_UNROLL_LIMIT 4096
+#endif
+
+/**
+ * Number of interleaved input streams of the AVX2 small layer kernel.
+ */
+#define STATIC_GEMV_SPLIT 4
+
+#if defined(__clang__)
+#define STATIC_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define STATIC_UNROLL _Pragma("GCC unroll 64")
+#else
+#define STATIC_UNROLL
+#endif
+
+/**
+ * @class StaticMatrix
+ * @brief Row-major R x C float matrix whose shape is a compile-time
+ * constant. The elements are stored inline (no heap allocation), so small
+ * matrices live on the stack, indexing is unchecked and every loop over
+ * them has constant bounds. Like Matrix, the elements are aligned to
+ * MATRIX_ALIGNMENT bytes. Shape mismatches are compile errors: the
+ * operators below only accept matching template arguments.
+ */
+template <int R, int C>
+class StaticMatrix
+{
+    static_assert(R > 0 && C > 0, "StaticMatrix dimensions must be positive");
+
+private:
+    alignas(MATRIX_ALIGNMENT) float elem[R * C];
+
+public:
+    static constexpr int rows = R;
+    static constexpr int cols = C;
+
+    /**
+    * @return Pointer to element (0,0).
+    */
+    float *data()
+    {
+        return elem;
+    }
+
+    /**
+    * @return Pointer to element (0,0).
+    */
+    const float *data() const
+    {
+        return elem;
+    }
+
+    /**
+    * @param i index in row-major order
+    * @return Reference to the i'th element.
+    */
+    float &operator[](int i)
+    {
+        return elem[i];
+    }
+
+    /**
+    * @param i index in row-major order
+    * @return Value of the i'th element.
+    */
+    float operator[](int i) const
+    {
+        return elem[i];
+    }
+
+    /**
+    * @param i row index
+    * @param j col index
+    * @return Reference to element (i,j).
+    */
+    float &operator()(int i, int j)
+    {
+        return elem[i * C + j];
+    }
+
+    /**
+    * @param i row index
+    * @param j col index
+    * @return Value of element (i,j).
+    */
+    float operator()(int i, int j) const
+    {
+        return elem[i * C + j];
+    }
+
+    /**
+    * @return A view of the whole matrix, for the runtime-shaped API.
+    */
+    MatrixView view() const
+    {
+        return MatrixView(elem, R, C, C, 1);
+    }
+
+    /**
+    * Copies runtime-shaped elements into the matrix.
+    * @param v view of R x C elements
+    */
+    void assign(const MatrixView &v)
+    {
+        if (v.get_rows() != R || v.get_cols() != C)
+        {
+            std::cerr << STATIC_SHAPE_ERR << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < R; ++i)
+        {
+            for (int j = 0; j < C; ++j)
+            {
+                elem[i * C + j] = v(i, j);
+            }
+        }
+    }
+};
+
+/**
+* Matrix product with compile-time shapes: (R x K) * (K x C).
+* @param a left operand
+* @param b right operand
+* @return The R x C product.
+*/
+template <int R, int K, int C>
+StaticMatrix<R, C> operator*(const StaticMatrix<R, K> &a,
+                             const StaticMatrix<K, C> &b)
+{
+    StaticMatrix<R, C> result;
+    gemm(R, C, K, a.data(), K, 1, b.data(), C, 1, result.data(), C, false);
+    return result;
+}
+
+/**
+* Element-wise sum with compile-time shapes.
+* @param a left operand
+* @param b right operand
+* @return a + b.
+*/
+template <int R, int C>
+StaticMatrix<R, C> operator+(const StaticMatrix<R, C> &a,
+                             const StaticMatrix<R, C> &b)
+{
+    StaticMatrix<R, C> result;
+    for (int i = 0; i < R * C; ++i)
+    {
+        result[i] = a[i] + b[i];
+    }
+    return result;
+}
+
+/**
+* Unrolled matrix-vector product of a small layer: sum = wt^T * x, with the
+* weights stored transposed (In x Out). Each input element updates a
+* contiguous run of Out accumulators, so the Out multiply-adds of one step
+* are independent instead of forming a single In long dependency chain.
+* @param wt transposed weights, In x Out
+* @param x In input elements
+* @param sum receives the Out results
+*/
+template <int In, int Out>
+inline void static_gemv_scalar(const float *wt, const float *x, float *sum)
+{
+    for (int i = 0; i < Out; ++i)
+    {
+        sum[i] = 0;
+    }
+    for (int p = 0; p < In; ++p)
+    {
+        const float *w_row = wt + p * Out;
+        STATIC_UNROLL
+        for (int i = 0; i < Out; ++i)
+        {
+            sum[i] += w_row[i] * x[p];
+        }
+    }
+}
+
+#ifdef MLP_HAVE_AVX2
+/**
+* AVX2/FMA version of static_gemv_scalar() for Out a multiple of 8: all
+* accumulators stay in registers, and the inputs are consumed in
+* STATIC_GEMV_SPLIT interleaved streams with their own accumulators, which
+* shortens the FMA dependency chains.
+*/
+template <int In, int Out>
+MLP_AVX2_TARGET
+inline void static_gemv_avx2(const float *wt, const float *x, float *sum)
+{
+    static_assert(Out % 8 == 0, "static_gemv_avx2 needs whole vectors");
+    const int vecs = Out / 8;
+    const int split = STATIC_GEMV_SPLIT;
+    __m256 acc[split][vecs];
+    for (int s = 0; s < split; ++s)
+    {
+        for (int v = 0; v < vecs; ++v)
+        {
+            acc[s][v] = _mm256_setzero_ps();
+        }
+    }
+    for (int p = 0; p < In; p += split)
+    {
+        STATIC_UNROLL
+        for (int s = 0; s < split; ++s)
+        {
+            if (p + s < In)
+            {
+                const float *w_row = wt + (p + s) * Out;
+                const __m256 xv = _mm256_set1_ps(x[p + s]);
+                STATIC_UNROLL
+                for (int v = 0; v < vecs; ++v)
+                {
+                    acc[s][v] = _mm256_fmadd_ps(
+                            _mm256_loadu_ps(w_row + v * 8), xv, acc[s][v]);
+                }
+            }
+        }
+    }
+    for (int v = 0; v < vecs; ++v)
+    {
+        __m256 total = acc[0][v];
+        for (int s = 1; s < split; ++s)
+        {
+            total = _mm256_add_ps(total, acc[s][v]);
+        }
+        _mm256_storeu_ps(sum + v * 8, total);
+    }
+}
+#endif // MLP_HAVE_AVX2
+
+/**
+ * @class StaticDense
+ * @brief A Dense layer with compile-time shape and activation:
+ * act(weights * x + bias) for an In-element input and Out outputs. The
+ * parameters are stored inline, so a StaticDense of a large layer should
+ * not be a local variable (allocate the owning network on the heap).
+ */
+template <int In, int Out, ActivationType Act>
+class StaticDense
+{
+public:
+    static constexpr int input_size = In;
+    static constexpr int output_size = Out;
+    static constexpr bool unrolled = In * Out <= STATIC_UNROLL_LIMIT;
+
+private:
+    // unrolled layers keep the transpose (In x Out), padded with zero
+    // columns to whole 8-float vectors, for static_gemv_*()
+    static constexpr int padded = (Out + 7) / 8 * 8;
+    StaticMatrix<unrolled ? In : Out, unrolled ? padded : In> weights;
+    StaticMatrix<Out, 1> bias;
+
+public:
+    /**
+    * Constructor for StaticDense instance - copies the parameters.
+    * @param w Weights, Out x In
+    * @param b Bias, Out x 1
+    */
+    StaticDense(const MatrixView &w, const MatrixView &b)
+    {
+        if (unrolled)
+        {
+            if (w.get_rows() != Out || w.get_cols() != In)
+            {
+                std::cerr << STATIC_SHAPE_ERR << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            for (int p = 0; p < In; ++p)
+            {
+                for (int i = 0; i < padded; ++i)
+                {
+                    weights[p * padded + i] = i < Out ? w(i, p) : 0;
+                }
+            }
+        }
+        else
+        {
+            weights.assign(w);
+        }
+        bias.assign(b);
+    }
+
+    /**
+    * Applies the layer on one sample.
+    * @param in input vector
+    * @param out output vector
+    */
+    void apply(const StaticMatrix<In, 1> &in, StaticMatrix<Out, 1> &out) const
+    {
+        apply(in.data(), out);
+    }
+
+    /**
+    * Applies the layer on one sample stored in a caller owned buffer (for
+    * example a contiguous image, which then needs no copy).
+    * @param in In contiguous input elements
+    * @param out output vector
+    */
+    void apply(const float *in, StaticMatrix<Out, 1> &out) const
+    {
+        apply_logits(in, out);
+        if (Act == SOFTMAX)
+        {
+            Activation(SOFTMAX).apply_in_place(out.data(), Out, 1);
+        }
+    }
+
+    /**
+    * Same as apply() but leaves out the SOFTMAX normalization (RELU is
+    * still applied), so a SOFTMAX layer writes its logits.
+    * @param in In contiguous input elements
+    * @param out output vector
+    */
+    void apply_logits(const float *in, StaticMatrix<Out, 1> &out) const
+    {
+        if (!unrolled)
+        {
+            gemm_bias_act(Out, 1, In, weights.data(), In, 1, in, 1, 1,
+                          out.data(), 1, bias.data(), Act == RELU);
+        }
+        else
+        {
+            float sum[padded];
+#ifdef MLP_HAVE_AVX2
+            if (cpu_has_avx2())
+            {
+                static_gemv_avx2<In, padded>(weights.data(), in, sum);
+            }
+            else
+#endif
+            {
+                static_gemv_scalar<In, padded>(weights.data(), in, sum);
+            }
+            for (int i = 0; i < Out; ++i)
+            {
+                float v = sum[i] + bias[i];
+                if (Act == RELU && v < 0)
+                {
+                    v = 0;
+                }
+                out[i] = v;
+            }
+        }
+    }
+};
+
+#endif //STATICMATRIX_H
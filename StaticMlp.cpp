@@ -0,0 +1,191 @@
+#include <cstdlib>
+#include "StaticMlp.h"
+
+using std::string;
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+*/
+static void exit_func(const string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that checks one layer of a runtime network against the
+* standard topology.
+* @param network Network to check.
+* @param i Layer index.
+* @return The layer.
+*/
+static const Dense &standard_layer(const MlpNetwork &network, int i)
+{
+    const Dense &layer = network.get_layer(i);
+    if (layer.get_input_size() != weights_dims[i].cols ||
+        layer.get_output_size() != weights_dims[i].rows ||
+        layer.get_activation().get_activation_type() != mlp_act_types[i])
+    {
+        exit_func(STATIC_TOPOLOGY_ERR);
+    }
+    return layer;
+}
+
+/**
+* Helper function that checks a runtime network has the standard layer
+* count before its layers are read.
+* @param network Network to check.
+* @return The network.
+*/
+static const MlpNetwork &standard_network(const MlpNetwork &network)
+{
+    if (network.get_layer_count() != MLP_SIZE)
+    {
+        exit_func(STATIC_TOPOLOGY_ERR);
+    }
+    return network;
+}
+
+/**
+* Constructor for StaticMlpNetwork instance.
+* @param weights Array of MLP_SIZE weight matrices (weights_dims).
+* @param biases Array of MLP_SIZE bias vectors (bias_dims).
+*/
+StaticMlpNetwork::StaticMlpNetwork(const Matrix *weights,
+                                   const Matrix *biases)
+        : layer1(weights[0], biases[0]), layer2(weights[1], biases[1]),
+          layer3(weights[2], biases[2]), layer4(weights[3], biases[3])
+{}
+
+/**
+* Constructor for StaticMlpNetwork instance - copies the parameters of
+* a runtime network, which must have the standard topology (FP16/BF16
+* weights are widened to float32).
+* @param network Network to specialize.
+*/
+StaticMlpNetwork::StaticMlpNetwork(const MlpNetwork &network)
+        : layer1(standard_layer(standard_network(network), 0).get_weights(),
+                 network.get_layer(0).get_bias()),
+          layer2(standard_layer(network, 1).get_weights(),
+                 network.get_layer(1).get_bias()),
+          layer3(standard_layer(network, 2).get_weights(),
+                 network.get_layer(2).get_bias()),
+          layer4(standard_layer(network, 3).get_weights(),
+                 network.get_layer(3).get_bias())
+{}
+
+/**
+* Allocates a network aligned to MATRIX_ALIGNMENT bytes (plain new only
+* guarantees 16 bytes before C++17).
+* @param size Object size in bytes.
+* @return The memory.
+*/
+void *StaticMlpNetwork::operator new(size_t size)
+{
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, MATRIX_ALIGNMENT, size) != 0)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    return ptr;
+}
+
+/**
+* Releases memory from operator new.
+* @param ptr The memory.
+*/
+void StaticMlpNetwork::operator delete(void *ptr)
+{
+    free(ptr);
+}
+
+/**
+* Computes the full forward pass of one image.
+* @param image input_size elements (any shape, read in row-major order).
+* @param output Receives the output_size class probabilities.
+* @param normalize Apply the output SOFTMAX; false leaves the logits.
+*/
+void StaticMlpNetwork::forward(const MatrixView &image,
+                               StaticMatrix<output_size, 1> &output,
+                               bool normalize) const
+{
+    int rows = image.get_rows(), cols = image.get_cols();
+    if (rows * cols != input_size)
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    StaticMatrix<weights_dims[0].rows, 1> out1;
+    StaticMatrix<weights_dims[1].rows, 1> out2;
+    StaticMatrix<weights_dims[2].rows, 1> out3;
+    if (image.is_contiguous())
+    {
+        layer1.apply(image.data(), out1);
+    }
+    else
+    {
+        StaticMatrix<input_size, 1> input;
+        const float *src = image.data();
+        int row_stride = image.get_row_stride();
+        int col_stride = image.get_col_stride();
+        for (int i = 0; i < rows; ++i)
+        {
+            for (int j = 0; j < cols; ++j)
+            {
+                input[i * cols + j] = src[i * row_stride + j * col_stride];
+            }
+        }
+        layer1.apply(input, out1);
+    }
+    layer2.apply(out1, out2);
+    layer3.apply(out2, out3);
+    if (normalize)
+    {
+        layer4.apply(out3.data(), output);
+    }
+    else
+    {
+        layer4.apply_logits(out3.data(), output);
+    }
+}
+
+/**
+* Applies the entire network on one image.
+* @param image input_size elements (any shape, read in row-major order).
+* @return digit struct with the most probable digit.
+*/
+digit StaticMlpNetwork::operator()(const MatrixView &image) const
+{
+    StaticMatrix<output_size, 1> logits;
+    forward(image, logits, false);
+    digit best_match;
+    softmax_top_k(logits.data(), output_size, 1, 1, &best_match.value,
+                  &best_match.probability);
+    return best_match;
+}
+
+/**
+* Batch prediction, one image per column.
+* @param images input_size x N images.
+* @param results Array of N digits receiving the predictions.
+*/
+void StaticMlpNetwork::predict_batch(const MatrixView &images,
+                                     digit *results) const
+{
+    if (images.get_rows() != input_size)
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    int n = images.get_cols();
+    for (int j = 0; j < n; ++j)
+    {
+        results[j] = (*this)(MatrixView(images.data() +
+                                        j * images.get_col_stride(),
+                                        input_size, 1,
+                                        images.get_row_stride(), 1));
+    }
+}
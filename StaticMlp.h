@@ -0,0 +1,91 @@
+// StaticMlp.h
+
+#ifndef STATICMLP_H
+#define STATICMLP_H
+
+#include "MlpNetwork.h"
+#include "StaticMatrix.h"
+
+#define STATIC_TOPOLOGY_ERR "Error: The network does not have the standard "\
+"784-128-64-20-10 topology!\n"
+
+/**
+   * StaticMlpNetwork Class - compile-time specialization of MlpNetwork for
+   * the standard topology (weights_dims, mlp_act_types). Every layer is a
+   * StaticDense, so all shapes are constants, the small 64x20 and 20x10
+   * layers run fully unrolled and the activations of one image live in
+   * stack buffers. The parameters (about 400KB) are stored inline: create
+   * the network with new (which aligns it) or as a static object, not as a
+   * local variable.
+   */
+class StaticMlpNetwork
+{
+public:
+    static constexpr int input_size = weights_dims[0].cols;
+    static constexpr int output_size = weights_dims[MLP_SIZE - 1].rows;
+
+private:
+    StaticDense<weights_dims[0].cols, weights_dims[0].rows,
+                mlp_act_types[0]> layer1;
+    StaticDense<weights_dims[1].cols, weights_dims[1].rows,
+                mlp_act_types[1]> layer2;
+    StaticDense<weights_dims[2].cols, weights_dims[2].rows,
+                mlp_act_types[2]> layer3;
+    StaticDense<weights_dims[3].cols, weights_dims[3].rows,
+                mlp_act_types[3]> layer4;
+
+public:
+    /**
+    * Constructor for StaticMlpNetwork instance.
+    * @param weights Array of MLP_SIZE weight matrices (weights_dims).
+    * @param biases Array of MLP_SIZE bias vectors (bias_dims).
+    */
+    StaticMlpNetwork(const Matrix *weights, const Matrix *biases);
+
+    /**
+    * Constructor for StaticMlpNetwork instance - copies the parameters of
+    * a runtime network, which must have the standard topology (FP16/BF16
+    * weights are widened to float32).
+    * @param network Network to specialize.
+    */
+    explicit StaticMlpNetwork(const MlpNetwork &network);
+
+    /**
+    * Allocates a network aligned to MATRIX_ALIGNMENT bytes (plain new only
+    * guarantees 16 bytes before C++17).
+    * @param size Object size in bytes.
+    * @return The memory.
+    */
+    static void *operator new(size_t size);
+
+    /**
+    * Releases memory from operator new.
+    * @param ptr The memory.
+    */
+    static void operator delete(void *ptr);
+
+    /**
+    * Computes the full forward pass of one image.
+    * @param image input_size elements (any shape, read in row-major order).
+    * @param output Receives the output_size class probabilities.
+    * @param normalize Apply the output SOFTMAX; false leaves the logits.
+    */
+    void forward(const MatrixView &image, StaticMatrix<output_size, 1> &output,
+                 bool normalize = true) const;
+
+    /**
+    * Applies the entire network on one image.
+    * @param image input_size elements (any shape, read in row-major order).
+    * @return digit struct with the most probable digit.
+    */
+    digit operator()(const MatrixView &image) const;
+
+    /**
+    * Batch prediction, one image per column.
+    * @param images input_size x N images.
+    * @param results Array of N digits receiving the predictions.
+    */
+    void predict_batch(const MatrixView &images, digit *results) const;
+};
+
+#endif //STATICMLP_H
@@ -0,0 +1,172 @@
+#include <iostream>
+#include "ThreadPool.h"
+
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+* @param
+*/
+static void exit_func(const std::string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Constructor for ThreadPool instance - starts the workers.
+* @param thread_count Number of workers, 0 for one per hardware thread.
+*/
+ThreadPool::ThreadPool(int thread_count)
+        : thread_count(thread_count), queues(nullptr), threads(nullptr),
+          pending(0), stopping(false)
+{
+    if (thread_count < 0)
+    {
+        exit_func(THREAD_COUNT_ERR);
+    }
+    if (thread_count == 0)
+    {
+        const unsigned int hw = std::thread::hardware_concurrency();
+        this->thread_count = hw ? (int) hw : 1;
+    }
+    queues = new WorkerQueue[this->thread_count];
+    threads = new std::thread[this->thread_count];
+    for (int i = 0; i < this->thread_count; ++i)
+    {
+        threads[i] = std::thread(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+/**
+* Destructor of ThreadPool instance - stops and joins the workers.
+*/
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake_cv.notify_all();
+    for (int i = 0; i < thread_count; ++i)
+    {
+        threads[i].join();
+    }
+    delete[] threads;
+    delete[] queues;
+}
+
+/**
+* Get the number of worker threads.
+* @return Number of workers as int.
+*/
+int ThreadPool::get_thread_count() const
+{
+    return thread_count;
+}
+
+/**
+* Runs body(task, worker) for every task in [0, task_count) on the
+* workers and returns once all of them finished.
+* @param task_count Number of tasks.
+* @param body Function to run for each task.
+*/
+void ThreadPool::parallel_for(int task_count, const TaskBody &body)
+{
+    if (task_count <= 0)
+    {
+        return;
+    }
+    Job job;
+    job.body = &body;
+    job.remaining = task_count;
+    for (int i = 0; i < task_count; ++i)
+    {
+        WorkerQueue &queue = queues[i % thread_count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{&job, i});
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        pending += task_count;
+    }
+    wake_cv.notify_all();
+
+    std::unique_lock<std::mutex> lock(job.done_mutex);
+    job.done_cv.wait(lock, [&job]
+    { return job.remaining.load() == 0; });
+}
+
+/**
+* Takes a task for a worker: its own newest task, or the oldest task of
+* another worker.
+* @param worker index of the worker
+* @param task receives the task
+* @return true if a task was taken.
+*/
+bool ThreadPool::take_task(int worker, Task &task)
+{
+    bool found = false;
+    {
+        WorkerQueue &own = queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            found = true;
+        }
+    }
+    for (int i = 1; i < thread_count && !found; ++i)
+    {
+        WorkerQueue &victim = queues[(worker + i) % thread_count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            found = true;
+        }
+    }
+    if (found)
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        --pending;
+    }
+    return found;
+}
+
+/**
+* Main loop of a worker thread.
+* @param worker index of the worker
+*/
+void ThreadPool::worker_loop(int worker)
+{
+    while (true)
+    {
+        Task task{};
+        if (take_task(worker, task))
+        {
+            (*task.job->body)(task.index, worker);
+            // Decrement under the job mutex: once the caller sees zero it
+            // may destroy the job, so nothing touches it after the unlock.
+            std::lock_guard<std::mutex> lock(task.job->done_mutex);
+            if (--task.job->remaining == 0)
+            {
+                task.job->done_cv.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake_cv.wait(lock, [this]
+        { return stopping || pending > 0; });
+        if (stopping && pending == 0)
+        {
+            return;
+        }
+    }
+}
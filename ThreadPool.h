@@ -0,0 +1,115 @@
+// ThreadPool.h
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#define THREAD_COUNT_ERR "Error: Invalid thread count!\n"
+
+/**
+   * ThreadPool Class - a fixed set of worker threads with one task queue per
+   * worker. parallel_for() deals its tasks round-robin over the queues; a
+   * worker pops from the back of its own queue and, once it is empty, steals
+   * from the front of the others, so uneven tasks balance themselves out.
+   */
+class ThreadPool
+{
+public:
+    /**
+    * Body of a parallel loop.
+    * @param task index of the task, in [0, task_count)
+    * @param worker index of the worker running it, in [0, thread count) -
+    * lets the body pick per-worker scratch memory without locking.
+    */
+    typedef std::function<void(int task, int worker)> TaskBody;
+
+    /**
+    * Constructor for ThreadPool instance - starts the workers.
+    * @param thread_count Number of workers, 0 for one per hardware thread.
+    */
+    explicit ThreadPool(int thread_count = 0);
+
+    /**
+    * Destructor of ThreadPool instance - stops and joins the workers.
+    */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+    * Get the number of worker threads.
+    * @return Number of workers as int.
+    */
+    int get_thread_count() const;
+
+    /**
+    * Runs body(task, worker) for every task in [0, task_count) on the
+    * workers and returns once all of them finished. May be called from
+    * several threads at once, but not from inside a task.
+    * @param task_count Number of tasks.
+    * @param body Function to run for each task.
+    */
+    void parallel_for(int task_count, const TaskBody &body);
+
+private:
+    /**
+     * One parallel_for() call: its body and the number of tasks left.
+     */
+    struct Job
+    {
+        const TaskBody *body;
+        std::atomic<int> remaining;
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+    };
+
+    /**
+     * A single queued task.
+     */
+    struct Task
+    {
+        Job *job;
+        int index;
+    };
+
+    /**
+     * Per-worker task queue.
+     */
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    int thread_count;
+    WorkerQueue *queues;
+    std::thread *threads;
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    int pending;
+    bool stopping;
+
+    /**
+    * Main loop of a worker thread.
+    * @param worker index of the worker
+    */
+    void worker_loop(int worker);
+
+    /**
+    * Takes a task for a worker: its own newest task, or the oldest task of
+    * another worker.
+    * @param worker index of the worker
+    * @param task receives the task
+    * @return true if a task was taken.
+    */
+    bool take_task(int worker, Task &task);
+};
+
+#endif //THREADPOOL_H
@@ -0,0 +1,569 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "Gemm.h"
+#include "MlpModel.h"
+#include "Trainer.h"
+
+// Probabilities are clamped before the logarithm of the loss, so a
+// confidently wrong prediction gives a large but finite loss.
+#define TRAIN_MIN_PROB 1e-30f
+
+using std::string;
+using std::cerr;
+using std::endl;
+
+/**
+* Helper function that prints a message and then terminates the program with
+* EXIT_FAILURE Code.
+* @param error_msg An error message to present in cerr before
+* program terminates.
+*/
+static void exit_func(const string &error_msg)
+{
+    cerr << error_msg << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+* Helper function that allocates an array of matrices.
+* @param count Number of matrices
+* @return The array.
+*/
+static Matrix *alloc_matrices(int count)
+{
+    if (count <= 0)
+    {
+        exit_func(LAYER_COUNT_ERR);
+    }
+    Matrix *matrices = new(std::nothrow) Matrix[count];
+    if (matrices == nullptr)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    return matrices;
+}
+
+/**
+* Helper function that copies the activation types.
+* @param act_types Activation of each layer.
+* @param layer_count Number of layers.
+* @return The copy.
+*/
+static ActivationType *copy_act_types(const ActivationType *act_types,
+                                      int layer_count)
+{
+    if (layer_count <= 0)
+    {
+        exit_func(LAYER_COUNT_ERR);
+    }
+    ActivationType *copy = new(std::nothrow) ActivationType[layer_count];
+    if (copy == nullptr)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    std::copy(act_types, act_types + layer_count, copy);
+    return copy;
+}
+
+/**
+* Default hyper-parameters: ADAM with learning rate 1e-3, or SGD with
+* learning rate 0.05 and momentum 0.9; batches of DEFAULT_TRAIN_BATCH.
+* @param optimizer the update rule
+* @return The options.
+*/
+train_options default_train_options(OptimizerType optimizer)
+{
+    train_options options;
+    options.optimizer = optimizer;
+    options.learning_rate = optimizer == ADAM ? 1e-3f : 0.05f;
+    options.momentum = 0.9f;
+    options.beta1 = 0.9f;
+    options.beta2 = 0.999f;
+    options.epsilon = 1e-8f;
+    options.batch_size = DEFAULT_TRAIN_BATCH;
+    options.seed = 0;
+    return options;
+}
+
+/**
+* Constructor for Trainer instance starting from given parameters
+* (copied).
+* @param weights Array of layer_count weight matrices.
+* @param biases Array of layer_count bias vectors.
+* @param act_types Activation of each layer (RELU..., SOFTMAX).
+* @param layer_count Number of layers.
+*/
+Trainer::Trainer(const Matrix *weights, const Matrix *biases,
+                 const ActivationType *act_types, int layer_count)
+        : layer_count(layer_count), max_width(0), capacity(0), steps(0),
+          epochs(0), act_types(copy_act_types(act_types, layer_count)),
+          weights(alloc_matrices(layer_count)),
+          biases(alloc_matrices(layer_count))
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        this->weights[i] = weights[i];
+        this->biases[i] = biases[i];
+    }
+    init();
+}
+
+/**
+* Constructor for Trainer instance with randomly initialized
+* parameters (He initialization, zero biases).
+* @param sizes layer_count + 1 layer widths, starting with the input.
+* @param act_types Activation of each layer (RELU..., SOFTMAX).
+* @param layer_count Number of layers.
+* @param seed Random seed.
+*/
+Trainer::Trainer(const int *sizes, const ActivationType *act_types,
+                 int layer_count, unsigned int seed)
+        : layer_count(layer_count), max_width(0), capacity(0), steps(0),
+          epochs(0), act_types(copy_act_types(act_types, layer_count)),
+          weights(alloc_matrices(layer_count)),
+          biases(alloc_matrices(layer_count))
+{
+    std::mt19937 rng(seed);
+    for (int i = 0; i < layer_count; ++i)
+    {
+        weights[i] = Matrix(sizes[i + 1], sizes[i]);
+        biases[i] = Matrix(sizes[i + 1], 1);
+        const float limit = std::sqrt(6.0f / (float) sizes[i]);
+        std::uniform_real_distribution<float> dist(-limit, limit);
+        float *w = weights[i].data();
+        for (int k = 0; k < sizes[i + 1] * sizes[i]; ++k)
+        {
+            w[k] = dist(rng);
+        }
+    }
+    init();
+}
+
+/**
+* Constructor for Trainer instance fine-tuning a network (FP16/BF16
+* weights are widened to float32).
+* @param network Network to start from.
+*/
+Trainer::Trainer(const MlpNetwork &network)
+        : layer_count(network.get_layer_count()), max_width(0), capacity(0),
+          steps(0), epochs(0), act_types(nullptr),
+          weights(alloc_matrices(layer_count)),
+          biases(alloc_matrices(layer_count))
+{
+    act_types = new(std::nothrow) ActivationType[layer_count];
+    if (act_types == nullptr)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    for (int i = 0; i < layer_count; ++i)
+    {
+        const Dense &layer = network.get_layer(i);
+        weights[i] = layer.get_weights();
+        biases[i] = layer.get_bias();
+        act_types[i] = layer.get_activation().get_activation_type();
+    }
+    init();
+}
+
+/**
+* Helper function that checks the layer types and builds the borrowing
+* Dense layers and the gradient and optimizer buffers.
+*/
+void Trainer::init()
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        if (act_types[i] != (i + 1 < layer_count ? RELU : SOFTMAX))
+        {
+            exit_func(TRAIN_LAYERS_ERR);
+        }
+        if (biases[i].get_rows() != weights[i].get_rows() ||
+            biases[i].get_cols() != 1 ||
+            (i > 0 && weights[i].get_cols() != weights[i - 1].get_rows()))
+        {
+            exit_func(BIAS_OR_WEIGHTS_SIZE_ERR);
+        }
+        max_width = std::max(max_width, weights[i].get_rows());
+    }
+    weight_grads = alloc_matrices(layer_count);
+    bias_grads = alloc_matrices(layer_count);
+    weight_m = alloc_matrices(layer_count);
+    weight_v = alloc_matrices(layer_count);
+    bias_m = alloc_matrices(layer_count);
+    bias_v = alloc_matrices(layer_count);
+    outputs = alloc_matrices(layer_count);
+    layers = new(std::nothrow) Dense *[layer_count];
+    if (layers == nullptr)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    for (int i = 0; i < layer_count; ++i)
+    {
+        const int rows = weights[i].get_rows(), cols = weights[i].get_cols();
+        weight_grads[i] = Matrix(rows, cols);
+        weight_m[i] = Matrix(rows, cols);
+        weight_v[i] = Matrix(rows, cols);
+        bias_grads[i] = Matrix(rows, 1);
+        bias_m[i] = Matrix(rows, 1);
+        bias_v[i] = Matrix(rows, 1);
+        layers[i] = new(std::nothrow) Dense(MatrixView(weights[i]),
+                                            MatrixView(biases[i]),
+                                            act_types[i]);
+        if (layers[i] == nullptr)
+        {
+            exit_func(MEMORY_ALLOC_FAIL);
+        }
+    }
+}
+
+/**
+* Destructor of Trainer instance.
+*/
+Trainer::~Trainer()
+{
+    for (int i = 0; i < layer_count; ++i)
+    {
+        delete layers[i];
+    }
+    delete[] layers;
+    delete[] outputs;
+    delete[] bias_v;
+    delete[] bias_m;
+    delete[] weight_v;
+    delete[] weight_m;
+    delete[] bias_grads;
+    delete[] weight_grads;
+    delete[] biases;
+    delete[] weights;
+    delete[] act_types;
+}
+
+/**
+* Helper function that grows the activation and delta buffers.
+* @param batch_size Number of images of the next step.
+*/
+void Trainer::reserve(int batch_size)
+{
+    if (batch_size <= capacity)
+    {
+        return;
+    }
+    for (int i = 0; i < layer_count; ++i)
+    {
+        outputs[i] = Matrix(weights[i].get_rows(), batch_size);
+    }
+    delta = Matrix(max_width, batch_size);
+    delta_prev = Matrix(max_width, batch_size);
+    capacity = batch_size;
+}
+
+/**
+* Runs the forward and backward pass on a batch and stores the
+* gradients of the mean cross-entropy loss. Does not update.
+* @param images Matrix (or view), one vectorized image per column.
+* @param labels Array of N labels.
+* @return The mean loss of the batch.
+*/
+float Trainer::backward(const MatrixView &images, const unsigned int *labels)
+{
+    if (images.get_rows() != weights[0].get_cols())
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    const int n = images.get_cols();
+    reserve(n);
+    for (int i = 0; i < layer_count; ++i)
+    {
+        const MatrixView input = i == 0 ? images :
+                MatrixView(outputs[i - 1].data(), weights[i - 1].get_rows(),
+                           n, n, 1);
+        if (i + 1 < layer_count)
+        {
+            layers[i]->apply(input, outputs[i].data());
+        }
+        else
+        {
+            // logits and softmax separately, as the inference path does
+            layers[i]->apply_logits(input, outputs[i].data());
+            Activation(SOFTMAX).apply_in_place(outputs[i].data(),
+                                               weights[i].get_rows(), n);
+        }
+    }
+
+    // softmax + cross-entropy: d loss / d logits = (p - one_hot) / n
+    const int classes = weights[layer_count - 1].get_rows();
+    const float *probs = outputs[layer_count - 1].data();
+    float *d = delta.data();
+    float *d_prev = delta_prev.data();
+    const float inv_n = 1.0f / (float) n;
+    double loss = 0;
+    for (int j = 0; j < n; ++j)
+    {
+        if (labels[j] >= (unsigned int) classes)
+        {
+            exit_func(TRAIN_LABEL_ERR);
+        }
+        loss -= std::log(std::max(probs[labels[j] * n + j], TRAIN_MIN_PROB));
+    }
+    for (int i = 0; i < classes; ++i)
+    {
+        for (int j = 0; j < n; ++j)
+        {
+            const float target = labels[j] == (unsigned int) i ? 1.0f : 0.0f;
+            d[i * n + j] = (probs[i * n + j] - target) * inv_n;
+        }
+    }
+
+    for (int l = layer_count - 1; l >= 0; --l)
+    {
+        const int out = weights[l].get_rows(), in = weights[l].get_cols();
+        const MatrixView input = l == 0 ? images :
+                MatrixView(outputs[l - 1].data(), in, n, n, 1);
+        // dW = delta * input^T - the transpose is given by swapped strides
+        gemm(out, in, n, d, n, 1,
+             input.data(), input.get_col_stride(), input.get_row_stride(),
+             weight_grads[l].data(), in, false);
+        float *db = bias_grads[l].data();
+        for (int i = 0; i < out; ++i)
+        {
+            float sum = 0;
+            for (int j = 0; j < n; ++j)
+            {
+                sum += d[i * n + j];
+            }
+            db[i] = sum;
+        }
+        if (l == 0)
+        {
+            break;
+        }
+        // delta of the previous layer = (W^T * delta) masked by its RELU
+        gemm(in, n, out, weights[l].data(), 1, in, d, n, 1, d_prev, n, false);
+        const float *a = outputs[l - 1].data();
+        for (int k = 0; k < in * n; ++k)
+        {
+            if (!(a[k] > 0))
+            {
+                d_prev[k] = 0;
+            }
+        }
+        std::swap(d, d_prev);
+    }
+    return (float) (loss / n);
+}
+
+/**
+* Helper function that applies one optimizer update to a parameter array.
+* @param param parameters
+* @param grad their gradients
+* @param m SGD velocity, or ADAM first moment
+* @param v ADAM second moment
+* @param size number of parameters
+* @param options optimizer and hyper-parameters
+* @param t number of the step (from 1)
+*/
+static void update_params(float *param, const float *grad, float *m, float *v,
+                          int size, const train_options &options, int t)
+{
+    if (options.optimizer == SGD)
+    {
+        for (int k = 0; k < size; ++k)
+        {
+            m[k] = options.momentum * m[k] + grad[k];
+            param[k] -= options.learning_rate * m[k];
+        }
+        return;
+    }
+    const float b1 = options.beta1, b2 = options.beta2;
+    // bias correction folded into the step size
+    const float step = options.learning_rate *
+                       std::sqrt(1.0f - std::pow(b2, (float) t)) /
+                       (1.0f - std::pow(b1, (float) t));
+    for (int k = 0; k < size; ++k)
+    {
+        m[k] = b1 * m[k] + (1.0f - b1) * grad[k];
+        v[k] = b2 * v[k] + (1.0f - b2) * grad[k] * grad[k];
+        param[k] -= step * m[k] / (std::sqrt(v[k]) + options.epsilon);
+    }
+}
+
+/**
+* Updates the parameters with the stored gradients.
+* @param options Optimizer and hyper-parameters.
+*/
+void Trainer::step(const train_options &options)
+{
+    if (!(options.learning_rate > 0) || options.batch_size <= 0 ||
+        (options.optimizer != SGD && options.optimizer != ADAM))
+    {
+        exit_func(TRAIN_OPTIONS_ERR);
+    }
+    ++steps;
+    for (int l = 0; l < layer_count; ++l)
+    {
+        update_params(weights[l].data(), weight_grads[l].data(),
+                      weight_m[l].data(), weight_v[l].data(),
+                      weights[l].get_rows() * weights[l].get_cols(), options,
+                      steps);
+        update_params(biases[l].data(), bias_grads[l].data(),
+                      bias_m[l].data(), bias_v[l].data(),
+                      biases[l].get_rows(), options, steps);
+    }
+}
+
+/**
+* One training step: backward() then step().
+* @param images Matrix (or view), one vectorized image per column.
+* @param labels Array of N labels.
+* @param options Optimizer and hyper-parameters.
+* @return The mean loss of the batch (before the update).
+*/
+float Trainer::train_batch(const MatrixView &images,
+                           const unsigned int *labels,
+                           const train_options &options)
+{
+    const float loss = backward(images, labels);
+    step(options);
+    return loss;
+}
+
+/**
+* Trains one epoch over a data set in shuffled mini-batches.
+* @param images Data set, one image per column. Images stored one per
+* row (then contiguous) can be passed as a transposed view.
+* @param labels Array of N labels.
+* @param options Optimizer and hyper-parameters.
+* @return The mean loss over the epoch.
+*/
+float Trainer::train_epoch(const MatrixView &images,
+                           const unsigned int *labels,
+                           const train_options &options)
+{
+    const int n = images.get_cols(), input = images.get_rows();
+    const int batch_size = options.batch_size;
+    if (batch_size <= 0)
+    {
+        exit_func(TRAIN_OPTIONS_ERR);
+    }
+    if (input != weights[0].get_cols())
+    {
+        exit_func(BATCH_SIZE_ERR);
+    }
+    if (batch.get_rows() != input || batch.get_cols() < batch_size)
+    {
+        batch = Matrix(input, batch_size);
+    }
+    int *order = new(std::nothrow) int[n];
+    unsigned int *batch_labels = new(std::nothrow) unsigned int[batch_size];
+    if (order == nullptr || batch_labels == nullptr)
+    {
+        exit_func(MEMORY_ALLOC_FAIL);
+    }
+    for (int j = 0; j < n; ++j)
+    {
+        order[j] = j;
+    }
+    std::mt19937 rng(options.seed + (unsigned int) epochs);
+    std::shuffle(order, order + n, rng);
+    ++epochs;
+
+    const float *src = images.data();
+    const int rs = images.get_row_stride(), cs = images.get_col_stride();
+    float *dst = batch.data();
+    double loss = 0;
+    for (int start = 0; start < n; start += batch_size)
+    {
+        const int count = std::min(batch_size, n - start);
+        for (int b = 0; b < count; ++b)
+        {
+            const float *column = src + (size_t) order[start + b] * cs;
+            for (int i = 0; i < input; ++i)
+            {
+                dst[i * count + b] = column[(size_t) i * rs];
+            }
+            batch_labels[b] = labels[order[start + b]];
+        }
+        loss += (double) train_batch(MatrixView(dst, input, count, count, 1),
+                                     batch_labels, options) * count;
+    }
+    delete[] batch_labels;
+    delete[] order;
+    return n > 0 ? (float) (loss / n) : 0.0f;
+}
+
+/**
+* Get the number of layers.
+* @return Number of layers as int.
+*/
+int Trainer::get_layer_count() const
+{
+    return layer_count;
+}
+
+/**
+* Getter of the weights of all layers.
+* @return Array of get_layer_count() weight matrices.
+*/
+const Matrix *Trainer::get_weights() const
+{
+    return weights;
+}
+
+/**
+* Getter of the biases of all layers.
+* @return Array of get_layer_count() bias vectors.
+*/
+const Matrix *Trainer::get_biases() const
+{
+    return biases;
+}
+
+/**
+* Getter of the activations of all layers.
+* @return Array of get_layer_count() activation types.
+*/
+const ActivationType *Trainer::get_act_types() const
+{
+    return act_types;
+}
+
+/**
+* Getter of the loss gradient of a layer's weights (see backward()).
+* @param layer layer index
+* @return The gradient, same shape as the weights.
+*/
+const Matrix &Trainer::get_weight_gradient(int layer) const
+{
+    if (layer < 0 || layer >= layer_count)
+    {
+        exit_func(LAYER_INDEX_ERR);
+    }
+    return weight_grads[layer];
+}
+
+/**
+* Getter of the loss gradient of a layer's bias (see backward()).
+* @param layer layer index
+* @return The gradient, same shape as the bias.
+*/
+const Matrix &Trainer::get_bias_gradient(int layer) const
+{
+    if (layer < 0 || layer >= layer_count)
+    {
+        exit_func(LAYER_INDEX_ERR);
+    }
+    return bias_grads[layer];
+}
+
+/**
+* Writes the trained parameters as a packed model file.
+* @param path Path of the file to create.
+* @param format Format to store the weights in.
+* @return true on success, false if the file could not be written.
+*/
+bool Trainer::save(const std::string &path, WeightFormat format) const
+{
+    return MlpModel::save(path, weights, biases, act_types, layer_count,
+                          format);
+}
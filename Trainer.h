@@ -0,0 +1,214 @@
+// Trainer.h
+
+#ifndef TRAINER_H
+#define TRAINER_H
+
+#include "MlpNetwork.h"
+
+#define DEFAULT_TRAIN_BATCH 64
+#define TRAIN_LAYERS_ERR "Error: Training needs RELU hidden layers and a "\
+"SOFTMAX output layer!\n"
+#define TRAIN_LABEL_ERR "Error: Training label out of range!\n"
+#define TRAIN_OPTIONS_ERR "Error: Invalid training options!\n"
+
+/**
+ * @enum OptimizerType
+ * @brief Parameter update rule of a Trainer.
+ */
+enum OptimizerType
+{
+    SGD,
+    ADAM
+};
+
+/**
+ * @struct train_options
+ * @brief Hyper-parameters of a training run.
+ * @var optimizer - SGD (with momentum) or ADAM
+ * @var learning_rate - step size
+ * @var momentum - SGD momentum, 0 for plain SGD
+ * @var beta1 - ADAM first moment decay
+ * @var beta2 - ADAM second moment decay
+ * @var epsilon - ADAM denominator guard
+ * @var batch_size - images per step
+ * @var seed - seed of the per-epoch shuffling
+ */
+typedef struct train_options
+{
+    OptimizerType optimizer;
+    float learning_rate;
+    float momentum;
+    float beta1;
+    float beta2;
+    float epsilon;
+    int batch_size;
+    unsigned int seed;
+} train_options;
+
+/**
+ * Default hyper-parameters: ADAM with learning rate 1e-3, or SGD with
+ * learning rate 0.05 and momentum 0.9; batches of DEFAULT_TRAIN_BATCH.
+ * @param optimizer the update rule
+ * @return The options.
+ */
+train_options default_train_options(OptimizerType optimizer = ADAM);
+
+/**
+   * Trainer Class - trains a network of RELU Dense layers with a SOFTMAX
+   * output on the cross-entropy loss, with mini-batch SGD or ADAM.
+   * The trainer owns float32 parameters; its Dense layers borrow them, so
+   * the forward pass is the inference code. The backward pass runs on the
+   * same blocked GEMM kernels (with transposed operands given by strides).
+   * Activations, gradients and optimizer state are allocated once and
+   * reused by every step.
+   */
+class Trainer
+{
+private:
+    int layer_count;
+    int max_width;
+    int capacity;
+    int steps;
+    int epochs;
+    ActivationType *act_types;
+    Matrix *weights, *biases;
+    Matrix *weight_grads, *bias_grads;
+    Matrix *weight_m, *weight_v, *bias_m, *bias_v; // optimizer state
+    Dense **layers;
+    Matrix *outputs; // per layer activations, (layer rows) x capacity
+    Matrix delta, delta_prev, batch;
+
+    /**
+    * Helper function that checks the layer types and builds the borrowing
+    * Dense layers and the gradient and optimizer buffers.
+    */
+    void init();
+
+    /**
+    * Helper function that grows the activation and delta buffers.
+    * @param batch_size Number of images of the next step.
+    */
+    void reserve(int batch_size);
+
+public:
+    /**
+    * Constructor for Trainer instance starting from given parameters
+    * (copied).
+    * @param weights Array of layer_count weight matrices.
+    * @param biases Array of layer_count bias vectors.
+    * @param act_types Activation of each layer (RELU..., SOFTMAX).
+    * @param layer_count Number of layers.
+    */
+    Trainer(const Matrix *weights, const Matrix *biases,
+            const ActivationType *act_types, int layer_count);
+
+    /**
+    * Constructor for Trainer instance with randomly initialized
+    * parameters (He initialization, zero biases).
+    * @param sizes layer_count + 1 layer widths, starting with the input.
+    * @param act_types Activation of each layer (RELU..., SOFTMAX).
+    * @param layer_count Number of layers.
+    * @param seed Random seed.
+    */
+    Trainer(const int *sizes, const ActivationType *act_types,
+            int layer_count, unsigned int seed);
+
+    /**
+    * Constructor for Trainer instance fine-tuning a network (FP16/BF16
+    * weights are widened to float32).
+    * @param network Network to start from.
+    */
+    explicit Trainer(const MlpNetwork &network);
+
+    /**
+    * Destructor of Trainer instance.
+    */
+    ~Trainer();
+
+    Trainer(const Trainer &) = delete;
+    Trainer &operator=(const Trainer &) = delete;
+
+    /**
+    * Runs the forward and backward pass on a batch and stores the
+    * gradients of the mean cross-entropy loss. Does not update.
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param labels Array of N labels.
+    * @return The mean loss of the batch.
+    */
+    float backward(const MatrixView &images, const unsigned int *labels);
+
+    /**
+    * Updates the parameters with the stored gradients.
+    * @param options Optimizer and hyper-parameters.
+    */
+    void step(const train_options &options);
+
+    /**
+    * One training step: backward() then step().
+    * @param images Matrix (or view), one vectorized image per column.
+    * @param labels Array of N labels.
+    * @param options Optimizer and hyper-parameters.
+    * @return The mean loss of the batch (before the update).
+    */
+    float train_batch(const MatrixView &images, const unsigned int *labels,
+                      const train_options &options);
+
+    /**
+    * Trains one epoch over a data set in shuffled mini-batches.
+    * @param images Data set, one image per column. Images stored one per
+    * row (then contiguous) can be passed as a transposed view.
+    * @param labels Array of N labels.
+    * @param options Optimizer and hyper-parameters.
+    * @return The mean loss over the epoch.
+    */
+    float train_epoch(const MatrixView &images, const unsigned int *labels,
+                      const train_options &options);
+
+    /**
+    * Get the number of layers.
+    * @return Number of layers as int.
+    */
+    int get_layer_count() const;
+
+    /**
+    * Getter of the weights of all layers.
+    * @return Array of get_layer_count() weight matrices.
+    */
+    const Matrix *get_weights() const;
+
+    /**
+    * Getter of the biases of all layers.
+    * @return Array of get_layer_count() bias vectors.
+    */
+    const Matrix *get_biases() const;
+
+    /**
+    * Getter of the activations of all layers.
+    * @return Array of get_layer_count() activation types.
+    */
+    const ActivationType *get_act_types() const;
+
+    /**
+    * Getter of the loss gradient of a layer's weights (see backward()).
+    * @param layer layer index
+    * @return The gradient, same shape as the weights.
+    */
+    const Matrix &get_weight_gradient(int layer) const;
+
+    /**
+    * Getter of the loss gradient of a layer's bias (see backward()).
+    * @param layer layer index
+    * @return The gradient, same shape as the bias.
+    */
+    const Matrix &get_bias_gradient(int layer) const;
+
+    /**
+    * Writes the trained parameters as a packed model file.
+    * @param path Path of the file to create.
+    * @param format Format to store the weights in.
+    * @return true on success, false if the file could not be written.
+    */
+    bool save(const std::string &path, WeightFormat format = FP32) const;
+};
+
+#endif //TRAINER_H
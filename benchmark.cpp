@@ -0,0 +1,610 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Activation.h"
+#include "AllocCounter.h"
+#include "CachedMlp.h"
+#include "Dense.h"
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "Profiler.h"
+#include "StaticMlp.h"
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./benchmark [--json out] [--baseline file] " \
+                  "[--max-regression percent] [--filter text] [--quick]\n" \
+                  "\t--json - write the results as JSON\n" \
+                  "\t--baseline - compare p50 latencies with a stored JSON run\n" \
+                  "\t--max-regression - exit with failure if a p50 is more " \
+                  "than percent slower than the baseline\n" \
+                  "\t--filter - run only benchmarks whose name contains text\n" \
+                  "\t--quick - shorter runs (less stable numbers)"
+#define ERROR_OPEN_FILE "Error: failed to open file: "
+
+#define MIN_SAMPLES 1000
+#define MAX_SAMPLES 100000
+#define SAMPLE_BUDGET_SEC 0.25
+#define QUICK_BUDGET_SEC 0.02
+#define MIN_SAMPLE_NS 1000.0
+#define BATCH_COLS 64
+#define SPARSE_BENCH_SPARSITY 0.9f
+#define INK_FRACTION 5 // one pixel in 5 is ink, as in MNIST digits
+
+typedef std::chrono::steady_clock bench_clock;
+
+/**
+ * @struct bench_result
+ * @brief Latency distribution of one benchmark.
+ * @var name - benchmark name
+ * @var samples - number of timed samples
+ * @var p50_ns, p99_ns, p999_ns - latency percentiles of one call
+ * @var mean_ns - mean latency of one call
+ * @var calls_per_sec - throughput
+ * @var allocs_per_call - heap allocations made by one call
+ */
+typedef struct bench_result
+{
+    std::string name;
+    int samples;
+    double p50_ns, p99_ns, p999_ns, mean_ns;
+    double calls_per_sec;
+    double allocs_per_call;
+} bench_result;
+
+/**
+ * Benchmark options given on the command line.
+ */
+typedef struct bench_options
+{
+    std::string json_path;
+    std::string baseline_path;
+    std::string filter;
+    double max_regression;
+    double budget_sec;
+} bench_options;
+
+// Results are accumulated here so the compiler cannot drop the timed calls.
+static volatile float sink;
+
+/**
+ * Fills a matrix with deterministic pseudo random values in [-1, 1).
+ * @param m matrix to fill
+ * @param seed generator seed
+ */
+void fill_matrix(Matrix &m, unsigned int seed)
+{
+    for (int i = 0; i < m.get_rows() * m.get_cols(); i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        m[i] = (float) ((seed >> 8) & 0xffff) / 32768.0f - 1.0f;
+    }
+}
+
+/**
+ * Fills a matrix like a digit image: pseudo random values in (0, 1] on one
+ * element in INK_FRACTION, zero background elsewhere.
+ * @param m matrix to fill
+ * @param seed generator seed
+ */
+void fill_image(Matrix &m, unsigned int seed)
+{
+    fill_matrix(m, seed);
+    for (int i = 0; i < m.get_rows() * m.get_cols(); i++)
+    {
+        m[i] = i % INK_FRACTION == 0 ? 1.0f - 0.5f * (m[i] + 1.0f) : 0.0f;
+    }
+}
+
+/**
+ * Gives the nanoseconds passed since a time point.
+ */
+double ns_since(const bench_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::nano>(bench_clock::now() -
+                                                    start).count();
+}
+
+/**
+ * Returns the value at a percentile of sorted samples.
+ */
+double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t idx = (size_t) (p * (double) (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+/**
+ * Times a benchmark body. Calls that take less than MIN_SAMPLE_NS are
+ * repeated inside one sample, so the clock overhead does not dominate.
+ * Samples are taken until the time budget is used, with at least
+ * MIN_SAMPLES (so p999 is meaningful) and at most MAX_SAMPLES.
+ * @param name benchmark name
+ * @param body function running one call
+ * @param options benchmark options
+ * @return The latency distribution.
+ */
+template <typename F>
+bench_result run_bench(const std::string &name, F body,
+                       const bench_options &options)
+{
+    // warm up (caches, workspaces, packing buffers) and calibrate
+    body();
+    bench_clock::time_point start = bench_clock::now();
+    body();
+    const double first_ns = std::max(ns_since(start), 1.0);
+    const int reps = (int) std::max(1.0, MIN_SAMPLE_NS / first_ns);
+
+    std::vector<double> samples;
+    samples.reserve(MAX_SAMPLES);
+    const size_t allocs_before = thread_alloc_count();
+    const bench_clock::time_point run_start = bench_clock::now();
+    while ((int) samples.size() < MAX_SAMPLES &&
+           ((int) samples.size() < MIN_SAMPLES ||
+            ns_since(run_start) < options.budget_sec * 1e9))
+    {
+        start = bench_clock::now();
+        for (int r = 0; r < reps; r++)
+        {
+            body();
+        }
+        samples.push_back(ns_since(start) / reps);
+    }
+    const size_t allocs = thread_alloc_count() - allocs_before;
+
+    bench_result result;
+    result.name = name;
+    result.samples = (int) samples.size();
+    double total = 0;
+    for (double s : samples)
+    {
+        total += s;
+    }
+    std::sort(samples.begin(), samples.end());
+    result.p50_ns = percentile(samples, 0.5);
+    result.p99_ns = percentile(samples, 0.99);
+    result.p999_ns = percentile(samples, 0.999);
+    result.mean_ns = total / (double) samples.size();
+    result.calls_per_sec = 1e9 / result.mean_ns;
+    result.allocs_per_call = (double) allocs /
+                             ((double) samples.size() * reps);
+    return result;
+}
+
+/**
+ * Runs a benchmark if it passes the filter and records its result.
+ */
+template <typename F>
+void add_bench(std::vector<bench_result> &results, const std::string &name,
+               F body, const bench_options &options)
+{
+    if (name.find(options.filter) == std::string::npos)
+    {
+        return;
+    }
+    results.push_back(run_bench(name, body, options));
+    const bench_result &r = results.back();
+    std::cout << std::left << std::setw(34) << r.name << std::right
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << r.p50_ns
+              << std::setw(12) << r.p99_ns
+              << std::setw(12) << r.p999_ns
+              << std::setw(14) << r.calls_per_sec
+              << std::setprecision(2) << std::setw(10) << r.allocs_per_call
+              << std::endl;
+}
+
+/**
+ * Benchmarks the Matrix operations across sizes.
+ */
+void bench_matrix(std::vector<bench_result> &results,
+                  const bench_options &options)
+{
+    const int sizes[] = {16, 64, 128, 256};
+    for (int n : sizes)
+    {
+        const std::string dims = std::to_string(n) + "x" + std::to_string(n);
+        Matrix a(n, n), b(n, n);
+        fill_matrix(a, 1);
+        fill_matrix(b, 2);
+        add_bench(results, "matrix/multiply/" + dims, [&]
+        {
+            Matrix c = a * b;
+            sink = sink + c[0];
+        }, options);
+        add_bench(results, "matrix/add/" + dims, [&]
+        {
+            Matrix c = a + b;
+            sink = sink + c[0];
+        }, options);
+        add_bench(results, "matrix/transpose/" + dims, [&]
+        {
+            a.transpose();
+            sink = sink + a[1];
+        }, options);
+        Matrix v(a);
+        add_bench(results, "matrix/vectorize/" + dims, [&]
+        {
+            v.vectorize();
+            sink = sink + v[0];
+        }, options);
+        add_bench(results, "matrix/dot/" + dims, [&]
+        {
+            Matrix c = a.dot(b);
+            sink = sink + c[0];
+        }, options);
+        add_bench(results, "matrix/norm/" + dims, [&]
+        {
+            sink = sink + a.norm();
+        }, options);
+    }
+}
+
+/**
+ * Benchmarks each activation type on a layer sized vector and batch.
+ */
+void bench_activation(std::vector<bench_result> &results,
+                      const bench_options &options)
+{
+    const ActivationType types[] = {RELU, SOFTMAX};
+    const char *type_names[] = {"relu", "softmax"};
+    for (int t = 0; t < 2; t++)
+    {
+        const Activation act(types[t]);
+        const int widths[] = {1, BATCH_COLS};
+        for (int cols : widths)
+        {
+            Matrix in(weights_dims[0].rows, cols);
+            fill_matrix(in, 3);
+            const std::string name = std::string("activation/") +
+                                     type_names[t] + "/" +
+                                     std::to_string(in.get_rows()) + "x" +
+                                     std::to_string(cols);
+            add_bench(results, name, [&]
+            {
+                Matrix out = act(in);
+                sink = sink + out[0];
+            }, options);
+            Matrix scratch(in);
+            add_bench(results, name + "/in_place", [&]
+            {
+                act.apply_in_place(scratch);
+                sink = sink + scratch[0];
+            }, options);
+        }
+    }
+}
+
+/**
+ * Benchmarks every Dense layer of the network at its real dimensions, dense
+ * (packing the weights per call and pre-packed), pruned to 90% sparsity
+ * (CSR), and the first layer on digit-like images with and without skipping
+ * zero pixels.
+ */
+void bench_dense(std::vector<bench_result> &results,
+                 const bench_options &options)
+{
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        Matrix w(weights_dims[i].rows, weights_dims[i].cols);
+        Matrix b(bias_dims[i].rows, bias_dims[i].cols);
+        fill_matrix(w, 10 + i);
+        fill_matrix(b, 20 + i);
+        const Dense layer(w, b, i + 1 < MLP_SIZE ? RELU : SOFTMAX);
+        Dense packed(layer);
+        packed.set_weight_packing(true);
+        const Dense sparse(SparseMatrix(prune_weights(w,
+                                                      SPARSE_BENCH_SPARSITY)),
+                           b, i + 1 < MLP_SIZE ? RELU : SOFTMAX);
+        const std::string dims = std::to_string(weights_dims[i].rows) + "x" +
+                                 std::to_string(weights_dims[i].cols);
+        const int widths[] = {1, BATCH_COLS};
+        for (int cols : widths)
+        {
+            Matrix in(weights_dims[i].cols, cols);
+            fill_matrix(in, 30 + i);
+            Matrix out(weights_dims[i].rows, cols);
+            const std::string name = "dense/" + std::to_string(i + 1) + "/" +
+                                     dims + "/batch" + std::to_string(cols);
+            add_bench(results, name, [&]
+            {
+                layer.apply(in, out);
+                sink = sink + out[0];
+            }, options);
+            if (cols > 1)
+            {
+                add_bench(results, name + "/prepacked", [&]
+                {
+                    packed.apply(in, out);
+                    sink = sink + out[0];
+                }, options);
+            }
+            add_bench(results, name + "/sparse90", [&]
+            {
+                sparse.apply(in, out);
+                sink = sink + out[0];
+            }, options);
+            if (i == 0)
+            {
+                Dense skipping(layer);
+                skipping.set_input_skipping(true);
+                Matrix image(weights_dims[i].cols, cols);
+                fill_image(image, 30 + i);
+                add_bench(results, name + "/digit", [&]
+                {
+                    layer.apply(image, out);
+                    sink = sink + out[0];
+                }, options);
+                add_bench(results, name + "/digit_skip", [&]
+                {
+                    skipping.apply(image, out);
+                    sink = sink + out[0];
+                }, options);
+            }
+        }
+    }
+}
+
+/**
+ * Benchmarks end-to-end MlpNetwork and StaticMlpNetwork latency on synthetic
+ * parameters.
+ */
+void bench_network(std::vector<bench_result> &results,
+                   const bench_options &options)
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weights_dims[i].rows, weights_dims[i].cols);
+        biases[i] = Matrix(bias_dims[i].rows, bias_dims[i].cols);
+        fill_matrix(weights[i], 40 + i);
+        fill_matrix(biases[i], 50 + i);
+    }
+    // mlp has the default configuration; tuned opts in to zero pixel
+    // skipping and pre-packed weights (the *_skip_packed entries)
+    const MlpNetwork mlp(weights, biases);
+    MlpNetwork tuned(weights, biases);
+    tuned.set_input_skipping(true);
+    tuned.set_weight_packing(true);
+    Matrix img(img_dims.rows * img_dims.cols, 1);
+    fill_matrix(img, 60);
+    add_bench(results, "mlp/image", [&]
+    {
+        sink = sink + mlp(img).probability;
+    }, options);
+    add_bench(results, "mlp/image_skip_packed", [&]
+    {
+        sink = sink + tuned(img).probability;
+    }, options);
+    Matrix digit_img(img_dims.rows * img_dims.cols, 1);
+    fill_image(digit_img, 60);
+    add_bench(results, "mlp/digit_image", [&]
+    {
+        sink = sink + mlp(digit_img).probability;
+    }, options);
+    add_bench(results, "mlp/digit_image_skip_packed", [&]
+    {
+        sink = sink + tuned(digit_img).probability;
+    }, options);
+    profiler_enable(true);
+    add_bench(results, "mlp/image_profiled", [&]
+    {
+        sink = sink + mlp(img).probability;
+    }, options);
+    profiler_enable(false);
+    add_bench(results, "mlp/classify", [&]
+    {
+        sink = sink + (float) mlp.classify(img);
+    }, options);
+    add_bench(results, "mlp/top3", [&]
+    {
+        unsigned int labels[3];
+        float probs[3];
+        mlp.top_k(img, 3, labels, probs);
+        sink = sink + probs[2];
+    }, options);
+    Matrix batch(img_dims.rows * img_dims.cols, BATCH_COLS);
+    fill_matrix(batch, 61);
+    digit out[BATCH_COLS];
+    add_bench(results, "mlp/batch" + std::to_string(BATCH_COLS), [&]
+    {
+        mlp.predict_batch(batch, out);
+        sink = sink + out[0].probability;
+    }, options);
+    add_bench(results,
+              "mlp/batch" + std::to_string(BATCH_COLS) + "_skip_packed", [&]
+    {
+        tuned.predict_batch(batch, out);
+        sink = sink + out[0].probability;
+    }, options);
+    add_bench(results, "mlp/hash_image", [&]
+    {
+        sink = sink + (float) (hash_image(img) & 1);
+    }, options);
+    CachedMlp cache(mlp);
+    cache(img);
+    add_bench(results, "mlp/cached_image", [&]
+    {
+        sink = sink + cache(img).probability;
+    }, options);
+    // one image per row, as InferenceServer batches them
+    Matrix batch_rows = batch;
+    batch_rows.transpose();
+    cache.predict_batch(MatrixView(batch_rows).transposed(), out);
+    add_bench(results, "mlp/cached_batch" + std::to_string(BATCH_COLS), [&]
+    {
+        cache.predict_batch(MatrixView(batch_rows).transposed(), out);
+        sink = sink + out[0].probability;
+    }, options);
+    const StaticMlpNetwork *static_mlp = new StaticMlpNetwork(weights,
+                                                              biases);
+    add_bench(results, "mlp/static_image", [&]
+    {
+        sink = sink + (*static_mlp)(img).probability;
+    }, options);
+    delete static_mlp;
+}
+
+/**
+ * Writes the results as JSON.
+ * @return true on success.
+ */
+bool write_json(const std::string &path,
+                const std::vector<bench_result> &results)
+{
+    std::ofstream os(path);
+    if (!os.is_open())
+    {
+        return false;
+    }
+    os << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const bench_result &r = results[i];
+        os << std::fixed << std::setprecision(3)
+           << "    {\"name\": \"" << r.name << "\", \"samples\": "
+           << r.samples << ", \"p50_ns\": " << r.p50_ns
+           << ", \"p99_ns\": " << r.p99_ns << ", \"p999_ns\": " << r.p999_ns
+           << ", \"mean_ns\": " << r.mean_ns << ", \"calls_per_sec\": "
+           << r.calls_per_sec << ", \"allocs_per_call\": "
+           << r.allocs_per_call << "}"
+           << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+    return os.good();
+}
+
+/**
+ * Finds the value of a numeric field in a JSON object written by
+ * write_json().
+ */
+double json_field(const std::string &object, const std::string &field)
+{
+    const std::string key = "\"" + field + "\": ";
+    const size_t pos = object.find(key);
+    if (pos == std::string::npos)
+    {
+        return -1;
+    }
+    return std::atof(object.c_str() + pos + key.size());
+}
+
+/**
+ * Compares the results with a baseline run written by write_json().
+ * @return Number of benchmarks whose p50 regressed by more than
+ * max_regression percent (0 when max_regression is negative).
+ */
+int compare_baseline(const std::string &path,
+                     const std::vector<bench_result> &results,
+                     double max_regression)
+{
+    std::ifstream is(path);
+    if (!is.is_open())
+    {
+        std::cerr << ERROR_OPEN_FILE << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::stringstream contents;
+    contents << is.rdbuf();
+    const std::string json = contents.str();
+    std::cout << std::endl << "Compared with " << path << " (p50):"
+              << std::endl;
+    int regressions = 0;
+    for (const bench_result &r : results)
+    {
+        const size_t pos = json.find("\"name\": \"" + r.name + "\"");
+        if (pos == std::string::npos)
+        {
+            continue;
+        }
+        const std::string object = json.substr(pos, json.find('}', pos) -
+                                                    pos);
+        const double base = json_field(object, "p50_ns");
+        if (base <= 0)
+        {
+            continue;
+        }
+        const double change = (r.p50_ns / base - 1) * 100;
+        const bool regressed = max_regression >= 0 && change > max_regression;
+        regressions += regressed;
+        std::cout << std::left << std::setw(34) << r.name << std::right
+                  << std::fixed << std::setprecision(1) << std::setw(12)
+                  << base << std::setw(12) << r.p50_ns << std::showpos
+                  << std::setw(10) << change << "%" << std::noshowpos
+                  << (regressed ? "  REGRESSION" : "") << std::endl;
+    }
+    return regressions;
+}
+
+/**
+ * Runs the benchmark suite.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    bench_options options;
+    options.max_regression = -1;
+    options.budget_sec = SAMPLE_BUDGET_SEC;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--json") == 0 && has_value)
+        {
+            options.json_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--baseline") == 0 && has_value)
+        {
+            options.baseline_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--max-regression") == 0 && has_value)
+        {
+            options.max_regression = std::atof(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--filter") == 0 && has_value)
+        {
+            options.filter = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            options.budget_sec = QUICK_BUDGET_SEC;
+        }
+        else
+        {
+            std::cout << USAGE_MSG << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    std::cout << std::left << std::setw(34) << "benchmark" << std::right
+              << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns"
+              << std::setw(12) << "p999 ns" << std::setw(14) << "calls/sec"
+              << std::setw(10) << "allocs" << std::endl;
+    std::vector<bench_result> results;
+    bench_matrix(results, options);
+    bench_activation(results, options);
+    bench_dense(results, options);
+    bench_network(results, options);
+
+    if (!options.json_path.empty() && !write_json(options.json_path,
+                                                  results))
+    {
+        std::cerr << ERROR_OPEN_FILE << options.json_path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!options.baseline_path.empty() &&
+        compare_baseline(options.baseline_path, results,
+                         options.max_regression) > 0)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
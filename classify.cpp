@@ -0,0 +1,164 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sys/stat.h>
+
+#include "ImageLoader.h"
+#include "MlpModel.h"
+#include "MlpNetwork.h"
+#include "ParallelMlp.h"
+
+#define ERROR_NO_FILES "Error: no image files found"
+#define READ_FAILED "read error"
+#define USAGE_MSG "Usage:\n" \
+                  "\t./classify [--batch n] [--io-threads n] [--depth n] " \
+                  "[--threads n] model path...\n" \
+                  "\t--batch n - images per network call (default 64)\n" \
+                  "\t--io-threads n - threads reading files (default 4)\n" \
+                  "\t--depth n - batches loaded ahead (default 8)\n" \
+                  "\t--threads n - inference threads, 0 for all cores " \
+                  "(default 1)\n" \
+                  "\tmodel - packed model file (see pack_model)\n" \
+                  "\tpath - an image file (28x28 float32, like the " \
+                  "presubmit images) or a directory of them"
+
+#define BATCH_FLAG "--batch"
+#define IO_THREADS_FLAG "--io-threads"
+#define DEPTH_FLAG "--depth"
+#define THREADS_FLAG "--threads"
+#define MODEL_PATH_IDX 0
+#define MIN_POSITIONAL_COUNT 2
+
+typedef std::chrono::steady_clock classify_clock;
+
+/**
+ * Classifies image files through an ImageLoader, printing one
+ * "path digit probability" line per file, then the loader's queue depth and
+ * stall times on stderr.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    int batch_size = DEFAULT_LOADER_BATCH;
+    int io_threads = DEFAULT_LOADER_THREADS;
+    int depth = DEFAULT_LOADER_DEPTH;
+    int threads = 1;
+    int first = 1;
+    for(; first + 1 < argc && argv[first][0] == '-'; first += 2)
+    {
+        int *option = nullptr;
+        if(std::strcmp(argv[first], BATCH_FLAG) == 0)
+        {
+            option = &batch_size;
+        }
+        else if(std::strcmp(argv[first], IO_THREADS_FLAG) == 0)
+        {
+            option = &io_threads;
+        }
+        else if(std::strcmp(argv[first], DEPTH_FLAG) == 0)
+        {
+            option = &depth;
+        }
+        else if(std::strcmp(argv[first], THREADS_FLAG) == 0)
+        {
+            option = &threads;
+        }
+        if(option == nullptr)
+        {
+            std::cout << USAGE_MSG << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        *option = std::atoi(argv[first + 1]);
+    }
+    char **args = argv + first;
+    const int positional = argc - first;
+    if(positional < MIN_POSITIONAL_COUNT || batch_size <= 0 ||
+       io_threads <= 0 || depth <= 0 || threads < 0)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::string> paths;
+    for(int i = MODEL_PATH_IDX + 1; i < positional; i++)
+    {
+        struct stat st;
+        if(stat(args[i], &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            const std::vector<std::string> files = list_files(args[i]);
+            paths.insert(paths.end(), files.begin(), files.end());
+        }
+        else
+        {
+            paths.push_back(args[i]);
+        }
+    }
+    if(paths.empty())
+    {
+        std::cerr << ERROR_NO_FILES << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    MlpModel model(args[MODEL_PATH_IDX]);
+    MlpNetwork mlp(model);
+    ParallelMlp *parallel = threads == 1 ? nullptr
+                                         : new ParallelMlp(mlp, threads);
+    std::vector<digit> results((size_t) batch_size);
+    const classify_clock::time_point start = classify_clock::now();
+    double inference_seconds = 0;
+    {
+        ImageLoader loader(paths, mlp.get_input_size(), batch_size,
+                           io_threads, depth);
+        loaded_batch batch;
+        while(loader.next(batch))
+        {
+            const classify_clock::time_point batch_start =
+                    classify_clock::now();
+            if(parallel != nullptr)
+            {
+                parallel->predict_batch(loader.get_images(batch),
+                                        results.data());
+            }
+            else
+            {
+                mlp.predict_batch(loader.get_images(batch), results.data());
+            }
+            inference_seconds += std::chrono::duration<double>(
+                    classify_clock::now() - batch_start).count();
+            for(int j = 0; j < batch.count; j++)
+            {
+                std::cout << loader.get_path(batch.first + j) << " ";
+                if(batch.valid[j])
+                {
+                    std::cout << results[j].value << " " << std::fixed
+                              << std::setprecision(4)
+                              << results[j].probability << "\n";
+                }
+                else
+                {
+                    std::cout << READ_FAILED << "\n";
+                }
+            }
+        }
+        const double total_seconds = std::chrono::duration<double>(
+                classify_clock::now() - start).count();
+        const loader_stats stats = loader.get_stats();
+        std::cerr << std::fixed << std::setprecision(1) << stats.images
+                  << " images (" << stats.failed << " unreadable) in "
+                  << std::setprecision(3) << total_seconds << "s, "
+                  << std::setprecision(1)
+                  << (total_seconds > 0 ? stats.images / total_seconds : 0)
+                  << " images/sec, inference " << std::setprecision(3)
+                  << inference_seconds << "s" << std::endl
+                  << "loader: queue depth mean " << std::setprecision(2)
+                  << stats.mean_depth << " max " << stats.max_depth
+                  << ", inference waited " << std::setprecision(3)
+                  << stats.consumer_stall_seconds << "s, I/O threads waited "
+                  << stats.producer_stall_seconds << "s" << std::endl;
+    }
+    delete parallel;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include <cstdlib>
+
+#include "Evaluation.h"
+#include "MlpModel.h"
+#include "MlpNetwork.h"
+#include "ParallelMlp.h"
+#include "Profiler.h"
+
+#define ERROR_IMAGE_SIZE "Error: data set images do not fit the network input"
+#define ERROR_OUTPUT_SIZE "Error: the network must have one output per digit"
+#define USAGE_MSG "Usage:\n" \
+                  "\t./evaluate model images labels [batch_size [threads]]\n" \
+                  "\tmodel - packed model file (see pack_model)\n" \
+                  "\timages - IDX image file, e.g. t10k-images-idx3-ubyte\n" \
+                  "\tlabels - IDX label file, e.g. t10k-labels-idx1-ubyte\n" \
+                  "\tbatch_size - images per network call (default 256)\n" \
+                  "\tthreads - worker threads, 0 for all cores (default 1)\n" \
+                  "\tset MLP_PROFILE=1 to print a per-layer profile"
+
+#define MODEL_PATH_IDX 1
+#define IMAGES_PATH_IDX 2
+#define LABELS_PATH_IDX 3
+#define BATCH_SIZE_IDX 4
+#define THREADS_IDX 5
+#define MIN_ARGS_COUNT 4
+#define MAX_ARGS_COUNT 6
+
+/**
+ * Evaluates a packed model on a labelled IDX data set and prints accuracy,
+ * throughput and the confusion matrix.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    if(argc < MIN_ARGS_COUNT || argc > MAX_ARGS_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const int batch_size = argc > BATCH_SIZE_IDX ?
+                           std::atoi(argv[BATCH_SIZE_IDX]) :
+                           DEFAULT_EVAL_BATCH;
+    const int threads = argc > THREADS_IDX ? std::atoi(argv[THREADS_IDX]) : 1;
+    if(batch_size <= 0 || threads < 0)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    MlpModel model(argv[MODEL_PATH_IDX]);
+    MlpNetwork mlp(model);
+    IdxReader reader(argv[IMAGES_PATH_IDX], argv[LABELS_PATH_IDX]);
+    if(reader.get_image_rows() * reader.get_image_cols() !=
+       mlp.get_input_size())
+    {
+        std::cerr << ERROR_IMAGE_SIZE << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(mlp.get_output_size() != DIGIT_COUNT)
+    {
+        std::cerr << ERROR_OUTPUT_SIZE << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    eval_report report;
+    if(threads == 1)
+    {
+        report = evaluate(reader, [&mlp](const MatrixView &images,
+                                         digit *results)
+        { mlp.predict_batch(images, results); }, batch_size);
+    }
+    else
+    {
+        ParallelMlp parallel(mlp, threads);
+        report = evaluate(reader, [&parallel](const MatrixView &images,
+                                              digit *results)
+        { parallel.predict_batch(images, results); }, batch_size);
+    }
+    print_report(std::cout, report);
+    if(profiler_enabled())
+    {
+        print_profile(std::cout, profiler_snapshot());
+    }
+    return EXIT_SUCCESS;
+}
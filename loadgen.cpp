@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "IdxReader.h"
+#include "InferenceClient.h"
+#include "MlpNetwork.h"
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./loadgen [--uint8] socket [clients [requests " \
+                  "[in_flight]]]\n" \
+                  "\t--uint8 - send 0..255 byte pixels instead of floats\n" \
+                  "\tsocket - Unix domain socket of a running ./serve\n" \
+                  "\tclients - concurrent connections (default 8)\n" \
+                  "\trequests - images sent by each client (default 2000)\n" \
+                  "\tin_flight - pipelined requests per client (default 1)"
+
+#define UINT8_FLAG "--uint8"
+#define DEFAULT_CLIENTS 8
+#define DEFAULT_REQUESTS 2000
+#define IMAGE_POOL 16
+
+#define SOCKET_PATH_IDX 0
+#define CLIENTS_IDX 1
+#define REQUESTS_IDX 2
+#define IN_FLIGHT_IDX 3
+#define MIN_POSITIONAL_COUNT 1
+#define MAX_POSITIONAL_COUNT 4
+
+typedef std::chrono::steady_clock load_clock;
+
+/**
+ * @struct load_sample
+ * @brief One answered request.
+ * @var latency_us - time from sending the request to reading its reply
+ * @var batch_size - size of the server batch it ran in
+ */
+typedef struct load_sample
+{
+    double latency_us;
+    unsigned int batch_size;
+} load_sample;
+
+/**
+ * Returns the value at a percentile of sorted samples.
+ * @param sorted samples in ascending order
+ * @param p percentile in [0, 1]
+ * @return the sample at that percentile
+ */
+double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t idx = (size_t) (p * (double) (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+/**
+ * Prints the count and latency percentiles of a group of samples.
+ * @param label name of the group
+ * @param latencies latencies in microseconds (sorted in place)
+ */
+void print_latencies(const std::string &label, std::vector<double> &latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::setw(8) << label << std::setw(10) << latencies.size()
+              << std::fixed << std::setprecision(1)
+              << std::setw(11) << percentile(latencies, 0.5)
+              << std::setw(11) << percentile(latencies, 0.99)
+              << std::setw(11) << percentile(latencies, 0.999) << std::endl;
+}
+
+/**
+ * Runs one client: keeps in_flight requests outstanding until all are
+ * answered.
+ * @param socket_path server socket
+ * @param client client index (seeds its images)
+ * @param requests number of requests to send
+ * @param in_flight pipelined requests
+ * @param use_uint8 send byte pixels
+ * @param samples receives one sample per request
+ */
+void run_client(const std::string &socket_path, int client, int requests,
+                int in_flight, bool use_uint8,
+                std::vector<load_sample> &samples)
+{
+    const int input_size = img_dims.rows * img_dims.cols;
+    std::mt19937 rng((unsigned int) client + 1);
+    std::uniform_int_distribution<int> pixel(0, 255);
+    std::vector<unsigned char> bytes((size_t) IMAGE_POOL * input_size);
+    Matrix floats(IMAGE_POOL, input_size);
+    for(size_t i = 0; i < bytes.size(); i++)
+    {
+        bytes[i] = (unsigned char) pixel(rng);
+        floats.data()[i] = (float) bytes[i] / IDX_PIXEL_SCALE;
+    }
+    std::vector<load_clock::time_point> sent_at(requests);
+    samples.resize(requests);
+
+    InferenceClient connection(socket_path, input_size);
+    int sent = 0;
+    for(int received = 0; received < requests; received++)
+    {
+        while(sent < requests && sent - received < in_flight)
+        {
+            const int image = sent % IMAGE_POOL;
+            sent_at[sent] = load_clock::now();
+            const bool ok = use_uint8 ?
+                connection.send((uint32_t) sent,
+                                bytes.data() + (size_t) image * input_size) :
+                connection.send((uint32_t) sent,
+                                MatrixView(floats.row_ptr(image),
+                                           input_size, 1, 1, 1));
+            if(!ok)
+            {
+                std::cerr << CLIENT_REPLY_ERR << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            sent++;
+        }
+        server_reply reply;
+        if(!connection.receive(reply) || reply.id >= (uint32_t) requests)
+        {
+            std::cerr << CLIENT_REPLY_ERR << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        samples[reply.id].latency_us = std::chrono::duration<double,
+                std::micro>(load_clock::now() - sent_at[reply.id]).count();
+        samples[reply.id].batch_size = reply.batch_size;
+    }
+}
+
+/**
+ * Load generator for ./serve: runs concurrent clients and reports the
+ * latency percentiles overall and for each server batch size.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    bool use_uint8 = false;
+    int first = 1;
+    if(first < argc && std::strcmp(argv[first], UINT8_FLAG) == 0)
+    {
+        use_uint8 = true;
+        first++;
+    }
+    char **args = argv + first;
+    const int positional = argc - first;
+    if(positional < MIN_POSITIONAL_COUNT || positional > MAX_POSITIONAL_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const int clients = positional > CLIENTS_IDX ?
+                        std::atoi(args[CLIENTS_IDX]) : DEFAULT_CLIENTS;
+    const int requests = positional > REQUESTS_IDX ?
+                         std::atoi(args[REQUESTS_IDX]) : DEFAULT_REQUESTS;
+    const int in_flight = positional > IN_FLIGHT_IDX ?
+                          std::atoi(args[IN_FLIGHT_IDX]) : 1;
+    if(clients <= 0 || requests <= 0 || in_flight <= 0)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::vector<load_sample>> samples(clients);
+    std::vector<std::thread> threads;
+    const load_clock::time_point start = load_clock::now();
+    for(int c = 0; c < clients; c++)
+    {
+        threads.emplace_back(run_client, std::string(args[SOCKET_PATH_IDX]),
+                             c, requests, in_flight, use_uint8,
+                             std::ref(samples[c]));
+    }
+    for(size_t c = 0; c < threads.size(); c++)
+    {
+        threads[c].join();
+    }
+    const double seconds = std::chrono::duration<double>(
+            load_clock::now() - start).count();
+
+    std::vector<double> all;
+    std::vector<std::vector<double>> by_batch;
+    for(int c = 0; c < clients; c++)
+    {
+        for(size_t i = 0; i < samples[c].size(); i++)
+        {
+            const load_sample &sample = samples[c][i];
+            if(sample.batch_size >= by_batch.size())
+            {
+                by_batch.resize(sample.batch_size + 1);
+            }
+            by_batch[sample.batch_size].push_back(sample.latency_us);
+            all.push_back(sample.latency_us);
+        }
+    }
+    std::cout << clients << " clients x " << requests << " requests ("
+              << in_flight << " in flight): " << std::fixed
+              << std::setprecision(0) << (double) all.size() / seconds
+              << " images/sec" << std::endl;
+    std::cout << std::setw(8) << "batch" << std::setw(10) << "requests"
+              << std::setw(11) << "p50_us" << std::setw(11) << "p99_us"
+              << std::setw(11) << "p999_us" << std::endl;
+    for(size_t b = 0; b < by_batch.size(); b++)
+    {
+        if(!by_batch[b].empty())
+        {
+            print_latencies(std::to_string(b), by_batch[b]);
+        }
+    }
+    print_latencies("all", all);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+#include <cstring>
+#include <fstream>
+
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "MlpModel.h"
+
+#define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
+#define ERROR_WRITE_MODEL "Error: failed to write model file: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./pack_model [--fp16|--bf16] model w1 w2 w3 w4 b1 b2 b3 b4\n" \
+                  "\t--fp16/--bf16 - store the weights in 16 bits\n" \
+                  "\tmodel - path of the packed model file to create\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases"
+
+#define FP16_FLAG "--fp16"
+#define BF16_FLAG "--bf16"
+
+#define MODEL_PATH_IDX 1
+#define ARGS_COUNT (MODEL_PATH_IDX + 1 + (MLP_SIZE * 2))
+#define WEIGHTS_START_IDX (MODEL_PATH_IDX + 1)
+#define BIAS_START_IDX (WEIGHTS_START_IDX + MLP_SIZE)
+
+/**
+ * Given a binary file path and a matrix,
+ * reads the content of the file into the matrix.
+ * file must match matrix in size in order to read successfully.
+ * @param filePath - path of the binary file to read
+ * @param mat -  matrix to read the file into.
+ * @return boolean status
+ *          true - success
+ *          false - failure
+ */
+bool readFileToMatrix(const std::string &filePath, Matrix &mat)
+{
+    std::ifstream is;
+    is.open(filePath, std::ios::in | std::ios::binary | std::ios::ate);
+    if(!is.is_open())
+    {
+        return false;
+    }
+
+    long int matByteSize = (long int) mat.get_cols () * mat.get_rows ()  *
+                           sizeof(float);
+    if(is.tellg() != matByteSize)
+    {
+        is.close();
+        return false;
+    }
+
+    is.seekg(0, std::ios_base::beg);
+    is>>mat;
+    is.close();
+    return true;
+}
+
+/**
+ * Converts the raw w1..w4, b1..b4 float32 parameter files into a single
+ * packed model file that MlpModel maps directly, optionally converting the
+ * weights to FP16 or BF16.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    WeightFormat format = FP32;
+    if(argc == ARGS_COUNT + 1)
+    {
+        if(std::strcmp(argv[1], FP16_FLAG) == 0)
+        {
+            format = FP16;
+        }
+        else if(std::strcmp(argv[1], BF16_FLAG) == 0)
+        {
+            format = BF16;
+        }
+        else
+        {
+            std::cout << USAGE_MSG << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        argc--;
+        argv++;
+    }
+    if(argc != ARGS_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    const ActivationType act_types[MLP_SIZE] = {RELU, RELU, RELU, SOFTMAX};
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weights_dims[i].rows, weights_dims[i].cols);
+        biases[i] = Matrix(bias_dims[i].rows, bias_dims[i].cols);
+        if(!(readFileToMatrix(argv[WEIGHTS_START_IDX + i], weights[i]) &&
+             readFileToMatrix(argv[BIAS_START_IDX + i], biases[i])))
+        {
+            std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(!MlpModel::save(argv[MODEL_PATH_IDX], weights, biases, act_types,
+                       MLP_SIZE, format))
+    {
+        std::cerr << ERROR_WRITE_MODEL << argv[MODEL_PATH_IDX] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}
@@ -7,10 +7,36 @@
 
 #include "Activation.h"
 #include "MlpNetwork.h"
+#include "Gemm.h"
+#include "MlpModel.h"
+#include "AllocCounter.h"
+#include "ParallelMlp.h"
+#include "QuantizedMlp.h"
+#include "Evaluation.h"
+#include "StaticMlp.h"
+#include "Trainer.h"
+#include "PipelinedMlp.h"
+#include "InferenceClient.h"
+#include "Profiler.h"
+#include "SparseMatrix.h"
+#include "CachedMlp.h"
+#include "ImageLoader.h"
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <utility>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #define QUIT "q"
 #define INSERT_IMAGE_PATH "Please insert image path:"
@@ -31,6 +57,29 @@
 int compile_matrix ();
 void compile_activation ();
 void compile_dense ();
+void check_gemm ();
+void check_batch (MlpNetwork & mlp);
+void check_zero_alloc (MlpNetwork & mlp);
+void check_parallel (MlpNetwork & mlp);
+void check_model (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE],
+                  MlpNetwork & mlp);
+void check_quantized (MlpNetwork & mlp);
+void check_half (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE],
+                 MlpNetwork & mlp);
+void check_idx (MlpNetwork & mlp);
+void check_topology (MlpNetwork & mlp);
+void check_static (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE],
+                   MlpNetwork & mlp);
+void check_activation_kernels (MlpNetwork & mlp);
+void check_training (MlpNetwork & mlp);
+void check_pipeline (MlpNetwork & mlp);
+void check_server (MlpNetwork & mlp);
+void check_profiler (MlpNetwork & mlp);
+void check_sparse (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE]);
+void check_input_skipping (MlpNetwork & mlp);
+void check_cache (MlpNetwork & mlp);
+void check_loader (MlpNetwork & mlp);
+void check_packing (MlpNetwork & mlp);
 
 /**
  * Prints program usage to stdout.
@@ -231,6 +280,30 @@ int compile_matrix ()
   // check +=
   c += c;
 
+  std::cout << "\tSums and scalar products are matrices" << std::endl;
+  // check the results of + and scalar * keep the Matrix interface
+  assert((b + c).norm () >= 0);
+  assert((b * 2).get_rows () == 3 && (2 * b).get_cols () == 3);
+  assert((b + c + b * 2)[4] == b[4] + c[4] + b[4] * 2);
+  std::cout << b + c;
+
+  std::cout << "\tLazy expression chain" << std::endl;
+  // check a chain of sums and scalar products evaluated in one loop
+  Matrix chain = lazy (b) + lazy (b) * 2 + 0.5f * (lazy (c) + lazy (b));
+  for (int i = 0; i < b.get_cols () * b.get_rows (); i++)
+    {
+      assert(chain[i] == b[i] + b[i] * 2 + (c[i] + b[i]) * 0.5f);
+      assert(chain[i] == (b + b * 2 + 0.5f * (c + b))[i]);
+    }
+  chain = 2 * lazy (chain) + chain; // expression referring to its target
+  chain += lazy (b) * 3;
+
+  std::cout << "\tMove constructor and move assignment" << std::endl;
+  Matrix moved (std::move (chain));
+  assert(chain.get_rows () == 0 && moved.get_rows () == 3);
+  chain = std::move (moved);
+  assert(moved.get_cols () == 0 && chain.get_cols () == 3);
+
   std::cout << "\tplain_print: Should print 0 to 8" << std::endl;
   // check plain print
   m.plain_print ();
@@ -308,9 +381,1631 @@ void compile_dense ()
   std::cout << "\toperator ()" << std::endl;
   Matrix D = d (m);
   assert(D[0] == 7);
+
+  std::cout << "\tapply (fused)" << std::endl;
+  Matrix fused;
+  d.apply (m, fused);
+  assert(fused[0] == D[0]);
   std::cout << "Passed: All Dense functions exist" << std::endl << std::endl;
 }
 
+/**
+ * Fills a matrix with deterministic pseudo random values in [-1, 1].
+ */
+void fill_matrix (Matrix & m, unsigned int seed)
+{
+  for (int i = 0; i < m.get_rows () * m.get_cols (); i++)
+    {
+      seed = seed * 1103515245u + 12345u;
+      m[i] = (float) ((seed >> 8) % 2001) / 1000.0f - 1.0f;
+    }
+}
+
+/**
+ * Naive i-j-k matrix product, used as a reference for the GEMM engine.
+ */
+Matrix naive_product (const Matrix & a, const Matrix & b)
+{
+  Matrix res (a.get_rows (), b.get_cols ());
+  for (int i = 0; i < a.get_rows (); i++)
+    {
+      for (int j = 0; j < b.get_cols (); j++)
+        {
+          double sum = 0;
+          for (int k = 0; k < a.get_cols (); k++)
+            {
+              sum += (double) a (i, k) * b (k, j);
+            }
+          res (i, j) = (float) sum;
+        }
+    }
+  return res;
+}
+
+void check_gemm ()
+/**
+ * function which compares the blocked GEMM behind operator* with the naive
+ * product on shapes that hit full tiles, edge tiles, several cache blocks
+ * and the matrix-vector path.
+ */
+{
+  std::cout << "Checking GEMM engine (simd: " << gemm_uses_simd () << "):"
+            << std::endl;
+  const int shapes[][3] = {{1, 1, 1}, {6, 16, 1}, {7, 13, 5}, {5, 17, 3},
+                           {128, 1, 784}, {13, 1, 21}, {10, 3, 20},
+                           {73, 1030, 2}, {33, 40, 300}, {128, 64, 784},
+                           {100, 37, 513}};
+  unsigned int seed = 1;
+  for (const auto &shape : shapes)
+    {
+      Matrix a (shape[0], shape[2]);
+      Matrix b (shape[2], shape[1]);
+      fill_matrix (a, seed++);
+      fill_matrix (b, seed++);
+      Matrix fast = a * b;
+      Matrix ref = naive_product (a, b);
+      for (int i = 0; i < ref.get_rows () * ref.get_cols (); i++)
+        {
+          assert(std::fabs (fast[i] - ref[i]) <= 1e-4f * (1 + shape[2]));
+        }
+      std::cout << "	" << shape[0] << "x" << shape[2] << " * "
+                << shape[2] << "x" << shape[1] << std::endl;
+    }
+
+  // transposed operand through strides: C = A^T * B
+  Matrix a (5, 7);
+  Matrix b (5, 9);
+  fill_matrix (a, 42);
+  fill_matrix (b, 43);
+  Matrix c (7, 9);
+  gemm (7, 9, 5, a.data (), 1, 7, b.data (), 9, 1, c.data (), 9, false);
+  Matrix at (a);
+  Matrix ref = naive_product (at.transpose (), b);
+  for (int i = 0; i < ref.get_rows () * ref.get_cols (); i++)
+    {
+      assert(std::fabs (c[i] - ref[i]) <= 1e-4f);
+    }
+  std::cout << "	strided (transposed) operand" << std::endl;
+  std::cout << "Passed: GEMM matches the naive product" << std::endl
+            << std::endl;
+}
+
+void check_batch (MlpNetwork & mlp)
+/**
+ * function which checks that predict_batch agrees with the single image
+ * operator () on a batch built from the presubmit image and its negation.
+ */
+{
+  std::cout << "Checking MlpNetwork batch prediction:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  Matrix images[3] = {img, -1 * img, img};
+  digit batch_res[3];
+  mlp.predict_batch (images, 3, batch_res);
+  for (int i = 0; i < 3; i++)
+    {
+      digit single = mlp (images[i]);
+      assert(batch_res[i].value == single.value);
+      assert(std::fabs (batch_res[i].probability - single.probability)
+             <= 1e-5f);
+    }
+  // images stored one per row, fed through a transposed view (no copy)
+  Matrix rows (3, img_dims.rows * img_dims.cols);
+  for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < rows.get_cols (); j++)
+        {
+          rows (i, j) = images[i][j];
+        }
+    }
+  digit view_res[2];
+  mlp.predict_batch (MatrixView (rows).transposed ().block (0, 1, rows.get_cols (), 2),
+                     view_res);
+  for (int i = 0; i < 2; i++)
+    {
+      assert(view_res[i].value == batch_res[i + 1].value);
+      assert(std::fabs (view_res[i].probability - batch_res[i + 1].probability)
+             <= 1e-5f);
+    }
+  Matrix square (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", square));
+  digit reshaped = mlp (MatrixView (square).reshaped (img.get_rows (), 1));
+  assert(reshaped.value == batch_res[0].value);
+
+  // an empty batch is valid and leaves a fresh workspace untouched
+  MlpWorkspace fresh;
+  digit untouched = {42, 0.5f};
+  mlp.predict_batch (images, 0, &untouched, fresh);
+  mlp.predict_batch (images, 0, &untouched);
+  Matrix empty;
+  Matrix taken (std::move (empty)); // leaves empty as 0x0
+  mlp.predict_batch (MatrixView (empty), &untouched, fresh);
+  fresh.reserve (mlp, 0);
+  assert(fresh.get_capacity () == 0);
+  assert(untouched.value == 42 && untouched.probability == 0.5f);
+  std::cout << "Passed: predict_batch matches single image predictions"
+            << std::endl << std::endl;
+}
+
+void check_model (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE],
+                  MlpNetwork & mlp)
+/**
+ * function which packs the parameters into a single model file, maps it
+ * back and checks the mapped network predicts exactly like the original.
+ */
+{
+  std::cout << "Checking packed model file:" << std::endl;
+  const ActivationType act_types[MLP_SIZE] = {RELU, RELU, RELU, SOFTMAX};
+  assert(MlpModel::save ("presubmit.model", weights, biases, act_types,
+                         MLP_SIZE));
+  MlpModel model ("presubmit.model");
+  assert(model.get_layer_count () == MLP_SIZE);
+  for (int i = 0; i < MLP_SIZE; i++)
+    {
+      assert(((uintptr_t) model.get_weights (i).data ()) % 64 == 0);
+      assert(model.get_bias (i).get_rows () == bias_dims[i].rows);
+    }
+  MlpNetwork mapped (model);
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  digit expected = mlp (img.vectorize ());
+  digit actual = mapped (img);
+  assert(expected.value == actual.value);
+  assert(expected.probability == actual.probability);
+
+  // a version 1 file (float32 only, no weight formats) still loads; the
+  // checksum does not cover the header
+  std::fstream file ("presubmit.model",
+                     std::ios::in | std::ios::out | std::ios::binary);
+  model_header header;
+  assert(file.read ((char *) &header, sizeof (header)));
+  assert(header.version == MODEL_VERSION && MODEL_VERSION > 1);
+  header.version = 1;
+  file.seekp (0);
+  assert(file.write ((const char *) &header, sizeof (header)));
+  file.close ();
+  MlpModel old_model ("presubmit.model");
+  digit old_actual = MlpNetwork (old_model) (img);
+  assert(old_actual.value == expected.value);
+  assert(old_actual.probability == expected.probability);
+  std::remove ("presubmit.model");
+  std::cout << "Passed: mapped model predicts like the parameter files"
+            << std::endl << std::endl;
+}
+
+void check_zero_alloc (MlpNetwork & mlp)
+/**
+ * function which proves that steady-state inference performs no heap
+ * allocation, counting allocations through AllocCounter.
+ */
+{
+  std::cout << "Checking zero-allocation inference:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  Matrix batch[3] = {img, img, img};
+  digit results[3];
+  MlpWorkspace workspace (mlp, 3);
+
+  // warm up: sizes the default workspace and the GEMM packing buffers
+  mlp (img);
+  mlp.predict_batch (batch, 3, results, workspace);
+
+  size_t before = thread_alloc_count ();
+  for (int i = 0; i < 100; i++)
+    {
+      mlp (img);
+      mlp (img, workspace);
+      mlp.predict_batch (batch, 3, results, workspace);
+    }
+  size_t allocations = thread_alloc_count () - before;
+  std::cout << "\tallocations in 300 inferences: " << allocations
+            << std::endl;
+  assert(allocations == 0);
+  std::cout << "Passed: inference does not allocate" << std::endl
+            << std::endl;
+}
+
+void check_parallel (MlpNetwork & mlp)
+/**
+ * function which runs a batch through the multi-threaded runner and checks
+ * the results come back in input order and match single image predictions.
+ */
+{
+  std::cout << "Checking multi-threaded batch inference:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  const int count = 203;
+  Matrix *images = new Matrix[count];
+  for (int i = 0; i < count; i++)
+    {
+      images[i] = ((float) (i % 7) - 3.0f) * img;
+    }
+  digit *results = new digit[count];
+  ParallelMlp parallel (mlp, 4, 16);
+  assert(parallel.get_thread_count () == 4);
+  parallel.predict_batch (images, count, results);
+  for (int i = 0; i < count; i++)
+    {
+      digit single = mlp (images[i]);
+      assert(results[i].value == single.value);
+      assert(std::fabs (results[i].probability - single.probability) <= 1e-5f);
+    }
+  delete[] results;
+  delete[] images;
+  std::cout << "Passed: parallel results match, in input order" << std::endl
+            << std::endl;
+}
+
+void check_quantized (MlpNetwork & mlp)
+/**
+ * function which quantizes the network to int8, calibrated on scaled
+ * copies of the presubmit image, and checks it classifies like the float
+ * network while keeping about a quarter of the weight memory.
+ */
+{
+  std::cout << "Checking int8 quantized inference:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  const int count = 16;
+  Matrix images (img.get_rows (), count);
+  for (int j = 0; j < count; j++)
+    {
+      const float factor = 0.25f + 0.125f * (float) j;
+      for (int i = 0; i < img.get_rows (); i++)
+        {
+          images (i, j) = factor * img[i];
+        }
+    }
+  QuantizedMlp quantized (mlp, images);
+  unsigned int labels[count];
+  for (int j = 0; j < count; j++)
+    {
+      labels[j] = mlp (MatrixView (images).block (0, j, img.get_rows (), 1))
+          .value;
+    }
+  quant_report report = QuantizedMlp::compare (mlp, quantized, images,
+                                               labels);
+  std::cout << "\tfloat accuracy: " << report.float_accuracy
+            << ", int8 accuracy: " << report.quantized_accuracy
+            << ", agreement: " << report.agreement << std::endl;
+  assert(report.samples == count);
+  assert(report.float_accuracy == 1.0f);
+  assert(report.agreement >= 0.9f);
+  digit single = quantized (img);
+  assert(single.value == mlp (img).value);
+  size_t float_bytes = 0;
+  for (int i = 0; i < MLP_SIZE; i++)
+    {
+      float_bytes += (size_t) weights_dims[i].rows * weights_dims[i].cols
+                     * sizeof (float);
+    }
+  assert(quantized.get_weight_bytes () * 3 < float_bytes);
+  // a wider network on the same thread and batch size must grow the
+  // thread's scratch instead of reusing the narrower one
+  const int input = img.get_rows ();
+  const int wide_width = 600;
+  Matrix wide_weights[2] = {Matrix (wide_width, input),
+                            Matrix (10, wide_width)};
+  Matrix wide_biases[2] = {Matrix (wide_width, 1), Matrix (10, 1)};
+  ActivationType wide_acts[2] = {RELU, SOFTMAX};
+  for (int i = 0; i < 2; i++)
+    {
+      fill_matrix (wide_weights[i], 300 + i);
+      fill_matrix (wide_biases[i], 350 + i);
+      wide_weights[i] = 0.1f * wide_weights[i];
+    }
+  MlpNetwork wide (wide_weights, wide_biases, wide_acts, 2);
+  assert(wide.get_max_width () > mlp.get_max_width ());
+  QuantizedMlp wide_quantized (wide, images);
+  quant_report wide_report = QuantizedMlp::compare (wide, wide_quantized,
+                                                    images, labels);
+  assert(wide_report.samples == count);
+  assert(wide_report.agreement >= 0.9f);
+  assert(quantized (img).value == single.value);
+  std::cout << "Passed: int8 network agrees with float32" << std::endl
+            << std::endl;
+}
+
+void check_half (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE],
+                 MlpNetwork & mlp)
+/**
+ * function which checks the FP16/BF16 conversions, then runs networks with
+ * half precision weights (built in memory and mapped from a model file) and
+ * compares them with the float32 network.
+ */
+{
+  std::cout << "Checking half precision weights:" << std::endl;
+  assert(fp16_to_float (float_to_fp16 (1.0f)) == 1.0f);
+  assert(fp16_to_float (float_to_fp16 (-0.5f)) == -0.5f);
+  assert(fp16_to_float (float_to_fp16 (65504.0f)) == 65504.0f);
+  assert(std::isinf (fp16_to_float (float_to_fp16 (65520.0f))));
+  assert(fp16_to_float (float_to_fp16 (std::ldexp (1.0f, -24)))
+         == std::ldexp (1.0f, -24));
+  assert(fp16_to_float (float_to_fp16 (1.0f + std::ldexp (1.0f, -11)))
+         == 1.0f);
+  assert(bf16_to_float (float_to_bf16 (3.0f)) == 3.0f);
+  assert(bf16_to_float (float_to_bf16 (1.0f + std::ldexp (1.0f, -8)))
+         == 1.0f);
+  assert(std::isnan (bf16_to_float (float_to_bf16 (NAN))));
+
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  const int count = 8;
+  Matrix images (img.get_rows (), count);
+  for (int j = 0; j < count; j++)
+    {
+      for (int i = 0; i < img.get_rows (); i++)
+        {
+          images (i, j) = (0.25f + 0.25f * (float) j) * img[i];
+        }
+    }
+  digit expected[count];
+  mlp.predict_batch (images, expected);
+  const WeightFormat formats[2] = {FP16, BF16};
+  const ActivationType act_types[MLP_SIZE] = {RELU, RELU, RELU, SOFTMAX};
+  for (int f = 0; f < 2; f++)
+    {
+      MlpNetwork half (weights, biases, formats[f]);
+      assert(half.get_layer (0).get_weight_format () == formats[f]);
+      assert(MlpModel::save ("presubmit.model", weights, biases, act_types,
+                             MLP_SIZE, formats[f]));
+      MlpModel model ("presubmit.model");
+      assert(model.get_weight_format (0) == formats[f]);
+      MlpNetwork mapped (model);
+      digit half_res[count];
+      digit mapped_res[count];
+      half.predict_batch (images, half_res);
+      mapped.predict_batch (images, mapped_res);
+      for (int j = 0; j < count; j++)
+        {
+          assert(half_res[j].value == expected[j].value);
+          assert(std::fabs (half_res[j].probability - expected[j].probability)
+                 <= 1e-2f);
+          assert(mapped_res[j].value == half_res[j].value);
+          assert(mapped_res[j].probability == half_res[j].probability);
+        }
+      digit single = half (img);
+      assert(single.value == half_res[3].value);
+      assert(std::fabs (single.probability - half_res[3].probability)
+             <= 1e-5f);
+      std::remove ("presubmit.model");
+    }
+  std::cout << "Passed: FP16 and BF16 weights agree with float32"
+            << std::endl << std::endl;
+}
+
+/**
+ * Writes a big-endian 32 bit IDX header field.
+ */
+void write_be32 (std::ofstream & os, uint32_t v)
+{
+  const char bytes[4] = {(char) (v >> 24), (char) (v >> 16), (char) (v >> 8),
+                         (char) v};
+  os.write (bytes, 4);
+}
+
+void check_idx (MlpNetwork & mlp)
+/**
+ * function which writes small IDX image/label files built from the
+ * presubmit image, streams them back in batches and evaluates the network.
+ */
+{
+  std::cout << "Checking IDX reader and evaluation:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  const int pixels = img_dims.rows * img_dims.cols;
+  const int count = 7;
+  std::ofstream images ("presubmit.idx3", std::ios::binary);
+  write_be32 (images, IDX_IMAGES_MAGIC);
+  write_be32 (images, count);
+  write_be32 (images, img_dims.rows);
+  write_be32 (images, img_dims.cols);
+  Matrix expected (pixels, count);
+  for (int j = 0; j < count; j++)
+    {
+      for (int i = 0; i < pixels; i++)
+        {
+          // image j is image 0 dimmed, so every image differs
+          unsigned char byte = (unsigned char) std::lround (img[i] * 255
+                                                            * (8 - j) / 8);
+          images.put ((char) byte);
+          expected (i, j) = byte / 255.0f;
+        }
+    }
+  images.close ();
+  digit predictions[count];
+  mlp.predict_batch (expected, predictions);
+  std::ofstream labels ("presubmit.idx1", std::ios::binary);
+  write_be32 (labels, IDX_LABELS_MAGIC);
+  write_be32 (labels, count);
+  for (int j = 0; j < count; j++)
+    {
+      // the last label is deliberately wrong
+      labels.put ((char) (j < count - 1 ? predictions[j].value
+                                        : (predictions[j].value + 1) % 10));
+    }
+  labels.close ();
+
+  IdxReader reader ("presubmit.idx3", "presubmit.idx1");
+  assert(reader.get_count () == count);
+  assert(reader.get_image_rows () == img_dims.rows);
+  Matrix batch (pixels, 4);
+  unsigned int batch_labels[4];
+  assert(reader.read_batch (batch, batch_labels) == 4);
+  assert(reader.read_batch (batch, batch_labels) == 3);
+  for (int i = 0; i < pixels; i++)
+    {
+      assert(batch (i, 2) == expected (i, 6));
+    }
+  assert(batch_labels[2] == (predictions[6].value + 1) % 10);
+  assert(reader.read_batch (batch, batch_labels) == 0);
+  reader.rewind ();
+  eval_report report = evaluate (reader, [&mlp] (const MatrixView & m,
+                                                 digit * results)
+  { mlp.predict_batch (m, results); }, 3);
+  assert(report.samples == count);
+  assert(report.correct == count - 1);
+  unsigned int total = 0;
+  for (int l = 0; l < DIGIT_COUNT; l++)
+    {
+      for (int p = 0; p < DIGIT_COUNT; p++)
+        {
+          total += report.confusion[l][p];
+        }
+    }
+  assert(total == (unsigned int) count);
+  assert(report.confusion[(predictions[6].value + 1) % 10]
+         [predictions[6].value] >= 1);
+  print_report (std::cout, report);
+  // a network with more than DIGIT_COUNT outputs may predict 10 or more:
+  // such predictions are wrong and stay out of the confusion matrix
+  reader.rewind ();
+  eval_report wide = evaluate (reader, [] (const MatrixView & m,
+                                           digit * results)
+  {
+    for (int j = 0; j < m.get_cols (); j++)
+      {
+        results[j].value = DIGIT_COUNT + j % 3;
+        results[j].probability = 1.0f;
+      }
+  }, 3);
+  assert(wide.samples == count && wide.correct == 0);
+  for (int l = 0; l < DIGIT_COUNT; l++)
+    {
+      for (int p = 0; p < DIGIT_COUNT; p++)
+        {
+          assert(wide.confusion[l][p] == 0);
+        }
+    }
+  std::remove ("presubmit.idx3");
+  std::remove ("presubmit.idx1");
+  std::cout << "Passed: IDX files stream and evaluate correctly"
+            << std::endl << std::endl;
+}
+
+void check_topology (MlpNetwork & mlp)
+/**
+ * function which builds networks of other depths and widths at runtime
+ * (a small distilled one and a wide one), checks them against chaining
+ * their Dense layers by hand, and reuses one workspace for all of them.
+ */
+{
+  std::cout << "Checking runtime network topologies:" << std::endl;
+  const int input = img_dims.rows * img_dims.cols;
+  const int small_dims[] = {input, 32, 10};
+  const int wide_dims[] = {input, 300, 200, 50, 20, 10};
+  const int *topologies[2] = {small_dims, wide_dims};
+  const int layer_counts[2] = {2, 5};
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  MlpWorkspace workspace (mlp, 1);
+  for (int t = 0; t < 2; t++)
+    {
+      const int count = layer_counts[t];
+      Matrix *weights = new Matrix[count];
+      Matrix *biases = new Matrix[count];
+      ActivationType *act_types = new ActivationType[count];
+      for (int i = 0; i < count; i++)
+        {
+          weights[i] = Matrix (topologies[t][i + 1], topologies[t][i]);
+          biases[i] = Matrix (topologies[t][i + 1], 1);
+          fill_matrix (weights[i], 100 * t + i);
+          fill_matrix (biases[i], 100 * t + i + 50);
+          weights[i] = 0.1f * weights[i];
+          act_types[i] = i + 1 < count ? RELU : SOFTMAX;
+        }
+      MlpNetwork net (weights, biases, act_types, count);
+      assert(net.get_layer_count () == count);
+      assert(net.get_input_size () == input);
+      assert(net.get_output_size () == 10);
+      assert(net.get_max_width () == topologies[t][1]);
+      Matrix expected = img;
+      for (int i = 0; i < count; i++)
+        {
+          expected = net.get_layer (i) (expected);
+        }
+      digit result = net (img, workspace);
+      assert(workspace.get_capacity () >= 1);
+      assert(std::fabs (expected[result.value] - result.probability) <= 1e-6f);
+      for (int c = 0; c < 10; c++)
+        {
+          assert(expected[c] <= result.probability);
+        }
+      assert(MlpModel::save ("presubmit.model", weights, biases, act_types,
+                             count));
+      MlpModel model ("presubmit.model");
+      MlpNetwork mapped (model);
+      assert(mapped.get_layer_count () == count);
+      digit mapped_result = mapped (img, workspace);
+      assert(mapped_result.value == result.value);
+      assert(mapped_result.probability == result.probability);
+      std::remove ("presubmit.model");
+      delete[] act_types;
+      delete[] biases;
+      delete[] weights;
+    }
+  // the course network still runs on the grown workspace
+  digit course = mlp (img, workspace);
+  assert(course.value == mlp (img).value);
+  std::cout << "Passed: runtime topologies predict like their layers"
+            << std::endl << std::endl;
+}
+
+void check_static (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE],
+                   MlpNetwork & mlp)
+/**
+ * function which checks the compile-time specialized network: static
+ * shapes, agreement with MlpNetwork on single images and batches, and
+ * specializing a runtime network.
+ */
+{
+  std::cout << "Checking the static (compile-time shaped) network:"
+            << std::endl;
+  static_assert (StaticMlpNetwork::input_size
+                 == img_dims.rows * img_dims.cols, "static input size");
+  static_assert (StaticMlpNetwork::output_size == 10, "static output size");
+  StaticMatrix<2, 3> a;
+  StaticMatrix<3, 1> x;
+  for (int i = 0; i < 6; i++)
+    {
+      a[i] = (float) i;
+    }
+  for (int i = 0; i < 3; i++)
+    {
+      x[i] = 1.0f;
+    }
+  StaticMatrix<2, 1> ax = a * x;
+  assert(ax (0, 0) == 3.0f && ax (1, 0) == 12.0f);
+  assert((ax + ax)[1] == 24.0f);
+  StaticMlpNetwork *net = new StaticMlpNetwork (weights, biases);
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  digit result = (*net) (img);
+  img.vectorize ();
+  digit expected = mlp (img);
+  assert(result.value == expected.value);
+  assert(std::fabs (result.probability - expected.probability) <= 1e-5f);
+  const int count = 8;
+  Matrix images (img.get_rows (), count);
+  for (int j = 0; j < count; j++)
+    {
+      const float factor = 0.25f + 0.25f * (float) j;
+      for (int i = 0; i < img.get_rows (); i++)
+        {
+          images (i, j) = factor * img[i];
+        }
+    }
+  digit static_results[count], results[count];
+  net->predict_batch (images, static_results);
+  mlp.predict_batch (images, results);
+  for (int j = 0; j < count; j++)
+    {
+      assert(static_results[j].value == results[j].value);
+      assert(std::fabs (static_results[j].probability
+                        - results[j].probability) <= 1e-5f);
+    }
+  MlpNetwork half (weights, biases, FP16);
+  StaticMlpNetwork *from_half = new StaticMlpNetwork (half);
+  digit half_result = (*from_half) (img);
+  assert(half_result.value == half (img).value);
+  assert(std::fabs (half_result.probability - half (img).probability)
+         <= 1e-5f);
+  delete from_half;
+  delete net;
+  std::cout << "Passed: static network predicts like MlpNetwork"
+            << std::endl << std::endl;
+}
+
+void check_activation_kernels (MlpNetwork & mlp)
+/**
+ * function which checks the vectorized RELU and the max-shifted SOFTMAX
+ * against a double precision reference (including logits that overflow a
+ * plain exp), and the fused classify / top-k paths of MlpNetwork.
+ */
+{
+  std::cout << "Checking activation kernels and fused classification:"
+            << std::endl;
+  const int rows = 11, cols = 19;
+  Matrix logits (rows, cols);
+  fill_matrix (logits, 7);
+  for (int i = 0; i < rows * cols; i++)
+    {
+      logits[i] *= 40.0f;
+    }
+  logits (3, 5) = 1000.0f;
+  logits (4, 5) = 999.0f;
+  Matrix probs = logits;
+  Activation (SOFTMAX).apply_in_place (probs);
+  for (int j = 0; j < cols; j++)
+    {
+      double max_value = logits (0, j), sum = 0, prob_sum = 0;
+      for (int i = 1; i < rows; i++)
+        {
+          max_value = std::max (max_value, (double) logits (i, j));
+        }
+      for (int i = 0; i < rows; i++)
+        {
+          sum += std::exp (logits (i, j) - max_value);
+        }
+      for (int i = 0; i < rows; i++)
+        {
+          const double expected = std::exp (logits (i, j) - max_value) / sum;
+          assert(std::isfinite (probs (i, j)));
+          assert(std::fabs (probs (i, j) - expected) <= 1e-6 + 1e-5 * expected);
+          prob_sum += probs (i, j);
+        }
+      assert(std::fabs (prob_sum - 1.0) <= 1e-5);
+    }
+  // operator () normalizes over all elements of a single vector
+  Matrix column (rows, 1);
+  for (int i = 0; i < rows; i++)
+    {
+      column[i] = logits (i, 5);
+    }
+  Matrix column_probs = Activation (SOFTMAX) (column);
+  assert(std::fabs (column_probs[3] - probs (3, 5)) <= 1e-6f);
+  assert(column_probs[3] > column_probs[4]);
+
+  Matrix relu_in (1, cols);
+  fill_matrix (relu_in, 8);
+  relu_in[0] = -0.0f;
+  relu_in[1] = NAN;
+  Matrix relu_out = Activation (RELU) (relu_in);
+  assert(std::signbit (relu_out[0]) && relu_out[0] == 0.0f);
+  assert(std::isnan (relu_out[1]));
+  for (int i = 2; i < cols; i++)
+    {
+      assert(relu_out[i] == (relu_in[i] < 0 ? 0.0f : relu_in[i]));
+    }
+
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  Matrix expected = img;
+  for (int i = 0; i < mlp.get_layer_count (); i++)
+    {
+      expected = mlp.get_layer (i) (expected);
+    }
+  const int k = 3;
+  unsigned int labels[k];
+  float top_probs[k];
+  assert(mlp.top_k (img, k, labels, top_probs) == k);
+  digit best = mlp (img);
+  assert(labels[0] == best.value && top_probs[0] == best.probability);
+  assert(mlp.classify (img) == best.value);
+  for (int m = 0; m < k; m++)
+    {
+      assert(std::fabs (top_probs[m] - expected[labels[m]]) <= 1e-6f);
+      for (int c = 0; c < mlp.get_output_size (); c++)
+        {
+          bool chosen = false;
+          for (int r = 0; r <= m; r++)
+            {
+              chosen = chosen || labels[r] == (unsigned int) c;
+            }
+          assert(chosen || expected[c] <= expected[labels[m]]);
+        }
+    }
+  unsigned int all_labels[20];
+  assert(mlp.top_k (img, 20, all_labels, nullptr) == mlp.get_output_size ());
+  assert(all_labels[0] == best.value);
+  std::cout << "Passed: stable softmax and fused top-k" << std::endl
+            << std::endl;
+}
+
+void check_training (MlpNetwork & mlp)
+/**
+ * function which checks the backward pass against finite differences on a
+ * tiny network, trains small networks with SGD and Adam on a synthetic
+ * clustered set, exports one as a packed model and fine-tunes the
+ * presubmit network.
+ */
+{
+  std::cout << "Checking training:" << std::endl;
+  const int tiny_sizes[] = {6, 5, 4, 3};
+  const ActivationType tiny_acts[] = {RELU, RELU, SOFTMAX};
+  Trainer tiny (tiny_sizes, tiny_acts, 3, 11);
+  Matrix tiny_images (6, 4);
+  fill_matrix (tiny_images, 12);
+  const unsigned int tiny_labels[] = {0, 2, 1, 2};
+  tiny.backward (tiny_images, tiny_labels);
+  const float eps = 1e-3f;
+  for (int l = 0; l < 3; l++)
+    {
+      for (int is_bias = 0; is_bias < 2; is_bias++)
+        {
+          const Matrix &grad = is_bias ? tiny.get_bias_gradient (l)
+                                       : tiny.get_weight_gradient (l);
+          for (int k = 0; k < grad.get_rows () * grad.get_cols (); k++)
+            {
+              float losses[2];
+              for (int side = 0; side < 2; side++)
+                {
+                  Matrix weights[3], biases[3];
+                  for (int i = 0; i < 3; i++)
+                    {
+                      weights[i] = tiny.get_weights ()[i];
+                      biases[i] = tiny.get_biases ()[i];
+                    }
+                  Matrix &param = is_bias ? biases[l] : weights[l];
+                  param[k] += side ? eps : -eps;
+                  Trainer shifted (weights, biases, tiny_acts, 3);
+                  losses[side] = shifted.backward (tiny_images, tiny_labels);
+                }
+              const float numeric = (losses[1] - losses[0]) / (2 * eps);
+              assert(std::fabs (numeric - grad[k])
+                     <= 2e-3f + 5e-2f * std::fabs (grad[k]));
+            }
+        }
+    }
+
+  // synthetic set: 10 noisy clusters around random centers
+  const int input = 20, count = 500;
+  const int sizes[] = {input, 32, 10};
+  const ActivationType acts[] = {RELU, SOFTMAX};
+  Matrix centers (10, input);
+  fill_matrix (centers, 13);
+  Matrix noise (count, input);
+  fill_matrix (noise, 14);
+  Matrix images (count, input);
+  unsigned int labels[count];
+  for (int j = 0; j < count; j++)
+    {
+      labels[j] = (unsigned int) j % 10;
+      for (int i = 0; i < input; i++)
+        {
+          images (j, i) = centers (labels[j], i) + 0.3f * noise (j, i);
+        }
+    }
+  const MatrixView columns = MatrixView (images).transposed ();
+  const OptimizerType optimizers[2] = {SGD, ADAM};
+  for (int o = 0; o < 2; o++)
+    {
+      train_options options = default_train_options (optimizers[o]);
+      options.batch_size = 32;
+      if (optimizers[o] == ADAM)
+        {
+          options.learning_rate = 1e-2f;
+        }
+      Trainer trainer (sizes, acts, 2, 15);
+      const float first_loss = trainer.train_epoch (columns, labels, options);
+      float loss = first_loss;
+      for (int epoch = 0; epoch < 20; epoch++)
+        {
+          loss = trainer.train_epoch (columns, labels, options);
+        }
+      assert(loss < 0.25f * first_loss);
+      MlpNetwork trained (trainer.get_weights (), trainer.get_biases (),
+                          trainer.get_act_types (), 2);
+      digit results[count];
+      trained.predict_batch (columns, results);
+      int correct = 0;
+      for (int j = 0; j < count; j++)
+        {
+          correct += results[j].value == labels[j];
+        }
+      std::cout << "	" << (optimizers[o] == SGD ? "SGD" : "Adam")
+                << " loss " << first_loss << " -> " << loss << ", accuracy "
+                << (float) correct / count << std::endl;
+      assert(correct >= 0.95f * count);
+      if (optimizers[o] == ADAM)
+        {
+          assert(trainer.save ("presubmit.model"));
+          MlpModel model ("presubmit.model");
+          MlpNetwork mapped (model);
+          digit mapped_results[count];
+          mapped.predict_batch (columns, mapped_results);
+          for (int j = 0; j < count; j++)
+            {
+              assert(mapped_results[j].value == results[j].value);
+              assert(mapped_results[j].probability == results[j].probability);
+            }
+          std::remove ("presubmit.model");
+        }
+    }
+
+  // fine-tuning the presubmit network on its own prediction lowers the loss
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  const unsigned int label = mlp (img).value;
+  Trainer fine (mlp);
+  assert(fine.get_layer_count () == mlp.get_layer_count ());
+  train_options options = default_train_options (ADAM);
+  const float before = fine.train_batch (img, &label, options);
+  const float after = fine.backward (img, &label);
+  assert(std::isfinite (before) && after < before);
+  std::cout << "Passed: gradients match and training converges" << std::endl
+            << std::endl;
+}
+
+void check_pipeline (MlpNetwork & mlp)
+/**
+ * function which streams images through the layer-pipelined executor, with
+ * the default and a grouped split, and checks the results come back in
+ * submission order and match single image predictions.
+ */
+{
+  std::cout << "Checking layer-pipelined streaming inference:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  const int count = 157;
+  Matrix batch (img_dims.rows * img_dims.cols, count);
+  for (int i = 0; i < batch.get_rows (); i++)
+    {
+      for (int j = 0; j < count; j++)
+        {
+          batch (i, j) = ((float) (j % 7) - 3.0f) * img[i];
+        }
+    }
+  digit *expected = new digit[count];
+  digit *results = new digit[count];
+  mlp.predict_batch (batch, expected);
+
+  PipelinedMlp pipeline (mlp, 4);
+  assert(pipeline.get_stage_count () == mlp.get_layer_count ());
+  pipeline.predict_stream (batch, results);
+  for (int j = 0; j < count; j++)
+    {
+      assert(results[j].value == expected[j].value);
+      assert(std::fabs (results[j].probability - expected[j].probability)
+             <= 1e-5f);
+    }
+  long long images = 0;
+  for (int s = 0; s < pipeline.get_stage_count (); s++)
+    {
+      stage_stats stats = pipeline.get_stage_stats (s);
+      assert(stats.first_layer == s && stats.layer_count == 1);
+      assert(stats.images == count);
+      assert(stats.utilization >= 0 && stats.utilization <= 1);
+      images += stats.images;
+    }
+  assert(images == (long long) count * mlp.get_layer_count ());
+  pipeline.print_stats (std::cout);
+
+  // Layer 0 alone, the three small layers grouped; a 28x28 image is
+  // accepted as is, and single images come back in order.
+  const int split[] = {1, 3};
+  PipelinedMlp grouped (mlp, split, 2, 2);
+  grouped.submit (img);
+  grouped.submit (MatrixView (batch).block (0, 1, batch.get_rows (), 1));
+  digit first = grouped.receive ();
+  digit second = grouped.receive ();
+  assert(first.value == mlp (Matrix (img).vectorize ()).value);
+  assert(second.value == expected[1].value);
+  digit none;
+  assert(!grouped.try_receive (none));
+  assert(grouped.get_stage_stats (1).first_layer == 1);
+  assert(grouped.get_stage_stats (1).layer_count == 3);
+  grouped.reset_stats ();
+  assert(grouped.get_stage_stats (0).images == 0);
+  delete[] results;
+  delete[] expected;
+  std::cout << "Passed: pipelined results match, in submission order"
+            << std::endl << std::endl;
+}
+
+void check_server (MlpNetwork & mlp)
+/**
+ * function which runs the socket server with concurrent pipelining
+ * clients and checks every reply against the network, that requests were
+ * batched, that a malformed request only closes its own connection, and
+ * that a half-closed client still gets its replies.
+ */
+{
+  std::cout << "Checking the batching socket server:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  const int input_size = mlp.get_input_size ();
+  const std::string path = "presubmit.sock";
+  server_options options = default_server_options ();
+  options.max_batch = 8;
+  options.deadline_us = 5000;
+  InferenceServer server (path, input_size,
+                          [&mlp] (const MatrixView &images, digit *results)
+                          { mlp.predict_batch (images, results); },
+                          options);
+  std::thread serving ([&server] ()
+                       { server.run (); });
+
+  const int clients = 4, requests = 30;
+  bool ok[clients];
+  std::thread threads[clients];
+  for (int c = 0; c < clients; c++)
+    {
+      threads[c] = std::thread ([&, c] ()
+        {
+          InferenceClient client (path, input_size);
+          ok[c] = true;
+          for (int i = 0; i < requests; i++)
+            {
+              Matrix image = ((float) ((c + i) % 5) - 2.0f) * img;
+              ok[c] = ok[c] && client.send ((uint32_t) i, image);
+            }
+          for (int i = 0; i < requests; i++)
+            {
+              server_reply reply;
+              ok[c] = ok[c] && client.receive (reply);
+              Matrix image = ((float) ((c + i) % 5) - 2.0f) * img;
+              digit expected = mlp (image);
+              ok[c] = ok[c] && reply.id == (uint32_t) i
+                      && reply.value == expected.value
+                      && std::fabs (reply.probability
+                                    - expected.probability) <= 1e-5f
+                      && reply.batch_size >= 1
+                      && reply.batch_size <= (uint32_t) options.max_batch;
+            }
+        });
+    }
+  for (int c = 0; c < clients; c++)
+    {
+      threads[c].join ();
+      assert(ok[c]);
+    }
+
+  // Byte pixels are scaled like IDX files.
+  unsigned char bytes[img_dims.rows * img_dims.cols];
+  Matrix scaled (input_size, 1);
+  for (int i = 0; i < input_size; i++)
+    {
+      bytes[i] = (unsigned char) ((i * 37) % 256);
+      scaled[i] = (float) bytes[i] / 255.0f;
+    }
+  {
+    InferenceClient client (path, input_size);
+    server_reply reply;
+    assert(client.send (7, bytes) && client.receive (reply));
+    assert(reply.id == 7 && reply.value == mlp (scaled).value);
+    assert(client.classify (img).value == mlp (img).value);
+  }
+  {
+    // An unknown pixel format closes that connection only.
+    int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    std::memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    std::strcpy (address.sun_path, path.c_str ());
+    assert(connect (fd, (sockaddr *) &address, sizeof (address)) == 0);
+    const request_header header = {99, 1};
+    assert(write (fd, &header, sizeof (header)) == (ssize_t) sizeof (header));
+    char byte;
+    assert(read (fd, &byte, 1) == 0);
+    close (fd);
+    InferenceClient client (path, input_size);
+    assert(client.classify (img).value == mlp (img).value);
+  }
+  {
+    // A client that shuts down its writing side after its requests still
+    // gets every reply, then EOF.
+    int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    std::memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    std::strcpy (address.sun_path, path.c_str ());
+    assert(connect (fd, (sockaddr *) &address, sizeof (address)) == 0);
+    for (uint32_t id = 20; id < 22; id++)
+      {
+        const request_header header = {PIXELS_FLOAT32, id};
+        assert(write (fd, &header, sizeof (header))
+               == (ssize_t) sizeof (header));
+        const ssize_t size = (ssize_t) (input_size * sizeof (float));
+        assert(write (fd, img.data (), (size_t) size) == size);
+      }
+    assert(shutdown (fd, SHUT_WR) == 0);
+    for (uint32_t id = 20; id < 22; id++)
+      {
+        server_reply reply;
+        size_t done = 0;
+        while (done < sizeof (reply))
+          {
+            const ssize_t n = read (fd, (char *) &reply + done,
+                                    sizeof (reply) - done);
+            assert(n > 0);
+            done += (size_t) n;
+          }
+        assert(reply.id == id && reply.value == mlp (img).value);
+      }
+    char byte;
+    assert(read (fd, &byte, 1) == 0);
+    close (fd);
+  }
+  server_stats stats = server.get_stats ();
+  server.stop ();
+  serving.join ();
+  std::cout << "\t" << stats.requests << " requests in " << stats.batches
+            << " batches" << std::endl;
+  assert(stats.requests == clients * requests + 5);
+  assert(stats.batches < stats.requests);
+  assert(stats.connections == clients + 4);
+  assert(stats.protocol_errors == 1);
+  std::cout << "Passed: server replies match the network, batched"
+            << std::endl << std::endl;
+}
+
+void check_profiler (MlpNetwork & mlp)
+/**
+ * function which records a profile of single image and batch inference,
+ * from one thread and from a thread pool, and checks the counts, FLOPs,
+ * allocations and the text/JSON dumps.
+ */
+{
+  std::cout << "Checking the inference profiler:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  Matrix batch (img_dims.rows * img_dims.cols, 64);
+  for (int i = 0; i < batch.get_rows (); i++)
+    {
+      for (int j = 0; j < batch.get_cols (); j++)
+        {
+          batch (i, j) = img[i];
+        }
+    }
+  digit results[64];
+  mlp.predict_batch (batch, results); // grows the workspace
+
+  // Disabled: nothing is recorded.
+  profiler_enable (false);
+  profiler_reset ();
+  mlp (img);
+  assert(profiler_snapshot ().inference.calls == 0);
+#ifdef MLP_NO_PROFILE
+  std::cout << "Skipped: built with MLP_NO_PROFILE, the probes record nothing"
+            << std::endl << std::endl;
+  return;
+#endif
+
+  profiler_enable (true);
+  profiler_reset ();
+  for (int i = 0; i < 50; i++)
+    {
+      mlp (img);
+    }
+  mlp.predict_batch (batch, results);
+  mlp.classify (img);
+  profile_report report = profiler_snapshot ();
+  assert(report.inference.calls == 52);
+  assert(report.inference.items == 50 + 64 + 1);
+  assert(report.inference.allocations == 0);
+  assert(report.inference.total_ns > 0);
+  assert(report.layer_count == mlp.get_layer_count ());
+  for (int l = 0; l < report.layer_count; l++)
+    {
+      const Dense &layer = mlp.get_layer (l);
+      const profile_counter &gemm = report.layers[l][PROFILE_GEMM];
+      const long long rows = layer.get_output_size ();
+      const long long depth = layer.get_input_size ();
+      const long long relu = layer.get_activation ().get_activation_type ()
+                             == RELU ? 2 : 1;
+      assert(report.layers[l][PROFILE_LAYER].calls == 52);
+      assert(gemm.calls == 52 && gemm.items == 115);
+      assert(gemm.flops == rows * 115 * (2 * depth + relu));
+      assert(gemm.bytes > (long long) (rows * depth * sizeof (float)));
+      assert(gemm.total_ns <= report.layers[l][PROFILE_LAYER].total_ns);
+      long long histogram = 0;
+      for (int b = 0; b < PROFILE_BUCKETS; b++)
+        {
+          histogram += gemm.histogram[b];
+        }
+      assert(histogram == gemm.calls);
+    }
+  // The output SOFTMAX is fused with the selection.
+  assert(report.layers[report.layer_count - 1][PROFILE_ACTIVATION].calls
+         == 52);
+  const profile_counter &first = report.layers[0][PROFILE_LAYER];
+  assert(report.layers[0][PROFILE_GEMM].flops == first.flops);
+  assert(profile_percentile (first, 0.5) <= profile_percentile (first, 0.99));
+  std::ostringstream text, json;
+  print_profile (text, report);
+  print_profile_json (json, report);
+  assert(text.str ().find ("layer 3") != std::string::npos);
+  assert(json.str ().find ("\"layers\": [") != std::string::npos);
+  assert(json.str ().find ("\"gemm\": {\"calls\": 52") != std::string::npos);
+
+  // Samples of pool threads are summed; standalone layers are separate.
+  profiler_reset ();
+  {
+    ParallelMlp parallel (mlp, 4, 16);
+    parallel.predict_batch (batch, results);
+  }
+  mlp.get_layer (0) (img);
+  report = profiler_snapshot ();
+  assert(report.inference.calls == 4 && report.inference.items == 64);
+  assert(report.standalone[PROFILE_GEMM].calls == 1);
+  profiler_enable (false);
+  std::cout << text.str ();
+  std::cout << "Passed: profile counts, FLOPs and dumps" << std::endl
+            << std::endl;
+}
+
+void check_sparse (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE])
+/**
+ * function which prunes the weights, checks the CSR form and that sparse
+ * layers (alone and mixed into a network) match dense layers on the same
+ * pruned weights.
+ */
+{
+  std::cout << "Checking sparse (CSR) layers and pruning:" << std::endl;
+  Matrix pruned[MLP_SIZE];
+  for (int i = 0; i < MLP_SIZE; i++)
+    {
+      pruned[i] = prune_weights (weights[i], i == 0 ? 0.9f : 0.5f);
+    }
+  const int size = weights[0].get_rows () * weights[0].get_cols ();
+  SparseMatrix csr (pruned[0]);
+  assert(csr.get_nonzeros () == size - (int) std::lround (0.9 * size));
+  assert(csr.get_density () < 0.11f);
+  float kept_min = INFINITY, dropped_max = 0;
+  for (int i = 0; i < size; i++)
+    {
+      if (pruned[0][i] != 0)
+        {
+          kept_min = std::min (kept_min, std::fabs (pruned[0][i]));
+        }
+      else
+        {
+          dropped_max = std::max (dropped_max, std::fabs (weights[0][i]));
+        }
+    }
+  assert(dropped_max <= kept_min);
+  Matrix expanded = csr.to_matrix ();
+  for (int i = 0; i < size; i++)
+    {
+      assert(expanded[i] == pruned[0][i]);
+    }
+  assert(csr (3, 5) == pruned[0] (3, 5));
+
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  const int count = 37;
+  Matrix images (img.get_rows (), count);
+  for (int j = 0; j < count; j++)
+    {
+      for (int i = 0; i < img.get_rows (); i++)
+        {
+          images (i, j) = (0.25f + 0.05f * (float) j) * img[i];
+        }
+    }
+  Matrix rows_major = images;
+  rows_major.transpose ();
+  const Dense dense (pruned[0], biases[0], RELU);
+  const Dense sparse (csr, biases[0], RELU);
+  assert(sparse.is_sparse () && !dense.is_sparse ());
+  assert(sparse.get_input_size () == dense.get_input_size ());
+  // a single vector, a batch and a batch with strided columns
+  const MatrixView inputs[3] = {MatrixView (img), MatrixView (images),
+                                MatrixView (rows_major).transposed ()};
+  for (const MatrixView &input : inputs)
+    {
+      Matrix expected = dense (input);
+      Matrix actual = sparse (input);
+      for (int i = 0; i < expected.get_rows () * expected.get_cols (); i++)
+        {
+          assert(std::fabs (actual[i] - expected[i])
+                 <= 1e-4f * (1 + std::fabs (expected[i])));
+        }
+    }
+
+  MlpNetwork dense_mlp (pruned, biases);
+  const Dense *layers[MLP_SIZE];
+  for (int i = 0; i < MLP_SIZE; i++)
+    {
+      layers[i] = i % 2 == 0 ?
+                  new Dense (SparseMatrix (pruned[i]), biases[i],
+                             mlp_act_types[i]) :
+                  new Dense (pruned[i], biases[i], mlp_act_types[i]);
+    }
+  MlpNetwork mixed (layers, MLP_SIZE);
+  for (int i = 0; i < MLP_SIZE; i++)
+    {
+      delete layers[i];
+    }
+  MlpNetwork copy (mixed);
+  assert(copy.get_layer (0).is_sparse () && !copy.get_layer (1).is_sparse ());
+  digit expected[count];
+  digit actual[count];
+  dense_mlp.predict_batch (images, expected);
+  copy.predict_batch (images, actual);
+  for (int j = 0; j < count; j++)
+    {
+      assert(actual[j].value == expected[j].value);
+      assert(std::fabs (actual[j].probability - expected[j].probability)
+             <= 1e-4f);
+    }
+  digit single = mixed (img);
+  assert(single.value == dense_mlp (img).value);
+
+  MlpWorkspace workspace (mixed, count);
+  mixed.predict_batch (images, actual, workspace);
+  size_t before = thread_alloc_count ();
+  for (int i = 0; i < 20; i++)
+    {
+      mixed (img, workspace);
+      mixed.predict_batch (images, actual, workspace);
+    }
+  assert(thread_alloc_count () == before);
+  std::cout << "	layer 1 keeps " << csr.get_nonzeros () << " of " << size
+            << " weights, " << csr.get_bytes () << " bytes" << std::endl;
+  std::cout << "Passed: sparse layers agree with dense pruned layers"
+            << std::endl << std::endl;
+}
+
+void check_input_skipping (MlpNetwork & mlp)
+/**
+ * function which checks that the first layer skips zero pixels on sparse
+ * inputs, falls back to the GEMM on dense inputs, and matches the layer
+ * without skipping either way.
+ */
+{
+  std::cout << "Checking zero pixel skipping in the first layer:"
+            << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  const int pixels = img.get_rows ();
+  // mostly background: keep one pixel in 8, and a fully dense image
+  Matrix sparse_img (pixels, 1), dense_img (pixels, 1);
+  for (int i = 0; i < pixels; i++)
+    {
+      sparse_img[i] = i % 8 == 0 ? img[i] + 0.5f : 0.0f;
+      dense_img[i] = img[i] + 0.5f;
+    }
+  const int count = 19;
+  Matrix images (pixels, count);
+  for (int j = 0; j < count; j++)
+    {
+      for (int i = 0; i < pixels; i++)
+        {
+          images (i, j) = (float) (j + 1) * 0.1f * sparse_img[i];
+        }
+    }
+  Matrix rows_major = images;
+  rows_major.transpose ();
+
+  assert(!mlp.get_layer (0).skips_zero_inputs ()); // off by default
+  mlp.set_input_skipping (true);
+  const Dense &skipping = mlp.get_layer (0);
+  Dense full (skipping);
+  full.set_input_skipping (false);
+  assert(skipping.skips_zero_inputs () && !full.skips_zero_inputs ());
+  const MatrixView inputs[4] = {MatrixView (sparse_img),
+                                MatrixView (dense_img), MatrixView (images),
+                                MatrixView (rows_major).transposed ()};
+  for (const MatrixView &input : inputs)
+    {
+      Matrix expected = full (input);
+      Matrix actual = skipping (input);
+      for (int i = 0; i < expected.get_rows () * expected.get_cols (); i++)
+        {
+          assert(std::fabs (actual[i] - expected[i])
+                 <= 1e-4f * (1 + std::fabs (expected[i])));
+        }
+    }
+
+#ifndef MLP_NO_PROFILE
+  // The profile shows which path ran: FLOPs follow the nonzero pixels.
+  const long long rows = skipping.get_output_size ();
+  profiler_enable (true);
+  profiler_reset ();
+  mlp (sparse_img);
+  long long flops = profiler_snapshot ().layers[0][PROFILE_GEMM].flops;
+  assert(flops == rows * (2 * (pixels / 8) + 2));
+  profiler_reset ();
+  mlp (dense_img);
+  flops = profiler_snapshot ().layers[0][PROFILE_GEMM].flops;
+  assert(flops == rows * (2 * pixels + 2));
+  profiler_enable (false);
+#endif
+
+  digit expected = MlpNetwork (mlp) (sparse_img);
+  mlp.set_input_skipping (false);
+  assert(!mlp.get_layer (0).skips_zero_inputs ());
+  digit actual = mlp (sparse_img);
+  assert(expected.value == actual.value);
+  assert(std::fabs (expected.probability - actual.probability) <= 1e-5f);
+  std::cout << "Passed: skipping zero pixels matches the full GEMM"
+            << std::endl << std::endl;
+}
+
+void check_cache (MlpNetwork & mlp)
+/**
+ * function which checks the result cache: image hashes ignore the layout,
+ * hits return the network's prediction without allocating, full shards evict
+ * the least recently used entry, and the counters add up under concurrent
+ * use.
+ */
+{
+  std::cout << "Checking the result cache:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  const uint64_t square_hash = hash_image (img);
+  img.vectorize ();
+  const int pixels = img.get_rows ();
+  const int count = 12;
+  Matrix images[count];
+  Matrix batch (pixels, count);
+  for (int j = 0; j < count; j++)
+    {
+      images[j] = ((float) (j % 6) - 2.5f) * img;
+      images[j][j] += (float) j;
+      for (int i = 0; i < pixels; i++)
+        {
+          batch (i, j) = images[j][i];
+        }
+    }
+  assert(hash_image (img) == square_hash);
+  assert(hash_image (MatrixView (batch).block (0, 5, pixels, 1))
+         == hash_image (images[5]));
+  for (int j = 1; j < count; j++)
+    {
+      assert(hash_image (images[j]) != hash_image (images[j - 1]));
+    }
+
+  // one shard, so the LRU order is global
+  CachedMlp lru (mlp, 2, 1);
+  assert(lru.get_capacity () == 2);
+  lru (images[0]);
+  lru (images[1]);
+  lru (images[0]);
+  lru (images[2]); // evicts images[1], the least recently used
+  cache_stats stats = lru.get_stats ();
+  assert(stats.hits == 1 && stats.misses == 3 && stats.evictions == 1);
+  assert(stats.size == 2 && stats.capacity == 2);
+  lru (images[0]);
+  assert(lru.get_stats ().hits == 2);
+  lru (images[1]);
+  assert(lru.get_stats ().misses == 4);
+  lru.clear ();
+  stats = lru.get_stats ();
+  assert(stats.hits == 0 && stats.misses == 0 && stats.size == 0);
+
+  CachedMlp cache (mlp, 64, 4);
+  digit results[count];
+  digit half_results[count];
+  cache.predict_batch (MatrixView (batch).block (0, 0, pixels, count / 2),
+                       half_results);
+  cache.predict_batch (batch, results);
+  stats = cache.get_stats ();
+  assert(stats.hits == count / 2 && stats.misses == count);
+  for (int j = 0; j < count; j++)
+    {
+      const digit expected = mlp (images[j]);
+      const digit cached = cache (images[j]);
+      assert(results[j].value == expected.value && cached.value == expected.value);
+      assert(std::fabs (results[j].probability - expected.probability) <= 1e-5f);
+      assert(cached.probability == results[j].probability);
+      if (j < count / 2)
+        {
+          assert(half_results[j].value == expected.value);
+        }
+    }
+
+  size_t before = thread_alloc_count ();
+  for (int i = 0; i < 100; i++)
+    {
+      cache (images[i % count]);
+    }
+  assert(thread_alloc_count () - before == 0);
+
+  cache.clear ();
+  const int threads = 4, calls = 500;
+  std::thread workers[threads];
+  bool correct[threads];
+  for (int t = 0; t < threads; t++)
+    {
+      workers[t] = std::thread ([&, t] ()
+                                {
+                                  correct[t] = true;
+                                  for (int i = 0; i < calls; i++)
+                                    {
+                                      const int j = (i * 7 + t) % count;
+                                      correct[t] = correct[t] &&
+                                          cache (images[j]).value
+                                          == results[j].value;
+                                    }
+                                });
+    }
+  for (int t = 0; t < threads; t++)
+    {
+      workers[t].join ();
+      assert(correct[t]);
+    }
+  stats = cache.get_stats ();
+  assert(stats.hits + stats.misses == threads * calls);
+  assert(stats.misses >= count && stats.size == count);
+  std::cout << "\t" << stats.hits << " hits, " << stats.misses
+            << " misses in " << threads << " threads" << std::endl;
+  std::cout << "Passed: cached predictions match the network" << std::endl
+            << std::endl;
+}
+
+void check_loader (MlpNetwork & mlp)
+/**
+ * function which writes a directory of image files (one of them truncated),
+ * loads it on several I/O threads with a small prefetch queue and checks the
+ * batches come back in order, match the files and flag the bad file.
+ */
+{
+  std::cout << "Checking the asynchronous image loader:" << std::endl;
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  const int pixels = img.get_rows ();
+  const int count = 23, bad = 17;
+  const std::string dir = "presubmit.images";
+  mkdir (dir.c_str (), 0700);
+  Matrix expected (pixels, count);
+  for (int j = 0; j < count; j++)
+    {
+      Matrix image = (float) (j + 1) / count * img;
+      std::ostringstream name;
+      name << dir << "/img" << std::setw (3) << std::setfill ('0') << j
+           << ".bin";
+      std::ofstream os (name.str (), std::ios::binary);
+      os.write ((const char *) image.data (),
+                (std::streamsize) ((j == bad ? pixels / 2 : pixels)
+                                   * sizeof (float)));
+      for (int i = 0; i < pixels; i++)
+        {
+          expected (i, j) = j == bad ? 0.0f : image[i];
+        }
+    }
+  std::vector<std::string> paths = list_files (dir);
+  assert((int) paths.size () == count);
+  paths.push_back (dir + "/missing.bin");
+  digit predictions[count];
+  mlp.predict_batch (expected, predictions);
+
+  ImageLoader loader (paths, pixels, 4, 3, 2);
+  assert(loader.get_count () == count + 1);
+  loaded_batch batch;
+  digit results[4];
+  int seen = 0;
+  while (loader.next (batch))
+    {
+      assert(batch.first == seen && batch.count <= 4);
+      const MatrixView images = loader.get_images (batch);
+      mlp.predict_batch (images, results);
+      for (int j = 0; j < batch.count; j++, seen++)
+        {
+          if (seen >= count)
+            {
+              assert(!batch.valid[j]);
+              continue;
+            }
+          assert(batch.valid[j] == (seen != bad));
+          for (int i = 0; i < pixels; i++)
+            {
+              assert(images (i, j) == expected (i, seen));
+            }
+          assert(results[j].value == predictions[seen].value);
+        }
+    }
+  assert(seen == count + 1);
+  assert(!loader.next (batch));
+  const loader_stats stats = loader.get_stats ();
+  assert(stats.images == count + 1 && stats.failed == 2);
+  assert(stats.batches == 6 && stats.depth == 0);
+  assert(stats.max_depth <= 2);
+  std::cout << "\tqueue depth mean " << stats.mean_depth << ", max "
+            << stats.max_depth << std::endl;
+  for (int j = 0; j < count; j++)
+    {
+      std::remove (paths[j].c_str ());
+    }
+  rmdir (dir.c_str ());
+  std::cout << "Passed: loaded batches match the files, in order"
+            << std::endl << std::endl;
+}
+
+void check_packing (MlpNetwork & mlp)
+/**
+ * function which checks that weights packed once by set_weight_packing () give
+ * exactly the results of packing on every call (across edge tiles and
+ * cache block boundaries), and that the cache-blocked transpose is a
+ * transpose.
+ */
+{
+  std::cout << "Checking pre-packed weights and blocked transpose:"
+            << std::endl;
+  Matrix t (45, 70);
+  fill_matrix (t, 11);
+  Matrix tt = t;
+  tt.transpose ();
+  assert(tt.get_rows () == 70 && tt.get_cols () == 45);
+  for (int i = 0; i < 45; i++)
+    {
+      for (int j = 0; j < 70; j++)
+        {
+          assert(tt (j, i) == t (i, j));
+        }
+    }
+  Matrix from_view (MatrixView (t).transposed ());
+  for (int i = 0; i < 70 * 45; i++)
+    {
+      assert(from_view[i] == tt[i]);
+    }
+
+  // m spans two GEMM_MC blocks with a partial panel, k two GEMM_KC blocks
+  const int m = GEMM_MC + 13, k = GEMM_KC + 44, n = 37;
+  Matrix a (m, k), b (k, n), bias (m, 1);
+  fill_matrix (a, 12);
+  fill_matrix (b, 13);
+  fill_matrix (bias, 14);
+  Matrix packed ((int) gemm_packed_a_size (m, k), 1);
+  assert(gemm_packed_a_size (m, k) % GEMM_MR == 0);
+  gemm_pack_a (m, k, a.data (), k, 1, packed.data ());
+  Matrix expected (m, n), actual (m, n);
+  gemm_bias_act (m, n, k, a.data (), k, 1, b.data (), n, 1, expected.data (),
+                 n, bias.data (), true);
+  gemm_packed_bias_act (m, n, k, packed.data (), b.data (), n, 1,
+                        actual.data (), n, bias.data (), true);
+  for (int i = 0; i < m * n; i++)
+    {
+      assert(actual[i] == expected[i]);
+    }
+
+  Matrix img (img_dims.rows, img_dims.cols);
+  assert(readFileToMatrix ("presubmit.inim0", img));
+  img.vectorize ();
+  const int count = 9;
+  Matrix batch (img.get_rows (), count);
+  for (int j = 0; j < count; j++)
+    {
+      for (int i = 0; i < img.get_rows (); i++)
+        {
+          batch (i, j) = (float) (j + 1) * 0.2f * img[i] + 0.01f * j;
+        }
+    }
+  assert(!mlp.get_layer (0).is_prepacked ()); // off by default
+  digit packed_results[count], unpacked_results[count];
+  mlp.predict_batch (batch, unpacked_results);
+  mlp.set_weight_packing (true);
+  for (int l = 0; l < mlp.get_layer_count (); l++)
+    {
+      assert(mlp.get_layer (l).is_prepacked ());
+    }
+  mlp.predict_batch (batch, packed_results);
+  mlp.set_weight_packing (false);
+  assert(!mlp.get_layer (0).is_prepacked ());
+  for (int j = 0; j < count; j++)
+    {
+      assert(packed_results[j].value == unpacked_results[j].value);
+      assert(packed_results[j].probability
+             == unpacked_results[j].probability);
+    }
+  std::cout << "Passed: pre-packed weights match packing per call"
+            << std::endl << std::endl;
+}
+
 /**
  * Program's main
  * @param argc count of args
@@ -323,6 +2018,7 @@ int main ()
   compile_matrix ();
   compile_activation ();
   compile_dense ();
+  check_gemm ();
   // std:: cout << argc << " " << ARGS_COUNT << std::endl;
   // if(argc != ARGS_COUNT){
   // 	usage();
@@ -341,6 +2037,25 @@ int main ()
   MlpNetwork mlp (weights, biases);
   // std::ifstream input(argv[ARGS_COUNT-1]);
   mlpCli (mlp);
+  check_batch (mlp);
+  check_zero_alloc (mlp);
+  check_parallel (mlp);
+  check_model (weights, biases, mlp);
+  check_quantized (mlp);
+  check_half (weights, biases, mlp);
+  check_idx (mlp);
+  check_topology (mlp);
+  check_static (weights, biases, mlp);
+  check_activation_kernels (mlp);
+  check_training (mlp);
+  check_pipeline (mlp);
+  check_server (mlp);
+  check_profiler (mlp);
+  check_sparse (weights, biases);
+  check_input_skipping (mlp);
+  check_cache (mlp);
+  check_loader (mlp);
+  check_packing (mlp);
 
   std::cout << "All presubmit tests finished!" << std::endl;
   return EXIT_SUCCESS;
@@ -0,0 +1,238 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+#include "Evaluation.h"
+#include "IdxReader.h"
+#include "Matrix.h"
+#include "MlpModel.h"
+#include "MlpNetwork.h"
+#include "SparseMatrix.h"
+
+#define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
+#define ERROR_IMAGE_SIZE "Error: data set images do not fit the network input"
+#define ERROR_WRITE_MODEL "Error: failed to write model file: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./prune [--layers n] [--batch n] sparsity images " \
+                  "labels w1 w2 w3 w4 b1 b2 b3 b4 [model]\n" \
+                  "\t--layers n - prune the first n layers (default all)\n" \
+                  "\t--batch n - images per network call (default 256)\n" \
+                  "\tsparsity - fraction of each pruned layer's weights to " \
+                  "zero, e.g. 0.9\n" \
+                  "\timages - IDX image file, e.g. t10k-images-idx3-ubyte\n" \
+                  "\tlabels - IDX label file, e.g. t10k-labels-idx1-ubyte\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tmodel - packed model file to write the pruned weights to"
+
+#define LAYERS_FLAG "--layers"
+#define BATCH_FLAG "--batch"
+// Pruned layers at most this dense run on CSR weights, others stay dense.
+#define SPARSE_MAX_DENSITY 0.5f
+#define LAYER_TIMING_CALLS 2000
+
+#define SPARSITY_IDX 0
+#define IMAGES_PATH_IDX 1
+#define LABELS_PATH_IDX 2
+#define WEIGHTS_START_IDX 3
+#define BIAS_START_IDX (WEIGHTS_START_IDX + MLP_SIZE)
+#define MODEL_PATH_IDX (BIAS_START_IDX + MLP_SIZE)
+#define POSITIONAL_COUNT MODEL_PATH_IDX
+#define MAX_POSITIONAL_COUNT (MODEL_PATH_IDX + 1)
+
+typedef std::chrono::steady_clock prune_clock;
+
+/**
+ * Given a binary file path and a matrix,
+ * reads the content of the file into the matrix.
+ * file must match matrix in size in order to read successfully.
+ * @param filePath - path of the binary file to read
+ * @param mat -  matrix to read the file into.
+ * @return boolean status
+ *          true - success
+ *          false - failure
+ */
+bool readFileToMatrix(const std::string &filePath, Matrix &mat)
+{
+    std::ifstream is;
+    is.open(filePath, std::ios::in | std::ios::binary | std::ios::ate);
+    if(!is.is_open())
+    {
+        return false;
+    }
+
+    long int matByteSize = (long int) mat.get_cols () * mat.get_rows ()  *
+                           sizeof(float);
+    if(is.tellg() != matByteSize)
+    {
+        is.close();
+        return false;
+    }
+
+    is.seekg(0, std::ios_base::beg);
+    is>>mat;
+    is.close();
+    return true;
+}
+
+/**
+ * Evaluates a network on the whole data set and prints one summary line.
+ * @param name label of the line
+ * @param mlp the network
+ * @param reader labelled data set, rewound first
+ * @param batch_size images per network call
+ * @return Images per second spent inside the network.
+ */
+double report_network(const std::string &name, const MlpNetwork &mlp,
+                      IdxReader &reader, int batch_size)
+{
+    reader.rewind();
+    const eval_report report = evaluate(reader, [&mlp](const MatrixView &images,
+                                                       digit *results)
+    { mlp.predict_batch(images, results); }, batch_size);
+    const double rate = report.inference_seconds > 0 ?
+                        report.samples / report.inference_seconds : 0;
+    std::cout << name << ": accuracy " << std::fixed << std::setprecision(4)
+              << (double) report.correct / report.samples << ", "
+              << std::setprecision(1) << rate << " images/sec" << std::endl;
+    return rate;
+}
+
+/**
+ * Times one image through a layer.
+ * @param layer the layer
+ * @param image input column
+ * @return Mean time per call in microseconds.
+ */
+double time_layer(const Dense &layer, const Matrix &image)
+{
+    Matrix output(layer.get_output_size(), 1);
+    const prune_clock::time_point start = prune_clock::now();
+    for(int i = 0; i < LAYER_TIMING_CALLS; i++)
+    {
+        layer.apply(image, output.data());
+    }
+    return std::chrono::duration<double, std::micro>(
+            prune_clock::now() - start).count() / LAYER_TIMING_CALLS;
+}
+
+/**
+ * Prunes the raw w1..w4 float32 parameter files to a target sparsity by
+ * weight magnitude, then reports the accuracy and speed of the dense and the
+ * pruned (CSR) network on a labelled IDX set, and optionally writes the
+ * pruned weights as a packed model.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    int pruned_layers = MLP_SIZE;
+    int batch_size = DEFAULT_EVAL_BATCH;
+    int first = 1;
+    for(; first + 1 < argc && argv[first][0] == '-'; first += 2)
+    {
+        if(std::strcmp(argv[first], LAYERS_FLAG) == 0)
+        {
+            pruned_layers = std::atoi(argv[first + 1]);
+        }
+        else if(std::strcmp(argv[first], BATCH_FLAG) == 0)
+        {
+            batch_size = std::atoi(argv[first + 1]);
+        }
+        else
+        {
+            std::cout << USAGE_MSG << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    char **args = argv + first;
+    const int positional = argc - first;
+    if(positional < POSITIONAL_COUNT || positional > MAX_POSITIONAL_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const float sparsity = (float) std::atof(args[SPARSITY_IDX]);
+    if(!(sparsity >= 0 && sparsity <= 1) || pruned_layers < 0 ||
+       pruned_layers > MLP_SIZE || batch_size <= 0)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    Matrix pruned[MLP_SIZE];
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weights_dims[i].rows, weights_dims[i].cols);
+        biases[i] = Matrix(bias_dims[i].rows, bias_dims[i].cols);
+        if(!(readFileToMatrix(args[WEIGHTS_START_IDX + i], weights[i]) &&
+             readFileToMatrix(args[BIAS_START_IDX + i], biases[i])))
+        {
+            std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        pruned[i] = i < pruned_layers ? prune_weights(weights[i], sparsity)
+                                      : weights[i];
+    }
+
+    const MlpNetwork dense(weights, biases);
+    const Dense *layers[MLP_SIZE];
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        const SparseMatrix sparse(pruned[i]);
+        layers[i] = sparse.get_density() <= SPARSE_MAX_DENSITY ?
+                    new Dense(sparse, biases[i], mlp_act_types[i]) :
+                    new Dense(pruned[i], biases[i], mlp_act_types[i]);
+        std::cout << "layer " << (i + 1) << ": " << sparse.get_nonzeros()
+                  << "/" << pruned[i].get_rows() * pruned[i].get_cols()
+                  << " weights kept (" << std::fixed << std::setprecision(1)
+                  << 100 * sparse.get_density() << "%), "
+                  << (layers[i]->is_sparse() ? "CSR" : "dense") << std::endl;
+    }
+    const MlpNetwork sparse(layers, MLP_SIZE);
+
+    IdxReader reader(args[IMAGES_PATH_IDX], args[LABELS_PATH_IDX]);
+    if(reader.get_image_rows() * reader.get_image_cols() !=
+       dense.get_input_size())
+    {
+        std::cerr << ERROR_IMAGE_SIZE << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const double dense_rate = report_network("dense", dense, reader,
+                                             batch_size);
+    const double sparse_rate = report_network("pruned", sparse, reader,
+                                              batch_size);
+    if(dense_rate > 0)
+    {
+        std::cout << "network speedup: " << std::setprecision(2)
+                  << sparse_rate / dense_rate << "x" << std::endl;
+    }
+
+    Matrix image(dense.get_input_size(), 1);
+    unsigned int label;
+    reader.rewind();
+    reader.read_batch(image, &label);
+    const double dense_us = time_layer(dense.get_layer(0), image);
+    const double sparse_us = time_layer(sparse.get_layer(0), image);
+    std::cout << "layer 1 per image: dense " << std::setprecision(2)
+              << dense_us << "us, pruned " << sparse_us << "us ("
+              << dense_us / sparse_us << "x)" << std::endl;
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        delete layers[i];
+    }
+
+    if(positional > MODEL_PATH_IDX &&
+       !MlpModel::save(args[MODEL_PATH_IDX], pruned, biases, mlp_act_types,
+                       MLP_SIZE))
+    {
+        std::cerr << ERROR_WRITE_MODEL << args[MODEL_PATH_IDX] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+#include "CachedMlp.h"
+#include "InferenceServer.h"
+#include "MlpModel.h"
+#include "MlpNetwork.h"
+#include "ParallelMlp.h"
+#include "Profiler.h"
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./serve [--cache n] model socket [max_batch " \
+                  "[deadline_us [threads]]]\n" \
+                  "\t--cache n - answer repeated images from an LRU cache " \
+                  "of n results\n" \
+                  "\tmodel - packed model file (see pack_model)\n" \
+                  "\tsocket - path of the Unix domain socket to create\n" \
+                  "\tmax_batch - images per network call (default 32)\n" \
+                  "\tdeadline_us - longest wait for a batch to fill " \
+                  "(default 200)\n" \
+                  "\tthreads - worker threads, 0 for all cores (default 1)\n" \
+                  "\tset MLP_PROFILE=1 to print a per-layer profile on exit"
+
+#define CACHE_FLAG "--cache"
+#define MODEL_PATH_IDX 0
+#define SOCKET_PATH_IDX 1
+#define MAX_BATCH_IDX 2
+#define DEADLINE_IDX 3
+#define THREADS_IDX 4
+#define MIN_ARGS_COUNT 2
+#define MAX_ARGS_COUNT 5
+
+static InferenceServer *running_server = nullptr;
+
+/**
+ * SIGINT/SIGTERM handler: stops the server, which then prints its counters.
+ * @param signal_number the signal
+ */
+void handle_stop_signal(int signal_number)
+{
+    (void) signal_number;
+    if(running_server != nullptr)
+    {
+        running_server->stop();
+    }
+}
+
+/**
+ * Serves a packed model on a Unix domain socket with dynamic batching until
+ * interrupted (see InferenceServer.h for the protocol and loadgen.cpp for a
+ * client).
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    int cache_capacity = 0;
+    int first = 1;
+    for(; first + 1 < argc && argv[first][0] == '-'; first += 2)
+    {
+        if(std::strcmp(argv[first], CACHE_FLAG) != 0)
+        {
+            std::cout << USAGE_MSG << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        cache_capacity = std::atoi(argv[first + 1]);
+    }
+    char **args = argv + first;
+    const int positional = argc - first;
+    if(positional < MIN_ARGS_COUNT || positional > MAX_ARGS_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    server_options options = default_server_options();
+    if(positional > MAX_BATCH_IDX)
+    {
+        options.max_batch = std::atoi(args[MAX_BATCH_IDX]);
+    }
+    if(positional > DEADLINE_IDX)
+    {
+        options.deadline_us = std::atoi(args[DEADLINE_IDX]);
+    }
+    const int threads = positional > THREADS_IDX ?
+                        std::atoi(args[THREADS_IDX]) : 1;
+    if(options.max_batch <= 0 || options.deadline_us < 0 || threads < 0 ||
+       cache_capacity < 0)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    MlpModel model(args[MODEL_PATH_IDX]);
+    MlpNetwork mlp(model);
+    ParallelMlp *parallel = nullptr;
+    BatchPredictor predict;
+    if(threads == 1)
+    {
+        predict = [&mlp](const MatrixView &images, digit *results)
+        { mlp.predict_batch(images, results); };
+    }
+    else
+    {
+        parallel = new ParallelMlp(mlp, threads);
+        predict = [parallel](const MatrixView &images, digit *results)
+        { parallel->predict_batch(images, results); };
+    }
+    // The cache runs on the server thread and hands only the misses to the
+    // network (or the worker pool).
+    CachedMlp *cache = nullptr;
+    if(cache_capacity > 0)
+    {
+        cache = new CachedMlp(mlp, cache_capacity);
+        const BatchPredictor run_misses = predict;
+        predict = [cache, run_misses](const MatrixView &images, digit *results)
+        { cache->predict_batch(images, results, run_misses); };
+    }
+    InferenceServer server(args[SOCKET_PATH_IDX], mlp.get_input_size(),
+                           predict, options);
+    running_server = &server;
+    std::signal(SIGINT, handle_stop_signal);
+    std::signal(SIGTERM, handle_stop_signal);
+    std::cout << "serving " << args[MODEL_PATH_IDX] << " on "
+              << args[SOCKET_PATH_IDX] << " (batch " << options.max_batch
+              << ", deadline " << options.deadline_us << "us)" << std::endl;
+    server.run();
+    running_server = nullptr;
+
+    const server_stats stats = server.get_stats();
+    std::cout << stats.requests << " requests in " << stats.batches
+              << " batches (mean batch "
+              << (stats.batches ? (double) stats.requests /
+                                  (double) stats.batches : 0)
+              << "), " << stats.connections << " connections, "
+              << stats.protocol_errors << " protocol errors" << std::endl;
+    if(cache != nullptr)
+    {
+        const cache_stats cached = cache->get_stats();
+        std::cout << "cache: " << cached.hits << " hits, " << cached.misses
+                  << " misses, " << cached.evictions << " evictions"
+                  << std::endl;
+        delete cache;
+    }
+    delete parallel;
+    if(profiler_enabled())
+    {
+        print_profile(std::cout, profiler_snapshot());
+    }
+    return EXIT_SUCCESS;
+}
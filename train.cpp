@@ -0,0 +1,185 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+
+#include "Evaluation.h"
+#include "IdxReader.h"
+#include "MlpNetwork.h"
+#include "Trainer.h"
+
+#define ERROR_IMAGE_SIZE "Error: data set images do not fit the network input"
+#define ERROR_WRITE_MODEL "Error: failed to write model file: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./train [--sgd] [--fp16|--bf16] train_images " \
+                  "train_labels test_images test_labels model " \
+                  "[epochs [batch_size [learning_rate]]]\n" \
+                  "\t--sgd - SGD with momentum instead of Adam\n" \
+                  "\t--fp16/--bf16 - store the weights in 16 bits\n" \
+                  "\ttrain_images, train_labels - IDX training set, e.g. " \
+                  "train-images-idx3-ubyte\n" \
+                  "\ttest_images, test_labels - IDX set evaluated after " \
+                  "every epoch\n" \
+                  "\tmodel - path of the packed model file to create\n" \
+                  "\tepochs - passes over the training set (default 3)\n" \
+                  "\tbatch_size - images per step (default 64)\n" \
+                  "\tlearning_rate - default 0.001 (Adam) or 0.05 (SGD)"
+
+#define SGD_FLAG "--sgd"
+#define FP16_FLAG "--fp16"
+#define BF16_FLAG "--bf16"
+#define DEFAULT_EPOCHS 3
+#define LOAD_BATCH 1024
+
+#define POSITIONAL_COUNT 5
+#define TRAIN_IMAGES_IDX 0
+#define TRAIN_LABELS_IDX 1
+#define TEST_IMAGES_IDX 2
+#define TEST_LABELS_IDX 3
+#define MODEL_PATH_IDX 4
+#define EPOCHS_IDX 5
+#define BATCH_SIZE_IDX 6
+#define LEARNING_RATE_IDX 7
+#define MAX_POSITIONAL_COUNT 8
+
+typedef std::chrono::steady_clock train_clock;
+
+/**
+ * Loads a whole labelled IDX data set, one image per row.
+ * @param reader the data set
+ * @param images receives a count x pixels matrix
+ * @param labels receives count labels (allocated with new[])
+ */
+void load_data_set(IdxReader &reader, Matrix &images, unsigned int *&labels)
+{
+    const int count = reader.get_count();
+    const int pixels = reader.get_image_rows() * reader.get_image_cols();
+    images = Matrix(count, pixels);
+    labels = new(std::nothrow) unsigned int[count];
+    if(labels == nullptr)
+    {
+        std::cerr << MEMORY_ALLOC_FAIL << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    Matrix batch(pixels, LOAD_BATCH);
+    float *dst = images.data();
+    int loaded = 0, n;
+    while((n = reader.read_batch(batch, labels + loaded)) > 0)
+    {
+        const float *src = batch.data();
+        for(int i = 0; i < pixels; i++)
+        {
+            for(int j = 0; j < n; j++)
+            {
+                dst[(size_t) (loaded + j) * pixels + i] = src[i * n + j];
+            }
+        }
+        loaded += n;
+    }
+}
+
+/**
+ * Trains the standard 784-128-64-20-10 network on an IDX training set,
+ * reports the test accuracy after every epoch and writes a packed model.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    OptimizerType optimizer = ADAM;
+    WeightFormat format = FP32;
+    int first = 1;
+    for(; first < argc && argv[first][0] == '-'; first++)
+    {
+        if(std::strcmp(argv[first], SGD_FLAG) == 0)
+        {
+            optimizer = SGD;
+        }
+        else if(std::strcmp(argv[first], FP16_FLAG) == 0)
+        {
+            format = FP16;
+        }
+        else if(std::strcmp(argv[first], BF16_FLAG) == 0)
+        {
+            format = BF16;
+        }
+        else
+        {
+            std::cout << USAGE_MSG << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    char **args = argv + first;
+    const int positional = argc - first;
+    if(positional < POSITIONAL_COUNT || positional > MAX_POSITIONAL_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    train_options options = default_train_options(optimizer);
+    const int epochs = positional > EPOCHS_IDX ?
+                       std::atoi(args[EPOCHS_IDX]) : DEFAULT_EPOCHS;
+    if(positional > BATCH_SIZE_IDX)
+    {
+        options.batch_size = std::atoi(args[BATCH_SIZE_IDX]);
+    }
+    if(positional > LEARNING_RATE_IDX)
+    {
+        options.learning_rate = (float) std::atof(args[LEARNING_RATE_IDX]);
+    }
+    if(epochs <= 0 || options.batch_size <= 0 ||
+       !(options.learning_rate > 0))
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    int sizes[MLP_SIZE + 1];
+    sizes[0] = weights_dims[0].cols;
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        sizes[i + 1] = weights_dims[i].rows;
+    }
+    IdxReader train_reader(args[TRAIN_IMAGES_IDX], args[TRAIN_LABELS_IDX]);
+    IdxReader test_reader(args[TEST_IMAGES_IDX], args[TEST_LABELS_IDX]);
+    if(train_reader.get_image_rows() * train_reader.get_image_cols() !=
+       sizes[0] ||
+       test_reader.get_image_rows() * test_reader.get_image_cols() != sizes[0])
+    {
+        std::cerr << ERROR_IMAGE_SIZE << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    Matrix images;
+    unsigned int *labels = nullptr;
+    load_data_set(train_reader, images, labels);
+
+    Trainer trainer(sizes, mlp_act_types, MLP_SIZE, options.seed);
+    const train_clock::time_point start = train_clock::now();
+    for(int epoch = 1; epoch <= epochs; epoch++)
+    {
+        const float loss = trainer.train_epoch(MatrixView(images).transposed(),
+                                               labels, options);
+        const double seconds = std::chrono::duration<double>(
+                train_clock::now() - start).count();
+        MlpNetwork mlp(trainer.get_weights(), trainer.get_biases(),
+                       trainer.get_act_types(), trainer.get_layer_count());
+        test_reader.rewind();
+        eval_report report = evaluate(test_reader,
+                                      [&mlp](const MatrixView &batch,
+                                             digit *results)
+        { mlp.predict_batch(batch, results); });
+        std::cout << "epoch " << epoch << ": loss " << std::setprecision(4)
+                  << loss << ", test accuracy "
+                  << (float) report.correct / (float) report.samples
+                  << ", " << std::setprecision(3) << seconds << "s"
+                  << std::endl;
+    }
+    delete[] labels;
+    if(!trainer.save(args[MODEL_PATH_IDX], format))
+    {
+        std::cerr << ERROR_WRITE_MODEL << args[MODEL_PATH_IDX] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}